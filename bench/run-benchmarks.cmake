@@ -0,0 +1,39 @@
+# Compiles every workload with sasmc and runs it with every core in a separate benchmark process, so that peak RSS
+# is reported per workload. Results are written as JSON lines in the same order every time, see cpu/benchmark.c.
+
+string(REPLACE "," ";" WORKLOADS "${WORKLOADS}")
+string(REPLACE "," ";" CORES "${CORES}")
+
+# Every workload gets the same amount of memory, only pages that it touches count towards its RSS.
+set(MEMORY 128M)
+
+file(WRITE "${OUTPUT}" "")
+
+foreach(workload IN LISTS WORKLOADS)
+    configure_file("${WORKLOADS_DIR}/${workload}.sasm" "${WORK_DIR}/${workload}.sasm" COPYONLY)
+
+    execute_process(
+        COMMAND "${SASMC}" --no-source-map "${WORK_DIR}/${workload}.sasm"
+        RESULT_VARIABLE status)
+
+    if (NOT status EQUAL 0)
+        message(FATAL_ERROR "unable to compile ${workload}.sasm")
+    endif()
+
+    foreach(core IN LISTS CORES)
+        execute_process(
+            COMMAND "${BENCHMARK}" --core=${core} --memory=${MEMORY} --runs=${RUNS} "${WORK_DIR}/${workload}.sasm.bin"
+            OUTPUT_VARIABLE result
+            OUTPUT_STRIP_TRAILING_WHITESPACE
+            RESULT_VARIABLE status)
+
+        message(STATUS "${result}")
+        file(APPEND "${OUTPUT}" "${result}\n")
+
+        if (NOT status EQUAL 0)
+            message(SEND_ERROR "${workload} did not halt with the ${core} core")
+        endif()
+    endforeach()
+endforeach()
+
+message(STATUS "results written to ${OUTPUT}")
\ No newline at end of file
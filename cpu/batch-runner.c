@@ -0,0 +1,415 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "utils.h"
+#include "thread-pool.h"
+#include "cpu-executor.h"
+#include "loader.h"
+#include "snapshot.h"
+#include "jit/jit.h"
+
+/* Default address that input files are loaded at, start of the data area shown by cpu_dump_memory. */
+#define BATCH_DEFAULT_INPUT_ADDRESS (CPU_RESERVED_MEMORY_SIZE + 1024)
+
+typedef struct {
+    const char *path;
+    char *data;
+    uint32_t size;
+
+    // Executables are loaded from their file by every run, so that their sections can be mapped instead of copied.
+    bool executable;
+} batch_file_t;
+
+typedef enum {
+    BATCH_RUN_HALTED,
+    BATCH_RUN_PANICKED,
+    BATCH_RUN_LIMIT_REACHED,
+    BATCH_RUN_LOAD_FAILED
+} batch_run_status_t;
+
+typedef struct {
+    batch_run_status_t status;
+    uint64_t instructions;
+    uint64_t time;
+    int32_t registers[3];
+    char message[CPU_PANIC_MESSAGE_SIZE];
+} batch_run_result_t;
+
+typedef struct {
+    // Either a single image with many inputs, or many images without any input.
+    batch_file_t *image;
+    batch_file_t *files;
+    uint32_t files_count;
+
+    uint32_t input_address;
+    uint64_t max_instructions;
+
+    // State of the image after its common prefix was executed, runs start from it instead of from the beginning.
+    cpu_snapshot_t *snapshot;
+
+    // One CPU per worker thread, reset before every run.
+    starkcpu_t **cpus;
+    batch_run_result_t *results;
+} batch_t;
+
+void print_usage() {
+    printf("usage: batch-runner [options] <image file>...\n");
+    printf("       batch-runner [options] --image=<image file> <input file>...\n");
+    printf("options:\n");
+    printf("  --core=<dispatch|threaded|jit>  execution core to use (default: dispatch)\n");
+    printf("  --memory=<size>                 size of memory, e.g. 64K or 16M (default: %d)\n", CPU_DEFAULT_MEMORY_SIZE);
+    printf("  --threads=<count>               number of worker threads (default: number of host threads)\n");
+    printf("  --max-instructions=<count>      stop a run after executing this many instructions (default: unlimited)\n");
+    printf("  --input-address=<address>       address that input files are loaded at (default: 0x%X)\n", BATCH_DEFAULT_INPUT_ADDRESS);
+    printf("  --snapshot-after=<count>        execute this many instructions of the image once, then start every run from there\n");
+    printf("  --quiet                         only print aggregate statistics\n");
+    printf("  --no-fusion                     execute every instruction separately instead of fusing common sequences\n");
+    printf("  --fusion-stats                  print how many times every fused instruction was executed\n");
+}
+
+bool read_whole_file(batch_file_t *file, const char *path) {
+    file->path = path;
+    file->data = 0;
+    file->size = 0;
+    file->executable = false;
+
+    FILE* handle = fopen(path, "rb");
+    if (!handle) {
+        return false;
+    }
+
+    fseek(handle, 0, SEEK_END);
+    long size = ftell(handle);
+    fseek(handle, 0, SEEK_SET);
+
+    file->data = malloc(size > 0 ? size : 1);
+    file->size = fread(file->data, 1, size, handle);
+    fclose(handle);
+
+    return file->size == size;
+}
+
+bool read_image_file(batch_file_t *file, const char *path) {
+    if (!cpu_is_executable_file(path)) {
+        return read_whole_file(file, path);
+    }
+
+    file->path = path;
+    file->data = 0;
+    file->size = 0;
+    file->executable = true;
+    return true;
+}
+
+bool load_file_at(starkcpu_t *cpu, const batch_file_t *file, uint32_t address) {
+    char *data = cpu_mem_alloc_at(cpu, address, file->size);
+    if (!data) {
+        return false;
+    }
+
+    memcpy(data, file->data, file->size);
+    return true;
+}
+
+bool load_image(starkcpu_t *cpu, const batch_file_t *image, batch_run_result_t *result) {
+    uint32_t entry_point = CPU_IMAGE_LOAD_ADDRESS;
+
+    cpu_reset(cpu);
+
+    if (image->executable) {
+        cpu_program_t program;
+        cpu_load_status_t status = cpu_load_program(cpu, image->path, &program);
+        free(program.source_map);
+
+        if (status != CPU_LOAD_OK) {
+            result->status = BATCH_RUN_LOAD_FAILED;
+            snprintf(result->message, CPU_PANIC_MESSAGE_SIZE, "%s", cpu_load_status_to_string(status));
+            return false;
+        }
+
+        entry_point = program.entry_point;
+    } else if (!load_file_at(cpu, image, CPU_IMAGE_LOAD_ADDRESS)) {
+        result->status = BATCH_RUN_LOAD_FAILED;
+        snprintf(result->message, CPU_PANIC_MESSAGE_SIZE, "image does not fit in memory");
+        return false;
+    }
+
+    cpu_jmp(cpu, entry_point);
+    return true;
+}
+
+/* Executes instructions until the CPU halts, panics, or executes `max_instructions` in total (0 for no limit). */
+void execute(starkcpu_t *cpu, uint64_t max_instructions, batch_run_result_t *result) {
+    jmp_buf panic_handler;
+    cpu->panic_handler = &panic_handler;
+    uint64_t start = cpu_get_monotonic_time();
+
+    if (setjmp(panic_handler) == 0) {
+        cpu->running = true;
+
+        while (cpu->running && cpu->ip < cpu->memsize) {
+            uint64_t count = CPU_UNTHROTTLED_BATCH_SIZE;
+            if (max_instructions > 0) {
+                uint64_t remaining = max_instructions - cpu->instructions_executed;
+                if (remaining == 0) {
+                    break;
+                }
+
+                if (remaining < count) {
+                    count = remaining;
+                }
+            }
+
+            cpu->instructions_executed += cpu_execute(cpu, count);
+        }
+
+        result->status = cpu->running && cpu->ip < cpu->memsize ? BATCH_RUN_LIMIT_REACHED : BATCH_RUN_HALTED;
+    } else {
+        // Instructions from the batch that panicked are not counted.
+        result->status = BATCH_RUN_PANICKED;
+        strcpy(result->message, cpu->panic_message);
+    }
+
+    cpu->panic_handler = 0;
+
+    result->time = cpu_get_monotonic_time() - start;
+    result->instructions = cpu->instructions_executed;
+    for (uint8_t i = 0; i < 3; i++) {
+        result->registers[i] = cpu_get_register_value(cpu, i);
+    }
+}
+
+void run_job(void *context, uint32_t worker, uint32_t job) {
+    batch_t *batch = context;
+    starkcpu_t *cpu = batch->cpus[worker];
+    batch_run_result_t *result = batch->results + job;
+
+    const batch_file_t *image = batch->image ? batch->image : batch->files + job;
+    const batch_file_t *input = batch->image ? batch->files + job : 0;
+
+    if (batch->snapshot) {
+        cpu_snapshot_restore(cpu, batch->snapshot);
+    } else if (!load_image(cpu, image, result)) {
+        return;
+    }
+
+    if (input && !load_file_at(cpu, input, batch->input_address)) {
+        result->status = BATCH_RUN_LOAD_FAILED;
+        snprintf(result->message, CPU_PANIC_MESSAGE_SIZE, "input does not fit in memory");
+        return;
+    }
+
+    execute(cpu, batch->max_instructions, result);
+}
+
+/* Executes the common prefix of all runs once and takes a snapshot of the CPU after it. */
+bool prepare_snapshot(batch_t *batch, starkcpu_t *cpu, uint64_t prefix_instructions) {
+    batch_run_result_t result;
+
+    if (!load_image(cpu, batch->image, &result)) {
+        printf("error: unable to load %s: %s\n", batch->image->path, result.message);
+        return false;
+    }
+
+    execute(cpu, prefix_instructions, &result);
+
+    if (result.status != BATCH_RUN_LIMIT_REACHED) {
+        printf("error: %s %s before the snapshot was taken\n",
+               batch->image->path,
+               result.status == BATCH_RUN_HALTED ? "halted" : "panicked");
+        return false;
+    }
+
+    batch->snapshot = cpu_snapshot_create(cpu);
+    if (!batch->snapshot) {
+        printf("error: unable to take a snapshot\n");
+        return false;
+    }
+
+    printf("executed %llu instructions of the common prefix in %.3f ms\n",
+           (unsigned long long) result.instructions,
+           result.time / 1000.0);
+    return true;
+}
+
+void print_result(const batch_file_t *file, const batch_run_result_t *result) {
+    switch (result->status) {
+        case BATCH_RUN_HALTED:
+        case BATCH_RUN_LIMIT_REACHED:
+            printf("%s: %s after %llu instructions in %.3f ms, r0=%d r1=%d r2=%d\n",
+                   file->path,
+                   result->status == BATCH_RUN_HALTED ? "halted" : "reached instruction limit",
+                   (unsigned long long) result->instructions,
+                   result->time / 1000.0,
+                   result->registers[0], result->registers[1], result->registers[2]);
+            break;
+
+        case BATCH_RUN_PANICKED:
+            printf("%s: panicked after %.3f ms: %s\n", file->path, result->time / 1000.0, result->message);
+            break;
+
+        case BATCH_RUN_LOAD_FAILED:
+            printf("%s: not executed, %s\n", file->path, result->message);
+            break;
+    }
+}
+
+int main(int argc, char** argv) {
+    const char *image_path = 0;
+    cpu_core_t core = CPU_CORE_DISPATCH;
+    uint64_t memory_size = CPU_DEFAULT_MEMORY_SIZE;
+    uint32_t threads = thread_pool_get_hardware_concurrency();
+    uint64_t max_instructions = 0;
+    uint32_t input_address = BATCH_DEFAULT_INPUT_ADDRESS;
+    uint64_t snapshot_after = 0;
+    bool quiet = false;
+    bool fusion = true;
+    bool fusion_stats = false;
+
+    const char **paths = malloc(sizeof(char *) * argc);
+    uint32_t paths_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strsimilar(argv[i], "--core=dispatch")) {
+            core = CPU_CORE_DISPATCH;
+        } else if (strsimilar(argv[i], "--core=threaded")) {
+            core = CPU_CORE_THREADED;
+        } else if (strsimilar(argv[i], "--core=jit")) {
+            core = CPU_CORE_JIT;
+        } else if (strncmp(argv[i], "--memory=", 9) == 0 && parse_size(argv[i] + 9) > 0) {
+            memory_size = parse_size(argv[i] + 9);
+        } else if (strncmp(argv[i], "--threads=", 10) == 0 && atol(argv[i] + 10) > 0) {
+            threads = atol(argv[i] + 10);
+        } else if (strncmp(argv[i], "--max-instructions=", 19) == 0) {
+            max_instructions = strtoull(argv[i] + 19, 0, 10);
+        } else if (strncmp(argv[i], "--input-address=", 16) == 0) {
+            input_address = strtoul(argv[i] + 16, 0, 0);
+        } else if (strncmp(argv[i], "--snapshot-after=", 17) == 0 && strtoull(argv[i] + 17, 0, 10) > 0) {
+            snapshot_after = strtoull(argv[i] + 17, 0, 10);
+        } else if (strncmp(argv[i], "--image=", 8) == 0) {
+            image_path = argv[i] + 8;
+        } else if (strsimilar(argv[i], "--quiet")) {
+            quiet = true;
+        } else if (strsimilar(argv[i], "--no-fusion")) {
+            fusion = false;
+        } else if (strsimilar(argv[i], "--fusion-stats")) {
+            fusion_stats = true;
+        } else if (argv[i][0] != '-') {
+            paths[paths_count++] = argv[i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (paths_count == 0 || input_address < CPU_RESERVED_MEMORY_SIZE || (snapshot_after > 0 && !image_path)) {
+        print_usage();
+        return 1;
+    }
+
+    if (core == CPU_CORE_JIT && !cpu_jit_is_supported()) {
+        printf("warning: native code generation is not supported on this host, JIT core will only interpret\n");
+    }
+
+    batch_t batch;
+    batch.image = 0;
+    batch.input_address = input_address;
+    batch.max_instructions = max_instructions;
+    batch.snapshot = 0;
+    batch.files_count = paths_count;
+    batch.files = calloc(paths_count, sizeof(batch_file_t));
+    batch.results = calloc(paths_count, sizeof(batch_run_result_t));
+
+    if (image_path) {
+        batch.image = malloc(sizeof(batch_file_t));
+        if (!read_image_file(batch.image, image_path)) {
+            printf("error: unable to load %s\n", image_path);
+            return 1;
+        }
+    }
+
+    for (uint32_t i = 0; i < paths_count; i++) {
+        bool read = image_path ? read_whole_file(batch.files + i, paths[i]) : read_image_file(batch.files + i, paths[i]);
+        if (!read) {
+            printf("error: unable to load %s\n", paths[i]);
+            return 1;
+        }
+    }
+
+    if (threads > paths_count) {
+        threads = paths_count;
+    }
+
+    batch.cpus = calloc(threads, sizeof(starkcpu_t *));
+    for (uint32_t i = 0; i < threads; i++) {
+        batch.cpus[i] = cpu_create(false, memory_size);
+
+        if (!batch.cpus[i]) {
+            printf("unable to create cpu\n");
+            return 1;
+        }
+
+        batch.cpus[i]->core = core;
+        batch.cpus[i]->fusion = fusion;
+    }
+
+    if (snapshot_after > 0 && !prepare_snapshot(&batch, batch.cpus[0], snapshot_after)) {
+        return 1;
+    }
+
+    uint64_t start = cpu_get_monotonic_time();
+    thread_pool_run(threads, paths_count, run_job, &batch);
+    uint64_t elapsed = cpu_get_monotonic_time() - start;
+
+    uint32_t counts[BATCH_RUN_LOAD_FAILED + 1] = {0};
+    uint64_t instructions = 0;
+
+    // instructions of the common prefix were executed only once, before the runs
+    uint64_t prefix_instructions = batch.snapshot ? batch.snapshot->instructions_executed : 0;
+
+    for (uint32_t i = 0; i < paths_count; i++) {
+        counts[batch.results[i].status]++;
+        if (batch.results[i].status != BATCH_RUN_LOAD_FAILED) {
+            instructions += batch.results[i].instructions - prefix_instructions;
+        }
+
+        if (!quiet) {
+            print_result(batch.files + i, batch.results + i);
+        }
+    }
+
+    printf("%u runs: %u halted, %u panicked, %u reached instruction limit, %u not executed\n",
+           paths_count,
+           counts[BATCH_RUN_HALTED],
+           counts[BATCH_RUN_PANICKED],
+           counts[BATCH_RUN_LIMIT_REACHED],
+           counts[BATCH_RUN_LOAD_FAILED]);
+
+    printf("executed %llu instructions in %.3f s on %u threads (%.2f MIPS)\n",
+           (unsigned long long) instructions,
+           elapsed / 1e6,
+           threads,
+           elapsed > 0 ? (double) instructions / elapsed : 0);
+
+    if (fusion_stats) {
+        uint64_t fusion_counts[CPU_FUSED_OPCODES_COUNT] = {0};
+        for (uint32_t i = 0; i < threads; i++) {
+            for (uint32_t j = 0; j < CPU_FUSED_OPCODES_COUNT; j++) {
+                fusion_counts[j] += batch.cpus[i]->executor->fusion_counts[j];
+            }
+        }
+
+        cpu_fusion_print_stats(fusion_counts);
+    }
+
+    for (uint32_t i = 0; i < threads; i++) {
+        cpu_destroy(batch.cpus[i]);
+    }
+
+    if (batch.snapshot) {
+        cpu_snapshot_destroy(batch.snapshot);
+    }
+
+    return counts[BATCH_RUN_PANICKED] + counts[BATCH_RUN_LOAD_FAILED] > 0 ? 2 : 0;
+}
\ No newline at end of file
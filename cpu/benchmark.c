@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "utils.h"
+#include "cpu-executor.h"
+#include "loader.h"
+#include "profiler.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define BENCHMARK_DEFAULT_RUNS 5
+#define BENCHMARK_DEFAULT_PROFILED_INSTRUCTIONS 2000000
+#define BENCHMARK_MAX_RUNS 100
+
+typedef enum {
+    BENCHMARK_CLASS_MOVE,
+    BENCHMARK_CLASS_ARITHMETIC,
+    BENCHMARK_CLASS_DIVISION,
+    BENCHMARK_CLASS_BRANCH,
+    BENCHMARK_CLASS_OTHER,
+    BENCHMARK_CLASSES_COUNT
+} benchmark_class_t;
+
+const char *benchmark_class_names[BENCHMARK_CLASSES_COUNT] = { "move", "arithmetic", "division", "branch", "other" };
+
+typedef struct {
+    cpu_core_t core;
+    uint32_t runs;
+    uint64_t profiled_instructions;
+} benchmark_options_t;
+
+typedef struct {
+    // Set if the workload did not halt, e.g. it panicked.
+    char error[CPU_PANIC_MESSAGE_SIZE];
+
+    uint64_t instructions;
+    uint64_t times[BENCHMARK_MAX_RUNS];
+
+    uint64_t class_counts[BENCHMARK_CLASSES_COUNT];
+    double class_nanoseconds[BENCHMARK_CLASSES_COUNT];
+} benchmark_result_t;
+
+void print_usage() {
+    printf("usage: benchmark [options] <executable>...\n");
+    printf("options:\n");
+    printf("  --core=<dispatch|threaded|jit>  execution core to use (default: dispatch)\n");
+    printf("  --memory=<size>                 size of memory, e.g. 64K or 16M (default: %d)\n", CPU_DEFAULT_MEMORY_SIZE);
+    printf("  --runs=<count>                  number of timed runs of every workload, at most %d (default: %d)\n", BENCHMARK_MAX_RUNS, BENCHMARK_DEFAULT_RUNS);
+    printf("  --profiled-instructions=<count> number of instructions executed with the profiler to time opcode classes, 0 to skip (default: %d)\n", BENCHMARK_DEFAULT_PROFILED_INSTRUCTIONS);
+    printf("  --no-fusion                     execute every instruction separately instead of fusing common sequences\n");
+}
+
+benchmark_class_t get_opcode_class(uint8_t opcode) {
+    const char *name = cpu_get_opcode_name(opcode);
+    if (!name) {
+        return BENCHMARK_CLASS_OTHER;
+    }
+
+    if (strncmp(name, "SET_", 4) == 0 || strncmp(name, "COPY_", 5) == 0 || strncmp(name, "FILL_", 5) == 0) {
+        return BENCHMARK_CLASS_MOVE;
+    }
+
+    if (strncmp(name, "DIV_", 4) == 0) {
+        return BENCHMARK_CLASS_DIVISION;
+    }
+
+    if (strncmp(name, "JMP_", 4) == 0 || strncmp(name, "CMP_", 4) == 0) {
+        return BENCHMARK_CLASS_BRANCH;
+    }
+
+    if (strncmp(name, "ADD_", 4) == 0 || strncmp(name, "SUB_", 4) == 0 || strncmp(name, "MUL_", 4) == 0
+        || strsimilar(name, "INCREMENT") || strsimilar(name, "DECREMENT")) {
+        return BENCHMARK_CLASS_ARITHMETIC;
+    }
+
+    return BENCHMARK_CLASS_OTHER;
+}
+
+/* Returns peak resident set size of the whole process in KiB, or 0 if the host does not report it. */
+uint64_t get_peak_rss() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+bool load_workload(starkcpu_t *cpu, const char *path, benchmark_result_t *result) {
+    cpu_reset(cpu);
+
+    cpu_program_t program;
+    cpu_load_status_t status = cpu_load_program(cpu, path, &program);
+    free(program.source_map);
+
+    if (status != CPU_LOAD_OK) {
+        snprintf(result->error, CPU_PANIC_MESSAGE_SIZE, "%s", cpu_load_status_to_string(status));
+        return false;
+    }
+
+    cpu_jmp(cpu, program.entry_point);
+    return true;
+}
+
+/* Executes instructions until the CPU halts or executes `max_instructions` in total (0 for no limit). Returns false if it panics. */
+bool execute(starkcpu_t *cpu, uint64_t max_instructions, benchmark_result_t *result) {
+    jmp_buf panic_handler;
+    cpu->panic_handler = &panic_handler;
+
+    if (setjmp(panic_handler) != 0) {
+        cpu->panic_handler = 0;
+        snprintf(result->error, CPU_PANIC_MESSAGE_SIZE, "%s", cpu->panic_message);
+        return false;
+    }
+
+    cpu->running = true;
+
+    while (cpu->running && cpu->ip < cpu->memsize) {
+        uint64_t count = CPU_UNTHROTTLED_BATCH_SIZE;
+        if (max_instructions > 0) {
+            uint64_t remaining = max_instructions - cpu->instructions_executed;
+            if (remaining == 0) {
+                break;
+            }
+
+            if (remaining < count) {
+                count = remaining;
+            }
+        }
+
+        cpu->instructions_executed += cpu_execute(cpu, count);
+    }
+
+    cpu->panic_handler = 0;
+    return true;
+}
+
+/*
+ * Runs the workload `runs` times and measures how long every run took, then runs the beginning of it once more with
+ * the profiler attached to measure time per opcode class. Profiled execution is much slower than any core, so
+ * time per opcode class is only meaningful relative to other classes and to the same class in other commits.
+ */
+bool run_workload(starkcpu_t *cpu, const char *path, const benchmark_options_t *options, benchmark_result_t *result) {
+    for (uint32_t run = 0; run < options->runs; run++) {
+        if (!load_workload(cpu, path, result)) {
+            return false;
+        }
+
+        uint64_t start = cpu_get_monotonic_time();
+        if (!execute(cpu, 0, result)) {
+            return false;
+        }
+
+        result->times[run] = cpu_get_monotonic_time() - start;
+        result->instructions = cpu->instructions_executed;
+    }
+
+    if (options->profiled_instructions == 0) {
+        return true;
+    }
+
+    if (!load_workload(cpu, path, result)) {
+        return false;
+    }
+
+    cpu_profiler_t *profiler = cpu_profiler_create(cpu);
+    bool completed = execute(cpu, options->profiled_instructions, result);
+
+    for (uint32_t opcode = 0; opcode < 256; opcode++) {
+        benchmark_class_t class = get_opcode_class(opcode);
+        result->class_counts[class] += profiler->opcodes[opcode].count;
+        result->class_nanoseconds[class] += cpu_profiler_get_nanoseconds(profiler, profiler->opcodes[opcode].ticks);
+    }
+
+    cpu_profiler_destroy(profiler);
+    return completed;
+}
+
+int compare_times(const void *a, const void *b) {
+    uint64_t left = *(const uint64_t *) a;
+    uint64_t right = *(const uint64_t *) b;
+    return (left > right) - (left < right);
+}
+
+/* Name of the workload is the name of its source file, e.g. `memcpy` for `bench/memcpy.sasm.bin`. */
+void get_workload_name(const char *path, char *buffer, size_t size) {
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+
+    size_t length = strcspn(name, ".");
+    if (length >= size) {
+        length = size - 1;
+    }
+
+    memcpy(buffer, name, length);
+    buffer[length] = '\0';
+}
+
+const char *get_core_name(cpu_core_t core) {
+    switch (core) {
+        case CPU_CORE_THREADED: return "threaded";
+        case CPU_CORE_JIT: return "jit";
+        default: return "dispatch";
+    }
+}
+
+/*
+ * Prints result of a workload as a single line of JSON, with keys always in the same order,
+ * so that results of two commits can be compared line by line.
+ */
+void print_result(const char *path, const benchmark_options_t *options, starkcpu_t *cpu, benchmark_result_t *result) {
+    char name[64];
+    get_workload_name(path, name, sizeof(name));
+
+    printf("{\"workload\": \"%s\", \"core\": \"%s\", \"fusion\": %s, \"memory\": %u, ",
+           name, get_core_name(options->core), cpu->fusion ? "true" : "false", cpu->memsize);
+
+    if (result->error[0]) {
+        printf("\"error\": \"");
+        for (const char *c = result->error; *c; c++) {
+            printf(*c == '"' || *c == '\\' ? "\\%c" : "%c", *c);
+        }
+
+        printf("\"}\n");
+        return;
+    }
+
+    qsort(result->times, options->runs, sizeof(uint64_t), compare_times);
+    uint64_t best = result->times[0] > 0 ? result->times[0] : 1;
+    uint64_t median = result->times[options->runs / 2];
+
+    printf("\"runs\": %u, \"instructions\": %llu, \"best_ms\": %.3f, \"median_ms\": %.3f, \"mips\": %.2f, \"ns_per_instruction\": %.3f, ",
+           options->runs,
+           (unsigned long long) result->instructions,
+           best / 1e3,
+           median / 1e3,
+           (double) result->instructions / best,
+           result->instructions > 0 ? best * 1e3 / result->instructions : 0);
+
+    printf("\"peak_rss_kb\": %llu, \"profiled_ns_per_instruction\": {", (unsigned long long) get_peak_rss());
+
+    for (uint32_t i = 0; i < BENCHMARK_CLASSES_COUNT; i++) {
+        double average = result->class_counts[i] > 0 ? result->class_nanoseconds[i] / result->class_counts[i] : 0;
+        printf("%s\"%s\": %.3f", i > 0 ? ", " : "", benchmark_class_names[i], average);
+    }
+
+    printf("}}\n");
+}
+
+int main(int argc, char** argv) {
+    benchmark_options_t options = { CPU_CORE_DISPATCH, BENCHMARK_DEFAULT_RUNS, BENCHMARK_DEFAULT_PROFILED_INSTRUCTIONS };
+    uint64_t memory_size = CPU_DEFAULT_MEMORY_SIZE;
+    bool fusion = true;
+    int first_file = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strsimilar(argv[i], "--core=dispatch")) {
+            options.core = CPU_CORE_DISPATCH;
+        } else if (strsimilar(argv[i], "--core=threaded")) {
+            options.core = CPU_CORE_THREADED;
+        } else if (strsimilar(argv[i], "--core=jit")) {
+            options.core = CPU_CORE_JIT;
+        } else if (strncmp(argv[i], "--memory=", 9) == 0 && parse_size(argv[i] + 9) > 0) {
+            memory_size = parse_size(argv[i] + 9);
+        } else if (strncmp(argv[i], "--runs=", 7) == 0 && atol(argv[i] + 7) > 0 && atol(argv[i] + 7) <= BENCHMARK_MAX_RUNS) {
+            options.runs = atol(argv[i] + 7);
+        } else if (strncmp(argv[i], "--profiled-instructions=", 24) == 0) {
+            options.profiled_instructions = strtoull(argv[i] + 24, 0, 10);
+        } else if (strsimilar(argv[i], "--no-fusion")) {
+            fusion = false;
+        } else if (argv[i][0] != '-') {
+            first_file = i;
+            break;
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (first_file == 0) {
+        print_usage();
+        return 1;
+    }
+
+    starkcpu_t *cpu = cpu_create(false, memory_size);
+    if (!cpu) {
+        printf("unable to create cpu\n");
+        return 1;
+    }
+
+    cpu->core = options.core;
+    cpu->clock_rate = 0;
+    cpu->fusion = fusion;
+
+    bool failed = false;
+
+    // peak RSS covers the whole process, so it is only accurate for the largest workload unless each one runs in its own process
+    for (int i = first_file; i < argc; i++) {
+        benchmark_result_t *result = calloc(1, sizeof(benchmark_result_t));
+
+        if (!run_workload(cpu, argv[i], &options, result)) {
+            failed = true;
+        }
+
+        print_result(argv[i], &options, cpu, result);
+        fflush(stdout);
+        free(result);
+    }
+
+    return failed ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "bus.h"
+#include "cpu-executor.h"
+#include <stdlib.h>
+
+bool cpu_bus_map(starkcpu_t *cpu, uint32_t address, uint32_t size, void *device, cpu_bus_read_t read, cpu_bus_write_t write) {
+    uint64_t end = ((uint64_t) address + size + CPU_PAGE_SIZE - 1) & ~(uint64_t) (CPU_PAGE_SIZE - 1);
+
+    if (size == 0 || address % CPU_PAGE_SIZE != 0 || address < CPU_PAGE_SIZE || end > cpu->memsize
+        || cpu_bus_overlaps(cpu, address, end - address)) {
+        return false;
+    }
+
+    if (!cpu->bus && !(cpu->bus = calloc(1, sizeof(cpu_bus_t)))) {
+        return false;
+    }
+
+    cpu_bus_t *bus = cpu->bus;
+    uint32_t index = 0;
+    while (index < CPU_BUS_MAX_DEVICES && bus->mappings[index].size > 0) {
+        index++;
+    }
+
+    if (index == CPU_BUS_MAX_DEVICES) {
+        return false;
+    }
+
+    bus->mappings[index] = (cpu_bus_mapping_t) { address, end - address, device, read, write, 0 };
+    bus->devices_count++;
+
+    for (uint32_t page = address >> CPU_PAGE_SHIFT; page < end >> CPU_PAGE_SHIFT; page++) {
+        cpu->io_pages[page] = index + 1;
+    }
+
+    // instructions decoded from the pages are no longer valid, and translated code has to check for the device
+    cpu_executor_reset(cpu->executor);
+    return true;
+}
+
+bool cpu_bus_unmap(starkcpu_t *cpu, uint32_t address) {
+    uint8_t entry = cpu_bus_overlaps(cpu, address, 1) ? cpu->io_pages[address >> CPU_PAGE_SHIFT] : 0;
+    if (entry == 0 || cpu->bus->mappings[entry - 1].address != address) {
+        return false;
+    }
+
+    cpu_bus_mapping_t *mapping = cpu->bus->mappings + entry - 1;
+    for (uint32_t page = address >> CPU_PAGE_SHIFT; page < (address + mapping->size) >> CPU_PAGE_SHIFT; page++) {
+        cpu->io_pages[page] = 0;
+    }
+
+    mapping->size = 0;
+    cpu->bus->devices_count--;
+
+    cpu_executor_reset(cpu->executor);
+    return true;
+}
+
+bool cpu_bus_set_hooks(starkcpu_t *cpu, uint32_t address, const cpu_bus_hooks_t *hooks) {
+    uint8_t entry = cpu_bus_overlaps(cpu, address, 1) ? cpu->io_pages[address >> CPU_PAGE_SHIFT] : 0;
+    if (entry == 0 || cpu->bus->mappings[entry - 1].address != address) {
+        return false;
+    }
+
+    cpu->bus->mappings[entry - 1].hooks = hooks;
+    return true;
+}
+
+void cpu_bus_reset_devices(starkcpu_t *cpu) {
+    if (!cpu->bus) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < CPU_BUS_MAX_DEVICES; i++) {
+        cpu_bus_mapping_t *mapping = cpu->bus->mappings + i;
+
+        if (mapping->size > 0 && mapping->hooks && mapping->hooks->reset) {
+            mapping->hooks->reset(mapping->device);
+        }
+    }
+}
+
+void cpu_bus_destroy_devices(starkcpu_t *cpu) {
+    if (!cpu->bus) {
+        return;
+    }
+
+    // devices unmap themselves as they are destroyed
+    for (uint32_t i = 0; i < CPU_BUS_MAX_DEVICES; i++) {
+        cpu_bus_mapping_t *mapping = cpu->bus->mappings + i;
+
+        if (mapping->size > 0 && mapping->hooks && mapping->hooks->destroy) {
+            mapping->hooks->destroy(mapping->device);
+        }
+    }
+}
+
+bool cpu_bus_can_access_memory(starkcpu_t *cpu, uint32_t address, uint64_t size, uint8_t permissions) {
+    if (size == 0) {
+        return true;
+    }
+
+    if (address + size > cpu->memsize || cpu_bus_overlaps(cpu, address, size)) {
+        return false;
+    }
+
+    for (uint32_t page = address >> CPU_PAGE_SHIFT; page <= (address + size - 1) >> CPU_PAGE_SHIFT; page++) {
+        if (!cpu_memory_can_access(cpu, page << CPU_PAGE_SHIFT, permissions)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Returns the device that given address belongs to, or 0 if it is in memory. */
+cpu_bus_mapping_t *find_mapping(starkcpu_t *cpu, uint32_t address) {
+    uint8_t entry = cpu->io_pages[address >> CPU_PAGE_SHIFT];
+    return entry ? cpu->bus->mappings + entry - 1 : 0;
+}
+
+uint32_t cpu_bus_read(starkcpu_t *cpu, uint32_t address, uint32_t size) {
+    cpu_bus_mapping_t *mapping = find_mapping(cpu, address);
+
+    if (mapping && (uint64_t) address + size <= (uint64_t) mapping->address + mapping->size) {
+        return mapping->read(mapping->device, address - mapping->address, size);
+    }
+
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t byte_address = address + i;
+        mapping = find_mapping(cpu, byte_address);
+
+        uint8_t byte = mapping
+            ? mapping->read(mapping->device, byte_address - mapping->address, 1)
+            : *cpu_mem_get(cpu, byte_address);
+
+        value |= (uint32_t) byte << (i * 8);
+    }
+
+    return value;
+}
+
+void cpu_bus_write(starkcpu_t *cpu, uint32_t address, uint32_t value, uint32_t size) {
+    cpu_bus_mapping_t *mapping = find_mapping(cpu, address);
+
+    if (mapping && (uint64_t) address + size <= (uint64_t) mapping->address + mapping->size) {
+        mapping->write(mapping->device, address - mapping->address, value, size);
+        return;
+    }
+
+    for (uint32_t i = 0; i < size; i++) {
+        // goes to the device of the byte, if it has one
+        cpu_mem_set(cpu, address + i, value >> (i * 8));
+    }
+}
\ No newline at end of file
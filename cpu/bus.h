@@ -0,0 +1,108 @@
+#pragma once
+
+#include "cpu.h"
+#include "memory.h"
+
+/* Size of cpu->io_pages: one entry for every page of the 4 GiB address space, so it never has to be bounds checked. */
+#define CPU_IO_PAGES_COUNT ((uint64_t) 1 << (32 - CPU_PAGE_SHIFT))
+
+#define CPU_BUS_MAX_DEVICES 255
+
+/*
+ * Accesses to pages of a device are handed to its callbacks instead of memory, with offset from the address the device
+ * is mapped at. Accesses are 1, 2 or 4 bytes wide and values are little endian, as the program sees them.
+ */
+typedef uint32_t (*cpu_bus_read_t)(void *device, uint32_t offset, uint32_t size);
+typedef void (*cpu_bus_write_t)(void *device, uint32_t offset, uint32_t value, uint32_t size);
+
+/* Callbacks of a device for the machine as a whole, set by cpu_bus_set_hooks. Any of them can be 0. */
+typedef struct {
+    // Brings the device back to the state it was created in, see cpu_bus_reset_devices.
+    void (*reset)(void *device);
+
+    // Writes `state_size` bytes of state of the device into a snapshot, including events it scheduled. Anything the device
+    // does on the host is finished first. A CPU with a device that can not be saved can not be snapshotted.
+    uint32_t state_size;
+    void (*save)(void *device, void *state);
+
+    // Brings the device, which was just reset, to a saved state, and schedules its events again.
+    void (*restore)(void *device, const void *state);
+
+    // Attaches a device of the same kind to another CPU, for cpu_fork. Returns 0 if it can not be attached.
+    void *(*copy)(void *device, starkcpu_t *cpu);
+
+    // Frees a device that is still attached when its CPU is destroyed.
+    void (*destroy)(void *device);
+} cpu_bus_hooks_t;
+
+typedef struct {
+    // Whole pages that belong to the device, no device is mapped in the slot if size is 0.
+    uint32_t address;
+    uint32_t size;
+
+    void *device;
+    cpu_bus_read_t read;
+    cpu_bus_write_t write;
+    const cpu_bus_hooks_t *hooks;
+} cpu_bus_mapping_t;
+
+/*
+ * Devices mapped into the address space of a CPU. Every page of it has an entry in cpu->io_pages, which is 0 for memory
+ * and index of the mapping plus one for a page of a device, so an access to memory only costs a single check of its page.
+ */
+typedef struct cpu_bus_t {
+    cpu_bus_mapping_t mappings[CPU_BUS_MAX_DEVICES];
+    uint32_t devices_count;
+} cpu_bus_t;
+
+/*
+ * Maps a device into `size` bytes at given address, rounded up to whole pages. The memory underneath is not used
+ * while the device is mapped, and code can not be executed from it. Returns false if the address is not a multiple
+ * of CPU_PAGE_SIZE, the range is not inside of memory, is in the first page (which holds the internal memory)
+ * or overlaps another device, if there are already CPU_BUS_MAX_DEVICES devices, or if the host is out of memory.
+ */
+bool cpu_bus_map(starkcpu_t *cpu, uint32_t address, uint32_t size, void *device, cpu_bus_read_t read, cpu_bus_write_t write);
+
+/* Removes a device mapped at given address, its pages become memory again. Returns false if there is no device at the address. */
+bool cpu_bus_unmap(starkcpu_t *cpu, uint32_t address);
+
+/* Sets callbacks of the device mapped at given address, which have to outlive the mapping. Returns false if there is no device at the address. */
+bool cpu_bus_set_hooks(starkcpu_t *cpu, uint32_t address, const cpu_bus_hooks_t *hooks);
+
+/*
+ * Resets every device of given CPU that has a reset hook, e.g. when the CPU is reset. Devices finish whatever they do
+ * on the host, like a transfer of the disk, so this has to be called before memory is cleared. They forget events
+ * they scheduled and interrupts they raised, dropping those is left to the caller.
+ */
+void cpu_bus_reset_devices(starkcpu_t *cpu);
+
+/* Destroys every device of given CPU that has a destroy hook, when the CPU itself is destroyed. */
+void cpu_bus_destroy_devices(starkcpu_t *cpu);
+
+/*
+ * Reads or writes `size` bytes at given address, which is in a page of a device. An access that does not fit into
+ * a single device is split into single bytes, each going either to its device or to memory.
+ */
+uint32_t cpu_bus_read(starkcpu_t *cpu, uint32_t address, uint32_t size);
+void cpu_bus_write(starkcpu_t *cpu, uint32_t address, uint32_t value, uint32_t size);
+
+/*
+ * Checks whether all of `size` bytes at given address are memory that the program can access in given way, e.g. for
+ * a device that reads or writes a block of memory natively. Devices can not be accessed this way.
+ */
+bool cpu_bus_can_access_memory(starkcpu_t *cpu, uint32_t address, uint64_t size, uint8_t permissions);
+
+/* Checks whether any of `size` bytes at given address belongs to a device. */
+static inline bool cpu_bus_overlaps(starkcpu_t *cpu, uint32_t address, uint32_t size) {
+    if (!cpu->bus || size == 0) {
+        return false;
+    }
+
+    for (uint64_t page = address >> CPU_PAGE_SHIFT; page <= ((uint64_t) address + size - 1) >> CPU_PAGE_SHIFT && page < CPU_IO_PAGES_COUNT; page++) {
+        if (cpu->io_pages[page]) {
+            return true;
+        }
+    }
+
+    return false;
+}
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include "console.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+uint32_t get_console_register(cpu_console_t *console, uint32_t offset) {
+    const uint8_t *bytes = console->io + offset;
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+void set_console_register(cpu_console_t *console, uint32_t offset, uint32_t value) {
+    for (uint32_t i = 0; i < 4; i++) {
+        console->io[offset + i] = value >> (i * 8);
+    }
+}
+
+void push_output(cpu_console_t *console, const uint8_t *data, uint32_t size) {
+    console->written += size;
+    set_console_register(console, CPU_CONSOLE_REGISTER_WRITTEN, console->written);
+    cpu_ring_push(&console->ring, data, size);
+}
+
+/* Writes all of given bytes into the output, which may take more than one call for pipes and terminals. */
+bool write_output(void *context, const uint8_t *data, uint64_t size) {
+    cpu_console_t *console = context;
+
+    while (size > 0) {
+#ifdef _WIN32
+        int result = _write(console->fd, data, size < INT32_MAX ? size : INT32_MAX);
+#else
+        ssize_t result = write(console->fd, data, size);
+#endif
+
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (result <= 0) {
+            return false;
+        }
+
+        data += result;
+        size -= result;
+    }
+
+    return true;
+}
+
+void output_memory(cpu_console_t *console) {
+    uint32_t address = get_console_register(console, CPU_CONSOLE_REGISTER_ADDRESS);
+    uint32_t size = get_console_register(console, CPU_CONSOLE_REGISTER_SIZE);
+
+    if (!cpu_bus_can_access_memory(console->cpu, address, size, CPU_PAGE_READ)) {
+        set_console_register(console, CPU_CONSOLE_REGISTER_STATUS, CPU_CONSOLE_ERROR_NOT_ACCESSIBLE);
+        return;
+    }
+
+    push_output(console, (const uint8_t *) console->cpu->mem + address, size);
+}
+
+uint32_t read_console(void *device, uint32_t offset, uint32_t size) {
+    cpu_console_t *console = device;
+    uint32_t value = 0;
+
+    for (uint32_t i = 0; i < size && offset + i < CPU_CONSOLE_IO_SIZE; i++) {
+        value |= (uint32_t) console->io[offset + i] << (i * 8);
+    }
+
+    return value;
+}
+
+void write_console(void *device, uint32_t offset, uint32_t value, uint32_t size) {
+    cpu_console_t *console = device;
+    bool output = false;
+
+    if (offset == CPU_CONSOLE_REGISTER_DATA) {
+        uint8_t byte = value;
+        push_output(console, &byte, 1);
+        return;
+    }
+
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t position = offset + i;
+
+        if (position >= CPU_CONSOLE_REGISTER_ADDRESS && position < CPU_CONSOLE_REGISTER_WRITE) {
+            console->io[position] = value >> (i * 8);
+        } else if (position >= CPU_CONSOLE_REGISTER_WRITE && position < CPU_CONSOLE_REGISTER_WRITE + 4) {
+            output = true;
+        }
+    }
+
+    if (output) {
+        output_memory(console);
+    }
+}
+
+void reset_console(void *device) {
+    cpu_console_t *console = device;
+
+    // output that was pushed already is still written
+    memset(console->io, 0, sizeof(console->io));
+    console->written = 0;
+}
+
+/* State of a console in a snapshot. Output that was pushed before the snapshot is not a part of it. */
+typedef struct {
+    uint8_t io[CPU_CONSOLE_IO_SIZE];
+    uint64_t written;
+} console_state_t;
+
+void save_console(void *device, void *state) {
+    cpu_console_t *console = device;
+    console_state_t *saved = state;
+
+    memcpy(saved->io, console->io, sizeof(saved->io));
+    saved->written = console->written;
+}
+
+void restore_console(void *device, const void *state) {
+    cpu_console_t *console = device;
+    const console_state_t *saved = state;
+
+    memcpy(console->io, saved->io, sizeof(console->io));
+    console->written = saved->written;
+}
+
+void *copy_console(void *device, starkcpu_t *cpu) {
+    cpu_console_t *console = device;
+    if (!console->file) {
+        return cpu_console_create_from_file(cpu, 0);
+    }
+
+    // the copy writes into the same file, output of both ends up interleaved as that of processes after a fork
+    int fd = dup(fileno(console->file));
+    FILE *file = fd >= 0 ? fdopen(fd, "wb") : 0;
+
+    if (!file) {
+        if (fd >= 0) {
+            close(fd);
+        }
+
+        return 0;
+    }
+
+    return cpu_console_create_from_file(cpu, file);
+}
+
+void destroy_console(void *device) {
+    cpu_console_destroy(device);
+}
+
+const cpu_bus_hooks_t console_hooks = { reset_console, sizeof(console_state_t), save_console, restore_console, copy_console, destroy_console };
+
+cpu_console_t *cpu_console_create_from_file(starkcpu_t *cpu, FILE *file) {
+    // output bypasses stdio, so anything printed so far has to come out first
+    fflush(stdout);
+
+    cpu_console_t *console = calloc(1, sizeof(cpu_console_t));
+    if (!console) {
+        if (file) {
+            fclose(file);
+        }
+
+        return 0;
+    }
+
+    console->cpu = cpu;
+    console->file = file;
+    console->fd = fileno(file ? file : stdout);
+
+    if (!cpu_ring_start(&console->ring, CPU_CONSOLE_RING_SIZE, CPU_CONSOLE_BATCH_SIZE, write_output, console)) {
+        if (file) {
+            fclose(file);
+        }
+
+        free(console);
+        return 0;
+    }
+
+    if (!cpu_bus_map(cpu, CPU_CONSOLE_ADDRESS, CPU_CONSOLE_IO_SIZE, console, read_console, write_console)) {
+        cpu_ring_stop(&console->ring);
+
+        if (file) {
+            fclose(file);
+        }
+
+        free(console);
+        return 0;
+    }
+
+    cpu_bus_set_hooks(cpu, CPU_CONSOLE_ADDRESS, &console_hooks);
+    return console;
+}
+
+cpu_console_t *cpu_console_create(starkcpu_t *cpu, const char *path) {
+    FILE *file = 0;
+    if (path && !(file = fopen(path, "wb"))) {
+        return 0;
+    }
+
+    return cpu_console_create_from_file(cpu, file);
+}
+
+bool cpu_console_destroy(cpu_console_t *console) {
+    cpu_bus_unmap(console->cpu, CPU_CONSOLE_ADDRESS);
+
+    bool written = cpu_ring_stop(&console->ring);
+    if (console->file) {
+        written = fclose(console->file) == 0 && written;
+    }
+
+    free(console);
+    return written;
+}
\ No newline at end of file
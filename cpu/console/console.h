@@ -0,0 +1,69 @@
+#pragma once
+
+#include "../cpu.h"
+#include "../bus.h"
+#include "../ring.h"
+#include <stdio.h>
+
+/* Guest address of the console's registers, mapped by the bus. */
+#define CPU_CONSOLE_ADDRESS 0xFD000
+
+/* Bytes of output that can wait for the writer thread, has to be a power of two. */
+#define CPU_CONSOLE_RING_SIZE (1024 * 1024)
+
+/* Output is written in batches of at least this many bytes, so a program that prints a character at a time still ends up in a few large writes. */
+#define CPU_CONSOLE_BATCH_SIZE (64 * 1024)
+
+/*
+ * Layout of the console's registers, all values are 32-bit and little endian:
+ * - data, every store into it outputs the lowest byte of the stored value,
+ * - address and size of a block of memory,
+ * - write, any store into it outputs the whole block at once, so a string costs a single access to the device,
+ * - status, 0 or one of CPU_CONSOLE_ERROR_* for the last block that was rejected,
+ * - number of bytes output so far.
+ * Only data, address, size and write can be written by the program.
+ */
+#define CPU_CONSOLE_REGISTER_DATA 0x00
+#define CPU_CONSOLE_REGISTER_ADDRESS 0x04
+#define CPU_CONSOLE_REGISTER_SIZE 0x08
+#define CPU_CONSOLE_REGISTER_WRITE 0x0C
+#define CPU_CONSOLE_REGISTER_STATUS 0x10
+#define CPU_CONSOLE_REGISTER_WRITTEN 0x14
+
+#define CPU_CONSOLE_IO_SIZE 0x18
+
+// Block can not be read by the program, or is not entirely in memory.
+#define CPU_CONSOLE_ERROR_NOT_ACCESSIBLE 1
+
+typedef struct cpu_console_t {
+    starkcpu_t *cpu;
+    int fd;
+
+    // Set if the output is a file that the console opened itself.
+    FILE *file;
+
+    // Contents of the registers, as the program sees them.
+    uint8_t io[CPU_CONSOLE_IO_SIZE];
+
+    // Output of the program, written out by a thread of the ring.
+    cpu_ring_t ring;
+
+    // Number of bytes output so far, mirrored in CPU_CONSOLE_REGISTER_WRITTEN.
+    uint64_t written;
+} cpu_console_t;
+
+/*
+ * Attaches a console to given CPU, with its registers mapped at CPU_CONSOLE_ADDRESS. Output of the program is collected
+ * in a ring and written into the file at given path, or the standard output if it is 0, by a thread of the console,
+ * so the program never waits for a system call. Returns 0 if the file can not be created or the registers can not be mapped.
+ */
+cpu_console_t *cpu_console_create(starkcpu_t *cpu, const char *path);
+
+/* Attaches a console that writes into a file that is already open, and closes it once destroyed, or into the standard output if it is 0. */
+cpu_console_t *cpu_console_create_from_file(starkcpu_t *cpu, FILE *file);
+
+/*
+ * Waits until all output is written, unmaps the console from its CPU and frees it. Returns false if any part of the output
+ * could not be written. A console that is still attached when its CPU is destroyed is destroyed along with it.
+ */
+bool cpu_console_destroy(cpu_console_t *console);
\ No newline at end of file
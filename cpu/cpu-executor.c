@@ -1,106 +1,165 @@
 #include "cpu-executor.h"
 #include "execution/exec-utils.h"
+#include "jit/jit.h"
+#include "tracer.h"
+#include "debugger.h"
+#include "bus.h"
+#include "scheduler.h"
+#include "interrupts.h"
+#include "smp.h"
 #include "../shared/stark1-opcodes.h"
+#include <stdatomic.h>
 #include <stdlib.h>
+#include <string.h>
+
+/*
+ * Every opcode supported by the executor, along with layout of its operands.
+ * Operand layout is described in opcode-handlers-map.h.
+ */
+#define CPU_OPCODES(OP) \
+    OP(OP_NOP, "") \
+    OP(OP_SET_REG_IMMEDIATE8, "rb") \
+    OP(OP_SET_REG_IMMEDIATE16, "rw") \
+    OP(OP_SET_REG_IMMEDIATE32, "rd") \
+    OP(OP_SET_REG_ADDR, "rd") \
+    OP(OP_SET_REG_REG, "rr") \
+    OP(OP_SET_ADDR_IMMEDIATE8, "db") \
+    OP(OP_SET_ADDR_IMMEDIATE16, "dw") \
+    OP(OP_SET_ADDR_IMMEDIATE32, "dd") \
+    OP(OP_SET_ADDR_ADDR, "dd") \
+    OP(OP_SET_ADDR_REG, "dr") \
+    OP(OP_SET_RADDR_RADDR, "rr") \
+    OP(OP_SET_RADDR_IMMEDIATE8, "rb") \
+    OP(OP_SET_RADDR_IMMEDIATE16, "rw") \
+    OP(OP_SET_RADDR_IMMEDIATE32, "rd") \
+    OP(OP_COPY_RADDR_RADDR_REG, "rrr") \
+    OP(OP_FILL_RADDR_REG_REG, "rrr") \
+    OP(OP_FILL_RADDR_IMMEDIATE8_REG, "rbr") \
+    OP(OP_JMP_RELATIVE, "d") \
+    OP(OP_JMP_ABSOLUTE, "d") \
+    OP(OP_JMP_REG, "r") \
+    OP(OP_JMP_IF_NOT_EQUAL, "d") \
+    OP(OP_INCREMENT, "r") \
+    OP(OP_DECREMENT, "r") \
+    OP(OP_CMP_REG_IMMEDIATE, "rd") \
+    OP(OP_HALT, "") \
+    OP(OP_ADD_REG_REG, "rrr") \
+    OP(OP_ADD_REG_IMM32, "rdr") \
+    OP(OP_SUB_REG_REG, "rrr") \
+    OP(OP_SUB_REG_IMM32, "rdr") \
+    OP(OP_SUB_IMM32_REG, "rdr") \
+    OP(OP_MUL_REG_REG, "rrr") \
+    OP(OP_MUL_REG_IMM32, "rdr") \
+    OP(OP_DIV_REG_REG, "rrr") \
+    OP(OP_DIV_REG_IMM32, "rdr") \
+    OP(OP_DIV_IMM32_REG, "rdr") \
+    OP(OP_INTERRUPTS_ENABLE, "") \
+    OP(OP_INTERRUPTS_DISABLE, "") \
+    OP(OP_INTERRUPT_RETURN, "") \
+    OP(OP_SET_INTERRUPT_VECTOR, "db") \
+    OP(OP_WAIT, "") \
+    OP(OP_COMPARE_EXCHANGE, "rrr") \
+    OP(OP_FETCH_ADD, "rr") \
+    OP(OP_FENCE, "") \
+    OP(OP_CORE_ID, "r") \
+    OP(OP_CORES_COUNT, "r")
+
+#define OP_NAME(op, operands) [op] = #op,
+#define OP_OPERANDS(op, operands) [op] = operands,
+
+static const char *opcode_names[256] = { CPU_OPCODES(OP_NAME) };
+static const char *opcode_operands[256] = { CPU_OPCODES(OP_OPERANDS) };
+
+const char *cpu_get_opcode_name(uint8_t opcode) {
+    // names are kept without the OP_ prefix
+    return opcode_names[opcode] ? opcode_names[opcode] + 3 : 0;
+}
+
+const char *cpu_get_opcode_operands(uint8_t opcode) {
+    return opcode_operands[opcode];
+}
 
 MAKE_OP_HANDLER(OP_NOP) {
     // does nothing
 }
 
 MAKE_OP_HANDLER(OP_SET_REG_IMMEDIATE8) {
-    uint8_t register_index = cpu_read_program(cpu);
-    uint8_t value = cpu_read_program(cpu);
-    assert_register_exists(register_index);
-    cpu_set_register_value(cpu, register_index, value);
+    cpu_set_register_value(cpu, instruction->operands[0], instruction->operands[1]);
 }
 
 MAKE_OP_HANDLER(OP_SET_REG_IMMEDIATE16) {
-    uint8_t register_index = cpu_read_program(cpu);
-    uint16_t value = cpu_read_program_int16(cpu);
-    assert_register_exists(register_index);
-    cpu_set_register_value(cpu, register_index, value);
+    cpu_set_register_value(cpu, instruction->operands[0], instruction->operands[1]);
 }
 
 MAKE_OP_HANDLER(OP_SET_REG_IMMEDIATE32) {
-    uint8_t register_index = cpu_read_program(cpu);
-    uint32_t value = cpu_read_program_int32(cpu);
-    assert_register_exists(register_index);
-    cpu_set_register_value(cpu, register_index, value);
+    cpu_set_register_value(cpu, instruction->operands[0], instruction->operands[1]);
 }
 
 MAKE_OP_HANDLER(OP_SET_REG_ADDR) {
-    uint8_t destination_register = cpu_read_program(cpu);
-    uint32_t source_address = cpu_read_program_int32(cpu);
+    uint8_t destination_register = instruction->operands[0];
+    uint32_t source_address = instruction->operands[1];
+
+    // unlike other reads, this one is not allowed to reach into the internal memory
+    if (source_address <= CPU_RESERVED_MEMORY_SIZE) {
+        cpu_panic(cpu, "address 0x%02x is not readable", source_address);
+    }
 
-    assert_register_exists(destination_register);
-    assert_address_writable(source_address);
+    assert_address_readable(source_address);
 
-    cpu_set_register_value(cpu, destination_register, *cpu_mem_get(cpu, source_address));
+    cpu_set_register_value(cpu, destination_register, cpu_mem_read(cpu, source_address));
 }
 
 MAKE_OP_HANDLER(OP_SET_REG_REG) {
-    uint8_t destination_register = cpu_read_program(cpu);
-    uint8_t source_register = cpu_read_program(cpu);
-
-    assert_register_exists(destination_register);
-    assert_register_exists(source_register);
+    uint8_t destination_register = instruction->operands[0];
+    uint8_t source_register = instruction->operands[1];
 
     cpu_set_register_value(cpu, destination_register, cpu_get_register_value(cpu, source_register));
 }
 
 MAKE_OP_HANDLER(OP_SET_ADDR_IMMEDIATE8) {
-    uint32_t destination_address = cpu_read_program_int32(cpu);
+    uint32_t destination_address = instruction->operands[0];
     assert_address_writable(destination_address);
-    cpu_mem_set(cpu, destination_address, cpu_read_program(cpu));
+    cpu_mem_set(cpu, destination_address, instruction->operands[1]);
 }
 
 MAKE_OP_HANDLER(OP_SET_ADDR_IMMEDIATE16) {
-    uint32_t destination_address = cpu_read_program_int32(cpu);
+    uint32_t destination_address = instruction->operands[0];
+    uint16_t value = instruction->operands[1];
     assert_address_writable(destination_address);
-    cpu_mem_set(cpu, destination_address, cpu_read_program(cpu));
-    cpu_mem_set(cpu, destination_address + 1, cpu_read_program(cpu));
+    cpu_mem_write(cpu, destination_address, value, 2);
 }
 
 MAKE_OP_HANDLER(OP_SET_ADDR_IMMEDIATE32) {
-    uint32_t destination_address = cpu_read_program_int32(cpu);
+    uint32_t destination_address = instruction->operands[0];
+    uint32_t value = instruction->operands[1];
     assert_address_writable(destination_address);
-    cpu_mem_set(cpu, destination_address, cpu_read_program(cpu));
-    cpu_mem_set(cpu, destination_address + 1, cpu_read_program(cpu));
-    cpu_mem_set(cpu, destination_address + 2, cpu_read_program(cpu));
-    cpu_mem_set(cpu, destination_address + 3, cpu_read_program(cpu));
+    cpu_mem_write(cpu, destination_address, value, 4);
 }
 
 MAKE_OP_HANDLER(OP_SET_ADDR_ADDR) {
-    uint32_t destination_address = cpu_read_program_int32(cpu);
-    uint32_t source_address = cpu_read_program_int32(cpu);
+    uint32_t destination_address = instruction->operands[0];
+    uint32_t source_address = instruction->operands[1];
 
     assert_address_writable(destination_address);
     assert_address_readable(source_address);
 
-    cpu_mem_set(cpu, destination_address, *cpu_mem_get(cpu, source_address));
+    cpu_mem_set(cpu, destination_address, cpu_mem_read(cpu, source_address));
 }
 
 MAKE_OP_HANDLER(OP_SET_ADDR_REG) {
-    uint32_t destination_address = cpu_read_program_int32(cpu);
-    uint8_t source_register = cpu_read_program(cpu);
+    uint32_t destination_address = instruction->operands[0];
+    uint8_t source_register = instruction->operands[1];
 
     assert_address_writable(destination_address);
-    assert_register_exists(source_register);
 
     int32_t value = cpu_get_register_value(cpu, source_register);
 
-    cpu_mem_set(cpu, destination_address, value);
-    cpu_mem_set(cpu, destination_address + 1, value >> 8);
-    cpu_mem_set(cpu, destination_address + 2, value >> 16);
-    cpu_mem_set(cpu, destination_address + 3, value >> 24);
+    cpu_mem_write(cpu, destination_address, value, 4);
 }
 
 MAKE_OP_HANDLER(OP_SET_RADDR_RADDR) {
-    uint8_t destination_register = cpu_read_program(cpu);
-    uint8_t source_register = cpu_read_program(cpu);
-
-    assert_register_exists(destination_register);
-    assert_register_exists(source_register);
+    uint8_t destination_register = instruction->operands[0];
+    uint8_t source_register = instruction->operands[1];
 
     uint32_t destination_address = cpu_get_register_value(cpu, destination_register);
     uint32_t source_address = cpu_get_register_value(cpu, source_register);
@@ -108,99 +167,209 @@ MAKE_OP_HANDLER(OP_SET_RADDR_RADDR) {
     assert_address_writable(destination_address);
     assert_address_readable(source_address);
 
-    cpu_mem_set(cpu, destination_address, *cpu_mem_get(cpu, source_address));
+    cpu_mem_set(cpu, destination_address, cpu_mem_read(cpu, source_address));
 }
 
 MAKE_OP_HANDLER(OP_SET_RADDR_IMMEDIATE8) {
-    uint8_t destination_register = cpu_read_program(cpu);
-    assert_register_exists(destination_register);
+    uint8_t destination_register = instruction->operands[0];
 
     uint32_t destination_address = cpu_get_register_value(cpu, destination_register);
     assert_address_writable(destination_address);
 
-    uint8_t value = cpu_read_program(cpu);
+    uint8_t value = instruction->operands[1];
 
     cpu_mem_set(cpu, destination_address, value);
 }
 
 MAKE_OP_HANDLER(OP_SET_RADDR_IMMEDIATE16) {
-    uint8_t destination_register = cpu_read_program(cpu);
-    assert_register_exists(destination_register);
+    uint8_t destination_register = instruction->operands[0];
 
     uint32_t destination_address = cpu_get_register_value(cpu, destination_register);
     assert_address_writable(destination_address);
 
-    uint16_t value = cpu_read_program_int16(cpu);
+    uint16_t value = instruction->operands[1];
 
-    cpu_mem_set(cpu, destination_address, value);
-    cpu_mem_set(cpu, destination_address + 1, value >> 8);
+    cpu_mem_write(cpu, destination_address, value, 2);
 }
 
 MAKE_OP_HANDLER(OP_SET_RADDR_IMMEDIATE32) {
-    uint8_t destination_register = cpu_read_program(cpu);
-    assert_register_exists(destination_register);
+    uint8_t destination_register = instruction->operands[0];
 
     uint32_t destination_address = cpu_get_register_value(cpu, destination_register);
     assert_address_writable(destination_address);
 
-    uint32_t value = cpu_read_program_int32(cpu);
+    uint32_t value = instruction->operands[1];
 
-    cpu_mem_set(cpu, destination_address, value);
-    cpu_mem_set(cpu, destination_address + 1, value >> 8);
-    cpu_mem_set(cpu, destination_address + 1, value >> 16);
-    cpu_mem_set(cpu, destination_address + 1, value >> 24);
+    cpu_mem_write(cpu, destination_address, value, 4);
+}
+
+/* Checks whether every page of `size` bytes at given address allows given access. */
+bool is_range_accessible(starkcpu_t *cpu, uint32_t address, uint32_t size, uint8_t permissions) {
+    if ((uint64_t) address + size > cpu->memsize) {
+        return false;
+    }
+
+    if (!cpu->pages->restricted) {
+        return true;
+    }
+
+    for (uint32_t page = address >> CPU_PAGE_SHIFT; page <= (address + (size - 1)) >> CPU_PAGE_SHIFT; page++) {
+        if (!cpu_memory_can_access(cpu, page << CPU_PAGE_SHIFT, permissions)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Makes sure that all of `size` bytes at given address can be written to, before any of them is. Panics if they can not. */
+void assert_range_writable(starkcpu_t *cpu, uint32_t address, uint32_t size) {
+    if (address <= CPU_RESERVED_MEMORY_SIZE || !is_range_accessible(cpu, address, size, CPU_PAGE_WRITE)) {
+        cpu_panic(cpu, "%u bytes at address 0x%02x are not writable", size, address);
+    }
+}
+
+/* Block writes bypass cpu_mem_set, so they have to drop decoded instructions, mark pages as dirty and let the tracer know themselves. */
+void finish_range_write(starkcpu_t *cpu, uint32_t address, uint32_t size) {
+    cpu_executor_invalidate_range(cpu->executor, address, size);
+    cpu_memory_mark_dirty(cpu, address, size);
+
+    if (cpu->tracer) {
+        cpu_tracer_note_write(cpu->tracer, address, size);
+    }
+}
+
+/* Copies a range that touches a device one byte at a time, in the order that gives the same result as memmove. */
+void copy_through_bus(starkcpu_t *cpu, uint32_t destination_address, uint32_t source_address, uint32_t size) {
+    bool backwards = destination_address > source_address && destination_address - source_address < size;
+
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t offset = backwards ? size - 1 - i : i;
+        cpu_mem_set(cpu, destination_address + offset, cpu_mem_read(cpu, source_address + offset));
+    }
+}
+
+void fill_through_bus(starkcpu_t *cpu, uint32_t destination_address, uint8_t value, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++) {
+        cpu_mem_set(cpu, destination_address + i, value);
+    }
+}
+
+MAKE_OP_HANDLER(OP_COPY_RADDR_RADDR_REG) {
+    uint32_t destination_address = cpu_get_register_value(cpu, instruction->operands[0]);
+    uint32_t source_address = cpu_get_register_value(cpu, instruction->operands[1]);
+    uint32_t size = cpu_get_register_value(cpu, instruction->operands[2]);
+
+    if (size == 0) {
+        return;
+    }
+
+    assert_range_writable(cpu, destination_address, size);
+
+    if (!is_range_accessible(cpu, source_address, size, CPU_PAGE_READ)) {
+        cpu_panic(cpu, "%u bytes at address 0x%02x are not readable", size, source_address);
+    }
+
+    if (cpu_bus_overlaps(cpu, destination_address, size) || cpu_bus_overlaps(cpu, source_address, size)) {
+        copy_through_bus(cpu, destination_address, source_address, size);
+        return;
+    }
+
+    if (source_address < CPU_RESERVED_MEMORY_SIZE) {
+        cpu_sync_internal_memory(cpu);
+    }
+
+    // ranges are allowed to overlap, the result is the same as if the source was copied aside first
+    memmove(cpu->mem + destination_address, cpu->mem + source_address, size);
+    finish_range_write(cpu, destination_address, size);
+}
+
+MAKE_OP_HANDLER(OP_FILL_RADDR_REG_REG) {
+    uint32_t destination_address = cpu_get_register_value(cpu, instruction->operands[0]);
+    uint8_t value = cpu_get_register_value(cpu, instruction->operands[1]);
+    uint32_t size = cpu_get_register_value(cpu, instruction->operands[2]);
+
+    if (size == 0) {
+        return;
+    }
+
+    assert_range_writable(cpu, destination_address, size);
+
+    if (cpu_bus_overlaps(cpu, destination_address, size)) {
+        fill_through_bus(cpu, destination_address, value, size);
+        return;
+    }
+
+    memset(cpu->mem + destination_address, value, size);
+    finish_range_write(cpu, destination_address, size);
+}
+
+MAKE_OP_HANDLER(OP_FILL_RADDR_IMMEDIATE8_REG) {
+    uint32_t destination_address = cpu_get_register_value(cpu, instruction->operands[0]);
+    uint8_t value = instruction->operands[1];
+    uint32_t size = cpu_get_register_value(cpu, instruction->operands[2]);
+
+    if (size == 0) {
+        return;
+    }
+
+    assert_range_writable(cpu, destination_address, size);
+
+    if (cpu_bus_overlaps(cpu, destination_address, size)) {
+        fill_through_bus(cpu, destination_address, value, size);
+        return;
+    }
+
+    memset(cpu->mem + destination_address, value, size);
+    finish_range_write(cpu, destination_address, size);
 }
 
 MAKE_OP_HANDLER(OP_JMP_RELATIVE) {
-    uint32_t offset = cpu_read_program_int32(cpu);
-    uint32_t address = *cpu->ip + offset;
+    uint32_t offset = instruction->operands[0];
+    uint32_t address = cpu->ip + offset;
     assert_address_jmpable(address);
     cpu_jmp(cpu, address);
 }
 
 MAKE_OP_HANDLER(OP_JMP_ABSOLUTE) {
-    uint32_t address = cpu_read_program_int32(cpu);
+    uint32_t address = instruction->operands[0];
     assert_address_jmpable(address);
     cpu_jmp(cpu, address);
 }
 
 MAKE_OP_HANDLER(OP_JMP_REG) {
-    uint8_t register_index = cpu_read_program(cpu);
-    assert_register_exists(register_index);
+    uint8_t register_index = instruction->operands[0];
     uint32_t address = cpu_get_register_value(cpu, register_index);
     assert_address_jmpable(address);
     cpu_jmp(cpu, address);
 }
 
 MAKE_OP_HANDLER(OP_JMP_IF_NOT_EQUAL) {
-    uint32_t address = cpu_read_program_int32(cpu);
+    uint32_t address = instruction->operands[0];
     assert_address_jmpable(address);
-    if (*cpu->flag_equal == 0) {
+    if (cpu->flag_equal == 0) {
         cpu_jmp(cpu, address);
     }
 }
 
 MAKE_OP_HANDLER(OP_CMP_REG_IMMEDIATE) {
-    uint8_t register_index = cpu_read_program(cpu);
-    assert_register_exists(register_index);
-    uint32_t value = cpu_read_program_int32(cpu);
+    uint8_t register_index = instruction->operands[0];
+    uint32_t value = instruction->operands[1];
 
     if (cpu_get_register_value(cpu, register_index) == value) {
-        *cpu->flag_equal = 1;
+        cpu->flag_equal = 1;
     } else {
-        *cpu->flag_equal = 0;
+        cpu->flag_equal = 0;
     }
 }
 
 MAKE_OP_HANDLER(OP_INCREMENT) {
-    uint8_t register_index = cpu_read_program(cpu);
-    assert_register_exists(register_index);
+    uint8_t register_index = instruction->operands[0];
     cpu_set_register_value(cpu, register_index, cpu_get_register_value(cpu, register_index) + 1);
 }
 
 MAKE_OP_HANDLER(OP_DECREMENT) {
-    uint8_t register_index = cpu_read_program(cpu);
-    assert_register_exists(register_index);
+    uint8_t register_index = instruction->operands[0];
     cpu_set_register_value(cpu, register_index, cpu_get_register_value(cpu, register_index) - 1);
 }
 
@@ -209,93 +378,65 @@ MAKE_OP_HANDLER(OP_HALT) {
 }
 
 MAKE_OP_HANDLER(OP_ADD_REG_REG) {
-    uint8_t register_a = cpu_read_program(cpu);
-    uint8_t register_b = cpu_read_program(cpu);
-    uint8_t destination_register = cpu_read_program(cpu);
-
-    assert_register_exists(register_a);
-    assert_register_exists(register_b);
-    assert_register_exists(destination_register);
+    uint8_t register_a = instruction->operands[0];
+    uint8_t register_b = instruction->operands[1];
+    uint8_t destination_register = instruction->operands[2];
 
     cpu_set_register_value(cpu, destination_register, cpu_get_register_value(cpu, register_a) + cpu_get_register_value(cpu, register_b));
 }
 
 MAKE_OP_HANDLER(OP_ADD_REG_IMM32) {
-    uint8_t register_a = cpu_read_program(cpu);
-    uint32_t value = cpu_read_program_int32(cpu);
-    uint8_t destination_register = cpu_read_program(cpu);
-
-    assert_register_exists(register_a);
-    assert_register_exists(destination_register);
+    uint8_t register_a = instruction->operands[0];
+    uint32_t value = instruction->operands[1];
+    uint8_t destination_register = instruction->operands[2];
 
     cpu_set_register_value(cpu, destination_register, cpu_get_register_value(cpu, register_a) + value);
 }
 
 MAKE_OP_HANDLER(OP_SUB_REG_REG) {
-    uint8_t register_a = cpu_read_program(cpu);
-    uint8_t register_b = cpu_read_program(cpu);
-    uint8_t destination_register = cpu_read_program(cpu);
-
-    assert_register_exists(register_a);
-    assert_register_exists(register_b);
-    assert_register_exists(destination_register);
+    uint8_t register_a = instruction->operands[0];
+    uint8_t register_b = instruction->operands[1];
+    uint8_t destination_register = instruction->operands[2];
 
     cpu_set_register_value(cpu, destination_register, cpu_get_register_value(cpu, register_a) - cpu_get_register_value(cpu, register_b));
 }
 
 MAKE_OP_HANDLER(OP_SUB_REG_IMM32) {
-    uint8_t register_a = cpu_read_program(cpu);
-    uint32_t value = cpu_read_program_int32(cpu);
-    uint8_t destination_register = cpu_read_program(cpu);
-
-    assert_register_exists(register_a);
-    assert_register_exists(destination_register);
+    uint8_t register_a = instruction->operands[0];
+    uint32_t value = instruction->operands[1];
+    uint8_t destination_register = instruction->operands[2];
 
     cpu_set_register_value(cpu, destination_register, cpu_get_register_value(cpu, register_a) - value);
 }
 
 MAKE_OP_HANDLER(OP_SUB_IMM32_REG) {
-    uint8_t register_a = cpu_read_program(cpu);
-    uint32_t value = cpu_read_program_int32(cpu);
-    uint8_t destination_register = cpu_read_program(cpu);
-
-    assert_register_exists(register_a);
-    assert_register_exists(destination_register);
+    uint8_t register_a = instruction->operands[0];
+    uint32_t value = instruction->operands[1];
+    uint8_t destination_register = instruction->operands[2];
 
     cpu_set_register_value(cpu, destination_register, value - cpu_get_register_value(cpu, register_a));
 }
 
 MAKE_OP_HANDLER(OP_MUL_REG_REG) {
-    uint8_t register_a = cpu_read_program(cpu);
-    uint8_t register_b = cpu_read_program(cpu);
-    uint8_t destination_register = cpu_read_program(cpu);
-
-    assert_register_exists(register_a);
-    assert_register_exists(register_b);
-    assert_register_exists(destination_register);
+    uint8_t register_a = instruction->operands[0];
+    uint8_t register_b = instruction->operands[1];
+    uint8_t destination_register = instruction->operands[2];
 
     cpu_set_register_value(cpu, destination_register, cpu_get_register_value(cpu, register_a) * cpu_get_register_value(cpu, register_b));
 }
 
 MAKE_OP_HANDLER(OP_MUL_REG_IMM32) {
-    uint8_t register_a = cpu_read_program(cpu);
-    uint32_t value = cpu_read_program_int32(cpu);
-    uint8_t destination_register = cpu_read_program(cpu);
-
-    assert_register_exists(register_a);
-    assert_register_exists(destination_register);
+    uint8_t register_a = instruction->operands[0];
+    uint32_t value = instruction->operands[1];
+    uint8_t destination_register = instruction->operands[2];
 
     cpu_set_register_value(cpu, destination_register, cpu_get_register_value(cpu, register_a) * value);
 }
 
 MAKE_OP_HANDLER(OP_DIV_REG_REG) {
-    uint8_t register_a = cpu_read_program(cpu);
-    uint8_t register_b = cpu_read_program(cpu);
-    uint8_t destination_register = cpu_read_program(cpu);
-
-    assert_register_exists(register_a);
-    assert_register_exists(register_b);
-    assert_register_exists(destination_register);
+    uint8_t register_a = instruction->operands[0];
+    uint8_t register_b = instruction->operands[1];
+    uint8_t destination_register = instruction->operands[2];
 
     uint32_t divisor = cpu_get_register_value(cpu, register_a);
     uint32_t denominator = cpu_get_register_value(cpu, register_b);
@@ -308,12 +449,9 @@ MAKE_OP_HANDLER(OP_DIV_REG_REG) {
 }
 
 MAKE_OP_HANDLER(OP_DIV_REG_IMM32) {
-    uint8_t register_a = cpu_read_program(cpu);
-    uint32_t denominator = cpu_read_program_int32(cpu);
-    uint8_t destination_register = cpu_read_program(cpu);
-
-    assert_register_exists(register_a);
-    assert_register_exists(destination_register);
+    uint8_t register_a = instruction->operands[0];
+    uint32_t denominator = instruction->operands[1];
+    uint8_t destination_register = instruction->operands[2];
 
     uint32_t divisor = cpu_get_register_value(cpu, register_a);
 
@@ -325,12 +463,9 @@ MAKE_OP_HANDLER(OP_DIV_REG_IMM32) {
 }
 
 MAKE_OP_HANDLER(OP_DIV_IMM32_REG) {
-    uint8_t register_a = cpu_read_program(cpu);
-    uint32_t divisor = cpu_read_program_int32(cpu);
-    uint8_t destination_register = cpu_read_program(cpu);
-
-    assert_register_exists(register_a);
-    assert_register_exists(destination_register);
+    uint8_t register_a = instruction->operands[0];
+    uint32_t divisor = instruction->operands[1];
+    uint8_t destination_register = instruction->operands[2];
 
     uint32_t denominator = cpu_get_register_value(cpu, register_a);
     if (denominator == 0) {
@@ -340,54 +475,509 @@ MAKE_OP_HANDLER(OP_DIV_IMM32_REG) {
     cpu_set_register_value(cpu, destination_register, divisor / denominator);
 }
 
+MAKE_OP_HANDLER(OP_INTERRUPTS_ENABLE) {
+    cpu->interrupts_enabled = true;
+
+    // interrupt that is already pending is delivered right after this instruction
+    if (cpu_has_pending_interrupt(cpu)) {
+        cpu_scheduler_end_batch(cpu);
+    }
+}
+
+MAKE_OP_HANDLER(OP_INTERRUPTS_DISABLE) {
+    cpu->interrupts_enabled = false;
+}
+
+MAKE_OP_HANDLER(OP_INTERRUPT_RETURN) {
+    uint32_t address = cpu->interrupt_return;
+    assert_address_jmpable(address);
+
+    cpu->flag_equal = cpu->interrupt_flag_equal;
+    cpu->interrupts_enabled = true;
+    cpu_jmp(cpu, address);
+
+    if (cpu_has_pending_interrupt(cpu)) {
+        cpu_scheduler_end_batch(cpu);
+    }
+}
+
+MAKE_OP_HANDLER(OP_SET_INTERRUPT_VECTOR) {
+    uint32_t address = instruction->operands[0];
+    uint8_t line = instruction->operands[1];
+
+    if (line >= CPU_INTERRUPT_LINES) {
+        cpu_panic(cpu, "interrupt line %d does not exist", line);
+    }
+
+    // 0 removes the handler
+    if (address != 0) {
+        assert_address_jmpable(address);
+    }
+
+    // the vector table is a part of the internal memory, which never holds any instructions
+    for (uint32_t i = 0; i < 4; i++) {
+        cpu->mem[CPU_INTERRUPT_VECTORS_ADDRESS + line * 4 + i] = address >> (i * 8);
+    }
+}
+
+MAKE_OP_HANDLER(OP_WAIT) {
+    if (!cpu_has_pending_interrupt(cpu)) {
+        cpu->waiting = true;
+        cpu_scheduler_end_batch(cpu);
+    }
+}
+
+/* Returns the aligned 32-bit value in memory that an atomic instruction works with. Panics if it can not be both read and written. */
+_Atomic uint32_t *get_atomic_value(starkcpu_t *cpu, uint32_t address) {
+    if (address % 4 != 0) {
+        cpu_panic(cpu, "address 0x%02x of an atomic instruction is not aligned to 4 bytes", address);
+    }
+
+    assert_range_writable(cpu, address, 4);
+
+    if (!is_range_accessible(cpu, address, 4, CPU_PAGE_READ)) {
+        cpu_panic(cpu, "address 0x%02x is not readable", address);
+    }
+
+    // cores other than the first one do not see devices at all (see smp.h), so this holds for every core
+    if (cpu->io_pages[address >> CPU_PAGE_SHIFT]) {
+        cpu_panic(cpu, "atomic instruction can not access the device at address 0x%02x", address);
+    }
+
+    return (_Atomic uint32_t *) (cpu->mem + address);
+}
+
+MAKE_OP_HANDLER(OP_COMPARE_EXCHANGE) {
+    uint32_t address = cpu_get_register_value(cpu, instruction->operands[0]);
+    _Atomic uint32_t *value = get_atomic_value(cpu, address);
+    uint32_t expected = cpu_get_register_value(cpu, instruction->operands[1]);
+
+    if (atomic_compare_exchange_strong(value, &expected, cpu_get_register_value(cpu, instruction->operands[2]))) {
+        cpu->flag_equal = 1;
+        finish_range_write(cpu, address, 4);
+    } else {
+        // a retry loop gets the value it lost to without reading it again
+        cpu->flag_equal = 0;
+        cpu_set_register_value(cpu, instruction->operands[1], expected);
+    }
+
+    if (cpu->smp_core) {
+        cpu_smp_sync_code(cpu->smp_core);
+    }
+}
+
+MAKE_OP_HANDLER(OP_FETCH_ADD) {
+    uint32_t address = cpu_get_register_value(cpu, instruction->operands[0]);
+    uint32_t previous = atomic_fetch_add(get_atomic_value(cpu, address), cpu_get_register_value(cpu, instruction->operands[1]));
+
+    cpu_set_register_value(cpu, instruction->operands[1], previous);
+    finish_range_write(cpu, address, 4);
+
+    if (cpu->smp_core) {
+        cpu_smp_sync_code(cpu->smp_core);
+    }
+}
+
+MAKE_OP_HANDLER(OP_FENCE) {
+    atomic_thread_fence(memory_order_seq_cst);
+
+    // code that other cores changed before this point is executed as it is now
+    if (cpu->smp_core) {
+        cpu_smp_sync_code(cpu->smp_core);
+    }
+}
+
+MAKE_OP_HANDLER(OP_CORE_ID) {
+    cpu_set_register_value(cpu, instruction->operands[0], cpu->core_id);
+}
+
+MAKE_OP_HANDLER(OP_CORES_COUNT) {
+    cpu_set_register_value(cpu, instruction->operands[0], cpu->cores_count);
+}
+
+void fused_jmp_if_not_equal(starkcpu_t *cpu, uint32_t address) {
+    assert_address_jmpable(address);
+    if (cpu->flag_equal == 0) {
+        cpu_jmp(cpu, address);
+    }
+}
+
+/*
+ * Handlers of fused instructions (see cpu-fusion.h) reuse handlers of the instructions they replace,
+ * which only read their own operands from the beginning of the fused instruction.
+ */
+MAKE_OP_HANDLER(OP_FUSED_CMP_JNE) {
+    cpu_execute_OP_CMP_REG_IMMEDIATE(cpu, instruction);
+    fused_jmp_if_not_equal(cpu, instruction->operands[2]);
+    cpu->executor->fusion_counts[OP_FUSED_CMP_JNE - OP_FUSED_FIRST]++;
+}
+
+MAKE_OP_HANDLER(OP_FUSED_DEC_CMP_JNE) {
+    cpu_execute_OP_DECREMENT(cpu, instruction);
+    cpu_execute_OP_CMP_REG_IMMEDIATE(cpu, instruction);
+    fused_jmp_if_not_equal(cpu, instruction->operands[2]);
+    cpu->executor->fusion_counts[OP_FUSED_DEC_CMP_JNE - OP_FUSED_FIRST]++;
+}
+
+MAKE_OP_HANDLER(OP_FUSED_INC_CMP_JNE) {
+    cpu_execute_OP_INCREMENT(cpu, instruction);
+    cpu_execute_OP_CMP_REG_IMMEDIATE(cpu, instruction);
+    fused_jmp_if_not_equal(cpu, instruction->operands[2]);
+    cpu->executor->fusion_counts[OP_FUSED_INC_CMP_JNE - OP_FUSED_FIRST]++;
+}
+
+MAKE_OP_HANDLER(OP_FUSED_COPY_INC_INC) {
+    uint32_t next_ip = cpu->ip;
+
+    // instruction pointer has to be right after the copy in case it panics
+    cpu->ip = instruction->operands[2];
+    cpu_execute_OP_SET_RADDR_RADDR(cpu, instruction);
+
+    // If the copy overwrote this instruction, the increments are decoded again and executed separately.
+    // The slot is already dropped from the cache, so it can report that only the copy was executed.
+    if (!instruction->handler) {
+        ((cpu_instruction_t *) instruction)->count = 1;
+        return;
+    }
+
+    cpu->ip = next_ip;
+    cpu_set_register_value(cpu, instruction->operands[0], cpu_get_register_value(cpu, instruction->operands[0]) + 1);
+    cpu_set_register_value(cpu, instruction->operands[1], cpu_get_register_value(cpu, instruction->operands[1]) + 1);
+    cpu->executor->fusion_counts[OP_FUSED_COPY_INC_INC - OP_FUSED_FIRST]++;
+}
+
+bool cpu_opcode_writes_memory(uint8_t opcode) {
+    switch (opcode) {
+        case OP_SET_ADDR_IMMEDIATE8:
+        case OP_SET_ADDR_IMMEDIATE16:
+        case OP_SET_ADDR_IMMEDIATE32:
+        case OP_SET_ADDR_ADDR:
+        case OP_SET_ADDR_REG:
+        case OP_SET_RADDR_RADDR:
+        case OP_SET_RADDR_IMMEDIATE8:
+        case OP_SET_RADDR_IMMEDIATE16:
+        case OP_SET_RADDR_IMMEDIATE32:
+        case OP_COPY_RADDR_RADDR_REG:
+        case OP_FILL_RADDR_REG_REG:
+        case OP_FILL_RADDR_IMMEDIATE8_REG:
+        case OP_FUSED_COPY_INC_INC:
+        case OP_COMPARE_EXCHANGE:
+        case OP_FETCH_ADD:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+uint32_t cpu_get_instruction_write(starkcpu_t *cpu, const cpu_instruction_t *instruction, uint32_t *address) {
+    const uint32_t *operands = instruction->operands;
+
+    switch (instruction->opcode) {
+        case OP_SET_ADDR_IMMEDIATE8:
+        case OP_SET_ADDR_ADDR:
+            *address = operands[0];
+            return 1;
+
+        case OP_SET_ADDR_IMMEDIATE16:
+            *address = operands[0];
+            return 2;
+
+        case OP_SET_ADDR_IMMEDIATE32:
+        case OP_SET_ADDR_REG:
+            *address = operands[0];
+            return 4;
+
+        case OP_SET_RADDR_RADDR:
+        case OP_SET_RADDR_IMMEDIATE8:
+        case OP_FUSED_COPY_INC_INC:
+            *address = cpu_get_register_value(cpu, operands[0]);
+            return 1;
+
+        case OP_SET_RADDR_IMMEDIATE16:
+            *address = cpu_get_register_value(cpu, operands[0]);
+            return 2;
+
+        case OP_SET_RADDR_IMMEDIATE32:
+        case OP_COMPARE_EXCHANGE:
+        case OP_FETCH_ADD:
+            *address = cpu_get_register_value(cpu, operands[0]);
+            return 4;
+
+        case OP_COPY_RADDR_RADDR_REG:
+        case OP_FILL_RADDR_REG_REG:
+        case OP_FILL_RADDR_IMMEDIATE8_REG:
+            *address = cpu_get_register_value(cpu, operands[0]);
+            return cpu_get_register_value(cpu, operands[2]);
+
+        default:
+            return 0;
+    }
+}
+
 cpu_executor_t *cpu_executor_create(starkcpu_t *cpu) {
     cpu_executor_t *executor = malloc(sizeof(cpu_executor_t));
+    if (!executor) {
+        return 0;
+    }
+
+    // one slot per byte of memory, far more than the memory itself
+    executor->instructions = cpu_memory_reserve((uint64_t) cpu->memsize * sizeof(cpu_instruction_t));
+    if (!executor->instructions) {
+        free(executor);
+        return 0;
+    }
+
     executor->cpu = cpu;
     executor->handlers_map = opcode_handlers_map_create();
-    opcode_handlers_map_reserve(executor->handlers_map, 255);
-
-    DEFINE_OP(OP_NOP);
-    DEFINE_OP(OP_SET_REG_IMMEDIATE8);
-    DEFINE_OP(OP_SET_REG_IMMEDIATE16);
-    DEFINE_OP(OP_SET_REG_IMMEDIATE32);
-    DEFINE_OP(OP_SET_REG_ADDR);
-    DEFINE_OP(OP_SET_REG_REG);
-    DEFINE_OP(OP_SET_ADDR_IMMEDIATE8);
-    DEFINE_OP(OP_SET_ADDR_IMMEDIATE16);
-    DEFINE_OP(OP_SET_ADDR_IMMEDIATE32);
-    DEFINE_OP(OP_SET_ADDR_ADDR);
-    DEFINE_OP(OP_SET_ADDR_REG);
-    DEFINE_OP(OP_SET_RADDR_RADDR);
-    DEFINE_OP(OP_SET_RADDR_IMMEDIATE8);
-    DEFINE_OP(OP_SET_RADDR_IMMEDIATE16);
-    DEFINE_OP(OP_SET_RADDR_IMMEDIATE32);
-    DEFINE_OP(OP_JMP_RELATIVE);
-    DEFINE_OP(OP_JMP_ABSOLUTE);
-    DEFINE_OP(OP_JMP_REG);
-    DEFINE_OP(OP_JMP_IF_NOT_EQUAL);
-    DEFINE_OP(OP_INCREMENT);
-    DEFINE_OP(OP_DECREMENT);
-    DEFINE_OP(OP_CMP_REG_IMMEDIATE);
-    DEFINE_OP(OP_HALT);
-    DEFINE_OP(OP_ADD_REG_REG);
-    DEFINE_OP(OP_ADD_REG_IMM32);
-    DEFINE_OP(OP_SUB_REG_REG);
-    DEFINE_OP(OP_SUB_REG_IMM32);
-    DEFINE_OP(OP_SUB_IMM32_REG);
-    DEFINE_OP(OP_MUL_REG_REG);
-    DEFINE_OP(OP_MUL_REG_IMM32);
-    DEFINE_OP(OP_DIV_REG_REG);
-    DEFINE_OP(OP_DIV_REG_IMM32);
-    DEFINE_OP(OP_DIV_IMM32_REG);
+    opcode_handlers_map_reserve(executor->handlers_map, 256);
+
+    executor->code_start = cpu->memsize;
+    executor->code_end = 0;
+    executor->jit = 0;
+    memset(executor->fusion_counts, 0, sizeof(executor->fusion_counts));
+
+    CPU_OPCODES(DEFINE_OP)
 
     return executor;
 }
 
-void cpu_execute_instruction(cpu_executor_t *executor, uint8_t code) {
-    opcode_exec_func handler = (opcode_exec_func) *opcode_handlers_map_get(executor->handlers_map, code);
-    if (handler) {
-        handler(executor->cpu);
-    } else {
-        cpu_panic(executor->cpu, "unknown opcode encountered: 0x%02X", code);
+void cpu_executor_destroy(cpu_executor_t *executor) {
+    if (executor->jit) {
+        cpu_jit_destroy(executor->jit);
+    }
+
+    opcode_handlers_map_destroy(executor->handlers_map);
+    cpu_memory_release(executor->instructions, (uint64_t) executor->cpu->memsize * sizeof(cpu_instruction_t));
+    free(executor);
+}
+
+void cpu_executor_reset(cpu_executor_t *executor) {
+    cpu_memory_zero(executor->instructions, (uint64_t) executor->cpu->memsize * sizeof(cpu_instruction_t));
+    executor->code_start = executor->cpu->memsize;
+    executor->code_end = 0;
+
+    if (executor->jit) {
+        cpu_jit_flush(executor->jit);
+    }
+}
+
+uint8_t read_program_byte(starkcpu_t *cpu, uint32_t address) {
+    return *(uint8_t *) (cpu->mem + address);
+}
+
+bool cpu_decode_instruction(cpu_executor_t *executor, uint32_t address, cpu_instruction_t *instruction, bool strict) {
+    starkcpu_t *cpu = executor->cpu;
+
+    // pages of devices are never executable, the memory underneath them does not hold what the program sees
+    if (!cpu_memory_can_access(cpu, address, CPU_PAGE_EXECUTE) || cpu->io_pages[address >> CPU_PAGE_SHIFT]) {
+        if (strict) {
+            cpu_panic(cpu, "address 0x%02x is not executable", address);
+        }
+
+        return false;
+    }
+
+    uint8_t code = read_program_byte(cpu, address);
+    opcode_handler_t *handler = opcode_handlers_map_get(executor->handlers_map, code);
+
+    if (!handler->func) {
+        if (strict) {
+            cpu_panic(cpu, "unknown opcode encountered: 0x%02X", code);
+        }
+
+        return false;
+    }
+
+    uint32_t length = 1;
+    for (const char *operand = handler->operands; *operand; operand++) {
+        switch (*operand) {
+            case 'r':
+            case 'b': length += 1; break;
+            case 'w': length += 2; break;
+            case 'd': length += 4; break;
+        }
+    }
+
+    if (address + length > cpu->memsize) {
+        if (strict) {
+            cpu_panic(cpu, "attempted to read memory from 0x%02X address, which is not readable", address);
+        }
+
+        return false;
+    }
+
+    if (!cpu_memory_can_access(cpu, address + length - 1, CPU_PAGE_EXECUTE) || cpu->io_pages[(address + length - 1) >> CPU_PAGE_SHIFT]) {
+        if (strict) {
+            cpu_panic(cpu, "address 0x%02x is not executable", address + length - 1);
+        }
+
+        return false;
+    }
+
+    uint32_t position = address + 1;
+    uint32_t index = 0;
+    for (const char *operand = handler->operands; *operand; operand++) {
+        uint32_t value = read_program_byte(cpu, position++);
+
+        if (*operand == 'w' || *operand == 'd') {
+            value |= read_program_byte(cpu, position++) << 8;
+        }
+
+        if (*operand == 'd') {
+            value |= read_program_byte(cpu, position++) << 16;
+            value |= read_program_byte(cpu, position++) << 24;
+        }
+
+        if (*operand == 'r' && value > 7) {
+            if (strict) {
+                cpu_panic(cpu, "register %d does not exist", value);
+            }
+
+            return false;
+        }
+
+        instruction->operands[index++] = value;
+    }
+
+    instruction->opcode = code;
+    instruction->length = length;
+    instruction->count = 1;
+    instruction->handler = handler->func;
+
+    if (address < executor->code_start || address + length > executor->code_end) {
+        if (address < executor->code_start) {
+            executor->code_start = address;
+        }
+
+        if (address + length > executor->code_end) {
+            executor->code_end = address + length;
+        }
+
+        if (cpu->smp_core) {
+            cpu_smp_add_code(cpu->smp_core->smp, executor->code_start, executor->code_end);
+        }
+    }
+
+    return true;
+}
+
+void cpu_cache_instruction(cpu_executor_t *executor, uint32_t address, cpu_instruction_t *instruction) {
+    cpu_decode_instruction(executor, address, instruction, true);
+
+    if (executor->cpu->fusion) {
+        cpu_fuse_instruction(executor, address, instruction);
+    }
+
+    if (executor->cpu->debugger) {
+        cpu_debugger_patch_instruction(executor->cpu->debugger, address, instruction);
+    }
+}
+
+cpu_instruction_t *cpu_unfuse_instruction(cpu_executor_t *executor, uint32_t address) {
+    cpu_decode_instruction(executor, address, &executor->unfused, true);
+    return &executor->unfused;
+}
+
+uint32_t cpu_execute_next_instruction(cpu_executor_t *executor, uint32_t budget) {
+    cpu_instruction_t *instruction = cpu_fetch_instruction(executor, budget);
+    instruction->handler(executor->cpu, instruction);
+    return instruction->count;
+}
+
+uint32_t cpu_execute_instructions(cpu_executor_t *executor, uint32_t count) {
+    starkcpu_t *cpu = executor->cpu;
+    uint32_t executed = 0;
+
+    while (executed < count && cpu->running && cpu->ip < cpu->memsize) {
+        executed += cpu_execute_next_instruction(executor, count - executed);
+    }
+
+    return executed;
+}
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(CPU_NO_COMPUTED_GOTO)
+#define CPU_COMPUTED_GOTO
+#endif
+
+uint32_t cpu_execute_threaded(cpu_executor_t *executor, uint32_t count) {
+    starkcpu_t *cpu = executor->cpu;
+    cpu_instruction_t *instruction;
+    uint32_t executed = 0;
+
+#ifdef CPU_COMPUTED_GOTO
+    // Every handler gets its own copy of the dispatch code, so the host CPU can predict
+    // each indirect jump based on the opcode that is being executed right now.
+#define OP_LABEL(op, operands) [op] = &&execute_##op,
+#define OP_BODY(op, operands) execute_##op: cpu_execute_##op(cpu, instruction); executed += instruction->count; DISPATCH();
+#define DISPATCH() \
+    if (executed == count || !cpu->running || cpu->ip >= cpu->memsize) { \
+        return executed; \
+    } \
+    instruction = cpu_fetch_instruction(executor, count - executed); \
+    goto *labels[instruction->opcode];
+
+    static void *labels[256] = { CPU_OPCODES(OP_LABEL) CPU_FUSED_OPCODES(OP_LABEL) OP_LABEL(OP_DEBUG_TRAP, "") };
+
+    DISPATCH();
+    CPU_OPCODES(OP_BODY)
+    CPU_FUSED_OPCODES(OP_BODY)
+    OP_BODY(OP_DEBUG_TRAP, "")
+#else
+#define OP_BODY(op, operands) case op: cpu_execute_##op(cpu, instruction); break;
+
+    while (executed < count && cpu->running && cpu->ip < cpu->memsize) {
+        instruction = cpu_fetch_instruction(executor, count - executed);
+
+        switch (instruction->opcode) {
+            CPU_OPCODES(OP_BODY)
+            CPU_FUSED_OPCODES(OP_BODY)
+            OP_BODY(OP_DEBUG_TRAP, "")
+        }
+
+        executed += instruction->count;
+    }
+
+    return executed;
+#endif
+}
+
+void cpu_executor_invalidate(cpu_executor_t *executor, uint32_t address) {
+    cpu_executor_invalidate_range(executor, address, 1);
+}
+
+void cpu_executor_discard_range(cpu_executor_t *executor, uint32_t address, uint32_t size) {
+    uint64_t end = (uint64_t) address + size;
+    if (size == 0 || address >= executor->code_end || end <= executor->code_start) {
+        return;
+    }
+
+    // Any instruction that starts at most CPU_MAX_FUSED_LENGTH - 1 bytes before given
+    // address might include it. Only the handler is cleared, so that an instruction that
+    // overwrites itself can still read its own operands until it finishes.
+    uint32_t first = address >= executor->code_start + (CPU_MAX_FUSED_LENGTH - 1)
+        ? address - (CPU_MAX_FUSED_LENGTH - 1)
+        : executor->code_start;
+
+    uint32_t last = end < executor->code_end ? end : executor->code_end;
+
+    for (uint32_t position = first; position < last; position++) {
+        executor->instructions[position].handler = 0;
+    }
+
+    if (executor->jit) {
+        cpu_jit_invalidate(executor->jit, address, size);
+    }
+}
+
+void cpu_executor_invalidate_range(cpu_executor_t *executor, uint32_t address, uint32_t size) {
+    cpu_executor_discard_range(executor, address, size);
+
+    // the range of code of every core covers code decoded by the others, so only writes into it can change their code
+    uint64_t end = (uint64_t) address + size;
+    if (executor->cpu->smp_core && size > 0 && address < executor->code_end && end > executor->code_start) {
+        uint32_t first = address > executor->code_start ? address : executor->code_start;
+        uint32_t last = end < executor->code_end ? end : executor->code_end;
+        cpu_smp_publish_code_change(executor->cpu->smp_core->smp, first, last - first);
     }
 }
\ No newline at end of file
@@ -2,11 +2,115 @@
 
 #include "cpu.h"
 #include "opcode-handlers-map.h"
+#include "cpu-fusion.h"
 
-typedef struct {
+/* Longest instruction in the Stark 1 instruction set: opcode followed by two 32-bit operands. */
+#define CPU_MAX_INSTRUCTION_LENGTH 9
+
+/* Instruction decoded from guest memory, ready to be executed without reading program bytes again. */
+typedef struct cpu_instruction_t {
+    opcode_exec_func handler;
+    uint32_t operands[3];
+    uint8_t opcode;
+    uint8_t length;
+
+    // Number of guest instructions executed by the handler, more than one for fused instructions.
+    uint8_t count;
+} cpu_instruction_t;
+
+struct cpu_jit_t;
+
+typedef struct cpu_executor_t {
     opcode_handlers_map_t *handlers_map;
     starkcpu_t *cpu;
+
+    // Decoded instruction cache, one slot per guest address. Slot is empty if its handler is not set.
+    cpu_instruction_t *instructions;
+
+    // Range of guest addresses that decoded instructions were read from.
+    uint32_t code_start;
+    uint32_t code_end;
+
+    // Created once the JIT core is used for the first time.
+    struct cpu_jit_t *jit;
+
+    // Holds the first instruction of a fused instruction when there is no budget left to execute all of it.
+    cpu_instruction_t unfused;
+
+    // Number of times every fused instruction was executed, indexed from OP_FUSED_FIRST. Kept across resets.
+    uint64_t fusion_counts[CPU_FUSED_OPCODES_COUNT];
 } cpu_executor_t;
 
+/* Creates an executor for given CPU. Returns 0 if the host is out of memory. */
 cpu_executor_t *cpu_executor_create(starkcpu_t *cpu);
-void cpu_execute_instruction(cpu_executor_t *executor, uint8_t code);
\ No newline at end of file
+void cpu_executor_destroy(cpu_executor_t *executor);
+
+/* Returns name of given opcode, e.g. SET_REG_ADDR, or 0 if the executor does not support it. */
+const char *cpu_get_opcode_name(uint8_t opcode);
+
+/* Returns operands that follow given opcode, described as in opcode_handler_t, or 0 if the executor does not support it. */
+const char *cpu_get_opcode_operands(uint8_t opcode);
+
+/* Drops all decoded instructions and translated code, e.g. before a new program is loaded. */
+void cpu_executor_reset(cpu_executor_t *executor);
+
+/*
+ * Decodes instruction located at given address into given slot of the instruction cache.
+ * Program bytes are bounds checked and register operands are validated only once here, so the handlers can use
+ * decoded operands directly. If `strict` is set, CPU panics when the instruction is not valid, otherwise false is returned.
+ */
+bool cpu_decode_instruction(cpu_executor_t *executor, uint32_t address, cpu_instruction_t *instruction, bool strict);
+
+/* Decodes instruction located at given address into its slot of the instruction cache, fusing it with the following ones if the CPU allows it. */
+void cpu_cache_instruction(cpu_executor_t *executor, uint32_t address, cpu_instruction_t *instruction);
+
+/* Decodes just the first instruction of a fused instruction located at given address. */
+cpu_instruction_t *cpu_unfuse_instruction(cpu_executor_t *executor, uint32_t address);
+
+/*
+ * Returns decoded instruction pointed to by the instruction pointer and moves the pointer past it.
+ * Fused instruction that would execute more than `budget` instructions is replaced with its first instruction.
+ */
+static inline cpu_instruction_t *cpu_fetch_instruction(cpu_executor_t *executor, uint32_t budget) {
+    starkcpu_t *cpu = executor->cpu;
+    uint32_t address = cpu->ip;
+    cpu_instruction_t *instruction = executor->instructions + address;
+
+    if (!instruction->handler) {
+        cpu_cache_instruction(executor, address, instruction);
+    }
+
+    if (instruction->count > budget) {
+        instruction = cpu_unfuse_instruction(executor, address);
+    }
+
+    cpu->ip = address + instruction->length;
+    return instruction;
+}
+
+/* Checks whether instructions with given opcode write into memory. */
+bool cpu_opcode_writes_memory(uint8_t opcode);
+
+/*
+ * Returns number of bytes that given instruction is going to write into memory, with the current values of registers,
+ * and sets `address` to where it writes them. Returns 0 if it does not write memory.
+ */
+uint32_t cpu_get_instruction_write(starkcpu_t *cpu, const cpu_instruction_t *instruction, uint32_t *address);
+
+/* Executes instruction pointed to by the instruction pointer, fused one only if it fits into `budget`. Returns number of executed instructions. */
+uint32_t cpu_execute_next_instruction(cpu_executor_t *executor, uint32_t budget);
+
+/* Executes up to `count` instructions by calling their handlers through the handlers map. Returns number of executed instructions. */
+uint32_t cpu_execute_instructions(cpu_executor_t *executor, uint32_t count);
+
+/* Same as cpu_execute_instructions, but uses a threaded dispatch loop that can inline every handler. */
+uint32_t cpu_execute_threaded(cpu_executor_t *executor, uint32_t count);
+
+/* Drops every decoded instruction that was read from given address. Must be called whenever guest memory changes. */
+void cpu_executor_invalidate(cpu_executor_t *executor, uint32_t address);
+
+/* Same as cpu_executor_invalidate, for every one of `size` bytes at given address. Other cores are told about it as well, see smp.h. */
+void cpu_executor_invalidate_range(cpu_executor_t *executor, uint32_t address, uint32_t size);
+
+/* Same as cpu_executor_invalidate_range, without telling other cores. */
+void cpu_executor_discard_range(cpu_executor_t *executor, uint32_t address, uint32_t size);
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "cpu-fusion.h"
+#include "cpu-executor.h"
+#include "../shared/stark1-opcodes.h"
+#include <stdio.h>
+
+#define FUSION_NAME(op, sequence) sequence,
+
+static const char *fusion_names[CPU_FUSED_OPCODES_COUNT] = { CPU_FUSED_OPCODES(FUSION_NAME) };
+
+/* Decodes up to `count` instructions that follow given one, stops early at an instruction that can not be decoded. */
+uint32_t decode_following_instructions(cpu_executor_t *executor, uint32_t address, const cpu_instruction_t *instruction,
+                                       cpu_instruction_t *following, uint32_t count) {
+    uint32_t decoded = 0;
+    address += instruction->length;
+
+    while (decoded < count && address < executor->cpu->memsize) {
+        if (!cpu_decode_instruction(executor, address, following + decoded, false)) {
+            break;
+        }
+
+        address += following[decoded].length;
+        decoded++;
+    }
+
+    return decoded;
+}
+
+bool is_cmp_jne(const cpu_instruction_t *cmp, const cpu_instruction_t *jne, uint8_t register_index) {
+    return cmp->opcode == OP_CMP_REG_IMMEDIATE && cmp->operands[0] == register_index && jne->opcode == OP_JMP_IF_NOT_EQUAL;
+}
+
+bool is_inc_pair(const cpu_instruction_t *first, const cpu_instruction_t *second, uint8_t register_a, uint8_t register_b) {
+    if (first->opcode != OP_INCREMENT || second->opcode != OP_INCREMENT) {
+        return false;
+    }
+
+    // increments of two registers can be executed in any order
+    return (first->operands[0] == register_a && second->operands[0] == register_b)
+        || (first->operands[0] == register_b && second->operands[0] == register_a);
+}
+
+void fuse(cpu_instruction_t *instruction, uint8_t opcode, opcode_exec_func handler,
+          const cpu_instruction_t *following, uint32_t following_count) {
+    instruction->opcode = opcode;
+    instruction->handler = handler;
+    instruction->count = 1 + following_count;
+
+    for (uint32_t i = 0; i < following_count; i++) {
+        instruction->length += following[i].length;
+    }
+}
+
+bool cpu_fuse_instruction(cpu_executor_t *executor, uint32_t address, cpu_instruction_t *instruction) {
+    cpu_instruction_t following[2];
+
+    switch (instruction->opcode) {
+        case OP_CMP_REG_IMMEDIATE:
+            if (decode_following_instructions(executor, address, instruction, following, 1) == 1
+                && following[0].opcode == OP_JMP_IF_NOT_EQUAL) {
+                instruction->operands[2] = following[0].operands[0];
+                fuse(instruction, OP_FUSED_CMP_JNE, cpu_execute_OP_FUSED_CMP_JNE, following, 1);
+                return true;
+            }
+
+            return false;
+
+        case OP_DECREMENT:
+        case OP_INCREMENT:
+            if (decode_following_instructions(executor, address, instruction, following, 2) == 2
+                && is_cmp_jne(following, following + 1, instruction->operands[0])) {
+                instruction->operands[1] = following[0].operands[1];
+                instruction->operands[2] = following[1].operands[0];
+
+                if (instruction->opcode == OP_DECREMENT) {
+                    fuse(instruction, OP_FUSED_DEC_CMP_JNE, cpu_execute_OP_FUSED_DEC_CMP_JNE, following, 2);
+                } else {
+                    fuse(instruction, OP_FUSED_INC_CMP_JNE, cpu_execute_OP_FUSED_INC_CMP_JNE, following, 2);
+                }
+
+                return true;
+            }
+
+            return false;
+
+        case OP_SET_RADDR_RADDR:
+            if (decode_following_instructions(executor, address, instruction, following, 2) == 2
+                && is_inc_pair(following, following + 1, instruction->operands[0], instruction->operands[1])) {
+                // the copy might overwrite instructions that follow it, handler continues from here if it does
+                instruction->operands[2] = address + instruction->length;
+                fuse(instruction, OP_FUSED_COPY_INC_INC, cpu_execute_OP_FUSED_COPY_INC_INC, following, 2);
+                return true;
+            }
+
+            return false;
+
+        default:
+            return false;
+    }
+}
+
+void cpu_fusion_print_stats(const uint64_t *counts) {
+    printf("%-34s %s\n", "fused instruction", "executed");
+
+    for (uint32_t i = 0; i < CPU_FUSED_OPCODES_COUNT; i++) {
+        printf("%-34s %llu\n", fusion_names[i], (unsigned long long) counts[i]);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "cpu.h"
+
+struct cpu_executor_t;
+struct cpu_instruction_t;
+
+/*
+ * Opcodes of fused instructions, which execute a common sequence of instructions in a single dispatch.
+ * They are only ever produced by the fusion pass and are never decoded from guest memory, so they
+ * take values that the instruction set does not use.
+ */
+#define OP_FUSED_CMP_JNE 0xF0
+#define OP_FUSED_DEC_CMP_JNE 0xF1
+#define OP_FUSED_INC_CMP_JNE 0xF2
+#define OP_FUSED_COPY_INC_INC 0xF3
+
+#define OP_FUSED_FIRST OP_FUSED_CMP_JNE
+#define CPU_FUSED_OPCODES_COUNT 4
+
+/*
+ * Every fused opcode, along with the sequence of instructions it replaces.
+ * Operands of the first instruction of a sequence always come first, so a fused instruction
+ * can be executed by the handler of its first instruction as well.
+ */
+#define CPU_FUSED_OPCODES(OP) \
+    OP(OP_FUSED_CMP_JNE, "cmp r, imm; jne") \
+    OP(OP_FUSED_DEC_CMP_JNE, "dec r; cmp r, imm; jne") \
+    OP(OP_FUSED_INC_CMP_JNE, "inc r; cmp r, imm; jne") \
+    OP(OP_FUSED_COPY_INC_INC, "set [ra], [rb]; inc ra; inc rb")
+
+#define DECLARE_FUSED_HANDLER(op, sequence) void cpu_execute_##op(starkcpu_t *cpu, const struct cpu_instruction_t *instruction);
+CPU_FUSED_OPCODES(DECLARE_FUSED_HANDLER)
+
+/* Longest sequence of guest memory covered by a single fused instruction. */
+#define CPU_MAX_FUSED_LENGTH (3 * CPU_MAX_INSTRUCTION_LENGTH)
+
+/*
+ * Replaces instruction decoded from given address with a fused instruction, if it starts one of the known sequences.
+ * Instructions that follow it are decoded as well, but are not put into the instruction cache.
+ * Returns whether the instruction was fused.
+ */
+bool cpu_fuse_instruction(struct cpu_executor_t *executor, uint32_t address, struct cpu_instruction_t *instruction);
+
+/* Prints how many times every fused instruction was executed, given counters summed from one or more executors. */
+void cpu_fusion_print_stats(const uint64_t *counts);
\ No newline at end of file
@@ -1,12 +1,14 @@
 #include "cpu-ui.h"
 #include "cpu.h"
 #include "utils.h"
+#include "memory.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
-char* get_formatted_register_value(starkcpu_t *cpu, int index) {
-    int32_t* ptr = cpu->reg_a + index;
+char* get_formatted_register_value(const cpu_ui_frame_t *frame, int index) {
+    const int32_t* ptr = frame->registers + index;
     char val = *ptr;
     char* out2 = malloc(sizeof(char) * 12);
     sprintf(out2, "R%d=%08X", index, val);
@@ -16,8 +18,39 @@ char* get_formatted_register_value(starkcpu_t *cpu, int index) {
 cpu_ui_t *cpu_ui_initialize(starkcpu_t *cpu) {
     cpu_ui_t *ui = malloc(sizeof(cpu_ui_t));
     ui->cpu = cpu;
-    ui->mem_snapshot = malloc(sizeof(char) * ui->cpu->memsize);
-    ui->disassembly_map = map_create();
+    ui->snapshot_size = cpu->memsize < CPU_UI_SNAPSHOT_SIZE ? cpu->memsize : CPU_UI_SNAPSHOT_SIZE;
+    ui->mem_snapshot = calloc(ui->snapshot_size, sizeof(char));
+    ui->source_map = 0;
+    ui->drawn_height = 0;
+    memset(ui->drawn_versions, 0, sizeof(ui->drawn_versions));
+    memset(ui->highlighted_lines, 0, sizeof(ui->highlighted_lines));
+
+    // frames start with version 0 of every page, so the first one copies all of them
+    for (uint32_t page = 0; page < CPU_UI_SNAPSHOT_PAGES; page++) {
+        ui->page_versions[page] = 1;
+    }
+
+    for (uint32_t value = 0; value < 256; value++) {
+        snprintf(ui->hex_bytes[value], sizeof(ui->hex_bytes[value]), "%02X", value);
+    }
+
+    // without tracking, every page is copied and drawn on every frame
+    cpu_memory_track_dirty_pages(cpu);
+
+    for (int i = 0; i < 3; i++) {
+        memset(ui->frames + i, 0, sizeof(cpu_ui_frame_t));
+        ui->frames[i].memory = calloc(ui->snapshot_size, sizeof(char));
+    }
+
+    ui->back = ui->frames;
+    ui->ready = ui->frames + 1;
+    ui->front = ui->frames + 2;
+    ui->fresh = false;
+    ui->running = false;
+    ui->stopping = false;
+    pthread_mutex_init(&ui->lock, 0);
+    pthread_cond_init(&ui->wake, 0);
+
     ui->screen = initscr();
 
     cbreak();
@@ -33,65 +66,66 @@ cpu_ui_t *cpu_ui_initialize(starkcpu_t *cpu) {
     return ui;
 }
 
+/* Draws bytes of a row of the memory panel, highlighting those that changed since the previous frame. */
+void cpu_ui_draw_memory_line(cpu_ui_t *ui, uint32_t row, uint32_t address) {
+    bool highlighted = false;
+
+    for (uint32_t x = 0; x < CPU_UI_MEMORY_LINE_SIZE; x++) {
+        uint8_t value = ui->front->memory[address + x];
+        bool changed = value != (uint8_t) ui->mem_snapshot[address + x];
+
+        attron(COLOR_PAIR(changed ? 4 : 1));
+        mvaddstr(row, (x * 3) + 5, ui->hex_bytes[value]);
+        highlighted |= changed;
+    }
+
+    ui->highlighted_lines[address / CPU_UI_MEMORY_LINE_SIZE] = highlighted;
+}
+
+/*
+ * Panel shows the first 4 rows of memory, then rows starting past the internal memory and the stack. Everything is
+ * drawn on the first frame or once the screen changes its height, after that rows are only drawn again if their
+ * page changed or if they have to lose their highlight.
+ */
 void cpu_ui_draw_memory_panel(cpu_ui_t *ui) {
     uint32_t height = getmaxy(ui->screen);
+    bool full = height != ui->drawn_height;
 
-    attron(COLOR_PAIR(2));
-    mvaddstr(0, 0, "                       MEMORY                       ");
-
-    const int cols = 16;
+    if (full) {
+        attron(COLOR_PAIR(2));
+        mvaddstr(0, 0, "                       MEMORY                       ");
 
-    for (int y = 0; y < 4; y++) {
         attron(COLOR_PAIR(3));
-        char* out = malloc(sizeof(char) * 5);
-        sprintf(out, "%04X", y * cols);
-        mvaddstr(y + 1, 0, out);
-        free(out);
-
-        attron(COLOR_PAIR(1));
-        for (int x = 0; x < cols; x++) {
-            int mem_offset = (y * cols + x);
-            char mem_value = *cpu_mem_get(ui->cpu, mem_offset);
-            char* out2 = malloc(sizeof(char) * 3);
-            sprintf(out2, "%02X", mem_value & 0xFF);
-
-            if (mem_value != ui->mem_snapshot[mem_offset]) {
-                attron(COLOR_PAIR(4));
-            } else {
-                attron(COLOR_PAIR(1));
-            }
+        mvaddstr(5, 0, "...");
+    }
 
-            mvaddstr(y + 1, (x * 3) + 5, out2);
-            free(out2);
+    for (uint32_t row = 1; row < height; row++) {
+        if (row == 5) {
+            continue;
         }
-    }
 
-    attron(COLOR_PAIR(3));
-    mvaddstr(5, 0, "...");
+        uint32_t address = row < 5
+            ? (row - 1) * CPU_UI_MEMORY_LINE_SIZE
+            : CPU_RESERVED_MEMORY_SIZE + 1024 + (row - 6) * CPU_UI_MEMORY_LINE_SIZE;
 
-    for (int y = 0; y < height - 4; y++) {
-        attron(COLOR_PAIR(3));
-        char* out = malloc(sizeof(char) * 5);
-        sprintf(out, "%04X", CPU_RESERVED_MEMORY_SIZE + 1024 + (y * cols));
-        mvaddstr(y + 1 + 5, 0, out);
-        free(out);
-
-        for (int x = 0; x < cols; x++) {
-            int mem_offset = CPU_RESERVED_MEMORY_SIZE + 1024 + (y * cols + x);
-            char mem_value = *cpu_mem_get(ui->cpu, mem_offset);
-            char* out2 = malloc(sizeof(char) * 3);
-            sprintf(out2, "%02X", mem_value & 0xFF);
-
-            if (mem_value != ui->mem_snapshot[mem_offset]) {
-                attron(COLOR_PAIR(4));
-            } else {
-                attron(COLOR_PAIR(1));
-            }
+        if (address + CPU_UI_MEMORY_LINE_SIZE > ui->snapshot_size) {
+            break;
+        }
+
+        if (full) {
+            char label[5];
+            snprintf(label, sizeof(label), "%04X", address & 0xFFFF);
+            attron(COLOR_PAIR(3));
+            mvaddstr(row, 0, label);
+        }
 
-            mvaddstr(y + 1 + 5, (x * 3) + 5, out2);
-            free(out2);
+        uint32_t page = address >> CPU_PAGE_SHIFT;
+        if (full || ui->highlighted_lines[address / CPU_UI_MEMORY_LINE_SIZE] || ui->front->page_versions[page] != ui->drawn_versions[page]) {
+            cpu_ui_draw_memory_line(ui, row, address);
         }
     }
+
+    ui->drawn_height = height;
 }
 
 void cpu_ui_draw_state(cpu_ui_t *ui) {
@@ -100,113 +134,224 @@ void cpu_ui_draw_state(cpu_ui_t *ui) {
 
     attron(COLOR_PAIR(1));
     for (int i = 0; i < 3; i++) {
-        char* formatted_value = get_formatted_register_value(ui->cpu, i);
+        char* formatted_value = get_formatted_register_value(ui->front, i);
         mvaddstr(1 + i, 53, formatted_value);
         free(formatted_value);
     }
 }
 
+/*
+ * Shows the source around the line that is being executed. Program is shown from its first line until the current line
+ * gets past the bottom of the screen, then it is scrolled to keep the current line in the middle.
+ */
 void cpu_ui_draw_code_disassembly(cpu_ui_t *ui) {
     const int basex = 53 + 14;
 
     attron(COLOR_PAIR(2));
     mvaddstr(0, basex, "                DISASSEMBLY               ");
 
-    uint32_t offset = *ui->cpu->ip - CPU_IMAGE_LOAD_ADDRESS;
+    cpu_source_map_t *source_map = ui->source_map;
+    if (!source_map) {
+        return;
+    }
 
-    attron(COLOR_PAIR(1));
+    uint32_t rows = getmaxy(ui->screen) - 1;
+    uint32_t current = cpu_source_map_find_line(source_map, ui->front->ip);
+    uint32_t first = current < source_map->lines_count && current >= rows ? current - rows / 2 : 0;
 
-    struct string_array_t *sl = ui->source_line;
+    int width = 2;
+    for (uint32_t count = source_map->lines_count; count >= 100; count /= 10) {
+        width++;
+    }
 
-    int i = 1;
-    while (sl) {
-        attron(COLOR_PAIR(3));
-        char* formatted = itoa2(i, 10);
-        if (i < 10) {
-            mvaddstr(1 + i - 1, basex + 1, formatted);
-        } else {
-            mvaddstr(1 + i - 1, basex, formatted);
-        }
+    for (uint32_t row = 0; row < rows; row++) {
+        uint32_t line = first + row;
+        move(1 + row, basex);
 
-        if (map_has(ui->disassembly_map, offset) && map_get(ui->disassembly_map, offset) == i - 1) {
-            attron(COLOR_PAIR(2));
-        } else {
-            attron(COLOR_PAIR(1));
+        if (line < source_map->lines_count) {
+            char number[12];
+            snprintf(number, sizeof(number), "%*u", width, line + 1);
+            attron(COLOR_PAIR(3));
+            addstr(number);
+
+            size_t length;
+            const char *text = cpu_source_map_get_line(source_map, line, &length);
+            attron(COLOR_PAIR(line == current ? 2 : 1));
+            mvaddnstr(1 + row, basex + width + 1, text, length < INT32_MAX ? (int) length : INT32_MAX);
         }
 
-        mvaddstr(1 + i - 1, basex + 3, sl->value);
-        sl = sl->next;
-        i++;
-        free(formatted);
+        attron(COLOR_PAIR(1));
+        clrtoeol();
     }
 }
 
-void cpu_ui_redraw(cpu_ui_t *ui) {
+/* Makes the most recently published frame the one that is drawn. Returns false if there is no new frame since the last call. */
+bool cpu_ui_take_frame(cpu_ui_t *ui) {
+    pthread_mutex_lock(&ui->lock);
+
+    bool fresh = ui->fresh;
+    if (fresh) {
+        cpu_ui_frame_t *frame = ui->front;
+        ui->front = ui->ready;
+        ui->ready = frame;
+        ui->fresh = false;
+    }
+
+    pthread_mutex_unlock(&ui->lock);
+    return fresh;
+}
+
+void cpu_ui_draw_frame(cpu_ui_t *ui) {
     cpu_ui_draw_code_disassembly(ui);
     cpu_ui_draw_memory_panel(ui);
     cpu_ui_draw_state(ui);
 
-    refresh();
-    memcpy(ui->mem_snapshot, ui->cpu->mem, ui->cpu->memsize);
+    char *instructions = itoa2(ui->front->instructions, 10);
+    cpu_ui_draw_text(ui, 0, 0, instructions);
+    free(instructions);
+
+    for (uint32_t page = 0; page < ui->snapshot_size >> CPU_PAGE_SHIFT; page++) {
+        if (ui->front->page_versions[page] != ui->drawn_versions[page]) {
+            memcpy(ui->mem_snapshot + (page << CPU_PAGE_SHIFT), ui->front->memory + (page << CPU_PAGE_SHIFT), CPU_PAGE_SIZE);
+            ui->drawn_versions[page] = ui->front->page_versions[page];
+        }
+    }
 }
 
-void cpu_ui_draw_text(cpu_ui_t *ui, int x, int y, char* text) {
-    mvaddstr(y, x, text);
-    refresh();
+void cpu_ui_redraw(cpu_ui_t *ui) {
+    cpu_ui_take_frame(ui);
+    cpu_ui_draw_frame(ui);
+}
+
+void cpu_ui_publish(cpu_ui_t *ui, uint64_t instructions) {
+    starkcpu_t *cpu = ui->cpu;
+    cpu_ui_frame_t *frame = ui->back;
+
+    frame->ip = cpu->ip;
+    frame->instructions = instructions;
+    memcpy(frame->registers, cpu->registers, sizeof(frame->registers));
+
+    // internal memory is brought up to date directly, not by stores
+    cpu_sync_internal_memory(cpu);
+    cpu_memory_mark_dirty(cpu, 0, CPU_RESERVED_MEMORY_SIZE);
+
+    // The back frame was last filled two frames ago, so pages are copied if they changed since then, not since the last frame.
+    for (uint32_t page = 0; page < ui->snapshot_size >> CPU_PAGE_SHIFT; page++) {
+        if (!cpu->dirty_pages || (cpu->dirty_pages[page] & CPU_DIRTY_UI)) {
+            ui->page_versions[page]++;
+
+            if (cpu->dirty_pages) {
+                cpu->dirty_pages[page] &= ~CPU_DIRTY_UI;
+            }
+        }
+
+        if (frame->page_versions[page] == ui->page_versions[page]) {
+            continue;
+        }
+
+        // Pages that the program can not read might not be readable by the host either. The first one always is.
+        uint32_t address = page << CPU_PAGE_SHIFT;
+        if (page == 0 || cpu_memory_can_access(cpu, address, CPU_PAGE_READ)) {
+            memcpy(frame->memory + address, cpu->mem + address, CPU_PAGE_SIZE);
+        } else {
+            memset(frame->memory + address, 0, CPU_PAGE_SIZE);
+        }
+
+        frame->page_versions[page] = ui->page_versions[page];
+    }
+
+    pthread_mutex_lock(&ui->lock);
+    ui->back = ui->ready;
+    ui->ready = frame;
+    ui->fresh = true;
+    pthread_mutex_unlock(&ui->lock);
 }
 
-char* read_file(const char *path) {
-    FILE* file = fopen(path, "r");
-    if (!file) {
-        return 0;
+void *cpu_ui_thread_main(void *argument) {
+    cpu_ui_t *ui = argument;
+    uint64_t frame_time = 1000000 / CPU_UI_UPDATE_PER_SECOND;
+
+    pthread_mutex_lock(&ui->lock);
+
+    while (!ui->stopping) {
+        pthread_mutex_unlock(&ui->lock);
+
+        // frames that did not change are not drawn again, so that changes stay highlighted until the next one
+        if (cpu_ui_take_frame(ui)) {
+            cpu_ui_draw_frame(ui);
+        }
+
+        struct timespec deadline;
+        timespec_get(&deadline, TIME_UTC);
+        uint64_t nanoseconds = deadline.tv_nsec + frame_time * 1000;
+        deadline.tv_sec += nanoseconds / 1000000000;
+        deadline.tv_nsec = nanoseconds % 1000000000;
+
+        pthread_mutex_lock(&ui->lock);
+        if (!ui->stopping) {
+            pthread_cond_timedwait(&ui->wake, &ui->lock, &deadline);
+        }
     }
 
-    fseek(file, 0, SEEK_END);
-    long size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    pthread_mutex_unlock(&ui->lock);
+    return 0;
+}
 
-    char* data = malloc(sizeof(char) * size);
-    fread(data, 1, size, file);
-    fclose(file);
+void cpu_ui_start(cpu_ui_t *ui) {
+    if (ui->running) {
+        return;
+    }
 
-    return data;
+    ui->stopping = false;
+    ui->running = pthread_create(&ui->thread, 0, cpu_ui_thread_main, ui) == 0;
 }
 
-void cpu_ui_load_disassembly_map(cpu_ui_t *ui, const char *map_path, const char *source_path) {
-    if (ui->disassembly_map) {
-        free(ui->disassembly_map);
+void cpu_ui_stop(cpu_ui_t *ui) {
+    if (!ui->running) {
+        return;
+    }
+
+    pthread_mutex_lock(&ui->lock);
+    ui->stopping = true;
+    pthread_cond_signal(&ui->wake);
+    pthread_mutex_unlock(&ui->lock);
+
+    pthread_join(ui->thread, 0);
+    ui->running = false;
+
+    if (cpu_ui_take_frame(ui)) {
+        cpu_ui_draw_frame(ui);
     }
+}
 
-    ui->disassembly_map = map_create();
+void cpu_ui_draw_text(cpu_ui_t *ui, int x, int y, char* text) {
+    mvaddstr(y, x, text);
+    refresh();
+}
 
+void cpu_ui_load_disassembly_map(cpu_ui_t *ui, const char *map_path, const char *source_path) {
     char* map_contents = read_file(map_path);
-    char* source_contents = read_file(source_path);
 
     if (!map_contents) {
         printf("error: File %s does not exist.\n", map_path);
         exit(1);
     }
 
-    if (!source_contents) {
+    cpu_ui_set_disassembly_map(ui, map_contents, source_path);
+    free(map_contents);
+}
+
+void cpu_ui_set_disassembly_map(cpu_ui_t *ui, const char *map_contents, const char *source_path) {
+    cpu_source_map_t *source_map = cpu_source_map_create(map_contents, source_path);
+
+    if (!source_map) {
         printf("error: File %s does not exist.\n", source_path);
         exit(1);
     }
 
-    ui->source_line = split_buffer_by_char(source_contents, strlen(source_contents), '\n');
-
-    struct string_array_t *line = split_buffer_by_char(map_contents, strlen(map_contents), '\n');
-    while (line) {
-        struct string_array_t *val = split_buffer_by_char(line->value, line->length, '|');
-
-        if (val && val->next) {
-            int offset = atoi(val->value);
-            int line_index = atoi(val->next->value);
-            map_set(ui->disassembly_map, offset, (void *) line_index);
-        }
-
-        line = line->next;
+    if (ui->source_map) {
+        cpu_source_map_destroy(ui->source_map);
     }
 
-    free(map_contents);
-    free(source_contents);
+    ui->source_map = source_map;
 }
\ No newline at end of file
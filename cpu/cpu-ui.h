@@ -1,8 +1,10 @@
 #pragma once
 
 #include "cpu.h"
-#include "map.h"
+#include "memory.h"
+#include "source-map.h"
 #include "utils.h"
+#include <pthread.h>
 
 #ifdef _WIN32
 #include <curses.h>
@@ -10,15 +12,79 @@
 #include <ncurses.h>
 #endif
 
+/* Memory panel only shows the beginning of memory, so only that part is copied into frames. */
+#define CPU_UI_SNAPSHOT_SIZE (64 * 1024)
+#define CPU_UI_SNAPSHOT_PAGES (CPU_UI_SNAPSHOT_SIZE / CPU_PAGE_SIZE)
+
+/* Number of bytes shown on every row of the memory panel. */
+#define CPU_UI_MEMORY_LINE_SIZE 16
+
+/* State of the machine that the UI draws, copied by the executing thread in between batches of instructions. */
+typedef struct {
+    uint32_t ip;
+    int32_t registers[CPU_REGISTERS_COUNT];
+
+    // Number of instructions executed since the previous frame.
+    uint64_t instructions;
+    char *memory;
+
+    // Version of every page of `memory`, pages are only copied again once the program writes to them.
+    uint32_t page_versions[CPU_UI_SNAPSHOT_PAGES];
+} cpu_ui_frame_t;
+
 typedef struct {
     starkcpu_t *cpu;
     WINDOW *screen;
+
+    // Memory of the frame drawn before the current one, changes since then are highlighted.
     char *mem_snapshot;
-    struct string_array_t *source_line;
-    struct map_t *disassembly_map;
+    uint32_t snapshot_size;
+
+    // Latest version of every page, bumped by the executing thread whenever the page is dirty.
+    uint32_t page_versions[CPU_UI_SNAPSHOT_PAGES];
+
+    // Versions of pages in `mem_snapshot` and rows of the memory panel with highlighted changes. Only rows of pages
+    // that changed, or rows that have to lose their highlight, are drawn again. Screen height is 0 before the first frame.
+    uint32_t drawn_versions[CPU_UI_SNAPSHOT_PAGES];
+    bool highlighted_lines[CPU_UI_SNAPSHOT_SIZE / CPU_UI_MEMORY_LINE_SIZE];
+    uint32_t drawn_height;
+
+    // Every value of a byte formatted as two hex digits, so that drawing memory does not format anything.
+    char hex_bytes[256][3];
+
+    // Program shown by the disassembly panel, 0 if there is no source map.
+    cpu_source_map_t *source_map;
+
+    // Frames are triple buffered: the executing thread fills `back` and swaps it with `ready`, the UI thread swaps `ready`
+    // with `front` and draws it. The lock is only held to swap them, so neither thread waits while the other copies or draws.
+    cpu_ui_frame_t frames[3];
+    cpu_ui_frame_t *back;
+    cpu_ui_frame_t *ready;
+    cpu_ui_frame_t *front;
+    bool fresh;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+    bool running;
+    bool stopping;
 } cpu_ui_t;
 
 cpu_ui_t *cpu_ui_initialize(starkcpu_t *cpu);
+
+/* Starts drawing frames on a separate thread, CPU_UI_UPDATE_PER_SECOND times per second. */
+void cpu_ui_start(cpu_ui_t *ui);
+
+/* Stops the UI thread and draws the last published frame. Does nothing if the UI thread is not running. */
+void cpu_ui_stop(cpu_ui_t *ui);
+
+/* Copies current state of the CPU into a frame that the UI thread draws next. Called by the executing thread. */
+void cpu_ui_publish(cpu_ui_t *ui, uint64_t instructions);
+
+/* Draws the most recently published frame. */
 void cpu_ui_redraw(cpu_ui_t *ui);
 void cpu_ui_draw_text(cpu_ui_t *ui, int x, int y, char* text);
-void cpu_ui_load_disassembly_map(cpu_ui_t *ui, const char *map_path, const char *source_path);
\ No newline at end of file
+void cpu_ui_load_disassembly_map(cpu_ui_t *ui, const char *map_path, const char *source_path);
+
+/* Same as cpu_ui_load_disassembly_map, for a source map that is already in memory, e.g. embedded in an executable. */
+void cpu_ui_set_disassembly_map(cpu_ui_t *ui, const char *map_contents, const char *source_path);
\ No newline at end of file
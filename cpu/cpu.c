@@ -1,21 +1,27 @@
 #include "cpu.h"
 #include "cpu-ui.h"
 #include "cpu-executor.h"
+#include "memory.h"
+#include "jit/jit.h"
+#include "profiler.h"
+#include "tracer.h"
+#include "bus.h"
+#include "scheduler.h"
+#include "interrupts.h"
+#include "smp.h"
 #include "../shared/stark1-opcodes.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 #include <sys/timeb.h>
 #else
-#include <sys/time.h>
-#include <unistd.h>
+#include <time.h>
 #endif
 
-static cpu_executor_t *executor;
-
 // ==========================================
 // Memory layout:
 // ---------|--------------------------------
@@ -24,46 +30,137 @@ static cpu_executor_t *executor;
 // 0x00     | CPU model
 // 0x01     | CPU version
 // 0x02     | Instruction Pointer
-// 0x06     | Register A
-// 0x10     | Register B
-// 0x14     | Register C
+// 0x06     | Register A (R0)
+// 0x0A     | Register B (R1)
+// 0x0E     | Register C (R2)
+// 0x12     | EQUAL flag
+// 0x13     | Registers R3-R7
+// 0x27     | Interrupt return address
+// 0x2B     | Interrupt EQUAL flag
+// 0x2C     | Interrupts enabled
+// 0x40     | Interrupt vectors
 // ==========================================
-void cpu_allocate_internal_memory(starkcpu_t *cpu) {
-    // clear entire memory so we are in a known state
-    for (int32_t position = 0; position < cpu->memsize; position++) {
-        cpu_mem_set(cpu, position, 0);
-    }
+#define CPU_INTERNAL_IP_OFFSET 0x02
+#define CPU_INTERNAL_REGISTERS_OFFSET 0x06
+#define CPU_INTERNAL_FLAG_EQUAL_OFFSET 0x12
+#define CPU_INTERNAL_HIGH_REGISTERS_OFFSET 0x13
+#define CPU_INTERNAL_REGISTERS_END (CPU_INTERNAL_HIGH_REGISTERS_OFFSET + (CPU_REGISTERS_COUNT - 3) * 4)
+#define CPU_INTERNAL_INTERRUPT_RETURN_OFFSET 0x27
+#define CPU_INTERNAL_INTERRUPT_FLAG_EQUAL_OFFSET 0x2B
+#define CPU_INTERNAL_INTERRUPTS_ENABLED_OFFSET 0x2C
 
+void cpu_allocate_internal_memory(starkcpu_t *cpu) {
     cpu->model = (uint8_t *) cpu_mem_alloc(cpu, 1);
     cpu->version = (uint8_t *) cpu_mem_alloc(cpu, 1);
-    cpu->ip = (uint32_t *) cpu_mem_alloc(cpu, 4);
-    cpu->reg_a = (int32_t *) cpu_mem_alloc(cpu, 4);
-    cpu->reg_b = (int32_t *) cpu_mem_alloc(cpu, 4);
-    cpu->reg_c = (int32_t *) cpu_mem_alloc(cpu, 4);
-    cpu->flag_equal = (uint8_t *) cpu_mem_alloc(cpu, 1);
+    cpu_mem_alloc(cpu, CPU_INTERNAL_REGISTERS_END - CPU_INTERNAL_IP_OFFSET);
 
     *cpu->model = CPU_MODEL;
     *cpu->version = 0x01;
-    *cpu->ip = 0;
-    *cpu->reg_a = 0;
-    *cpu->reg_b = 0;
-    *cpu->reg_c = 0;
-    *cpu->flag_equal = 0;
+    cpu->ip = 0;
+    for (uint8_t i = 0; i < CPU_REGISTERS_COUNT; i++) {
+        cpu->registers[i] = 0;
+    }
+    cpu->flag_equal = 0;
+
+    cpu->interrupts_enabled = false;
+    cpu->interrupt_return = 0;
+    cpu->interrupt_flag_equal = 0;
+    cpu->waiting = false;
+}
+
+void cpu_sync_internal_value(starkcpu_t *cpu, uint32_t offset, uint32_t value) {
+    cpu->mem[offset] = value;
+    cpu->mem[offset + 1] = value >> 8;
+    cpu->mem[offset + 2] = value >> 16;
+    cpu->mem[offset + 3] = value >> 24;
+}
+
+void cpu_sync_internal_memory(starkcpu_t *cpu) {
+    cpu_sync_internal_value(cpu, CPU_INTERNAL_IP_OFFSET, cpu->ip);
+
+    for (uint8_t i = 0; i < 3; i++) {
+        cpu_sync_internal_value(cpu, CPU_INTERNAL_REGISTERS_OFFSET + i * 4, cpu->registers[i]);
+    }
+
+    for (uint8_t i = 3; i < CPU_REGISTERS_COUNT; i++) {
+        cpu_sync_internal_value(cpu, CPU_INTERNAL_HIGH_REGISTERS_OFFSET + (i - 3) * 4, cpu->registers[i]);
+    }
+
+    cpu->mem[CPU_INTERNAL_FLAG_EQUAL_OFFSET] = cpu->flag_equal;
+
+    cpu_sync_internal_value(cpu, CPU_INTERNAL_INTERRUPT_RETURN_OFFSET, cpu->interrupt_return);
+    cpu->mem[CPU_INTERNAL_INTERRUPT_FLAG_EQUAL_OFFSET] = cpu->interrupt_flag_equal;
+    cpu->mem[CPU_INTERNAL_INTERRUPTS_ENABLED_OFFSET] = cpu->interrupts_enabled;
 }
 
-starkcpu_t* cpu_create(bool with_ui) {
+starkcpu_t* cpu_create(bool with_ui, uint64_t memsize) {
+    if (memsize < CPU_DEFAULT_MEMORY_SIZE) {
+        memsize = CPU_DEFAULT_MEMORY_SIZE;
+    } else if (memsize > CPU_MAX_MEMORY_SIZE) {
+        memsize = CPU_MAX_MEMORY_SIZE;
+    }
+
     starkcpu_t *cpu = malloc(sizeof(starkcpu_t));
+    if (!cpu) {
+        return 0;
+    }
 
-    cpu->memsize = CPU_RESERVED_MEMORY_SIZE + 2048;
-    cpu->mem = malloc(cpu->memsize);
+    // memory comes zeroed, so it is in a known state
+    cpu->memsize = (memsize + CPU_PAGE_SIZE - 1) & ~(CPU_PAGE_SIZE - 1);
+    cpu->mem = cpu_memory_allocate(cpu->memsize);
     cpu->nextmem = cpu->mem;
+    cpu->pages = cpu_page_table_create();
+    cpu->dirty_pages = 0;
+    cpu->file_extents = 0;
+    cpu->file_extents_count = 0;
+    cpu->io_pages = cpu_memory_reserve(CPU_IO_PAGES_COUNT);
+    cpu->bus = 0;
+    cpu->running = false;
+
+    cpu->core = CPU_CORE_DISPATCH;
+    cpu->fusion = true;
+    cpu->clock_rate = CPU_TICK_PER_SECOND;
+    cpu->instructions_executed = 0;
+    cpu->panic_handler = 0;
+    cpu->panic_message[0] = '\0';
+    cpu->core_id = 0;
+    cpu->cores_count = 1;
+    cpu->smp_core = 0;
+
+    cpu->executor = cpu_executor_create(cpu);
+    cpu->scheduler = cpu_scheduler_create();
+
+    if (!cpu->mem || !cpu->pages || !cpu->io_pages || !cpu->executor || !cpu->scheduler) {
+        if (cpu->mem) {
+            cpu_memory_free(cpu->mem, cpu->memsize);
+        }
+
+        if (cpu->io_pages) {
+            cpu_memory_release(cpu->io_pages, CPU_IO_PAGES_COUNT);
+        }
 
-    if (!cpu->mem) {
+        if (cpu->pages) {
+            cpu_page_table_destroy(cpu->pages);
+        }
+
+        if (cpu->executor) {
+            cpu_executor_destroy(cpu->executor);
+        }
+
+        if (cpu->scheduler) {
+            cpu_scheduler_destroy(cpu->scheduler);
+        }
+
+        free(cpu);
         return 0;
     }
 
+    cpu->next_event = UINT64_MAX;
+    cpu->interrupts = 0;
+    cpu->profiler = 0;
+    cpu->tracer = 0;
+    cpu->debugger = 0;
     cpu_allocate_internal_memory(cpu);
-    executor = cpu_executor_create(cpu);
 
     if (with_ui) {
         cpu->ui = cpu_ui_initialize(cpu);
@@ -74,102 +171,248 @@ starkcpu_t* cpu_create(bool with_ui) {
     return cpu;
 }
 
-void cpu_set_register_value(starkcpu_t *cpu, uint8_t index, int32_t value) {
-    if (index > 3) {
-        return;
-    }
-
-    int32_t *ptr = cpu->reg_a + index;
-    *ptr = value;
+void cpu_destroy(starkcpu_t *cpu) {
+    cpu_bus_destroy_devices(cpu);
+    cpu_executor_destroy(cpu->executor);
+    cpu_memory_free(cpu->mem, cpu->memsize);
+    cpu_page_table_destroy(cpu->pages);
+    free(cpu->dirty_pages);
+    free(cpu->file_extents);
+    cpu_memory_release(cpu->io_pages, CPU_IO_PAGES_COUNT);
+    free(cpu->bus);
+    cpu_scheduler_destroy(cpu->scheduler);
+    free(cpu->interrupts);
+    free(cpu);
 }
 
-int32_t cpu_get_register_value(starkcpu_t *cpu, uint8_t index) {
-    if (index > 3) {
-        return 0;
-    }
+void cpu_reset(starkcpu_t *cpu) {
+    cpu->nextmem = cpu->mem;
+    cpu->running = false;
+    cpu->instructions_executed = 0;
+    cpu->panic_message[0] = '\0';
+
+    // devices stay attached and start over, nothing they scheduled or raised is carried over
+    cpu_bus_reset_devices(cpu);
 
-    int32_t *ptr = cpu->reg_a + index;
-    return *ptr;
+    cpu_executor_reset(cpu->executor);
+    cpu_memory_reset(cpu);
+    cpu_allocate_internal_memory(cpu);
+    cpu_scheduler_reset(cpu->scheduler);
+    cpu->next_event = UINT64_MAX;
+    if (cpu->interrupts) {
+        cpu_interrupts_reset(cpu->interrupts);
+    }
 }
 
-uint32_t get_time() {
+uint64_t cpu_get_monotonic_time() {
 #ifdef _WIN32
-    static const uint64_t EPOCH = ((uint64_t) 116444736000000000ULL);
-
-    SYSTEMTIME system_time;
-    FILETIME file_time;
-
-    GetSystemTime(&system_time);
-    SystemTimeToFileTime(&system_time, &file_time);
-
-    uint64_t time = ((uint64_t)file_time.dwLowDateTime);
-    time += ((uint64_t)file_time.dwHighDateTime) << 32;
-
-    uint64_t tv_sec = (long) ((time - EPOCH) / 10000000L);
-    uint64_t tv_usec = (long) (system_time.wMilliseconds * 1000);
-    int32_t s1 = (int32_t)(tv_sec) * 1000;
-    int32_t s2 = (tv_usec / 1000);
-    return s1 + s2;
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+
+    uint64_t seconds = counter.QuadPart / frequency.QuadPart;
+    uint64_t remainder = counter.QuadPart % frequency.QuadPart;
+    return seconds * 1000000 + remainder * 1000000 / frequency.QuadPart;
 #else
-    struct timeval now;
-    gettimeofday(&now, NULL);
-    int32_t s1 = (int32_t)(now.tv_sec) * 1000;
-    int32_t s2 = (now.tv_usec / 1000);
-    return s1 + s2;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
 #endif
 }
 
+void cpu_sleep(uint64_t usec) {
 #ifdef _WIN32
-void usleep(__int64 usec) {
     HANDLE timer;
     LARGE_INTEGER ft;
 
-    ft.QuadPart = -(10*usec); // Convert to 100 nanosecond interval, negative value indicates relative time
+    ft.QuadPart = -(10 * (int64_t) usec); // Convert to 100 nanosecond interval, negative value indicates relative time
 
     timer = CreateWaitableTimer(NULL, TRUE, NULL);
     SetWaitableTimer(timer, &ft, 0, NULL, NULL, 0);
     WaitForSingleObject(timer, INFINITE);
     CloseHandle(timer);
+#else
+    struct timespec duration;
+    duration.tv_sec = usec / 1000000;
+    duration.tv_nsec = (usec % 1000000) * 1000;
+    nanosleep(&duration, NULL);
+#endif
 }
+
+uint32_t execute_batch(starkcpu_t *cpu, uint32_t count) {
+    if (cpu->profiler) {
+        return cpu_execute_profiled(cpu->profiler, count);
+    } else if (cpu->tracer) {
+        return cpu_execute_traced(cpu->tracer, count);
+    } else if (cpu->core == CPU_CORE_THREADED) {
+        return cpu_execute_threaded(cpu->executor, count);
+    } else if (cpu->core == CPU_CORE_JIT) {
+        return cpu_execute_jit(cpu->executor, count);
+    } else {
+        return cpu_execute_instructions(cpu->executor, count);
+    }
+}
+
+/*
+ * Runs events that are due at given cycle and delivers a pending interrupt. A CPU that waits for an interrupt skips
+ * ahead from event to event, up to `budget` cycles, or stops if there is nothing left that could wake it up.
+ * Returns the number of skipped cycles.
+ */
+uint32_t handle_events(starkcpu_t *cpu, uint64_t cycle, uint32_t budget) {
+    uint32_t waited = 0;
+
+    while (true) {
+        cpu_scheduler_run(cpu, cycle + waited);
+        cpu_deliver_interrupt(cpu);
+
+        uint64_t next = cpu_scheduler_next_cycle(cpu->scheduler);
+        cpu->next_event = next;
+
+        if (!cpu->waiting) {
+            return waited;
+        }
+
+        if (next == UINT64_MAX) {
+            cpu->waiting = false;
+            cpu->running = false;
+            return waited;
+        }
+
+        if (next - (cycle + waited) > budget - waited) {
+            cpu->next_event = 0;
+            return budget;
+        }
+
+        waited += next - (cycle + waited);
+    }
+}
+
+uint32_t cpu_execute(starkcpu_t *cpu, uint32_t count) {
+#ifdef CPU_GUARD_PAGES
+    // Handlers do not check whether addresses are past the end of memory, accessing them faults instead.
+    cpu_memory_guard_t guard;
+    if (sigsetjmp(guard.jump, 0)) {
+        cpu_panic(cpu, "address 0x%02x is not %s", guard.address, guard.write ? "writable" : "readable");
+    }
+
+    cpu_memory_enter_guard(&guard, cpu);
 #endif
 
+    cpu_scheduler_t *scheduler = cpu->scheduler;
+    uint32_t executed = 0;
+
+    // Batch is split at the next event, so without any events this runs a single batch of `count` instructions.
+    while (true) {
+        uint64_t cycle = cpu->instructions_executed + executed;
+        if (cycle >= cpu->next_event) {
+            executed += handle_events(cpu, cycle, count - executed);
+            cycle = cpu->instructions_executed + executed;
+        }
+
+        if (cpu->smp_core) {
+            cpu_smp_sync_code(cpu->smp_core);
+
+            if (atomic_load_explicit(&cpu->smp_core->stop_requested, memory_order_relaxed)) {
+                cpu->running = false;
+            }
+        }
+
+        if (executed >= count || !cpu->running || cpu->ip >= cpu->memsize) {
+            break;
+        }
+
+        uint32_t budget = count - executed;
+        if (cpu->next_event - cycle < budget) {
+            budget = cpu->next_event - cycle;
+        }
+
+        scheduler->in_batch = true;
+        executed += execute_batch(cpu, budget);
+        scheduler->in_batch = false;
+
+        if (scheduler->ended_batch) {
+            scheduler->ended_batch = false;
+            cpu->running = true;
+        }
+    }
+
+#ifdef CPU_GUARD_PAGES
+    cpu_memory_leave_guard();
+#endif
+
+    return executed;
+}
+
 void cpu_start(starkcpu_t *cpu) {
-    uint32_t last_ui_update = 0;
     cpu->running = true;
 
+    // Instructions are executed in batches, time is only checked in between them.
+    // With a clock rate set, CPU sleeps after every batch until the time it would take to execute
+    // all instructions so far at that rate has passed.
+    uint32_t batch_size = CPU_UNTHROTTLED_BATCH_SIZE;
+    if (cpu->clock_rate > 0) {
+        batch_size = cpu->clock_rate / CPU_CLOCK_SYNC_PER_SECOND;
+        if (batch_size == 0) {
+            batch_size = 1;
+        }
+    }
+
     uint32_t ops = 0;
-    uint32_t sleep_time = (1000 / CPU_TICK_PER_SECOND) * 1000;
-    uint32_t ui_refresh_time = (1000 / CPU_UI_UPDATE_PER_SECOND);
+    uint64_t ui_refresh_time = 1000000 / CPU_UI_UPDATE_PER_SECOND;
+    uint64_t last_ui_update = 0;
+    uint64_t clock_start = cpu_get_monotonic_time();
+    uint64_t clock_instructions = 0;
+
+    // UI draws on its own thread, this one only copies the state it needs once per refresh
+    if (cpu->ui) {
+        cpu_ui_publish(cpu->ui, 0);
+        cpu_ui_start(cpu->ui);
+    }
 
-    while (cpu->running && *cpu->ip < cpu->memsize) {
-        cpu_execute_instruction(executor, cpu_read_program(cpu));
+    while (cpu->running && cpu->ip < cpu->memsize) {
+        uint32_t executed = cpu_execute(cpu, batch_size);
 
-        ops++;
+        ops += executed;
+        cpu->instructions_executed += executed;
 
-        uint32_t now = get_time();
+        uint64_t now = cpu_get_monotonic_time();
         if (cpu->ui && now - last_ui_update >= ui_refresh_time) {
-            cpu_ui_redraw(cpu->ui);
-            cpu_ui_draw_text(cpu->ui, 0, 0, itoa2(ops, 10));
+            cpu_ui_publish(cpu->ui, ops);
             last_ui_update = now;
             ops = 0;
         }
 
-        if (sleep_time > 0) {
-            usleep(sleep_time);
+        if (cpu->clock_rate > 0) {
+            clock_instructions += executed;
+            uint64_t target = clock_start + clock_instructions * 1000000 / cpu->clock_rate;
+
+            if (target > now) {
+                cpu_sleep(target - now);
+            } else if (now - target > CPU_CLOCK_MAX_LAG) {
+                // Host could not keep up (or was suspended), don't try to catch up by running unthrottled.
+                clock_start = now;
+                clock_instructions = 0;
+            }
         }
     }
+
+    if (cpu->ui) {
+        cpu_ui_publish(cpu->ui, ops);
+        cpu_ui_stop(cpu->ui);
+    }
 }
 
 uint8_t cpu_read_program(starkcpu_t *cpu) {
-    uint8_t value = *cpu_mem_get(cpu, *cpu->ip);
-    *cpu->ip = *cpu->ip + 1;
+    uint8_t value = *cpu_mem_get(cpu, cpu->ip);
+    cpu->ip = cpu->ip + 1;
     return value;
 }
 
 uint16_t cpu_read_program_int16(starkcpu_t *cpu) {
 #ifdef QUICK_INT_READ
-    uint16_t *value = (uint16_t*) cpu_mem_get(cpu, *cpu->ip);
-    *cpu->ip = *cpu->ip + 2;
+    uint16_t *value = (uint16_t*) cpu_mem_get(cpu, cpu->ip);
+    cpu->ip = cpu->ip + 2;
     return *value;
 #else
     uint8_t value1 = cpu_read_program(cpu);
@@ -180,8 +423,8 @@ uint16_t cpu_read_program_int16(starkcpu_t *cpu) {
 
 uint32_t cpu_read_program_int32(starkcpu_t *cpu) {
 #ifdef QUICK_INT_READ
-    uint32_t *value = (uint32_t*) cpu_mem_get(cpu, *cpu->ip);
-    *cpu->ip = *cpu->ip + 4;
+    uint32_t *value = (uint32_t*) cpu_mem_get(cpu, cpu->ip);
+    cpu->ip = cpu->ip + 4;
     return *value;
 #else
     uint8_t value1 = cpu_read_program(cpu);
@@ -193,7 +436,7 @@ uint32_t cpu_read_program_int32(starkcpu_t *cpu) {
 }
 
 void cpu_jmp(starkcpu_t *cpu, uint32_t position) {
-    *cpu->ip = position;
+    cpu->ip = position;
 }
 
 void cpu_dump_memory(starkcpu_t *cpu) {
@@ -243,17 +486,69 @@ char* cpu_mem_alloc_at(starkcpu_t *cpu, uint32_t start, uint32_t size) {
     return ptr;
 }
 
-void cpu_mem_set(starkcpu_t *cpu, uint32_t position, char value) {
+void write_memory_byte(starkcpu_t *cpu, uint32_t position, char value) {
     char* ptr = cpu->mem + position;
-    if (ptr) {
+    cpu_executor_t *executor = cpu->executor;
+
+    // Writing the same value again does not change any decoded instruction.
+    // Memory is only read before writing inside of the decoded code, so that writing past the end of memory faults as a write.
+    if (position >= executor->code_start && position < executor->code_end) {
+        if (*ptr != value) {
+            *ptr = value;
+            cpu_executor_invalidate(executor, position);
+        }
+    } else {
         *ptr = value;
     }
+
+    if (cpu->dirty_pages) {
+        cpu->dirty_pages[position >> CPU_PAGE_SHIFT] = CPU_DIRTY_ALL;
+    }
+
+    if (cpu->tracer) {
+        cpu_tracer_note_write(cpu->tracer, position, 1);
+    }
+}
+
+void cpu_mem_set(starkcpu_t *cpu, uint32_t position, char value) {
+    if (cpu->io_pages[position >> CPU_PAGE_SHIFT]) {
+        cpu_bus_write(cpu, position, (uint8_t) value, 1);
+        return;
+    }
+
+    write_memory_byte(cpu, position, value);
+}
+
+void cpu_mem_write(starkcpu_t *cpu, uint32_t position, uint32_t value, uint32_t size) {
+    // an access that ends in a page of a device is split up by the bus
+    if (cpu->io_pages[position >> CPU_PAGE_SHIFT] | cpu->io_pages[(position + (size - 1)) >> CPU_PAGE_SHIFT]) {
+        cpu_bus_write(cpu, position, value, size);
+        return;
+    }
+
+    for (uint32_t i = 0; i < size; i++) {
+        write_memory_byte(cpu, position + i, value >> (i * 8));
+    }
+}
+
+char cpu_mem_read(starkcpu_t *cpu, uint32_t position) {
+    if (cpu->io_pages[position >> CPU_PAGE_SHIFT]) {
+        return cpu_bus_read(cpu, position, 1);
+    }
+
+    return *cpu_mem_get(cpu, position);
 }
 
 char* cpu_mem_get(starkcpu_t *cpu, uint32_t position) {
+#ifndef CPU_GUARD_PAGES
     if (*cpu->mem + position >= cpu->memsize) {
         cpu_panic(cpu, "attempted to read memory from 0x%02X address, which is not readable", position);
     }
+#endif
+
+    if (position < CPU_RESERVED_MEMORY_SIZE) {
+        cpu_sync_internal_memory(cpu);
+    }
 
     return cpu->mem + position;
 }
@@ -263,14 +558,23 @@ uint32_t cpu_mem_get_block_offset(starkcpu_t *cpu, char* block) {
 }
 
 void cpu_panic(starkcpu_t *cpu, char* message, ...) {
-    printf("PANIC: ");
-
     va_list list;
     va_start(list, message);
-    vprintf(message, list);
+    vsnprintf(cpu->panic_message, CPU_PANIC_MESSAGE_SIZE, message, list);
     va_end(list);
 
-    printf("\n");
+    if (cpu->panic_handler) {
+        // the jump leaves cpu_execute without cleaning up after the batch
+#ifdef CPU_GUARD_PAGES
+        cpu_memory_leave_guard();
+#endif
+        cpu->scheduler->in_batch = false;
+        cpu->scheduler->ended_batch = false;
+
+        cpu->running = false;
+        longjmp(*cpu->panic_handler, 1);
+    }
 
+    printf("PANIC: %s\n", cpu->panic_message);
     exit(1);
 }
\ No newline at end of file
@@ -2,43 +2,176 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <setjmp.h>
 
 #define CPU_RESERVED_MEMORY_SIZE 256
+
+// Memory is made of 4 KiB pages, so its size is always rounded up to whole pages.
+#define CPU_DEFAULT_MEMORY_SIZE 0x1000
+#define CPU_MAX_MEMORY_SIZE 0xFFFFF000
 #define CPU_IMAGE_LOAD_ADDRESS 0x00000100
 #define CPU_TICK_PER_SECOND 2
 #define CPU_UI_UPDATE_PER_SECOND 3
 
+// How many times per second a CPU with a clock rate set synchronizes with the host's clock.
+#define CPU_CLOCK_SYNC_PER_SECOND 100
+
+// Maximum time (in microseconds) that a CPU with a clock rate set can fall behind before it stops trying to catch up.
+#define CPU_CLOCK_MAX_LAG 1000000
+
+// Number of instructions executed between checking the time when running without a clock rate.
+#define CPU_UNTHROTTLED_BATCH_SIZE 65536
+
+#define CPU_PANIC_MESSAGE_SIZE 256
+#define CPU_REGISTERS_COUNT 8
+
+struct cpu_executor_t;
+struct cpu_page_table_t;
+struct cpu_profiler_t;
+struct cpu_tracer_t;
+struct cpu_debugger_t;
+struct cpu_bus_t;
+struct cpu_scheduler_t;
+struct cpu_interrupts_t;
+struct cpu_smp_core_t;
+
+typedef enum {
+    // Calls handler of every instruction through a function pointer from the handlers map.
+    CPU_CORE_DISPATCH,
+
+    // Uses a threaded dispatch loop with all handlers inlined into it.
+    CPU_CORE_THREADED,
+
+    // Translates frequently executed basic blocks into native code, interprets everything else.
+    CPU_CORE_JIT
+} cpu_core_t;
+
 typedef struct {
     char* mem;
     char* nextmem;
     uint32_t memsize;
+    struct cpu_page_table_t *pages;
+
+    // One byte per page, set when the page is written to. Only allocated while something tracks changes, see memory.h.
+    uint8_t *dirty_pages;
+
+    // Runs of pages mapped from files, as pairs of first page and number of pages. They hold data without being resident.
+    uint32_t *file_extents;
+    uint32_t file_extents_count;
+
+    // One byte per page of the whole address space, non-zero for pages that belong to a device mapped by the bus (see bus.h).
+    uint8_t *io_pages;
+    struct cpu_bus_t *bus;
     bool running;
     void *ui;
+    cpu_core_t core;
+
+    // Whether common sequences of instructions are executed as a single fused instruction, see cpu-fusion.h.
+    bool fusion;
+
+    // Number of instructions executed per second, 0 runs the CPU as fast as possible.
+    uint32_t clock_rate;
+    uint64_t instructions_executed;
+
+    // Events of devices (see scheduler.h). Batches of instructions end before the cycle in next_event, which is
+    // the only thing checked in between them, it is 0 whenever events, interrupts or waiting have to be handled right away.
+    struct cpu_scheduler_t *scheduler;
+    uint64_t next_event;
+
+    // Created by the first device that raises interrupts, see interrupts.h.
+    struct cpu_interrupts_t *interrupts;
+
+    struct cpu_executor_t *executor;
+
+    // When set, instructions are executed one by one and counted by the profiler, regardless of the core (see profiler.h).
+    struct cpu_profiler_t *profiler;
+
+    // When set, instructions are executed one by one and recorded into a trace, regardless of the core (see tracer.h).
+    struct cpu_tracer_t *tracer;
+
+    // Only consulted when instructions are decoded, instructions at breakpoints are replaced with traps (see debugger.h).
+    struct cpu_debugger_t *debugger;
+
+    // When set, cpu_panic stops the CPU and jumps here instead of terminating the process.
+    jmp_buf *panic_handler;
+    char panic_message[CPU_PANIC_MESSAGE_SIZE];
 
     uint8_t* version;
     uint8_t* model;
-    uint32_t* ip;
-    int32_t* reg_a;
-    int32_t* reg_b;
-    int32_t* reg_c;
-    uint8_t* flag_equal;
+
+    // Registers are kept outside of guest memory, its internal part is only
+    // brought up to date when something reads from it (see cpu_sync_internal_memory).
+    uint32_t ip;
+    int32_t registers[CPU_REGISTERS_COUNT];
+    uint8_t flag_equal;
+
+    // Set by OP_INTERRUPTS_ENABLE and OP_INTERRUPT_RETURN, delivering an interrupt clears it and saves the state it returns to.
+    bool interrupts_enabled;
+    uint32_t interrupt_return;
+    uint8_t interrupt_flag_equal;
+
+    // Set by OP_WAIT until an interrupt is pending, cycles spent waiting are counted as executed instructions.
+    bool waiting;
+
+    // Index of this core and number of cores sharing its memory, read by OP_CORE_ID and OP_CORES_COUNT (see smp.h).
+    uint32_t core_id;
+    uint32_t cores_count;
+
+    // Set while the CPU is one of the cores of a machine with more of them.
+    struct cpu_smp_core_t *smp_core;
 } starkcpu_t;
 
-starkcpu_t* cpu_create(bool with_ui);
+/* Creates a CPU with given amount of memory, between CPU_DEFAULT_MEMORY_SIZE and CPU_MAX_MEMORY_SIZE bytes. */
+starkcpu_t* cpu_create(bool with_ui, uint64_t memsize);
+
+/* Frees the CPU along with devices that are still attached to it. */
+void cpu_destroy(starkcpu_t *cpu);
+
+/* Brings the CPU back to the state it was created in, with memory cleared and devices reset, so another program can be loaded. */
+void cpu_reset(starkcpu_t *cpu);
 char* cpu_mem_alloc(starkcpu_t *cpu, uint32_t size);
 char* cpu_mem_alloc_at(starkcpu_t *cpu, uint32_t start, uint32_t size);
 void cpu_mem_set(starkcpu_t *cpu, uint32_t position, char value);
 char* cpu_mem_get(starkcpu_t *cpu, uint32_t position);
+
+/*
+ * Reads a byte, or writes 1, 2 or 4 bytes as a single access, on behalf of the program. Unlike cpu_mem_get, these
+ * go to the device if the address belongs to one. cpu_mem_set does as well, one byte at a time.
+ */
+char cpu_mem_read(starkcpu_t *cpu, uint32_t position);
+void cpu_mem_write(starkcpu_t *cpu, uint32_t position, uint32_t value, uint32_t size);
+
+/* Copies current values of the registers into the internal memory. */
+void cpu_sync_internal_memory(starkcpu_t *cpu);
 uint32_t cpu_mem_get_block_offset(starkcpu_t *cpu, char* block);
 
 void cpu_jmp(starkcpu_t *cpu, uint32_t position);
 
 void cpu_start(starkcpu_t *cpu);
 
+/*
+ * Executes up to `count` instructions using the selected core, running events of devices and delivering interrupts in between.
+ * Returns number of executed instructions, which includes cycles the CPU spent waiting for an interrupt.
+ */
+uint32_t cpu_execute(starkcpu_t *cpu, uint32_t count);
+
+/* Returns time in microseconds from a clock that never goes backwards. */
+uint64_t cpu_get_monotonic_time();
+
+/* Suspends the calling thread for given number of microseconds. */
+void cpu_sleep(uint64_t usec);
+
 void cpu_dump_memory(starkcpu_t *cpu);
 
-void cpu_set_register_value(starkcpu_t *cpu, uint8_t index, int32_t value);
-int32_t cpu_get_register_value(starkcpu_t *cpu, uint8_t index);
+static inline void cpu_set_register_value(starkcpu_t *cpu, uint8_t index, int32_t value) {
+    if (index < CPU_REGISTERS_COUNT) {
+        cpu->registers[index] = value;
+    }
+}
+
+static inline int32_t cpu_get_register_value(starkcpu_t *cpu, uint8_t index) {
+    return index < CPU_REGISTERS_COUNT ? cpu->registers[index] : 0;
+}
 
 uint8_t cpu_read_program(starkcpu_t *cpu);
 uint16_t cpu_read_program_int16(starkcpu_t *cpu);
@@ -0,0 +1,222 @@
+#include "debugger.h"
+#include <stdlib.h>
+#include <string.h>
+
+cpu_debugger_t *cpu_debugger_create(starkcpu_t *cpu) {
+    cpu_debugger_t *debugger = calloc(1, sizeof(cpu_debugger_t));
+    debugger->cpu = cpu;
+    cpu->debugger = debugger;
+    return debugger;
+}
+
+/* Drops every decoded instruction, so that watchpoints are applied to (or removed from) all stores. */
+void invalidate_code(cpu_debugger_t *debugger) {
+    cpu_executor_t *executor = debugger->cpu->executor;
+
+    if (executor->code_end > executor->code_start) {
+        cpu_executor_invalidate_range(executor, executor->code_start, executor->code_end - executor->code_start);
+    }
+}
+
+void cpu_debugger_destroy(cpu_debugger_t *debugger) {
+    if (debugger->breakpoints_count > 0 || debugger->watchpoints_count > 0) {
+        invalidate_code(debugger);
+    }
+
+    debugger->cpu->debugger = 0;
+    free(debugger->breakpoints);
+    free(debugger->watchpoints);
+    free(debugger);
+}
+
+/* Returns index of the first breakpoint at given address or after it. */
+uint32_t find_breakpoint(cpu_debugger_t *debugger, uint32_t address) {
+    uint32_t low = 0;
+    uint32_t high = debugger->breakpoints_count;
+
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+
+        if (debugger->breakpoints[middle] < address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+bool has_breakpoint(cpu_debugger_t *debugger, uint32_t address) {
+    uint32_t index = find_breakpoint(debugger, address);
+    return index < debugger->breakpoints_count && debugger->breakpoints[index] == address;
+}
+
+bool cpu_debugger_add_breakpoint(cpu_debugger_t *debugger, uint32_t address) {
+    if (address >= debugger->cpu->memsize || has_breakpoint(debugger, address)) {
+        return false;
+    }
+
+    if (debugger->breakpoints_count == debugger->breakpoints_capacity) {
+        debugger->breakpoints_capacity = debugger->breakpoints_capacity ? debugger->breakpoints_capacity * 2 : 16;
+        debugger->breakpoints = realloc(debugger->breakpoints, debugger->breakpoints_capacity * sizeof(uint32_t));
+    }
+
+    uint32_t index = find_breakpoint(debugger, address);
+    memmove(debugger->breakpoints + index + 1, debugger->breakpoints + index, (debugger->breakpoints_count - index) * sizeof(uint32_t));
+    debugger->breakpoints[index] = address;
+    debugger->breakpoints_count++;
+
+    // also drops fused instructions and translated blocks that include the address
+    cpu_executor_invalidate(debugger->cpu->executor, address);
+    return true;
+}
+
+bool cpu_debugger_remove_breakpoint(cpu_debugger_t *debugger, uint32_t address) {
+    if (!has_breakpoint(debugger, address)) {
+        return false;
+    }
+
+    uint32_t index = find_breakpoint(debugger, address);
+    debugger->breakpoints_count--;
+    memmove(debugger->breakpoints + index, debugger->breakpoints + index + 1, (debugger->breakpoints_count - index) * sizeof(uint32_t));
+
+    cpu_executor_invalidate(debugger->cpu->executor, address);
+    return true;
+}
+
+bool cpu_debugger_add_watchpoint(cpu_debugger_t *debugger, uint32_t address, uint32_t size) {
+    if (size == 0 || (uint64_t) address + size > debugger->cpu->memsize) {
+        return false;
+    }
+
+    if (debugger->watchpoints_count == debugger->watchpoints_capacity) {
+        debugger->watchpoints_capacity = debugger->watchpoints_capacity ? debugger->watchpoints_capacity * 2 : 4;
+        debugger->watchpoints = realloc(debugger->watchpoints, debugger->watchpoints_capacity * sizeof(cpu_watchpoint_t));
+    }
+
+    debugger->watchpoints[debugger->watchpoints_count].address = address;
+    debugger->watchpoints[debugger->watchpoints_count].size = size;
+    debugger->watchpoints_count++;
+
+    // every store has to be trapped from now on, not only the ones decoded later
+    if (debugger->watchpoints_count == 1) {
+        invalidate_code(debugger);
+    }
+
+    return true;
+}
+
+bool cpu_debugger_remove_watchpoint(cpu_debugger_t *debugger, uint32_t address, uint32_t size) {
+    for (uint32_t i = 0; i < debugger->watchpoints_count; i++) {
+        cpu_watchpoint_t *watchpoint = debugger->watchpoints + i;
+
+        if (watchpoint->address == address && watchpoint->size == size) {
+            *watchpoint = debugger->watchpoints[--debugger->watchpoints_count];
+
+            // once the last one is gone, stores are executed by the core directly again
+            if (debugger->watchpoints_count == 0) {
+                invalidate_code(debugger);
+            }
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void cpu_debugger_resume(cpu_debugger_t *debugger) {
+    starkcpu_t *cpu = debugger->cpu;
+
+    debugger->stop = CPU_DEBUG_NOT_STOPPED;
+    debugger->skip_breakpoint = has_breakpoint(debugger, cpu->ip);
+    debugger->skip_address = cpu->ip;
+}
+
+void cpu_debugger_step(cpu_debugger_t *debugger) {
+    starkcpu_t *cpu = debugger->cpu;
+
+    cpu_debugger_resume(debugger);
+    cpu->running = true;
+    cpu->instructions_executed += cpu_execute(cpu, 1);
+
+    if (debugger->stop == CPU_DEBUG_NOT_STOPPED && cpu->running && cpu->ip < cpu->memsize) {
+        debugger->stop = CPU_DEBUG_STEPPED;
+        debugger->stop_address = cpu->ip;
+        cpu->running = false;
+    }
+}
+
+bool cpu_debugger_traps(cpu_debugger_t *debugger, uint32_t address, uint8_t opcode) {
+    return has_breakpoint(debugger, address) || (debugger->watchpoints_count > 0 && cpu_opcode_writes_memory(opcode));
+}
+
+/* Checks whether there is a breakpoint within [start, end). */
+bool has_breakpoint_within(cpu_debugger_t *debugger, uint32_t start, uint32_t end) {
+    uint32_t index = find_breakpoint(debugger, start);
+    return index < debugger->breakpoints_count && debugger->breakpoints[index] < end;
+}
+
+void cpu_debugger_patch_instruction(cpu_debugger_t *debugger, uint32_t address, cpu_instruction_t *instruction) {
+    bool trapped = cpu_debugger_traps(debugger, address, instruction->opcode);
+
+    // A fused instruction must not hide a breakpoint on one of the instructions it replaces. Only the first
+    // instruction of a fused sequence can write memory, so trapping just that one is enough for watchpoints.
+    if (instruction->count > 1 && (trapped || has_breakpoint_within(debugger, address + 1, address + instruction->length))) {
+        cpu_decode_instruction(debugger->cpu->executor, address, instruction, true);
+    }
+
+    if (trapped) {
+        instruction->opcode = OP_DEBUG_TRAP;
+        instruction->handler = cpu_execute_OP_DEBUG_TRAP;
+    }
+}
+
+/*
+ * Trapped instruction keeps its operands and length, and the instruction it stands for is still in memory right
+ * at its address, since writing there would have dropped it from the cache.
+ */
+void cpu_execute_OP_DEBUG_TRAP(starkcpu_t *cpu, const cpu_instruction_t *instruction) {
+    cpu_debugger_t *debugger = cpu->debugger;
+    uint32_t address = cpu->ip - instruction->length;
+
+    // Handler of the trapped instruction reports to the loop how many instructions were executed through its slot.
+    cpu_instruction_t *slot = (cpu_instruction_t *) instruction;
+
+    if (has_breakpoint(debugger, address) && !(debugger->skip_breakpoint && debugger->skip_address == address)) {
+        cpu->ip = address;
+        cpu->running = false;
+        debugger->stop = CPU_DEBUG_BREAKPOINT;
+        debugger->stop_address = address;
+        slot->count = 0;
+        return;
+    }
+
+    debugger->skip_breakpoint = false;
+
+    cpu_instruction_t original = *instruction;
+    original.opcode = cpu->mem[address];
+    original.handler = opcode_handlers_map_get(cpu->executor->handlers_map, original.opcode)->func;
+
+    // registers that make up the address might be changed by the instruction itself
+    uint32_t write_address = 0;
+    uint32_t write_size = debugger->watchpoints_count > 0 ? cpu_get_instruction_write(cpu, &original, &write_address) : 0;
+
+    original.handler(cpu, &original);
+    slot->count = 1;
+
+    for (uint32_t i = 0; i < debugger->watchpoints_count && write_size > 0; i++) {
+        cpu_watchpoint_t *watchpoint = debugger->watchpoints + i;
+
+        if ((uint64_t) write_address + write_size > watchpoint->address && (uint64_t) watchpoint->address + watchpoint->size > write_address) {
+            cpu->running = false;
+            debugger->stop = CPU_DEBUG_WATCHPOINT;
+            debugger->stop_address = address;
+            debugger->watchpoint = *watchpoint;
+            debugger->write_address = write_address;
+            debugger->write_size = write_size;
+            return;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "cpu.h"
+#include "cpu-executor.h"
+
+/*
+ * Opcode of decoded instructions that the debugger has to see before they are executed, i.e. instructions at
+ * a breakpoint, and instructions that write memory while a watchpoint is set. Like fused opcodes, it is never
+ * decoded from guest memory, so it takes a value that the instruction set does not use.
+ */
+#define OP_DEBUG_TRAP 0xFE
+
+typedef enum {
+    CPU_DEBUG_NOT_STOPPED,
+
+    // Stopped right before executing an instruction at a breakpoint.
+    CPU_DEBUG_BREAKPOINT,
+
+    // Stopped right after an instruction wrote into a watched range of memory.
+    CPU_DEBUG_WATCHPOINT,
+
+    // Stopped after cpu_debugger_step executed a single instruction.
+    CPU_DEBUG_STEPPED
+} cpu_debug_stop_t;
+
+typedef struct {
+    uint32_t address;
+    uint32_t size;
+} cpu_watchpoint_t;
+
+/*
+ * Breakpoints and watchpoints cost nothing while they are not hit: the debugger is only consulted when an instruction
+ * is decoded into the instruction cache, and only the affected instructions are replaced with OP_DEBUG_TRAP.
+ * Everything else is executed by the selected core as usual, fused and translated by the JIT.
+ */
+typedef struct cpu_debugger_t {
+    starkcpu_t *cpu;
+
+    // Addresses of breakpoints, sorted.
+    uint32_t *breakpoints;
+    uint32_t breakpoints_count;
+    uint32_t breakpoints_capacity;
+
+    cpu_watchpoint_t *watchpoints;
+    uint32_t watchpoints_count;
+    uint32_t watchpoints_capacity;
+
+    // Why the CPU stopped, and the address of the instruction that made it stop.
+    cpu_debug_stop_t stop;
+    uint32_t stop_address;
+
+    // For a watchpoint, the one that was hit and the memory written by the instruction.
+    cpu_watchpoint_t watchpoint;
+    uint32_t write_address;
+    uint32_t write_size;
+
+    // Breakpoint that execution continues from is skipped once, so that its instruction can be executed.
+    bool skip_breakpoint;
+    uint32_t skip_address;
+} cpu_debugger_t;
+
+/*
+ * Attaches a debugger to given CPU. When a breakpoint or a watchpoint is hit, the CPU stops as if it halted and
+ * `stop` tells why, cpu_debugger_resume (or cpu_debugger_step) lets it continue.
+ */
+cpu_debugger_t *cpu_debugger_create(starkcpu_t *cpu);
+
+/* Removes all breakpoints and watchpoints, detaches the debugger from its CPU and frees it. */
+void cpu_debugger_destroy(cpu_debugger_t *debugger);
+
+/* Returns false if there already is a breakpoint at given address, or if it is past the end of memory. */
+bool cpu_debugger_add_breakpoint(cpu_debugger_t *debugger, uint32_t address);
+bool cpu_debugger_remove_breakpoint(cpu_debugger_t *debugger, uint32_t address);
+
+/* Stops the CPU whenever an instruction writes any of `size` bytes at given address. Returns false if the range is not in memory. */
+bool cpu_debugger_add_watchpoint(cpu_debugger_t *debugger, uint32_t address, uint32_t size);
+bool cpu_debugger_remove_watchpoint(cpu_debugger_t *debugger, uint32_t address, uint32_t size);
+
+/* Clears the reason of the last stop, so that the CPU can be started again from the instruction it stopped at. */
+void cpu_debugger_resume(cpu_debugger_t *debugger);
+
+/* Executes a single instruction from where the CPU stopped, then stops it again. */
+void cpu_debugger_step(cpu_debugger_t *debugger);
+
+/* Checks whether the debugger has to see an instruction with given opcode at given address before it is executed. */
+bool cpu_debugger_traps(cpu_debugger_t *debugger, uint32_t address, uint8_t opcode);
+
+/* Replaces instruction that was just decoded into the instruction cache with OP_DEBUG_TRAP, if the debugger has to see it. */
+void cpu_debugger_patch_instruction(cpu_debugger_t *debugger, uint32_t address, cpu_instruction_t *instruction);
+
+void cpu_execute_OP_DEBUG_TRAP(starkcpu_t *cpu, const cpu_instruction_t *instruction);
\ No newline at end of file
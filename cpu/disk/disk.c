@@ -0,0 +1,376 @@
+#include "disk.h"
+#include "../cpu-executor.h"
+#include "../scheduler.h"
+#include "../interrupts.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#else
+#include <unistd.h>
+#endif
+
+uint32_t get_disk_register(cpu_disk_t *disk, uint32_t offset) {
+    const uint8_t *bytes = disk->io + offset;
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+void set_disk_register(cpu_disk_t *disk, uint32_t offset, uint32_t value) {
+    for (uint32_t i = 0; i < 4; i++) {
+        disk->io[offset + i] = value >> (i * 8);
+    }
+}
+
+/* Copies data of the pending transfer between the file and memory, straight from or into memory of the CPU. */
+bool transfer_sectors(cpu_disk_t *disk) {
+    int fd = fileno(disk->file);
+    char *memory = disk->cpu->mem + disk->address;
+    uint64_t offset = disk->offset;
+    uint64_t size = disk->size;
+
+#ifdef _WIN32
+    // only the worker moves the position in the file
+    if (_lseeki64(fd, offset, SEEK_SET) < 0) {
+        return false;
+    }
+#endif
+
+    while (size > 0) {
+#ifdef _WIN32
+        unsigned int chunk = size < INT32_MAX ? size : INT32_MAX;
+        int result = disk->command == CPU_DISK_READ ? _read(fd, memory, chunk) : _write(fd, memory, chunk);
+#else
+        ssize_t result = disk->command == CPU_DISK_READ ? pread(fd, memory, size, offset) : pwrite(fd, memory, size, offset);
+#endif
+
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+
+        // the file could have been truncated by someone else
+        if (result <= 0) {
+            return false;
+        }
+
+        memory += result;
+        offset += result;
+        size -= result;
+    }
+
+    return true;
+}
+
+void *run_transfers(void *argument) {
+    cpu_disk_t *disk = argument;
+    pthread_mutex_lock(&disk->lock);
+
+    while (true) {
+        while (!disk->pending && !disk->stopping) {
+            pthread_cond_wait(&disk->wake, &disk->lock);
+        }
+
+        if (!disk->pending) {
+            break;
+        }
+
+        // the executing thread does not touch the transfer until it is done, so the data is copied without the lock
+        pthread_mutex_unlock(&disk->lock);
+        bool transferred = transfer_sectors(disk);
+        pthread_mutex_lock(&disk->lock);
+
+        disk->failed = !transferred;
+        disk->pending = false;
+        pthread_cond_signal(&disk->done);
+    }
+
+    pthread_mutex_unlock(&disk->lock);
+    return 0;
+}
+
+/* Waits until the worker is done with the pending transfer. Returns false if the transfer failed. */
+bool wait_for_transfer(cpu_disk_t *disk) {
+    pthread_mutex_lock(&disk->lock);
+
+    while (disk->pending) {
+        pthread_cond_wait(&disk->done, &disk->lock);
+    }
+
+    bool transferred = !disk->failed;
+    pthread_mutex_unlock(&disk->lock);
+    return transferred;
+}
+
+void complete_transfer(void *context, uint64_t cycle) {
+    cpu_disk_t *disk = context;
+    starkcpu_t *cpu = disk->cpu;
+    bool transferred = wait_for_transfer(disk);
+
+    // memory was written behind the back of the executor, even a failed read could have written a part of it
+    if (disk->command == CPU_DISK_READ && disk->size > 0) {
+        cpu_executor_invalidate_range(cpu->executor, disk->address, disk->size);
+        cpu_memory_mark_dirty(cpu, disk->address, disk->size);
+    }
+
+    disk->busy = false;
+    disk->event = 0;
+    set_disk_register(disk, CPU_DISK_REGISTER_STATUS, 0);
+    set_disk_register(disk, CPU_DISK_REGISTER_COMPLETED, ++disk->completed);
+
+    if (!transferred) {
+        set_disk_register(disk, CPU_DISK_REGISTER_ERROR, CPU_DISK_ERROR_IO);
+    }
+
+    cpu_raise_interrupt(cpu, CPU_DISK_INTERRUPT_LINE);
+}
+
+void schedule_completion(void *context, uint64_t cycle) {
+    cpu_disk_t *disk = context;
+    uint64_t sectors = disk->size / CPU_DISK_SECTOR_SIZE;
+
+    disk->completion = cycle + CPU_DISK_COMMAND_CYCLES + sectors * CPU_DISK_SECTOR_CYCLES;
+    disk->event = cpu_schedule_event(disk->cpu, disk->completion, complete_transfer, disk);
+}
+
+void hand_to_worker(cpu_disk_t *disk) {
+    pthread_mutex_lock(&disk->lock);
+    disk->pending = disk->size > 0;
+    disk->failed = false;
+    pthread_cond_signal(&disk->wake);
+    pthread_mutex_unlock(&disk->lock);
+}
+
+/* Checks the command written by the program and hands the transfer to the worker. Returns 0 or one of CPU_DISK_ERROR_*. */
+uint32_t start_transfer(cpu_disk_t *disk) {
+    uint32_t command = get_disk_register(disk, CPU_DISK_REGISTER_COMMAND);
+    uint32_t sector = get_disk_register(disk, CPU_DISK_REGISTER_SECTOR);
+    uint32_t count = get_disk_register(disk, CPU_DISK_REGISTER_COUNT);
+    uint32_t address = get_disk_register(disk, CPU_DISK_REGISTER_ADDRESS);
+    uint64_t size = (uint64_t) count * CPU_DISK_SECTOR_SIZE;
+
+    if (disk->busy) {
+        return CPU_DISK_ERROR_BUSY;
+    }
+
+    if (command != CPU_DISK_READ && command != CPU_DISK_WRITE) {
+        return CPU_DISK_ERROR_UNKNOWN_COMMAND;
+    }
+
+    if ((uint64_t) sector + count > get_disk_register(disk, CPU_DISK_REGISTER_SECTORS)) {
+        return CPU_DISK_ERROR_OUT_OF_RANGE;
+    }
+
+    if (!cpu_bus_can_access_memory(disk->cpu, address, size, command == CPU_DISK_READ ? CPU_PAGE_WRITE : CPU_PAGE_READ)) {
+        return CPU_DISK_ERROR_NOT_ACCESSIBLE;
+    }
+
+    disk->busy = true;
+    disk->command = command;
+    disk->offset = (uint64_t) sector * CPU_DISK_SECTOR_SIZE;
+    disk->address = address;
+    disk->size = size;
+    disk->completion = UINT64_MAX;
+    set_disk_register(disk, CPU_DISK_REGISTER_STATUS, CPU_DISK_BUSY);
+
+    // the data is transferred while the program goes on, the transfer only takes virtual time from the cycle of the command
+    hand_to_worker(disk);
+    disk->event = cpu_schedule_event(disk->cpu, 0, schedule_completion, disk);
+    cpu_scheduler_end_batch(disk->cpu);
+    return 0;
+}
+
+uint32_t read_disk(void *device, uint32_t offset, uint32_t size) {
+    cpu_disk_t *disk = device;
+    uint32_t value = 0;
+
+    for (uint32_t i = 0; i < size && offset + i < CPU_DISK_IO_SIZE; i++) {
+        value |= (uint32_t) disk->io[offset + i] << (i * 8);
+    }
+
+    return value;
+}
+
+void write_disk(void *device, uint32_t offset, uint32_t value, uint32_t size) {
+    cpu_disk_t *disk = device;
+    bool command = false;
+
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t position = offset + i;
+
+        if (position >= CPU_DISK_REGISTER_SECTOR && position < CPU_DISK_REGISTER_STATUS) {
+            disk->io[position] = value >> (i * 8);
+            command |= position >= CPU_DISK_REGISTER_COMMAND;
+        }
+    }
+
+    if (command) {
+        set_disk_register(disk, CPU_DISK_REGISTER_ERROR, start_transfer(disk));
+    }
+}
+
+void reset_disk(void *device) {
+    cpu_disk_t *disk = device;
+
+    if (disk->event) {
+        cpu_cancel_event(disk->cpu, disk->event);
+        disk->event = 0;
+    }
+
+    // the worker must be done with memory before it is cleared
+    wait_for_transfer(disk);
+    disk->busy = false;
+    disk->completed = 0;
+
+    uint32_t sectors = get_disk_register(disk, CPU_DISK_REGISTER_SECTORS);
+    memset(disk->io, 0, sizeof(disk->io));
+    set_disk_register(disk, CPU_DISK_REGISTER_SECTORS, sectors);
+}
+
+/* State of a disk in a snapshot. The number of sectors is not saved, it is always that of the file of the disk. */
+typedef struct {
+    uint8_t io[CPU_DISK_IO_SIZE];
+    uint32_t completed;
+    uint8_t busy;
+    uint8_t command;
+    uint32_t address;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t completion;
+} disk_state_t;
+
+void save_disk(void *device, void *state) {
+    cpu_disk_t *disk = device;
+    disk_state_t *saved = state;
+
+    // memory is saved after devices, with everything the transfer read into it
+    wait_for_transfer(disk);
+
+    memcpy(saved->io, disk->io, sizeof(saved->io));
+    saved->completed = disk->completed;
+    saved->busy = disk->busy;
+    saved->command = disk->command;
+    saved->address = disk->address;
+    saved->offset = disk->offset;
+    saved->size = disk->size;
+    saved->completion = disk->completion;
+}
+
+void restore_disk(void *device, const void *state) {
+    cpu_disk_t *disk = device;
+    const disk_state_t *saved = state;
+    uint32_t sectors = get_disk_register(disk, CPU_DISK_REGISTER_SECTORS);
+
+    memcpy(disk->io, saved->io, sizeof(disk->io));
+    set_disk_register(disk, CPU_DISK_REGISTER_SECTORS, sectors);
+    disk->completed = saved->completed;
+
+    if (!saved->busy) {
+        return;
+    }
+
+    disk->busy = true;
+    disk->command = saved->command;
+    disk->address = saved->address;
+    disk->offset = saved->offset;
+    disk->size = saved->size;
+    disk->completion = saved->completion;
+
+    // the transfer is done again, so that it reads or writes the file of this disk, which might not be the saved one
+    hand_to_worker(disk);
+
+    if (disk->completion == UINT64_MAX) {
+        disk->event = cpu_schedule_event(disk->cpu, 0, schedule_completion, disk);
+    } else {
+        disk->event = cpu_schedule_event(disk->cpu, disk->completion, complete_transfer, disk);
+    }
+}
+
+void *copy_disk(void *device, starkcpu_t *cpu) {
+    cpu_disk_t *disk = device;
+    return cpu_disk_create(cpu, disk->path);
+}
+
+void destroy_disk(void *device) {
+    cpu_disk_destroy(device);
+}
+
+const cpu_bus_hooks_t disk_hooks = { reset_disk, sizeof(disk_state_t), save_disk, restore_disk, copy_disk, destroy_disk };
+
+cpu_disk_t *cpu_disk_create(starkcpu_t *cpu, const char *path) {
+    FILE *file = fopen(path, "r+b");
+    if (!file) {
+        return 0;
+    }
+
+    cpu_disk_t *disk = calloc(1, sizeof(cpu_disk_t));
+    char *path_copy = malloc(strlen(path) + 1);
+
+    if (!disk || !path_copy) {
+        fclose(file);
+        free(disk);
+        free(path_copy);
+        return 0;
+    }
+
+    disk->cpu = cpu;
+    disk->file = file;
+    disk->path = strcpy(path_copy, path);
+
+    int64_t file_size = fseeko(file, 0, SEEK_END) == 0 ? ftello(file) : -1;
+    uint64_t sectors = file_size > 0 ? file_size / CPU_DISK_SECTOR_SIZE : 0;
+    set_disk_register(disk, CPU_DISK_REGISTER_SECTORS, sectors < UINT32_MAX ? sectors : UINT32_MAX);
+
+    if (file_size < 0 || !cpu_interrupts_attach(cpu)
+        || !cpu_bus_map(cpu, CPU_DISK_ADDRESS, CPU_DISK_IO_SIZE, disk, read_disk, write_disk)) {
+        fclose(file);
+        free(disk->path);
+        free(disk);
+        return 0;
+    }
+
+    pthread_mutex_init(&disk->lock, 0);
+    pthread_cond_init(&disk->wake, 0);
+    pthread_cond_init(&disk->done, 0);
+
+    // without the worker, the first command would wait for its transfer forever
+    if (pthread_create(&disk->worker, 0, run_transfers, disk) != 0) {
+        pthread_mutex_destroy(&disk->lock);
+        pthread_cond_destroy(&disk->wake);
+        pthread_cond_destroy(&disk->done);
+        cpu_bus_unmap(cpu, CPU_DISK_ADDRESS);
+        fclose(file);
+        free(disk->path);
+        free(disk);
+        return 0;
+    }
+
+    cpu_bus_set_hooks(cpu, CPU_DISK_ADDRESS, &disk_hooks);
+    return disk;
+}
+
+void cpu_disk_destroy(cpu_disk_t *disk) {
+    if (disk->event) {
+        cpu_cancel_event(disk->cpu, disk->event);
+    }
+
+    // memory must not be written once the disk is gone
+    wait_for_transfer(disk);
+
+    pthread_mutex_lock(&disk->lock);
+    disk->stopping = true;
+    pthread_cond_signal(&disk->wake);
+    pthread_mutex_unlock(&disk->lock);
+    pthread_join(disk->worker, 0);
+
+    pthread_mutex_destroy(&disk->lock);
+    pthread_cond_destroy(&disk->wake);
+    pthread_cond_destroy(&disk->done);
+
+    cpu_bus_unmap(disk->cpu, CPU_DISK_ADDRESS);
+    fclose(disk->file);
+    free(disk->path);
+    free(disk);
+}
\ No newline at end of file
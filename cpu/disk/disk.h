@@ -0,0 +1,115 @@
+#pragma once
+
+#include "../cpu.h"
+#include "../bus.h"
+#include <pthread.h>
+#include <stdio.h>
+
+/* Guest address of the disk's registers, mapped by the bus. */
+#define CPU_DISK_ADDRESS 0xFC000
+
+/* Line of the interrupt controller that the disk raises whenever a transfer completes. */
+#define CPU_DISK_INTERRUPT_LINE 1
+
+#define CPU_DISK_SECTOR_SIZE 512
+
+/*
+ * Virtual cycles (see scheduler.h) that a transfer takes, regardless of how long the host takes. Execution goes on
+ * while the host transfers the data, and only waits for it if the host has not finished by the time the transfer completes.
+ */
+#define CPU_DISK_COMMAND_CYCLES 2000
+#define CPU_DISK_SECTOR_CYCLES 32
+
+/*
+ * Layout of the disk's registers, all values are 32-bit and little endian:
+ * - number of sectors of the disk, set by the disk,
+ * - first sector, number of sectors and address of memory of the next transfer,
+ * - command, storing CPU_DISK_READ or CPU_DISK_WRITE starts a transfer of the sectors,
+ * - status, CPU_DISK_BUSY while a transfer is in progress,
+ * - error, 0 or one of CPU_DISK_ERROR_* for the last command that was rejected or transfer that failed,
+ * - number of transfers completed so far.
+ * Only sector, count, address and command can be written by the program. Memory of a transfer must not be touched
+ * until it completes, which raises CPU_DISK_INTERRUPT_LINE.
+ */
+#define CPU_DISK_REGISTER_SECTORS 0x00
+#define CPU_DISK_REGISTER_SECTOR 0x04
+#define CPU_DISK_REGISTER_COUNT 0x08
+#define CPU_DISK_REGISTER_ADDRESS 0x0C
+#define CPU_DISK_REGISTER_COMMAND 0x10
+#define CPU_DISK_REGISTER_STATUS 0x14
+#define CPU_DISK_REGISTER_ERROR 0x18
+#define CPU_DISK_REGISTER_COMPLETED 0x1C
+
+#define CPU_DISK_IO_SIZE 0x20
+
+/* Copies sectors of the disk into memory. */
+#define CPU_DISK_READ 1
+
+/* Copies memory into sectors of the disk. */
+#define CPU_DISK_WRITE 2
+
+#define CPU_DISK_BUSY 0x01
+
+#define CPU_DISK_ERROR_UNKNOWN_COMMAND 1
+
+// Memory of the transfer can not be accessed by the program in that way, or is not entirely in memory.
+#define CPU_DISK_ERROR_NOT_ACCESSIBLE 2
+
+// Sectors of the transfer are past the end of the disk.
+#define CPU_DISK_ERROR_OUT_OF_RANGE 3
+
+// Another transfer is still in progress, the command was ignored.
+#define CPU_DISK_ERROR_BUSY 4
+
+// Host could not read or write the file, the transfer completed without all of its data.
+#define CPU_DISK_ERROR_IO 5
+
+typedef struct cpu_disk_t {
+    starkcpu_t *cpu;
+    FILE *file;
+
+    // Path of the file, which a copy of the disk made by cpu_fork opens as well.
+    char *path;
+
+    // Contents of the registers, as the program sees them.
+    uint8_t io[CPU_DISK_IO_SIZE];
+
+    // Number of transfers completed so far, mirrored in CPU_DISK_REGISTER_COMPLETED.
+    uint32_t completed;
+
+    // Transfer that is in progress, from the command until the event that completes it, which is scheduled once
+    // the cycle of the command is known.
+    bool busy;
+    uint32_t event;
+    uint8_t command;
+    uint64_t offset;
+    uint32_t address;
+    uint64_t size;
+
+    // Cycle the transfer completes at, UINT64_MAX until the cycle of the command is known.
+    uint64_t completion;
+
+    // Thread that transfers the data between the file and memory. It is woken up once a transfer is pending,
+    // and clears `pending` once it is done. Fields below are guarded by the lock.
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    bool pending;
+    bool failed;
+    bool stopping;
+} cpu_disk_t;
+
+/*
+ * Attaches a disk backed by the file at given path to given CPU, with its registers mapped at CPU_DISK_ADDRESS, and
+ * the interrupt controller if there is none yet. The disk has as many sectors as fit into the file, which is never resized.
+ * Returns 0 if the file can not be opened for reading and writing, the registers of either device can not be mapped,
+ * or the worker thread can not be started.
+ */
+cpu_disk_t *cpu_disk_create(starkcpu_t *cpu, const char *path);
+
+/*
+ * Waits for the transfer in progress, if any, unmaps the disk from its CPU, closes the file and frees the disk.
+ * A disk that is still attached when its CPU is destroyed is destroyed along with it.
+ */
+void cpu_disk_destroy(cpu_disk_t *disk);
\ No newline at end of file
@@ -1,16 +1,33 @@
 #pragma once
 #include <stdbool.h>
+#include "../memory.h"
 
-#define DEFINE_OP(op) opcode_handlers_map_set(executor->handlers_map, op, cpu_execute_##op);
-#define MAKE_OP_HANDLER(op) void cpu_execute_##op(starkcpu_t *cpu)
+#define DEFINE_OP(op, operands) opcode_handlers_map_set(executor->handlers_map, op, cpu_execute_##op, operands);
+#define MAKE_OP_HANDLER(op) void cpu_execute_##op(starkcpu_t *cpu, const cpu_instruction_t *instruction)
 
+#ifdef CPU_GUARD_PAGES
+/*
+ * Accessing an address past the end of memory, or accessing a page in a way it does not permit,
+ * faults (see memory.h), so only the internal memory and the first page it is a part of have to be checked.
+ */
+#define is_address_writable(address) \
+    (address > CPU_RESERVED_MEMORY_SIZE && (address >= CPU_PAGE_SIZE || cpu_memory_can_access(cpu, address, CPU_PAGE_WRITE)))
+
+#define is_address_readable(address) \
+    (address >= CPU_PAGE_SIZE || cpu_memory_can_access(cpu, address, CPU_PAGE_READ))
+#else
 /* Checks whether given address can be written to by a program. */
 #define is_address_writable(address) \
-    (address > CPU_RESERVED_MEMORY_SIZE && address < cpu->memsize)
+    (address > CPU_RESERVED_MEMORY_SIZE && cpu_memory_can_access(cpu, address, CPU_PAGE_WRITE))
 
 /* Checks whether given address can be read from by a program. */
 #define is_address_readable(address) \
-    (address < cpu->memsize)
+    (cpu_memory_can_access(cpu, address, CPU_PAGE_READ))
+#endif
+
+/* Checks whether a program can jump to given address. */
+#define is_address_jmpable(address) \
+    (address > CPU_RESERVED_MEMORY_SIZE && cpu_memory_can_access(cpu, address, CPU_PAGE_EXECUTE))
 
 /* Makes sure that given address can be written to. Panics and shuts down if it can not. */
 #define assert_address_writable(address) \
@@ -24,7 +41,7 @@
 
 /* Makes sure that given address can be jumped to. Panics and shuts down if it can not. */
 #define assert_address_jmpable(address) \
-    if (!is_address_writable(address)) \
+    if (!is_address_jmpable(address)) \
         cpu_panic(cpu, "can not jump to protected address 0x%02x", address);
 
 /* Makes sure that a register with given index exists. Panics and shuts down if it does not. */
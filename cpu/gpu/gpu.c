@@ -0,0 +1,436 @@
+#include "gpu.h"
+#include "../memory.h"
+#include "../cpu-executor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint32_t read_register(cpu_gpu_t *gpu, uint32_t offset) {
+    const uint8_t *bytes = gpu->io + offset;
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+void write_register(cpu_gpu_t *gpu, uint32_t offset, uint32_t value) {
+    for (uint32_t i = 0; i < 4; i++) {
+        gpu->io[offset + i] = value >> (i * 8);
+    }
+}
+
+void add_dirty_rect(cpu_gpu_t *gpu, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    if (width == 0 || height == 0) {
+        return;
+    }
+
+    if (gpu->dirty_count < CPU_GPU_MAX_DIRTY_RECTS) {
+        gpu->dirty[gpu->dirty_count++] = (cpu_gpu_rect_t) { x, y, width, height };
+        return;
+    }
+
+    // too many separate changes, their bounding box is rendered instead
+    uint32_t left = x;
+    uint32_t top = y;
+    uint32_t right = x + width;
+    uint32_t bottom = y + height;
+
+    for (uint32_t i = 0; i < gpu->dirty_count; i++) {
+        cpu_gpu_rect_t *rect = gpu->dirty + i;
+        left = rect->x < left ? rect->x : left;
+        top = rect->y < top ? rect->y : top;
+        right = rect->x + rect->width > right ? rect->x + rect->width : right;
+        bottom = rect->y + rect->height > bottom ? rect->y + rect->height : bottom;
+    }
+
+    gpu->dirty[0] = (cpu_gpu_rect_t) { left, top, right - left, bottom - top };
+    gpu->dirty_count = 1;
+}
+
+/* Turns pages of the framebuffer written by the program since the last frame into rectangles of whole rows. */
+void collect_dirty_pages(cpu_gpu_t *gpu) {
+    starkcpu_t *cpu = gpu->cpu;
+    uint32_t pitch = gpu->width * 4;
+    uint32_t end = gpu->framebuffer + pitch * gpu->height;
+
+    // consecutive dirty pages make up a single band of rows
+    uint32_t band_top = 0;
+    uint32_t band_bottom = 0;
+    bool band = false;
+
+    for (uint32_t page = gpu->framebuffer >> CPU_PAGE_SHIFT; page <= (end - 1) >> CPU_PAGE_SHIFT; page++) {
+        if (!(cpu->dirty_pages[page] & CPU_DIRTY_GPU)) {
+            continue;
+        }
+
+        cpu->dirty_pages[page] &= ~CPU_DIRTY_GPU;
+
+        uint32_t page_start = page << CPU_PAGE_SHIFT;
+        uint32_t page_end = page_start + CPU_PAGE_SIZE;
+        uint32_t top = ((page_start > gpu->framebuffer ? page_start : gpu->framebuffer) - gpu->framebuffer) / pitch;
+        uint32_t bottom = ((page_end < end ? page_end : end) - gpu->framebuffer - 1) / pitch + 1;
+
+        if (band && top <= band_bottom) {
+            band_bottom = bottom;
+            continue;
+        }
+
+        if (band) {
+            add_dirty_rect(gpu, 0, band_top, gpu->width, band_bottom - band_top);
+        }
+
+        band = true;
+        band_top = top;
+        band_bottom = bottom;
+    }
+
+    if (band) {
+        add_dirty_rect(gpu, 0, band_top, gpu->width, band_bottom - band_top);
+    }
+}
+
+/* Cuts a rectangle that starts at given position down to the part inside of the framebuffer. Returns false if nothing is left. */
+bool clip_rect(cpu_gpu_t *gpu, uint32_t x, uint32_t y, uint32_t *width, uint32_t *height) {
+    if (x >= gpu->width || y >= gpu->height) {
+        return false;
+    }
+
+    *width = *width < gpu->width - x ? *width : gpu->width - x;
+    *height = *height < gpu->height - y ? *height : gpu->height - y;
+    return *width > 0 && *height > 0;
+}
+
+uint32_t *get_pixel(cpu_gpu_t *gpu, uint32_t x, uint32_t y) {
+    return (uint32_t *) (gpu->cpu->mem + gpu->framebuffer + ((size_t) y * gpu->width + x) * 4);
+}
+
+/*
+ * Commands draw into the framebuffer directly. Decoded instructions still have to be dropped and other readers
+ * of dirty pages have to see the change, while the GPU itself tracks the exact rectangle instead of the pages.
+ * Returns false if the program can not write the rectangle.
+ */
+bool draw_rect(cpu_gpu_t *gpu, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    starkcpu_t *cpu = gpu->cpu;
+    uint32_t start = gpu->framebuffer + (y * gpu->width + x) * 4;
+    uint32_t size = ((height - 1) * gpu->width + width) * 4;
+
+    if (!cpu_bus_can_access_memory(cpu, start, size, CPU_PAGE_WRITE)) {
+        return false;
+    }
+
+    cpu_executor_invalidate_range(cpu->executor, start, size);
+
+    for (uint32_t page = start >> CPU_PAGE_SHIFT; page <= (start + size - 1) >> CPU_PAGE_SHIFT; page++) {
+        cpu->dirty_pages[page] |= CPU_DIRTY_ALL & ~CPU_DIRTY_GPU;
+    }
+
+    add_dirty_rect(gpu, x, y, width, height);
+    return true;
+}
+
+uint32_t fill_rect(cpu_gpu_t *gpu, const uint32_t *arguments) {
+    uint32_t x = arguments[0];
+    uint32_t y = arguments[1];
+    uint32_t width = arguments[2];
+    uint32_t height = arguments[3];
+    uint32_t color = arguments[4];
+
+    if (!clip_rect(gpu, x, y, &width, &height)) {
+        return 0;
+    }
+
+    if (!draw_rect(gpu, x, y, width, height)) {
+        return CPU_GPU_ERROR_NOT_ACCESSIBLE;
+    }
+
+    uint32_t *first_row = get_pixel(gpu, x, y);
+    for (uint32_t i = 0; i < width; i++) {
+        first_row[i] = color;
+    }
+
+    for (uint32_t row = 1; row < height; row++) {
+        memcpy(get_pixel(gpu, x, y + row), first_row, width * 4);
+    }
+
+    return 0;
+}
+
+uint32_t blit(cpu_gpu_t *gpu, const uint32_t *arguments) {
+    starkcpu_t *cpu = gpu->cpu;
+    uint32_t source = arguments[0];
+    uint32_t source_pitch = arguments[1];
+    uint32_t x = arguments[2];
+    uint32_t y = arguments[3];
+    uint32_t width = arguments[4];
+    uint32_t height = arguments[5];
+
+    if (!clip_rect(gpu, x, y, &width, &height)) {
+        return 0;
+    }
+
+    if (!cpu_bus_can_access_memory(cpu, source, (uint64_t) (height - 1) * source_pitch + width * 4, CPU_PAGE_READ)
+        || !draw_rect(gpu, x, y, width, height)) {
+        return CPU_GPU_ERROR_NOT_ACCESSIBLE;
+    }
+
+    if (source < CPU_RESERVED_MEMORY_SIZE) {
+        cpu_sync_internal_memory(cpu);
+    }
+
+    // source might be a part of the framebuffer itself
+    for (uint32_t row = 0; row < height; row++) {
+        memmove(get_pixel(gpu, x, y + row), cpu->mem + source + (size_t) row * source_pitch, width * 4);
+    }
+
+    return 0;
+}
+
+uint32_t copy_rect(cpu_gpu_t *gpu, const uint32_t *arguments) {
+    uint32_t source_x = arguments[0];
+    uint32_t source_y = arguments[1];
+    uint32_t x = arguments[2];
+    uint32_t y = arguments[3];
+    uint32_t width = arguments[4];
+    uint32_t height = arguments[5];
+
+    if (!clip_rect(gpu, source_x, source_y, &width, &height) || !clip_rect(gpu, x, y, &width, &height)) {
+        return 0;
+    }
+
+    if (!draw_rect(gpu, x, y, width, height)) {
+        return CPU_GPU_ERROR_NOT_ACCESSIBLE;
+    }
+
+    // rows are copied in the order that never overwrites a row before it is copied
+    for (uint32_t i = 0; i < height; i++) {
+        uint32_t row = source_y < y ? height - 1 - i : i;
+        memmove(get_pixel(gpu, x, y + row), get_pixel(gpu, source_x, source_y + row), width * 4);
+    }
+
+    return 0;
+}
+
+void execute_commands(cpu_gpu_t *gpu) {
+    uint32_t written = read_register(gpu, CPU_GPU_REGISTER_COMMANDS_WRITTEN);
+
+    if (written == gpu->commands_executed) {
+        return;
+    }
+
+    if (written - gpu->commands_executed > CPU_GPU_COMMANDS_COUNT) {
+        write_register(gpu, CPU_GPU_REGISTER_STATUS, CPU_GPU_ERROR_OVERRUN);
+        gpu->commands_executed = written;
+    }
+
+    while (gpu->commands_executed != written) {
+        uint32_t slot = CPU_GPU_COMMANDS_OFFSET + (gpu->commands_executed % CPU_GPU_COMMANDS_COUNT) * CPU_GPU_COMMAND_SIZE;
+        uint32_t command[CPU_GPU_COMMAND_SIZE / 4];
+
+        for (uint32_t i = 0; i < CPU_GPU_COMMAND_SIZE / 4; i++) {
+            command[i] = read_register(gpu, slot + i * 4);
+        }
+
+        uint32_t error = 0;
+        switch (command[0]) {
+            case CPU_GPU_FILL_RECT: error = fill_rect(gpu, command + 1); break;
+            case CPU_GPU_BLIT: error = blit(gpu, command + 1); break;
+            case CPU_GPU_COPY_RECT: error = copy_rect(gpu, command + 1); break;
+            case CPU_GPU_PRESENT: cpu_gpu_present(gpu); break;
+            default: error = CPU_GPU_ERROR_UNKNOWN_COMMAND; break;
+        }
+
+        if (error) {
+            write_register(gpu, CPU_GPU_REGISTER_STATUS, error);
+        }
+
+        write_register(gpu, slot, 0);
+
+        gpu->commands_executed++;
+    }
+
+    write_register(gpu, CPU_GPU_REGISTER_COMMANDS_EXECUTED, gpu->commands_executed);
+}
+
+uint32_t read_io(void *device, uint32_t offset, uint32_t size) {
+    cpu_gpu_t *gpu = device;
+    uint32_t value = 0;
+
+    for (uint32_t i = 0; i < size && offset + i < CPU_GPU_IO_SIZE; i++) {
+        value |= (uint32_t) gpu->io[offset + i] << (i * 8);
+    }
+
+    return value;
+}
+
+void write_io(void *device, uint32_t offset, uint32_t value, uint32_t size) {
+    cpu_gpu_t *gpu = device;
+    bool doorbell = false;
+
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t position = offset + i;
+        bool commands_written = position >= CPU_GPU_REGISTER_COMMANDS_WRITTEN && position < CPU_GPU_REGISTER_COMMANDS_WRITTEN + 4;
+
+        // registers set by the GPU can not be changed by the program
+        if (commands_written || (position >= CPU_GPU_COMMANDS_OFFSET && position < CPU_GPU_IO_SIZE)) {
+            gpu->io[position] = value >> (i * 8);
+            doorbell |= commands_written;
+        }
+    }
+
+    if (doorbell) {
+        execute_commands(gpu);
+    }
+}
+
+void reset_gpu(void *device) {
+    cpu_gpu_t *gpu = device;
+
+    // frames keep counting, so that frames presented after the reset do not replace those written before it
+    memset(gpu->io + CPU_GPU_REGISTER_COMMANDS_WRITTEN, 0, CPU_GPU_IO_SIZE - CPU_GPU_REGISTER_COMMANDS_WRITTEN);
+    write_register(gpu, CPU_GPU_REGISTER_FRAMES, gpu->frames);
+    gpu->commands_executed = 0;
+}
+
+/* State of a GPU in a snapshot, the registers and the command ring. The framebuffer is a part of memory. */
+typedef struct {
+    uint8_t io[CPU_GPU_IO_SIZE];
+    uint32_t commands_executed;
+} gpu_state_t;
+
+void save_gpu(void *device, void *state) {
+    cpu_gpu_t *gpu = device;
+    gpu_state_t *saved = state;
+
+    memcpy(saved->io, gpu->io, sizeof(saved->io));
+    saved->commands_executed = gpu->commands_executed;
+}
+
+void restore_gpu(void *device, const void *state) {
+    cpu_gpu_t *gpu = device;
+    const gpu_state_t *saved = state;
+
+    // registers that describe the framebuffer stay those of this GPU, and the whole of it is rendered anew
+    memcpy(gpu->io + CPU_GPU_REGISTER_COMMANDS_WRITTEN, saved->io + CPU_GPU_REGISTER_COMMANDS_WRITTEN, CPU_GPU_IO_SIZE - CPU_GPU_REGISTER_COMMANDS_WRITTEN);
+    gpu->commands_executed = saved->commands_executed;
+    gpu->frames = read_register(gpu, CPU_GPU_REGISTER_FRAMES);
+    add_dirty_rect(gpu, 0, 0, gpu->width, gpu->height);
+}
+
+/* The copy does not write frames, which would replace those of the original. */
+void *copy_gpu(void *device, starkcpu_t *cpu) {
+    cpu_gpu_t *gpu = device;
+    return cpu_gpu_create(cpu, gpu->width, gpu->height);
+}
+
+void destroy_gpu(void *device) {
+    cpu_gpu_destroy(device);
+}
+
+const cpu_bus_hooks_t gpu_hooks = { reset_gpu, sizeof(gpu_state_t), save_gpu, restore_gpu, copy_gpu, destroy_gpu };
+
+cpu_gpu_t *cpu_gpu_create(starkcpu_t *cpu, uint32_t width, uint32_t height) {
+    if (width == 0 || height == 0 || width > CPU_GPU_MAX_WIDTH || height > CPU_GPU_MAX_HEIGHT) {
+        return 0;
+    }
+
+    uint64_t end = CPU_GPU_ADDRESS + CPU_GPU_FRAMEBUFFER_OFFSET + (uint64_t) width * height * 4;
+    if (end > cpu->memsize || !cpu_memory_track_dirty_pages(cpu)) {
+        return 0;
+    }
+
+    cpu_gpu_t *gpu = calloc(1, sizeof(cpu_gpu_t));
+    gpu->cpu = cpu;
+    gpu->width = width;
+    gpu->height = height;
+    gpu->framebuffer = CPU_GPU_ADDRESS + CPU_GPU_FRAMEBUFFER_OFFSET;
+    gpu->image = calloc((size_t) width * height, 3);
+
+    if (!cpu_bus_map(cpu, CPU_GPU_ADDRESS, CPU_GPU_IO_SIZE, gpu, read_io, write_io)) {
+        free(gpu->image);
+        free(gpu);
+        return 0;
+    }
+
+    write_register(gpu, CPU_GPU_REGISTER_WIDTH, width);
+    write_register(gpu, CPU_GPU_REGISTER_HEIGHT, height);
+    write_register(gpu, CPU_GPU_REGISTER_FRAMEBUFFER, gpu->framebuffer);
+    write_register(gpu, CPU_GPU_REGISTER_COMMANDS_WRITTEN, 0);
+    write_register(gpu, CPU_GPU_REGISTER_COMMANDS_EXECUTED, 0);
+    write_register(gpu, CPU_GPU_REGISTER_FRAMES, 0);
+    write_register(gpu, CPU_GPU_REGISTER_STATUS, 0);
+    cpu_bus_set_hooks(cpu, CPU_GPU_ADDRESS, &gpu_hooks);
+
+    // the first frame is rendered whole
+    add_dirty_rect(gpu, 0, 0, width, height);
+    return gpu;
+}
+
+void cpu_gpu_destroy(cpu_gpu_t *gpu) {
+    cpu_bus_unmap(gpu->cpu, CPU_GPU_ADDRESS);
+    free(gpu->output_prefix);
+    free(gpu->image);
+    free(gpu);
+}
+
+void cpu_gpu_set_output(cpu_gpu_t *gpu, const char *prefix) {
+    free(gpu->output_prefix);
+    gpu->output_prefix = malloc(strlen(prefix) + 1);
+    strcpy(gpu->output_prefix, prefix);
+}
+
+bool cpu_gpu_has_changes(cpu_gpu_t *gpu) {
+    collect_dirty_pages(gpu);
+    return gpu->dirty_count > 0;
+}
+
+void write_frame(cpu_gpu_t *gpu) {
+    char *path = malloc(strlen(gpu->output_prefix) + 32);
+    sprintf(path, "%s-%06llu.ppm", gpu->output_prefix, (unsigned long long) gpu->frames);
+
+    FILE *file = fopen(path, "wb");
+    free(path);
+
+    if (!file) {
+        gpu->output_failed = true;
+        return;
+    }
+
+    fprintf(file, "P6\n%u %u\n255\n", gpu->width, gpu->height);
+    size_t size = (size_t) gpu->width * gpu->height * 3;
+
+    if (fwrite(gpu->image, 1, size, file) != size) {
+        gpu->output_failed = true;
+    }
+
+    if (fclose(file) != 0) {
+        gpu->output_failed = true;
+    }
+
+    gpu->frames_written++;
+}
+
+void cpu_gpu_present(cpu_gpu_t *gpu) {
+    collect_dirty_pages(gpu);
+
+    for (uint32_t i = 0; i < gpu->dirty_count; i++) {
+        const cpu_gpu_rect_t *rect = gpu->dirty + i;
+
+        for (uint32_t y = rect->y; y < rect->y + rect->height; y++) {
+            const uint32_t *pixels = get_pixel(gpu, rect->x, y);
+            uint8_t *output = gpu->image + ((size_t) y * gpu->width + rect->x) * 3;
+
+            for (uint32_t x = 0; x < rect->width; x++) {
+                output[x * 3] = pixels[x] >> 16;
+                output[x * 3 + 1] = pixels[x] >> 8;
+                output[x * 3 + 2] = pixels[x];
+            }
+        }
+
+        gpu->pixels_rendered += (uint64_t) rect->width * rect->height;
+    }
+
+    gpu->dirty_count = 0;
+    gpu->frames++;
+    write_register(gpu, CPU_GPU_REGISTER_FRAMES, gpu->frames);
+
+    if (gpu->output_prefix) {
+        write_frame(gpu);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "../cpu.h"
+#include "../bus.h"
+
+/* Guest address of the GPU's registers and command ring, mapped by the bus. The framebuffer is plain memory on the next page. */
+#define CPU_GPU_ADDRESS 0x100000
+#define CPU_GPU_FRAMEBUFFER_OFFSET 0x1000
+
+#define CPU_GPU_MAX_WIDTH 4096
+#define CPU_GPU_MAX_HEIGHT 4096
+
+/*
+ * Layout of the GPU's registers, all values are 32-bit and little endian:
+ * - width and height of the framebuffer in pixels, and its address, set by the GPU,
+ * - number of commands the program has written into the ring so far, and number of commands the GPU has executed.
+ *   Every write into CPU_GPU_REGISTER_COMMANDS_WRITTEN makes the GPU execute commands up to the new value right away,
+ * - number of frames presented so far,
+ * - status, 0 or one of CPU_GPU_ERROR_* for the last command that was rejected.
+ * Only CPU_GPU_REGISTER_COMMANDS_WRITTEN and the command ring can be written by the program.
+ * Every pixel of the framebuffer is a 32-bit 0x00RRGGBB value, rows follow each other without any padding.
+ */
+#define CPU_GPU_REGISTER_WIDTH 0x00
+#define CPU_GPU_REGISTER_HEIGHT 0x04
+#define CPU_GPU_REGISTER_FRAMEBUFFER 0x08
+#define CPU_GPU_REGISTER_COMMANDS_WRITTEN 0x0C
+#define CPU_GPU_REGISTER_COMMANDS_EXECUTED 0x10
+#define CPU_GPU_REGISTER_FRAMES 0x14
+#define CPU_GPU_REGISTER_STATUS 0x18
+
+/*
+ * Command N is written at CPU_GPU_COMMANDS_OFFSET + (N % CPU_GPU_COMMANDS_COUNT) * CPU_GPU_COMMAND_SIZE as eight 32-bit
+ * values, an opcode followed by its arguments. The program then bumps CPU_GPU_REGISTER_COMMANDS_WRITTEN, and may reuse
+ * the slot once CPU_GPU_REGISTER_COMMANDS_EXECUTED moves past it. The GPU also sets the opcode of every command it executed
+ * to 0, so a program can wait for a slot by reading just its first byte.
+ */
+#define CPU_GPU_COMMANDS_OFFSET 0x100
+#define CPU_GPU_COMMANDS_COUNT 64
+#define CPU_GPU_COMMAND_SIZE 32
+
+/* x, y, width, height, color. */
+#define CPU_GPU_FILL_RECT 1
+
+/* Source address, distance between source rows in bytes, x, y, width, height. Copies pixels from memory into the framebuffer. */
+#define CPU_GPU_BLIT 2
+
+/* Source x, source y, x, y, width, height. Copies pixels within the framebuffer, the rectangles may overlap. */
+#define CPU_GPU_COPY_RECT 3
+
+/* Marks the frame as complete, so that it is rendered. */
+#define CPU_GPU_PRESENT 4
+
+#define CPU_GPU_ERROR_UNKNOWN_COMMAND 1
+
+// Memory that the command reads from or draws into can not be accessed by the program in that way.
+#define CPU_GPU_ERROR_NOT_ACCESSIBLE 2
+
+// Program wrote more commands than the ring holds before the GPU got to them, all of them were dropped.
+#define CPU_GPU_ERROR_OVERRUN 3
+
+/* Registers followed by the command ring. */
+#define CPU_GPU_IO_SIZE (CPU_GPU_COMMANDS_OFFSET + CPU_GPU_COMMANDS_COUNT * CPU_GPU_COMMAND_SIZE)
+
+/* Changed parts of the framebuffer that are tracked separately, more are merged into a single rectangle. */
+#define CPU_GPU_MAX_DIRTY_RECTS 32
+
+typedef struct {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+} cpu_gpu_rect_t;
+
+typedef struct cpu_gpu_t {
+    starkcpu_t *cpu;
+    uint32_t width;
+    uint32_t height;
+    uint32_t framebuffer;
+
+    // Number of commands executed so far, mirrored in CPU_GPU_REGISTER_COMMANDS_EXECUTED.
+    uint32_t commands_executed;
+
+    // Contents of the registers and the command ring, as the program sees them.
+    uint8_t io[CPU_GPU_IO_SIZE];
+
+    // Parts of the framebuffer that changed since the last rendered frame.
+    cpu_gpu_rect_t dirty[CPU_GPU_MAX_DIRTY_RECTS];
+    uint32_t dirty_count;
+
+    // Rendered frame, 24-bit RGB. Only dirty rectangles are converted from the framebuffer.
+    uint8_t *image;
+
+    // Presented frames are written as `<prefix>-<frame>.ppm` if set.
+    char *output_prefix;
+    bool output_failed;
+
+    uint64_t frames;
+    uint64_t frames_written;
+    uint64_t pixels_rendered;
+} cpu_gpu_t;
+
+/*
+ * Attaches a GPU with a framebuffer of given size to given CPU, with its registers mapped at CPU_GPU_ADDRESS.
+ * Guest stores into the framebuffer are tracked through dirty pages, commands are executed natively once the program
+ * writes CPU_GPU_REGISTER_COMMANDS_WRITTEN. Returns 0 if the size is not valid, the GPU does not fit into memory,
+ * or its registers can not be mapped.
+ */
+cpu_gpu_t *cpu_gpu_create(starkcpu_t *cpu, uint32_t width, uint32_t height);
+
+/* Unmaps the GPU from its CPU and frees it. A GPU that is still attached when its CPU is destroyed is destroyed along with it. */
+void cpu_gpu_destroy(cpu_gpu_t *gpu);
+
+/* Writes every presented frame into a PPM file named `<prefix>-<frame>.ppm`. */
+void cpu_gpu_set_output(cpu_gpu_t *gpu, const char *prefix);
+
+/* Checks whether any part of the framebuffer changed since the last frame. */
+bool cpu_gpu_has_changes(cpu_gpu_t *gpu);
+
+/* Renders the parts of the framebuffer that changed since the last frame, and writes the frame if there is an output. */
+void cpu_gpu_present(cpu_gpu_t *gpu);
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "interrupts.h"
+#include "scheduler.h"
+#include "execution/exec-utils.h"
+#include <stdlib.h>
+
+#define CPU_INTERRUPT_ALL_LINES ((1u << CPU_INTERRUPT_LINES) - 1)
+
+uint32_t read_controller(void *device, uint32_t offset, uint32_t size) {
+    cpu_interrupts_t *interrupts = device;
+    uint32_t registers[] = { interrupts->pending, interrupts->enabled, interrupts->line };
+    uint32_t value = 0;
+
+    for (uint32_t i = 0; i < size && offset + i < CPU_INTERRUPTS_IO_SIZE; i++) {
+        uint32_t position = offset + i;
+        value |= ((registers[position / 4] >> (position % 4 * 8)) & 0xFF) << (i * 8);
+    }
+
+    return value;
+}
+
+void write_controller(void *device, uint32_t offset, uint32_t value, uint32_t size) {
+    cpu_interrupts_t *interrupts = device;
+
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t position = offset + i;
+        uint32_t shift = position % 4 * 8;
+        uint32_t byte = (value >> (i * 8)) & 0xFF;
+
+        if (position / 4 == CPU_INTERRUPTS_REGISTER_PENDING / 4) {
+            interrupts->pending &= ~(byte << shift);
+        } else if (position / 4 == CPU_INTERRUPTS_REGISTER_ENABLED / 4) {
+            interrupts->enabled = ((interrupts->enabled & ~(0xFFu << shift)) | byte << shift) & CPU_INTERRUPT_ALL_LINES;
+        }
+    }
+
+    // unmasked line that is already pending interrupts right away
+    if (cpu_has_pending_interrupt(interrupts->cpu)) {
+        cpu_scheduler_end_batch(interrupts->cpu);
+    }
+}
+
+void cpu_interrupts_reset(cpu_interrupts_t *interrupts) {
+    interrupts->pending = 0;
+    interrupts->enabled = CPU_INTERRUPT_ALL_LINES;
+    interrupts->line = 0;
+}
+
+/* Registers of the controller in a snapshot. It is reset along with the CPU rather than by a hook, and freed along with it. */
+typedef struct {
+    uint32_t pending;
+    uint32_t enabled;
+    uint32_t line;
+} interrupts_state_t;
+
+void save_controller(void *device, void *state) {
+    cpu_interrupts_t *interrupts = device;
+    *(interrupts_state_t *) state = (interrupts_state_t) { interrupts->pending, interrupts->enabled, interrupts->line };
+}
+
+void restore_controller(void *device, const void *state) {
+    cpu_interrupts_t *interrupts = device;
+    const interrupts_state_t *saved = state;
+
+    interrupts->pending = saved->pending;
+    interrupts->enabled = saved->enabled & CPU_INTERRUPT_ALL_LINES;
+    interrupts->line = saved->line;
+}
+
+void *copy_controller(void *device, starkcpu_t *cpu) {
+    return cpu_interrupts_attach(cpu);
+}
+
+const cpu_bus_hooks_t controller_hooks = { 0, sizeof(interrupts_state_t), save_controller, restore_controller, copy_controller, 0 };
+
+cpu_interrupts_t *cpu_interrupts_attach(starkcpu_t *cpu) {
+    if (cpu->interrupts) {
+        return cpu->interrupts;
+    }
+
+    cpu_interrupts_t *interrupts = malloc(sizeof(cpu_interrupts_t));
+    interrupts->cpu = cpu;
+    cpu_interrupts_reset(interrupts);
+
+    if (!cpu_bus_map(cpu, CPU_INTERRUPTS_ADDRESS, CPU_INTERRUPTS_IO_SIZE, interrupts, read_controller, write_controller)) {
+        free(interrupts);
+        return 0;
+    }
+
+    cpu_bus_set_hooks(cpu, CPU_INTERRUPTS_ADDRESS, &controller_hooks);
+    cpu->interrupts = interrupts;
+    return interrupts;
+}
+
+void cpu_raise_interrupt(starkcpu_t *cpu, uint32_t line) {
+    cpu_interrupts_t *interrupts = cpu->interrupts;
+    interrupts->pending |= 1u << line;
+
+    if (interrupts->enabled & (1u << line)) {
+        cpu_scheduler_end_batch(cpu);
+    }
+}
+
+uint32_t read_vector(starkcpu_t *cpu, uint32_t line) {
+    const uint8_t *bytes = (const uint8_t *) cpu->mem + CPU_INTERRUPT_VECTORS_ADDRESS + line * 4;
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+void cpu_deliver_interrupt(starkcpu_t *cpu) {
+    if (!cpu_has_pending_interrupt(cpu)) {
+        return;
+    }
+
+    cpu->waiting = false;
+    if (!cpu->interrupts_enabled) {
+        return;
+    }
+
+    cpu_interrupts_t *interrupts = cpu->interrupts;
+    for (uint32_t line = 0; line < CPU_INTERRUPT_LINES; line++) {
+        uint32_t vector = read_vector(cpu, line);
+        if (!(interrupts->pending & interrupts->enabled & (1u << line)) || vector == 0) {
+            continue;
+        }
+
+        // permissions of the page might have changed since the vector was set
+        assert_address_jmpable(vector);
+
+        interrupts->pending &= ~(1u << line);
+        interrupts->line = line;
+
+        cpu->interrupt_return = cpu->ip;
+        cpu->interrupt_flag_equal = cpu->flag_equal;
+        cpu->interrupts_enabled = false;
+        cpu_jmp(cpu, vector);
+        return;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "cpu.h"
+#include "bus.h"
+
+/* Guest address of the interrupt controller's registers, mapped by the bus. */
+#define CPU_INTERRUPTS_ADDRESS 0xFF000
+
+#define CPU_INTERRUPT_LINES 16
+
+/*
+ * Address of the vector table in the internal memory, a 32-bit handler address for every line, set by OP_SET_INTERRUPT_VECTOR.
+ * An interrupt is never delivered for a line whose vector is 0.
+ */
+#define CPU_INTERRUPT_VECTORS_ADDRESS 0x40
+
+/*
+ * Layout of the controller's registers, all values are 32-bit and have a bit for every line:
+ * - lines that raised an interrupt which was not delivered yet. Writing clears the lines that are set in the value,
+ * - lines that are allowed to interrupt the CPU, all of them at first,
+ * - number of the line whose interrupt was delivered last, so a handler can be shared by many lines.
+ */
+#define CPU_INTERRUPTS_REGISTER_PENDING 0x00
+#define CPU_INTERRUPTS_REGISTER_ENABLED 0x04
+#define CPU_INTERRUPTS_REGISTER_LINE 0x08
+
+#define CPU_INTERRUPTS_IO_SIZE 0x0C
+
+typedef struct cpu_interrupts_t {
+    starkcpu_t *cpu;
+    uint32_t pending;
+    uint32_t enabled;
+    uint32_t line;
+} cpu_interrupts_t;
+
+/*
+ * Returns interrupt controller of given CPU, which is created and mapped at CPU_INTERRUPTS_ADDRESS by the first device
+ * that raises interrupts, and freed along with the CPU. Returns 0 if its registers can not be mapped.
+ */
+cpu_interrupts_t *cpu_interrupts_attach(starkcpu_t *cpu);
+
+/* Clears pending lines and enables all of them again, e.g. when the CPU is reset. */
+void cpu_interrupts_reset(cpu_interrupts_t *interrupts);
+
+/*
+ * Marks given line as pending. If the line is enabled, the current batch of instructions ends, so the interrupt is
+ * delivered right after the instruction that raised it, or once the event that raised it is done.
+ */
+void cpu_raise_interrupt(starkcpu_t *cpu, uint32_t line);
+
+/*
+ * Called in between batches of instructions. A CPU that waits for an interrupt resumes once any enabled line is pending,
+ * and if the program enabled interrupts, the lowest of the lines with a vector is cleared and its handler is entered:
+ * the instruction pointer and the EQUAL flag are saved for OP_INTERRUPT_RETURN, and interrupts are disabled until then.
+ */
+void cpu_deliver_interrupt(starkcpu_t *cpu);
+
+/* Checks whether any enabled line is pending. */
+static inline bool cpu_has_pending_interrupt(starkcpu_t *cpu) {
+    return cpu->interrupts && (cpu->interrupts->pending & cpu->interrupts->enabled);
+}
\ No newline at end of file
@@ -0,0 +1,718 @@
+#include "jit.h"
+#include "../../shared/stark1-opcodes.h"
+#include "../memory.h"
+#include "../debugger.h"
+#include "../bus.h"
+#include <stddef.h>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#include <sys/mman.h>
+
+// ==========================================
+// Host register allocation:
+// ---------|--------------------------------
+// Register | Description
+// ---------|--------------------------------
+// rdi      | cpu_jit_frame_t pointer
+// rsi      | guest memory
+// r8d      | Register A
+// r9d      | Register B
+// r10d     | Register C
+// r11d     | EQUAL flag
+// eax      | scratch
+// ecx      | guest address of memory access
+// edx      | scratch
+// ==========================================
+#define HOST_RAX 0
+#define HOST_RCX 1
+#define HOST_RDX 2
+#define HOST_RSI 6
+#define HOST_RDI 7
+#define HOST_R8 8
+#define HOST_R11 11
+
+#define HOST_FLAG HOST_R11
+#define host_register(index) (HOST_R8 + (index))
+
+#define X64_ADD 0x01
+#define X64_SUB 0x29
+#define X64_CMP 0x39
+#define X64_TEST 0x85
+
+#define X64_EXT_ADD 0
+#define X64_EXT_SUB 5
+#define X64_EXT_CMP 7
+
+#define X64_CC_B 0x2
+#define X64_CC_AE 0x3
+#define X64_CC_E 0x4
+#define X64_CC_NE 0x5
+#define X64_CC_BE 0x6
+
+#define X64_MAX_EXITS (CPU_JIT_MAX_BLOCK_LENGTH * 8)
+
+typedef struct {
+    // Position of the 32-bit displacement of the jump that leads to this exit.
+    uint32_t patch;
+    uint32_t ip;
+    uint32_t refund;
+} x64_exit_t;
+
+typedef struct {
+    uint8_t *code;
+    uint32_t size;
+
+    x64_exit_t exits[X64_MAX_EXITS];
+    uint32_t exits_count;
+} x64_emitter_t;
+
+void x64_byte(x64_emitter_t *e, uint8_t value) {
+    e->code[e->size++] = value;
+}
+
+void x64_int16(x64_emitter_t *e, uint16_t value) {
+    x64_byte(e, value);
+    x64_byte(e, value >> 8);
+}
+
+void x64_int32(x64_emitter_t *e, uint32_t value) {
+    x64_byte(e, value);
+    x64_byte(e, value >> 8);
+    x64_byte(e, value >> 16);
+    x64_byte(e, value >> 24);
+}
+
+void x64_rex(x64_emitter_t *e, bool wide, uint8_t reg, uint8_t index, uint8_t base) {
+    uint8_t rex = 0x40 | (wide << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+    if (rex != 0x40) {
+        x64_byte(e, rex);
+    }
+}
+
+void x64_modrm(x64_emitter_t *e, uint8_t mod, uint8_t reg, uint8_t rm) {
+    x64_byte(e, (mod << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* ModRM and SIB bytes addressing guest memory at [rsi + rcx]. */
+void x64_guest_operand(x64_emitter_t *e, uint8_t reg) {
+    x64_modrm(e, 0, reg, 4);
+    x64_byte(e, (HOST_RCX << 3) | HOST_RSI);
+}
+
+/* ModRM byte and displacement addressing [rdi + offset], a field of the frame. */
+void x64_frame_operand(x64_emitter_t *e, uint8_t reg, uint32_t offset) {
+    x64_modrm(e, 2, reg, HOST_RDI);
+    x64_int32(e, offset);
+}
+
+void x64_mov_rr(x64_emitter_t *e, uint8_t destination, uint8_t source) {
+    x64_rex(e, false, source, 0, destination);
+    x64_byte(e, 0x89);
+    x64_modrm(e, 3, source, destination);
+}
+
+void x64_mov_ri(x64_emitter_t *e, uint8_t destination, uint32_t value) {
+    x64_rex(e, false, 0, 0, destination);
+    x64_byte(e, 0xB8 | (destination & 7));
+    x64_int32(e, value);
+}
+
+void x64_alu_rr(x64_emitter_t *e, uint8_t op, uint8_t destination, uint8_t source) {
+    x64_rex(e, false, source, 0, destination);
+    x64_byte(e, op);
+    x64_modrm(e, 3, source, destination);
+}
+
+void x64_alu_ri(x64_emitter_t *e, uint8_t extension, uint8_t destination, uint32_t value) {
+    x64_rex(e, false, 0, 0, destination);
+    x64_byte(e, 0x81);
+    x64_modrm(e, 3, extension, destination);
+    x64_int32(e, value);
+}
+
+void x64_shr_ri(x64_emitter_t *e, uint8_t destination, uint8_t count) {
+    x64_rex(e, false, 0, 0, destination);
+    x64_byte(e, 0xC1);
+    x64_modrm(e, 3, 5, destination);
+    x64_byte(e, count);
+}
+
+void x64_imul_rr(x64_emitter_t *e, uint8_t destination, uint8_t source) {
+    x64_rex(e, false, destination, 0, source);
+    x64_byte(e, 0x0F);
+    x64_byte(e, 0xAF);
+    x64_modrm(e, 3, destination, source);
+}
+
+/* Unsigned division of edx:eax by given register. */
+void x64_div_r(x64_emitter_t *e, uint8_t source) {
+    x64_rex(e, false, 0, 0, source);
+    x64_byte(e, 0xF7);
+    x64_modrm(e, 3, 6, source);
+}
+
+void x64_load_frame(x64_emitter_t *e, bool wide, uint8_t destination, uint32_t offset) {
+    x64_rex(e, wide, destination, 0, HOST_RDI);
+    x64_byte(e, 0x8B);
+    x64_frame_operand(e, destination, offset);
+}
+
+void x64_store_frame(x64_emitter_t *e, uint8_t source, uint32_t offset) {
+    x64_rex(e, false, source, 0, HOST_RDI);
+    x64_byte(e, 0x89);
+    x64_frame_operand(e, source, offset);
+}
+
+void x64_alu_frame_imm(x64_emitter_t *e, uint8_t extension, uint32_t offset, uint32_t value) {
+    x64_byte(e, 0x81);
+    x64_frame_operand(e, extension, offset);
+    x64_int32(e, value);
+}
+
+/* `op reg, [rdi + offset]`, where `op` is one of the X64_* opcodes. */
+void x64_alu_r_frame(x64_emitter_t *e, uint8_t op, uint8_t destination, uint32_t offset) {
+    x64_rex(e, false, destination, 0, HOST_RDI);
+    x64_byte(e, op | 0x02);
+    x64_frame_operand(e, destination, offset);
+}
+
+void x64_load_guest_byte(x64_emitter_t *e, uint8_t destination, bool sign_extend) {
+    x64_rex(e, false, destination, HOST_RCX, HOST_RSI);
+    x64_byte(e, 0x0F);
+    x64_byte(e, sign_extend ? 0xBE : 0xB6);
+    x64_guest_operand(e, destination);
+}
+
+void x64_store_guest_al(x64_emitter_t *e) {
+    x64_byte(e, 0x88);
+    x64_guest_operand(e, HOST_RAX);
+}
+
+void x64_store_guest_r32(x64_emitter_t *e, uint8_t source) {
+    x64_rex(e, false, source, HOST_RCX, HOST_RSI);
+    x64_byte(e, 0x89);
+    x64_guest_operand(e, source);
+}
+
+void x64_store_guest_imm(x64_emitter_t *e, uint32_t width, uint32_t value) {
+    if (width == 2) {
+        x64_byte(e, 0x66);
+    }
+
+    x64_byte(e, width == 1 ? 0xC6 : 0xC7);
+    x64_guest_operand(e, 0);
+
+    if (width == 1) {
+        x64_byte(e, value);
+    } else if (width == 2) {
+        x64_int16(e, value);
+    } else {
+        x64_int32(e, value);
+    }
+}
+
+void x64_patch(x64_emitter_t *e, uint32_t patch, uint32_t target) {
+    uint32_t relative = target - (patch + 4);
+    e->code[patch + 0] = relative;
+    e->code[patch + 1] = relative >> 8;
+    e->code[patch + 2] = relative >> 16;
+    e->code[patch + 3] = relative >> 24;
+}
+
+uint32_t x64_jmp(x64_emitter_t *e) {
+    x64_byte(e, 0xE9);
+    x64_int32(e, 0);
+    return e->size - 4;
+}
+
+uint32_t x64_jcc(x64_emitter_t *e, uint8_t condition) {
+    x64_byte(e, 0x0F);
+    x64_byte(e, 0x80 | condition);
+    x64_int32(e, 0);
+    return e->size - 4;
+}
+
+/* Leaves the block at `ip` once given jump is taken, giving back `refund` instructions that were not executed. */
+void x64_exit_on(x64_emitter_t *e, uint32_t patch, uint32_t ip, uint32_t refund) {
+    x64_exit_t *exit = e->exits + e->exits_count++;
+    exit->patch = patch;
+    exit->ip = ip;
+    exit->refund = refund;
+}
+
+void x64_emit_exits(x64_emitter_t *e) {
+    for (uint32_t i = 0; i < e->exits_count; i++) {
+        x64_exit_t *exit = e->exits + i;
+        x64_patch(e, exit->patch, e->size);
+
+        if (exit->refund > 0) {
+            x64_alu_frame_imm(e, X64_EXT_ADD, offsetof(cpu_jit_frame_t, budget), exit->refund);
+        }
+
+        for (uint8_t index = 0; index < 3; index++) {
+            x64_store_frame(e, host_register(index), offsetof(cpu_jit_frame_t, registers) + index * 4);
+        }
+
+        x64_store_frame(e, HOST_FLAG, offsetof(cpu_jit_frame_t, flag_equal));
+
+        x64_byte(e, 0xC7);
+        x64_frame_operand(e, 0, offsetof(cpu_jit_frame_t, ip));
+        x64_int32(e, exit->ip);
+
+        x64_byte(e, 0xC3);
+    }
+}
+
+/* Marks the page holding guest address `rcx + offset` as dirty, `mov byte [dirty_pages + (address >> 12)], CPU_DIRTY_ALL`. */
+void x64_mark_dirty(x64_emitter_t *e, uint32_t offset) {
+    x64_mov_rr(e, HOST_RAX, HOST_RCX);
+    if (offset > 0) {
+        x64_alu_ri(e, X64_EXT_ADD, HOST_RAX, offset);
+    }
+
+    x64_shr_ri(e, HOST_RAX, CPU_PAGE_SHIFT);
+    x64_load_frame(e, true, HOST_RDX, offsetof(cpu_jit_frame_t, dirty_pages));
+
+    x64_byte(e, 0xC6);
+    x64_modrm(e, 0, 0, 4);
+    x64_byte(e, (HOST_RAX << 3) | HOST_RDX);
+    x64_byte(e, CPU_DIRTY_ALL);
+}
+
+/* Side exit to the interpreter if guest address in ecx can not be written to, or if it belongs to a decoded instruction. */
+void x64_check_writable(x64_emitter_t *e, starkcpu_t *cpu, uint32_t width, uint32_t ip, uint32_t refund) {
+    x64_alu_ri(e, X64_EXT_CMP, HOST_RCX, CPU_RESERVED_MEMORY_SIZE);
+    x64_exit_on(e, x64_jcc(e, X64_CC_BE), ip, refund);
+    x64_alu_ri(e, X64_EXT_CMP, HOST_RCX, cpu->memsize - (width - 1));
+    x64_exit_on(e, x64_jcc(e, X64_CC_AE), ip, refund);
+
+    // Store overlaps [code_start, code_start + code_size) if
+    // (address + width - 1 - code_start) < (code_size + width - 1).
+    x64_mov_rr(e, HOST_RAX, HOST_RCX);
+    x64_alu_ri(e, X64_EXT_ADD, HOST_RAX, width - 1);
+    x64_alu_r_frame(e, X64_SUB, HOST_RAX, offsetof(cpu_jit_frame_t, code_start));
+    x64_load_frame(e, false, HOST_RDX, offsetof(cpu_jit_frame_t, code_size));
+    x64_alu_ri(e, X64_EXT_ADD, HOST_RDX, width - 1);
+    x64_alu_rr(e, X64_CMP, HOST_RAX, HOST_RDX);
+    x64_exit_on(e, x64_jcc(e, X64_CC_B), ip, refund);
+
+    if (cpu->dirty_pages) {
+        x64_mark_dirty(e, 0);
+
+        if (width > 1) {
+            x64_mark_dirty(e, width - 1);
+        }
+    }
+}
+
+/*
+ * Side exit to the interpreter if guest address in ecx belongs to a device, `cmp byte [io_pages + (address >> 12)], 0`.
+ * Only needed for addresses taken from registers, and only while any device is mapped, mapping one drops all translated code.
+ */
+void x64_check_device(x64_emitter_t *e, starkcpu_t *cpu, uint32_t ip, uint32_t refund) {
+    if (!cpu->bus || cpu->bus->devices_count == 0) {
+        return;
+    }
+
+    x64_mov_rr(e, HOST_RAX, HOST_RCX);
+    x64_shr_ri(e, HOST_RAX, CPU_PAGE_SHIFT);
+    x64_load_frame(e, true, HOST_RDX, offsetof(cpu_jit_frame_t, io_pages));
+
+    x64_byte(e, 0x80);
+    x64_modrm(e, 0, X64_EXT_CMP, 4);
+    x64_byte(e, (HOST_RAX << 3) | HOST_RDX);
+    x64_byte(e, 0);
+    x64_exit_on(e, x64_jcc(e, X64_CC_NE), ip, refund);
+}
+
+/* Checks that native code can access given range of memory directly. */
+bool is_writable_range(starkcpu_t *cpu, uint32_t address, uint32_t width) {
+    return address > CPU_RESERVED_MEMORY_SIZE && address < cpu->memsize && cpu->memsize - address >= width
+        && !cpu_bus_overlaps(cpu, address, width);
+}
+
+bool is_jmpable(starkcpu_t *cpu, uint32_t address) {
+    return address > CPU_RESERVED_MEMORY_SIZE && cpu_memory_can_access(cpu, address, CPU_PAGE_EXECUTE);
+}
+
+bool accesses_memory(uint8_t opcode) {
+    switch (opcode) {
+        case OP_SET_REG_ADDR:
+        case OP_SET_ADDR_IMMEDIATE8:
+        case OP_SET_ADDR_IMMEDIATE16:
+        case OP_SET_ADDR_IMMEDIATE32:
+        case OP_SET_ADDR_ADDR:
+        case OP_SET_ADDR_REG:
+        case OP_SET_RADDR_RADDR:
+        case OP_SET_RADDR_IMMEDIATE8:
+        case OP_SET_RADDR_IMMEDIATE16:
+        case OP_SET_RADDR_IMMEDIATE32:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/* Checks that all register operands of given instruction are kept in host registers. */
+bool uses_host_registers(cpu_executor_t *executor, const cpu_instruction_t *instruction) {
+    const char *operands = opcode_handlers_map_get(executor->handlers_map, instruction->opcode)->operands;
+    for (uint32_t i = 0; operands[i]; i++) {
+        if (operands[i] == 'r' && instruction->operands[i] > 2) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Emits native code of a single instruction. `refund` is the number of instructions that were not
+ * executed if the block exits before this instruction. Returns false if the instruction
+ * can not be translated, in which case nothing is emitted.
+ */
+bool x64_emit_instruction(x64_emitter_t *e, cpu_executor_t *executor, const cpu_instruction_t *instruction,
+                          uint32_t ip, uint32_t refund) {
+    starkcpu_t *cpu = executor->cpu;
+    const uint32_t *operands = instruction->operands;
+
+    if (!uses_host_registers(executor, instruction)) {
+        return false;
+    }
+
+    // Native code only checks that addresses are inside of memory, so once permissions
+    // of any page are changed all memory accesses are left to the interpreter.
+    if (cpu->pages->restricted && accesses_memory(instruction->opcode)) {
+        return false;
+    }
+
+    switch (instruction->opcode) {
+        case OP_NOP:
+            return true;
+
+        case OP_SET_REG_IMMEDIATE8:
+        case OP_SET_REG_IMMEDIATE16:
+        case OP_SET_REG_IMMEDIATE32:
+            x64_mov_ri(e, host_register(operands[0]), operands[1]);
+            return true;
+
+        case OP_SET_REG_REG:
+            x64_mov_rr(e, host_register(operands[0]), host_register(operands[1]));
+            return true;
+
+        case OP_SET_REG_ADDR:
+            if (!is_writable_range(cpu, operands[1], 1)) {
+                return false;
+            }
+
+            x64_mov_ri(e, HOST_RCX, operands[1]);
+            x64_load_guest_byte(e, host_register(operands[0]), true);
+            return true;
+
+        case OP_SET_ADDR_IMMEDIATE8:
+        case OP_SET_ADDR_IMMEDIATE16:
+        case OP_SET_ADDR_IMMEDIATE32: {
+            uint32_t width = instruction->opcode == OP_SET_ADDR_IMMEDIATE8 ? 1 : instruction->opcode == OP_SET_ADDR_IMMEDIATE16 ? 2 : 4;
+            if (!is_writable_range(cpu, operands[0], width)) {
+                return false;
+            }
+
+            x64_mov_ri(e, HOST_RCX, operands[0]);
+            x64_check_writable(e, cpu, width, ip, refund);
+            x64_store_guest_imm(e, width, operands[1]);
+            return true;
+        }
+
+        case OP_SET_ADDR_ADDR:
+            // reads from the internal memory are left to the interpreter, which brings it up to date first
+            if (!is_writable_range(cpu, operands[0], 1) || operands[1] < CPU_RESERVED_MEMORY_SIZE || operands[1] >= cpu->memsize
+                || cpu_bus_overlaps(cpu, operands[1], 1)) {
+                return false;
+            }
+
+            x64_mov_ri(e, HOST_RCX, operands[0]);
+            x64_check_writable(e, cpu, 1, ip, refund);
+            x64_mov_ri(e, HOST_RCX, operands[1]);
+            x64_load_guest_byte(e, HOST_RAX, false);
+            x64_mov_ri(e, HOST_RCX, operands[0]);
+            x64_store_guest_al(e);
+            return true;
+
+        case OP_SET_ADDR_REG:
+            if (!is_writable_range(cpu, operands[0], 4)) {
+                return false;
+            }
+
+            x64_mov_ri(e, HOST_RCX, operands[0]);
+            x64_check_writable(e, cpu, 4, ip, refund);
+            x64_store_guest_r32(e, host_register(operands[1]));
+            return true;
+
+        case OP_SET_RADDR_RADDR:
+            x64_mov_rr(e, HOST_RCX, host_register(operands[0]));
+            x64_check_device(e, cpu, ip, refund);
+            x64_check_writable(e, cpu, 1, ip, refund);
+
+            // source address has to be readable and outside of the internal memory
+            x64_mov_rr(e, HOST_RCX, host_register(operands[1]));
+            x64_alu_ri(e, X64_EXT_CMP, HOST_RCX, cpu->memsize);
+            x64_exit_on(e, x64_jcc(e, X64_CC_AE), ip, refund);
+            x64_alu_ri(e, X64_EXT_CMP, HOST_RCX, CPU_RESERVED_MEMORY_SIZE);
+            x64_exit_on(e, x64_jcc(e, X64_CC_B), ip, refund);
+            x64_check_device(e, cpu, ip, refund);
+            x64_load_guest_byte(e, HOST_RAX, false);
+
+            x64_mov_rr(e, HOST_RCX, host_register(operands[0]));
+            x64_store_guest_al(e);
+            return true;
+
+        case OP_SET_RADDR_IMMEDIATE8:
+            x64_mov_rr(e, HOST_RCX, host_register(operands[0]));
+            x64_check_device(e, cpu, ip, refund);
+            x64_check_writable(e, cpu, 1, ip, refund);
+            x64_store_guest_imm(e, 1, operands[1]);
+            return true;
+
+        case OP_INCREMENT:
+            x64_alu_ri(e, X64_EXT_ADD, host_register(operands[0]), 1);
+            return true;
+
+        case OP_DECREMENT:
+            x64_alu_ri(e, X64_EXT_SUB, host_register(operands[0]), 1);
+            return true;
+
+        case OP_CMP_REG_IMMEDIATE:
+            x64_alu_ri(e, X64_EXT_CMP, host_register(operands[0]), operands[1]);
+            // sete al; movzx r11d, al
+            x64_byte(e, 0x0F);
+            x64_byte(e, 0x90 | X64_CC_E);
+            x64_byte(e, 0xC0);
+            x64_rex(e, false, HOST_FLAG, 0, HOST_RAX);
+            x64_byte(e, 0x0F);
+            x64_byte(e, 0xB6);
+            x64_modrm(e, 3, HOST_FLAG, HOST_RAX);
+            return true;
+
+        case OP_ADD_REG_REG:
+        case OP_SUB_REG_REG:
+            x64_mov_rr(e, HOST_RAX, host_register(operands[0]));
+            x64_alu_rr(e, instruction->opcode == OP_ADD_REG_REG ? X64_ADD : X64_SUB, HOST_RAX, host_register(operands[1]));
+            x64_mov_rr(e, host_register(operands[2]), HOST_RAX);
+            return true;
+
+        case OP_ADD_REG_IMM32:
+        case OP_SUB_REG_IMM32:
+            x64_mov_rr(e, HOST_RAX, host_register(operands[0]));
+            x64_alu_ri(e, instruction->opcode == OP_ADD_REG_IMM32 ? X64_EXT_ADD : X64_EXT_SUB, HOST_RAX, operands[1]);
+            x64_mov_rr(e, host_register(operands[2]), HOST_RAX);
+            return true;
+
+        case OP_SUB_IMM32_REG:
+            x64_mov_ri(e, HOST_RAX, operands[1]);
+            x64_alu_rr(e, X64_SUB, HOST_RAX, host_register(operands[0]));
+            x64_mov_rr(e, host_register(operands[2]), HOST_RAX);
+            return true;
+
+        case OP_MUL_REG_REG:
+            x64_mov_rr(e, HOST_RAX, host_register(operands[0]));
+            x64_imul_rr(e, HOST_RAX, host_register(operands[1]));
+            x64_mov_rr(e, host_register(operands[2]), HOST_RAX);
+            return true;
+
+        case OP_MUL_REG_IMM32:
+            x64_mov_ri(e, HOST_RAX, operands[1]);
+            x64_imul_rr(e, HOST_RAX, host_register(operands[0]));
+            x64_mov_rr(e, host_register(operands[2]), HOST_RAX);
+            return true;
+
+        case OP_DIV_REG_REG:
+        case OP_DIV_IMM32_REG: {
+            // division by zero is reported by the interpreter
+            uint8_t denominator = host_register(instruction->opcode == OP_DIV_REG_REG ? operands[1] : operands[0]);
+            x64_alu_rr(e, X64_TEST, denominator, denominator);
+            x64_exit_on(e, x64_jcc(e, X64_CC_E), ip, refund);
+
+            if (instruction->opcode == OP_DIV_REG_REG) {
+                x64_mov_rr(e, HOST_RAX, host_register(operands[0]));
+            } else {
+                x64_mov_ri(e, HOST_RAX, operands[1]);
+            }
+
+            x64_mov_ri(e, HOST_RDX, 0);
+            x64_div_r(e, denominator);
+            x64_mov_rr(e, host_register(operands[2]), HOST_RAX);
+            return true;
+        }
+
+        case OP_DIV_REG_IMM32:
+            if (operands[1] == 0) {
+                return false;
+            }
+
+            x64_mov_rr(e, HOST_RAX, host_register(operands[0]));
+            x64_mov_ri(e, HOST_RCX, operands[1]);
+            x64_mov_ri(e, HOST_RDX, 0);
+            x64_div_r(e, HOST_RCX);
+            x64_mov_rr(e, host_register(operands[2]), HOST_RAX);
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/* Returns the address that given jump instruction always leads to, or 0 if it can not be translated. */
+uint32_t get_static_jump_target(starkcpu_t *cpu, const cpu_instruction_t *instruction, uint32_t next_ip) {
+    uint32_t target;
+    switch (instruction->opcode) {
+        case OP_JMP_ABSOLUTE:
+        case OP_JMP_IF_NOT_EQUAL:
+            target = instruction->operands[0];
+            break;
+
+        case OP_JMP_RELATIVE:
+            target = next_ip + instruction->operands[0];
+            break;
+
+        default:
+            return 0;
+    }
+
+    return is_jmpable(cpu, target) ? target : 0;
+}
+
+cpu_jit_code_t cpu_jit_compile_block(cpu_jit_t *jit, uint32_t start, uint32_t *end) {
+    cpu_executor_t *executor = jit->executor;
+    starkcpu_t *cpu = executor->cpu;
+
+    // Every pass through the block is charged for all of its instructions up front, so collect
+    // the instructions that can be translated first. Each one is emitted into a scratch buffer to find out.
+    uint8_t scratch_code[256];
+    x64_emitter_t scratch;
+    scratch.code = scratch_code;
+
+    // Instructions are decoded again instead of being taken from the cache, where they might be fused.
+    cpu_instruction_t instructions[CPU_JIT_MAX_BLOCK_LENGTH];
+    uint32_t count = 0;
+    uint32_t ip = start;
+    bool terminated = false;
+
+    while (count < CPU_JIT_MAX_BLOCK_LENGTH && ip < cpu->memsize) {
+        cpu_instruction_t *instruction = instructions + count;
+        if (!cpu_decode_instruction(executor, ip, instruction, false)) {
+            break;
+        }
+
+        // instructions that the debugger traps are left to the interpreter
+        if (cpu->debugger && cpu_debugger_traps(cpu->debugger, ip, instruction->opcode)) {
+            break;
+        }
+
+        if (cpu_jit_is_block_terminator(instruction->opcode)) {
+            if (get_static_jump_target(cpu, instruction, ip + instruction->length)) {
+                count++;
+                ip += instruction->length;
+                terminated = true;
+            }
+
+            break;
+        }
+
+        scratch.size = 0;
+        scratch.exits_count = 0;
+        if (!x64_emit_instruction(&scratch, executor, instruction, ip, 0)) {
+            break;
+        }
+
+        count++;
+        ip += instruction->length;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    x64_emitter_t e;
+    e.code = jit->code_buffer + jit->code_buffer_used;
+    e.size = 0;
+    e.exits_count = 0;
+
+    for (uint8_t index = 0; index < 3; index++) {
+        x64_load_frame(&e, false, host_register(index), offsetof(cpu_jit_frame_t, registers) + index * 4);
+    }
+
+    x64_load_frame(&e, false, HOST_FLAG, offsetof(cpu_jit_frame_t, flag_equal));
+    x64_load_frame(&e, true, HOST_RSI, offsetof(cpu_jit_frame_t, mem));
+
+    // leave if there are not enough instructions left in the budget for another pass
+    uint32_t loop_start = e.size;
+    x64_alu_frame_imm(&e, X64_EXT_CMP, offsetof(cpu_jit_frame_t, budget), count);
+    x64_exit_on(&e, x64_jcc(&e, X64_CC_B), start, 0);
+    x64_alu_frame_imm(&e, X64_EXT_SUB, offsetof(cpu_jit_frame_t, budget), count);
+
+    ip = start;
+    for (uint32_t i = 0; i < count; i++) {
+        cpu_instruction_t *instruction = instructions + i;
+        uint32_t next_ip = ip + instruction->length;
+
+        if (cpu_jit_is_block_terminator(instruction->opcode)) {
+            uint32_t target = get_static_jump_target(cpu, instruction, next_ip);
+
+            if (instruction->opcode == OP_JMP_IF_NOT_EQUAL) {
+                x64_alu_rr(&e, X64_TEST, HOST_FLAG, HOST_FLAG);
+                x64_exit_on(&e, x64_jcc(&e, X64_CC_NE), next_ip, 0);
+            }
+
+            // jumping back to the start of the block doesn't need to leave native code
+            if (target == start) {
+                x64_patch(&e, x64_jmp(&e), loop_start);
+            } else {
+                x64_exit_on(&e, x64_jmp(&e), target, 0);
+            }
+        } else {
+            x64_emit_instruction(&e, executor, instruction, ip, count - i);
+        }
+
+        ip = next_ip;
+    }
+
+    if (!terminated) {
+        x64_exit_on(&e, x64_jmp(&e), ip, 0);
+    }
+
+    x64_emit_exits(&e);
+
+    *end = ip;
+    cpu_jit_code_t code = (cpu_jit_code_t) e.code;
+    jit->code_buffer_used += (e.size + 15) & ~15u;
+    return code;
+}
+
+uint8_t *cpu_jit_allocate_code_buffer() {
+    void *buffer = mmap(0, CPU_JIT_CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return buffer == MAP_FAILED ? 0 : buffer;
+}
+
+void cpu_jit_free_code_buffer(uint8_t *buffer) {
+    munmap(buffer, CPU_JIT_CODE_BUFFER_SIZE);
+}
+
+bool cpu_jit_is_supported() {
+    return true;
+}
+#else
+cpu_jit_code_t cpu_jit_compile_block(cpu_jit_t *jit, uint32_t start, uint32_t *end) {
+    return 0;
+}
+
+uint8_t *cpu_jit_allocate_code_buffer() {
+    return 0;
+}
+
+void cpu_jit_free_code_buffer(uint8_t *buffer) {
+}
+
+bool cpu_jit_is_supported() {
+    return false;
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,249 @@
+#include "jit.h"
+#include "../memory.h"
+#include "../../shared/stark1-opcodes.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Upper bound of native code generated for a single block, checked before a block is compiled. A copy of a byte between
+ * addresses in registers takes the most while devices are mapped, about 180 bytes plus seven exits of about 50 bytes each.
+ */
+#define CPU_JIT_MAX_BLOCK_CODE_SIZE (CPU_JIT_MAX_BLOCK_LENGTH * 768)
+
+cpu_jit_t *cpu_jit_create(cpu_executor_t *executor) {
+    cpu_jit_t *jit = malloc(sizeof(cpu_jit_t));
+    if (!jit) {
+        return 0;
+    }
+
+    jit->executor = executor;
+    jit->blocks_capacity = CPU_JIT_INITIAL_BLOCKS_CAPACITY;
+    jit->blocks_count = 0;
+    jit->blocks = calloc(jit->blocks_capacity, sizeof(cpu_jit_block_t));
+    jit->code_pages = calloc(executor->cpu->memsize >> CPU_PAGE_SHIFT, sizeof(uint32_t));
+
+    if (!jit->blocks || !jit->code_pages) {
+        free(jit->blocks);
+        free(jit->code_pages);
+        free(jit);
+        return 0;
+    }
+
+    jit->code_buffer = cpu_jit_allocate_code_buffer();
+    jit->code_buffer_used = 0;
+    return jit;
+}
+
+void cpu_jit_destroy(cpu_jit_t *jit) {
+    if (jit->code_buffer) {
+        cpu_jit_free_code_buffer(jit->code_buffer);
+    }
+
+    free(jit->blocks);
+    free(jit->code_pages);
+    free(jit);
+}
+
+uint32_t cpu_jit_hash(uint32_t address) {
+    return address * 2654435761u;
+}
+
+cpu_jit_block_t *cpu_jit_insert_block(cpu_jit_block_t *blocks, uint32_t capacity, uint32_t address) {
+    uint32_t index = cpu_jit_hash(address) & (capacity - 1);
+    while (blocks[index].used && blocks[index].start != address) {
+        index = (index + 1) & (capacity - 1);
+    }
+
+    return blocks + index;
+}
+
+void cpu_jit_grow_blocks(cpu_jit_t *jit) {
+    uint32_t capacity = jit->blocks_capacity * 2;
+    cpu_jit_block_t *blocks = calloc(capacity, sizeof(cpu_jit_block_t));
+
+    for (uint32_t i = 0; i < jit->blocks_capacity; i++) {
+        if (jit->blocks[i].used) {
+            *cpu_jit_insert_block(blocks, capacity, jit->blocks[i].start) = jit->blocks[i];
+        }
+    }
+
+    free(jit->blocks);
+    jit->blocks = blocks;
+    jit->blocks_capacity = capacity;
+}
+
+cpu_jit_block_t *cpu_jit_find_block(cpu_jit_t *jit, uint32_t address) {
+    if ((jit->blocks_count + 1) * 4 > jit->blocks_capacity * 3) {
+        cpu_jit_grow_blocks(jit);
+    }
+
+    cpu_jit_block_t *block = cpu_jit_insert_block(jit->blocks, jit->blocks_capacity, address);
+    if (!block->used) {
+        block->used = true;
+        block->start = address;
+        block->end = address;
+        block->hits = 0;
+        block->uncompilable = false;
+        block->code = 0;
+        jit->blocks_count++;
+    }
+
+    return block;
+}
+
+bool cpu_jit_is_block_terminator(uint8_t opcode) {
+    switch (opcode) {
+        case OP_JMP_RELATIVE:
+        case OP_JMP_ABSOLUTE:
+        case OP_JMP_REG:
+        case OP_JMP_IF_NOT_EQUAL:
+        case OP_FUSED_CMP_JNE:
+        case OP_FUSED_DEC_CMP_JNE:
+        case OP_FUSED_INC_CMP_JNE:
+        case OP_INTERRUPT_RETURN:
+        case OP_HALT:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+uint32_t cpu_jit_run_block(cpu_jit_t *jit, cpu_jit_block_t *block, uint32_t budget) {
+    cpu_executor_t *executor = jit->executor;
+    starkcpu_t *cpu = executor->cpu;
+
+    cpu_jit_frame_t frame;
+    frame.registers[0] = cpu->registers[0];
+    frame.registers[1] = cpu->registers[1];
+    frame.registers[2] = cpu->registers[2];
+    frame.flag_equal = cpu->flag_equal;
+    frame.ip = cpu->ip;
+    frame.budget = budget;
+    frame.code_start = executor->code_start;
+    frame.code_size = executor->code_end > executor->code_start ? executor->code_end - executor->code_start : 0;
+    frame.mem = cpu->mem;
+    frame.dirty_pages = cpu->dirty_pages;
+    frame.io_pages = cpu->io_pages;
+
+    block->code(&frame);
+
+    cpu->registers[0] = frame.registers[0];
+    cpu->registers[1] = frame.registers[1];
+    cpu->registers[2] = frame.registers[2];
+    cpu->flag_equal = frame.flag_equal;
+    cpu->ip = frame.ip;
+
+    return budget - frame.budget;
+}
+
+void cpu_jit_compile(cpu_jit_t *jit, uint32_t address) {
+    if (CPU_JIT_CODE_BUFFER_SIZE - jit->code_buffer_used < CPU_JIT_MAX_BLOCK_CODE_SIZE) {
+        cpu_jit_flush(jit);
+    }
+
+    cpu_jit_block_t *block = cpu_jit_find_block(jit, address);
+    block->code = cpu_jit_compile_block(jit, address, &block->end);
+
+    if (!block->code) {
+        block->uncompilable = true;
+        return;
+    }
+
+    for (uint32_t page = block->start >> CPU_PAGE_SHIFT; page <= (block->end - 1) >> CPU_PAGE_SHIFT; page++) {
+        jit->code_pages[page]++;
+    }
+}
+
+uint32_t cpu_execute_jit(cpu_executor_t *executor, uint32_t count) {
+    starkcpu_t *cpu = executor->cpu;
+    uint32_t executed = 0;
+
+    if (!executor->jit) {
+        executor->jit = cpu_jit_create(executor);
+    }
+
+    // without any memory for the blocks, the code is only interpreted
+    if (!executor->jit) {
+        return cpu_execute_instructions(executor, count);
+    }
+
+    cpu_jit_t *jit = executor->jit;
+
+    while (executed < count && cpu->running && cpu->ip < cpu->memsize) {
+        cpu_jit_block_t *block = cpu_jit_find_block(jit, cpu->ip);
+
+        if (!block->code && !block->uncompilable && jit->code_buffer && ++block->hits >= CPU_JIT_THRESHOLD) {
+            cpu_jit_compile(jit, cpu->ip);
+            block = cpu_jit_find_block(jit, cpu->ip);
+        }
+
+        if (block->code) {
+            uint32_t block_executed = cpu_jit_run_block(jit, block, count - executed);
+            executed += block_executed;
+
+            // Block exits without executing anything if it needs more instructions than
+            // the budget allows, or if its first instruction has to be left to the interpreter.
+            if (block_executed > 0) {
+                continue;
+            }
+        }
+
+        cpu_instruction_t *instruction;
+        do {
+            instruction = cpu_fetch_instruction(executor, count - executed);
+            instruction->handler(cpu, instruction);
+            executed += instruction->count;
+        } while (!cpu_jit_is_block_terminator(instruction->opcode) && executed < count && cpu->running && cpu->ip < cpu->memsize);
+    }
+
+    return executed;
+}
+
+/* Checks whether any translated block covers a page of given range. */
+bool has_translated_code(cpu_jit_t *jit, uint32_t address, uint64_t end) {
+    uint32_t pages_count = jit->executor->cpu->memsize >> CPU_PAGE_SHIFT;
+    uint64_t last = (end - 1) >> CPU_PAGE_SHIFT;
+
+    for (uint64_t page = address >> CPU_PAGE_SHIFT; page <= last && page < pages_count; page++) {
+        if (jit->code_pages[page]) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void cpu_jit_invalidate(cpu_jit_t *jit, uint32_t address, uint32_t size) {
+    uint64_t end = (uint64_t) address + size;
+
+    // stores into data between the code only cost a look at their page
+    if (size == 0 || !has_translated_code(jit, address, end)) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < jit->blocks_capacity; i++) {
+        cpu_jit_block_t *block = jit->blocks + i;
+        if (block->used && address < block->end && end > block->start) {
+            for (uint32_t page = block->start >> CPU_PAGE_SHIFT; page <= (block->end - 1) >> CPU_PAGE_SHIFT; page++) {
+                jit->code_pages[page]--;
+            }
+
+            // the block covers nothing until it is translated again
+            block->end = block->start;
+            block->code = 0;
+            block->hits = 0;
+            block->uncompilable = false;
+        }
+    }
+}
+
+void cpu_jit_flush(cpu_jit_t *jit) {
+    for (uint32_t i = 0; i < jit->blocks_capacity; i++) {
+        jit->blocks[i].used = false;
+    }
+
+    memset(jit->code_pages, 0, (jit->executor->cpu->memsize >> CPU_PAGE_SHIFT) * sizeof(uint32_t));
+    jit->blocks_count = 0;
+    jit->code_buffer_used = 0;
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "../cpu-executor.h"
+
+/* Number of times a basic block has to be entered before it is translated into native code. */
+#define CPU_JIT_THRESHOLD 16
+
+/* Maximum number of instructions translated into a single block. */
+#define CPU_JIT_MAX_BLOCK_LENGTH 64
+
+#define CPU_JIT_CODE_BUFFER_SIZE (16 * 1024 * 1024)
+#define CPU_JIT_INITIAL_BLOCKS_CAPACITY 1024
+
+/*
+ * State shared between the executor and translated code. Registers are copied in before
+ * a block is entered and copied back after it returns, while the block itself keeps them
+ * in host registers.
+ */
+typedef struct {
+    int32_t registers[3];
+    uint32_t flag_equal;
+
+    // Address of the next instruction to execute, set by the block before it returns.
+    uint32_t ip;
+
+    // Number of instructions that the block can still execute. Decremented by the block.
+    uint32_t budget;
+
+    // Range of addresses holding decoded instructions. Writes into it are left to the interpreter.
+    uint32_t code_start;
+    uint32_t code_size;
+
+    char *mem;
+
+    // Pages written to are marked here if they are tracked, see cpu_memory_track_dirty_pages.
+    uint8_t *dirty_pages;
+
+    // Accesses to pages of devices are left to the interpreter, see bus.h.
+    uint8_t *io_pages;
+} cpu_jit_frame_t;
+
+typedef void (*cpu_jit_code_t)(cpu_jit_frame_t *frame);
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+    uint32_t hits;
+    bool used;
+    bool uncompilable;
+    cpu_jit_code_t code;
+} cpu_jit_block_t;
+
+typedef struct cpu_jit_t {
+    cpu_executor_t *executor;
+
+    // Open-addressing hash table of basic blocks, keyed by their start address.
+    cpu_jit_block_t *blocks;
+    uint32_t blocks_capacity;
+    uint32_t blocks_count;
+
+    uint8_t *code_buffer;
+    uint32_t code_buffer_used;
+
+    // Number of translated blocks that cover every page of memory, so that writes into pages without any skip the blocks.
+    uint32_t *code_pages;
+} cpu_jit_t;
+
+/* Creates a JIT for given executor. Returns 0 if the host is out of memory. */
+cpu_jit_t *cpu_jit_create(cpu_executor_t *executor);
+void cpu_jit_destroy(cpu_jit_t *jit);
+
+/* Checks whether native code can be generated on this host. If it can not, JIT core only interprets the code. */
+bool cpu_jit_is_supported();
+
+/*
+ * Executes up to `count` instructions. Basic blocks are interpreted until they are entered
+ * CPU_JIT_THRESHOLD times, then they get translated and executed natively.
+ */
+uint32_t cpu_execute_jit(cpu_executor_t *executor, uint32_t count);
+
+/* Checks whether given opcode ends a basic block. */
+bool cpu_jit_is_block_terminator(uint8_t opcode);
+
+/* Drops every translated block that overlaps `size` bytes at given address. */
+void cpu_jit_invalidate(cpu_jit_t *jit, uint32_t address, uint32_t size);
+
+/* Drops all translated blocks and releases the space they used in the code buffer. */
+void cpu_jit_flush(cpu_jit_t *jit);
+
+/*
+ * Translates a basic block starting at given address into native code, written into the code buffer.
+ * Returns 0 if not even the first instruction of the block could be translated.
+ * Implemented by the host-specific backend.
+ */
+cpu_jit_code_t cpu_jit_compile_block(cpu_jit_t *jit, uint32_t start, uint32_t *end);
+
+uint8_t *cpu_jit_allocate_code_buffer();
+void cpu_jit_free_code_buffer(uint8_t *buffer);
\ No newline at end of file
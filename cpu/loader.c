@@ -0,0 +1,253 @@
+#include "loader.h"
+#include "memory.h"
+#include "../shared/stark1-executable.h"
+#include "../shared/stark1-opcodes.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+bool read_file_at(FILE *file, uint64_t offset, void *destination, uint32_t size) {
+    return fseek(file, (long) offset, SEEK_SET) == 0 && fread(destination, 1, size, file) == size;
+}
+
+bool is_memory_section(const stark1_section_header_t *section) {
+    return section->type != STARK1_SECTION_SOURCE_MAP;
+}
+
+cpu_load_status_t validate_section(starkcpu_t *cpu, const stark1_section_header_t *section, uint64_t file_size) {
+    if (section->type < STARK1_SECTION_CODE || section->type > STARK1_SECTION_SOURCE_MAP) {
+        return CPU_LOAD_INVALID_SECTION;
+    }
+
+    if ((uint64_t) section->offset + section->file_size > file_size) {
+        return CPU_LOAD_INVALID_SECTION;
+    }
+
+    if (!is_memory_section(section)) {
+        return CPU_LOAD_OK;
+    }
+
+    // same rules as for cpu_memory_protect
+    if ((section->flags & ~CPU_PAGE_ALL) || (section->flags != 0 && !(section->flags & CPU_PAGE_READ))) {
+        return CPU_LOAD_INVALID_SECTION;
+    }
+
+    if (section->size == 0 || section->file_size > section->size) {
+        return CPU_LOAD_INVALID_SECTION;
+    }
+
+    if (section->type == STARK1_SECTION_BSS && section->file_size != 0) {
+        return CPU_LOAD_INVALID_SECTION;
+    }
+
+    if (section->address < CPU_RESERVED_MEMORY_SIZE) {
+        return CPU_LOAD_INVALID_SECTION;
+    }
+
+    if ((uint64_t) section->address + section->size > cpu->memsize) {
+        return CPU_LOAD_DOES_NOT_FIT;
+    }
+
+    return CPU_LOAD_OK;
+}
+
+bool sections_overlap(const stark1_section_header_t *a, const stark1_section_header_t *b) {
+    return a->address < (uint64_t) b->address + b->size && b->address < (uint64_t) a->address + a->size;
+}
+
+bool load_section(starkcpu_t *cpu, FILE *file, const stark1_section_header_t *section) {
+    uint32_t address = section->address;
+    uint64_t offset = section->offset;
+    uint32_t size = section->file_size;
+
+    if (size == 0) {
+        return true;
+    }
+
+    // Whole pages that start at the same position within a page both in the file and in memory can be mapped.
+    // Anything before and after them is copied, so that nothing past the end of section contents is mapped.
+    if ((address - offset) % CPU_PAGE_SIZE == 0) {
+        uint32_t head = (CPU_PAGE_SIZE - address % CPU_PAGE_SIZE) % CPU_PAGE_SIZE;
+        uint32_t mapped = size > head ? (size - head) & ~(CPU_PAGE_SIZE - 1) : 0;
+
+        if (mapped > 0 && cpu_memory_map_file(cpu, address + head, mapped, fileno(file), offset + head)) {
+            uint32_t tail = size - head - mapped;
+            return read_file_at(file, offset, cpu->mem + address, head)
+                && read_file_at(file, offset + head + mapped, cpu->mem + address + head + mapped, tail);
+        }
+    }
+
+    return read_file_at(file, offset, cpu->mem + address, size);
+}
+
+uint8_t get_page_permissions(const stark1_section_header_t *sections, uint16_t count, uint32_t page) {
+    uint64_t start = (uint64_t) page << CPU_PAGE_SHIFT;
+    uint8_t permissions = 0;
+
+    for (uint16_t i = 0; i < count; i++) {
+        const stark1_section_header_t *section = sections + i;
+        if (is_memory_section(section) && section->address < start + CPU_PAGE_SIZE && start < (uint64_t) section->address + section->size) {
+            permissions |= section->flags;
+        }
+    }
+
+    return permissions;
+}
+
+/*
+ * Pages at both ends of a section can be shared with other sections, or with memory that is not a part of any section.
+ * They get permissions of all the sections they are a part of, so that none of them loses access to its own memory.
+ */
+void protect_section(starkcpu_t *cpu, const stark1_section_header_t *sections, uint16_t count, const stark1_section_header_t *section) {
+    uint32_t first = section->address >> CPU_PAGE_SHIFT;
+    uint32_t last = (section->address + section->size - 1) >> CPU_PAGE_SHIFT;
+
+    cpu_memory_protect(cpu, first << CPU_PAGE_SHIFT, CPU_PAGE_SIZE, get_page_permissions(sections, count, first));
+
+    if (last > first) {
+        cpu_memory_protect(cpu, last << CPU_PAGE_SHIFT, CPU_PAGE_SIZE, get_page_permissions(sections, count, last));
+    }
+
+    if (last > first + 1) {
+        cpu_memory_protect(cpu, (first + 1) << CPU_PAGE_SHIFT, (last - first - 1) << CPU_PAGE_SHIFT, section->flags);
+    }
+}
+
+cpu_load_status_t load_executable(starkcpu_t *cpu, FILE *file, uint64_t file_size, const stark1_executable_header_t *header, cpu_program_t *program) {
+    if (header->version != STARK1_EXECUTABLE_VERSION || header->sections_count > STARK1_EXECUTABLE_MAX_SECTIONS) {
+        return CPU_LOAD_INVALID_HEADER;
+    }
+
+    if (header->model != CPU_MODEL) {
+        return CPU_LOAD_UNSUPPORTED_MODEL;
+    }
+
+    stark1_section_header_t sections[STARK1_EXECUTABLE_MAX_SECTIONS];
+    uint16_t count = header->sections_count;
+
+    if (!read_file_at(file, sizeof(stark1_executable_header_t), sections, count * sizeof(stark1_section_header_t))) {
+        return CPU_LOAD_INVALID_HEADER;
+    }
+
+    bool entry_point_executable = false;
+
+    for (uint16_t i = 0; i < count; i++) {
+        cpu_load_status_t status = validate_section(cpu, sections + i, file_size);
+        if (status != CPU_LOAD_OK) {
+            return status;
+        }
+
+        if (!is_memory_section(sections + i)) {
+            continue;
+        }
+
+        for (uint16_t j = 0; j < i; j++) {
+            if (is_memory_section(sections + j) && sections_overlap(sections + i, sections + j)) {
+                return CPU_LOAD_INVALID_SECTION;
+            }
+        }
+
+        if ((sections[i].flags & CPU_PAGE_EXECUTE)
+            && header->entry_point >= sections[i].address
+            && header->entry_point - sections[i].address < sections[i].size) {
+            entry_point_executable = true;
+        }
+    }
+
+    if (!entry_point_executable) {
+        return CPU_LOAD_INVALID_HEADER;
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        const stark1_section_header_t *section = sections + i;
+
+        if (is_memory_section(section)) {
+            if (!load_section(cpu, file, section)) {
+                return CPU_LOAD_INVALID_SECTION;
+            }
+        } else if (!program->source_map) {
+            program->source_map = malloc(section->file_size + 1);
+            program->source_map_size = section->file_size;
+            program->source_map[section->file_size] = '\0';
+
+            if (!read_file_at(file, section->offset, program->source_map, section->file_size)) {
+                return CPU_LOAD_INVALID_SECTION;
+            }
+        }
+    }
+
+    // permissions are applied last, so that contents of read-only sections can still be written above
+    for (uint16_t i = 0; i < count; i++) {
+        if (is_memory_section(sections + i) && sections[i].flags != CPU_PAGE_ALL) {
+            protect_section(cpu, sections, count, sections + i);
+        }
+    }
+
+    program->entry_point = header->entry_point;
+    return CPU_LOAD_OK;
+}
+
+cpu_load_status_t load_raw_image(starkcpu_t *cpu, FILE *file, uint64_t file_size) {
+    char *data = file_size <= cpu->memsize ? cpu_mem_alloc_at(cpu, CPU_IMAGE_LOAD_ADDRESS, file_size) : 0;
+    if (!data) {
+        return CPU_LOAD_DOES_NOT_FIT;
+    }
+
+    return read_file_at(file, 0, data, file_size) ? CPU_LOAD_OK : CPU_LOAD_CANNOT_OPEN;
+}
+
+cpu_load_status_t cpu_load_program(starkcpu_t *cpu, const char *path, cpu_program_t *program) {
+    program->entry_point = CPU_IMAGE_LOAD_ADDRESS;
+    program->source_map = 0;
+    program->source_map_size = 0;
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return CPU_LOAD_CANNOT_OPEN;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+
+    stark1_executable_header_t header;
+    cpu_load_status_t status;
+
+    if (size >= (long) sizeof(header) && read_file_at(file, 0, &header, sizeof(header)) && header.magic == STARK1_EXECUTABLE_MAGIC) {
+        status = load_executable(cpu, file, size, &header, program);
+    } else {
+        status = load_raw_image(cpu, file, size);
+    }
+
+    fclose(file);
+
+    if (status != CPU_LOAD_OK) {
+        free(program->source_map);
+        program->source_map = 0;
+        program->source_map_size = 0;
+    }
+
+    return status;
+}
+
+bool cpu_is_executable_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+
+    uint32_t magic = 0;
+    bool executable = fread(&magic, 1, sizeof(magic), file) == sizeof(magic) && magic == STARK1_EXECUTABLE_MAGIC;
+    fclose(file);
+    return executable;
+}
+
+const char *cpu_load_status_to_string(cpu_load_status_t status) {
+    switch (status) {
+        case CPU_LOAD_OK: return "ok";
+        case CPU_LOAD_CANNOT_OPEN: return "file can not be read";
+        case CPU_LOAD_INVALID_HEADER: return "header of the executable is not valid";
+        case CPU_LOAD_UNSUPPORTED_MODEL: return "executable targets a different CPU model";
+        case CPU_LOAD_INVALID_SECTION: return "a section of the executable is not valid";
+        case CPU_LOAD_DOES_NOT_FIT: return "program does not fit in memory";
+        default: return "unknown error";
+    }
+}
\ No newline at end of file
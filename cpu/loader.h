@@ -0,0 +1,35 @@
+#pragma once
+
+#include "cpu.h"
+
+typedef enum {
+    CPU_LOAD_OK,
+    CPU_LOAD_CANNOT_OPEN,
+    CPU_LOAD_INVALID_HEADER,
+    CPU_LOAD_UNSUPPORTED_MODEL,
+    CPU_LOAD_INVALID_SECTION,
+    CPU_LOAD_DOES_NOT_FIT
+} cpu_load_status_t;
+
+typedef struct {
+    uint32_t entry_point;
+
+    // Source map embedded in the executable, terminated with a zero byte. Set to 0 if there is none, freed by the caller.
+    char *source_map;
+    uint32_t source_map_size;
+} cpu_program_t;
+
+/*
+ * Loads a program into memory of given CPU, which has to be freshly created or reset. The program is either an executable
+ * (see shared/stark1-executable.h), or a raw image that is loaded at CPU_IMAGE_LOAD_ADDRESS and starts at its first byte.
+ *
+ * Whole pages of executable's sections are mapped straight from the file where the host allows it, instead of being copied,
+ * so loading takes about the same time regardless of their size. Zeroes past the end of section contents and bss sections
+ * do not have to be written at all, since memory starts zeroed. Pages of sections get permissions given by their flags.
+ */
+cpu_load_status_t cpu_load_program(starkcpu_t *cpu, const char *path, cpu_program_t *program);
+
+/* Checks whether given file starts with the header of an executable. */
+bool cpu_is_executable_file(const char *path);
+
+const char *cpu_load_status_to_string(cpu_load_status_t status);
\ No newline at end of file
@@ -1,41 +1,598 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "cpu.h"
 #include "cpu-ui.h"
+#include "utils.h"
+#include "cpu-executor.h"
+#include "loader.h"
+#include "jit/jit.h"
+#include "profiler.h"
+#include "snapshot.h"
+#include "tracer.h"
+#include "debugger.h"
+#include "gpu/gpu.h"
+#include "timer/timer.h"
+#include "console/console.h"
+#include "disk/disk.h"
+#include "smp.h"
 
-void execute_binary_file(starkcpu_t *cpu, const char* path) {
-    FILE* file = fopen(path, "rb");
+void print_usage() {
+    printf("usage: emulator [options] <input file>\n");
+    printf("options:\n");
+    printf("  --core=<dispatch|threaded|jit>  execution core to use (default: dispatch)\n");
+    printf("  --memory=<size>                 size of memory, e.g. 64K or 16M (default: %d)\n", CPU_DEFAULT_MEMORY_SIZE);
+    printf("  --clock=<rate|unlimited>        number of instructions executed per second (default: %d)\n", CPU_TICK_PER_SECOND);
+    printf("  --no-ui                         run without the UI and print statistics once the program halts\n");
+    printf("  --no-fusion                     execute every instruction separately instead of fusing common sequences\n");
+    printf("  --fusion-stats                  print how many times every fused instruction was executed\n");
+    printf("  --profile                       print which opcodes and source lines took the most time once the program halts\n");
+    printf("  --profile-stacks=<file>         write time spent on every source line as collapsed stacks for flame graphs\n");
+    printf("  --trace=<file>                  record every executed instruction into a trace, and the starting state into <file>%s\n", CPU_TRACE_SNAPSHOT_SUFFIX);
+    printf("  --gpu=<width>x<height>          attach a GPU with a framebuffer of given size at 0x%x\n", CPU_GPU_ADDRESS);
+    printf("  --gpu-frames=<prefix>           write every frame presented by the GPU into <prefix>-<frame>.ppm\n");
+    printf("  --timer                         attach a programmable timer at 0x%x, which raises interrupts\n", CPU_TIMER_ADDRESS);
+    printf("  --console[=<file>]              attach a console at 0x%x, whose output goes into given file or the standard output (requires --no-ui)\n", CPU_CONSOLE_ADDRESS);
+    printf("  --disk=<file>                   attach a disk backed by given file at 0x%x, which raises interrupts\n", CPU_DISK_ADDRESS);
+    printf("  --cores=<count>                 run given number of cores that share memory, each on a thread of its own (requires --no-ui)\n");
+    printf("  --break=<address>               stop before executing the instruction at given address, can be repeated (requires --no-ui)\n");
+    printf("  --watch=<address>[:<size>]      stop after an instruction writes into given range, 4 bytes by default, can be repeated (requires --no-ui)\n");
+}
 
+bool file_exists(const char *path) {
+    FILE* file = fopen(path, "r");
     if (!file) {
-        return;
+        return false;
     }
 
-    fseek(file, 0, SEEK_END);
-    long size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    fclose(file);
+    return true;
+}
 
-    void* data = cpu_mem_alloc_at(cpu, CPU_IMAGE_LOAD_ADDRESS, size);
-    fread(data, 1, size, file);
-    uint32_t offset = cpu_mem_get_block_offset(cpu, data);
+/*
+ * Compiler puts the source file next to the binary, e.g. `test.sasm.bin` is compiled from `test.sasm`.
+ * Returns path of the source file, or 0 if it can not be found.
+ */
+char *find_source_path(const char *binary_path) {
+    size_t length = strlen(binary_path);
+    if (length < 4 || !strsimilar(binary_path + length - 4, ".bin")) {
+        return 0;
+    }
 
-    fclose(file);
+    char *source_path = malloc(length + 1);
+    memcpy(source_path, binary_path, length - 4);
+    source_path[length - 4] = '\0';
+
+    if (!file_exists(source_path)) {
+        free(source_path);
+        return 0;
+    }
+
+    return source_path;
+}
+
+/*
+ * Executables carry their source map with them, the source map of a raw image is next to its source file,
+ * e.g. `test.sasm.map`. Returns 0 if there is none.
+ */
+char *read_source_map(const char *source_path, const char *embedded_map) {
+    if (embedded_map) {
+        size_t length = strlen(embedded_map);
+        char *map = malloc(length + 1);
+        memcpy(map, embedded_map, length + 1);
+        return map;
+    }
+
+    char *map_path = malloc(strlen(source_path) + 5);
+    sprintf(map_path, "%s.map", source_path);
 
-    cpu_jmp(cpu, offset);
-    cpu_start(cpu);
+    char *map = read_file(map_path);
+    free(map_path);
+    return map;
 }
 
-int main() {
-    starkcpu_t *cpu = cpu_create(true);
+/* Saves the current state of the CPU next to the trace, so that the trace can be replayed from it, and starts tracing. */
+cpu_tracer_t *start_trace(starkcpu_t *cpu, const char *trace_path) {
+    char *snapshot_path = malloc(strlen(trace_path) + sizeof(CPU_TRACE_SNAPSHOT_SUFFIX));
+    sprintf(snapshot_path, "%s%s", trace_path, CPU_TRACE_SNAPSHOT_SUFFIX);
+
+    cpu->running = true;
+    cpu_snapshot_t *snapshot = cpu_snapshot_create(cpu);
+    bool written = snapshot && cpu_snapshot_write(snapshot, snapshot_path);
+
+    if (snapshot) {
+        cpu_snapshot_destroy(snapshot);
+    }
+
+    if (!written) {
+        printf("error: unable to write %s\n", snapshot_path);
+        free(snapshot_path);
+        return 0;
+    }
+
+    free(snapshot_path);
+
+    cpu_tracer_t *tracer = cpu_tracer_create(cpu, trace_path);
+    if (!tracer) {
+        printf("error: unable to write %s\n", trace_path);
+    }
+
+    return tracer;
+}
+
+/* Prints why the debugger stopped the CPU, the state of the CPU and the instruction that is going to be executed next. */
+void print_debugger_stop(starkcpu_t *cpu, cpu_debugger_t *debugger) {
+    if (debugger->stop == CPU_DEBUG_BREAKPOINT) {
+        printf("breakpoint at 0x%08x\n", debugger->stop_address);
+    } else if (debugger->stop == CPU_DEBUG_WATCHPOINT) {
+        const cpu_watchpoint_t *watchpoint = &debugger->watchpoint;
+        uint32_t start = debugger->write_address > watchpoint->address ? debugger->write_address : watchpoint->address;
+        uint64_t write_end = (uint64_t) debugger->write_address + debugger->write_size;
+        uint64_t end = write_end < (uint64_t) watchpoint->address + watchpoint->size ? write_end : (uint64_t) watchpoint->address + watchpoint->size;
+
+        printf("watchpoint 0x%x:%u written by instruction at 0x%08x, [0x%x] =", watchpoint->address, watchpoint->size, debugger->stop_address, start);
+
+        for (uint64_t address = start; address < end && address < start + 16; address++) {
+            printf(" %02x", (uint8_t) cpu->mem[address]);
+        }
+
+        printf(end - start > 16 ? " ...\n" : "\n");
+    }
+
+    printf("ip=0x%08x eq=%u", cpu->ip, cpu->flag_equal);
+
+    for (uint32_t i = 0; i < CPU_REGISTERS_COUNT; i++) {
+        printf(" r%u=%d", i, cpu->registers[i]);
+    }
+
+    printf("\n");
+
+    cpu_instruction_t instruction;
+    if (cpu->ip < cpu->memsize && cpu_decode_instruction(cpu->executor, cpu->ip, &instruction, false)) {
+        const char *operands = cpu_get_opcode_operands(instruction.opcode);
+        printf("next: %s", cpu_get_opcode_name(instruction.opcode));
+
+        for (uint32_t i = 0; operands[i]; i++) {
+            printf(operands[i] == 'r' ? "%sr%u" : "%s0x%x", i == 0 ? " " : ", ", instruction.operands[i]);
+        }
+
+        printf("\n");
+    }
+}
+
+/*
+ * Reports where the debugger stopped the CPU and asks what to do next. Returns true once the program should continue,
+ * false when asked to quit or when the program halts while stepping. Without any more input, stops are only reported.
+ */
+bool debug_prompt(starkcpu_t *cpu, cpu_debugger_t *debugger, bool *interactive) {
+    while (debugger->stop != CPU_DEBUG_NOT_STOPPED) {
+        print_debugger_stop(cpu, debugger);
+
+        char command[64] = "c";
+        if (*interactive) {
+            printf("(c)ontinue, (s)tep or (q)uit? ");
+            fflush(stdout);
+
+            if (!fgets(command, sizeof(command), stdin)) {
+                printf("\n");
+                *interactive = false;
+                command[0] = 'c';
+            }
+        }
+
+        if (command[0] == 'q') {
+            return false;
+        } else if (command[0] == 's') {
+            cpu_debugger_step(debugger);
+        } else {
+            cpu_debugger_resume(debugger);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+double get_seconds() {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv) {
+    const char *input_path = 0;
+    cpu_core_t core = CPU_CORE_DISPATCH;
+    uint64_t memory_size = CPU_DEFAULT_MEMORY_SIZE;
+    bool with_ui = true;
+    bool fusion = true;
+    bool fusion_stats = false;
+    bool profile = false;
+    const char *profile_stacks_path = 0;
+    const char *trace_path = 0;
+    uint32_t clock_rate = CPU_TICK_PER_SECOND;
+    uint32_t gpu_width = 0;
+    uint32_t gpu_height = 0;
+    const char *gpu_frames_prefix = 0;
+    bool with_timer = false;
+    bool with_console = false;
+    const char *console_path = 0;
+    const char *disk_path = 0;
+    uint32_t cores_count = 1;
+
+    // at most one per argument
+    uint32_t *breakpoints = malloc(argc * sizeof(uint32_t));
+    cpu_watchpoint_t *watchpoints = malloc(argc * sizeof(cpu_watchpoint_t));
+    uint32_t breakpoints_count = 0;
+    uint32_t watchpoints_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strsimilar(argv[i], "--core=dispatch")) {
+            core = CPU_CORE_DISPATCH;
+        } else if (strsimilar(argv[i], "--core=threaded")) {
+            core = CPU_CORE_THREADED;
+        } else if (strsimilar(argv[i], "--core=jit")) {
+            core = CPU_CORE_JIT;
+        } else if (strncmp(argv[i], "--memory=", 9) == 0 && parse_size(argv[i] + 9) > 0) {
+            memory_size = parse_size(argv[i] + 9);
+        } else if (strsimilar(argv[i], "--clock=unlimited")) {
+            clock_rate = 0;
+        } else if (strncmp(argv[i], "--clock=", 8) == 0 && atol(argv[i] + 8) > 0) {
+            clock_rate = atol(argv[i] + 8);
+        } else if (strsimilar(argv[i], "--no-ui")) {
+            with_ui = false;
+        } else if (strsimilar(argv[i], "--no-fusion")) {
+            fusion = false;
+        } else if (strsimilar(argv[i], "--fusion-stats")) {
+            fusion_stats = true;
+        } else if (strsimilar(argv[i], "--profile")) {
+            profile = true;
+        } else if (strncmp(argv[i], "--profile-stacks=", 17) == 0 && argv[i][17]) {
+            profile_stacks_path = argv[i] + 17;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0 && argv[i][8]) {
+            trace_path = argv[i] + 8;
+        } else if (strncmp(argv[i], "--gpu=", 6) == 0 && sscanf(argv[i] + 6, "%ux%u", &gpu_width, &gpu_height) == 2) {
+            // size is validated once the GPU is created
+        } else if (strncmp(argv[i], "--gpu-frames=", 13) == 0 && argv[i][13]) {
+            gpu_frames_prefix = argv[i] + 13;
+        } else if (strsimilar(argv[i], "--timer")) {
+            with_timer = true;
+        } else if (strsimilar(argv[i], "--console")) {
+            with_console = true;
+        } else if (strncmp(argv[i], "--console=", 10) == 0 && argv[i][10]) {
+            with_console = true;
+            console_path = argv[i] + 10;
+        } else if (strncmp(argv[i], "--disk=", 7) == 0 && argv[i][7]) {
+            disk_path = argv[i] + 7;
+        } else if (strncmp(argv[i], "--cores=", 8) == 0 && atol(argv[i] + 8) > 0 && atol(argv[i] + 8) <= CPU_SMP_MAX_CORES) {
+            cores_count = atol(argv[i] + 8);
+        } else if (strncmp(argv[i], "--break=", 8) == 0 && argv[i][8]) {
+            breakpoints[breakpoints_count++] = strtoul(argv[i] + 8, 0, 0);
+        } else if (strncmp(argv[i], "--watch=", 8) == 0 && argv[i][8]) {
+            char *end;
+            watchpoints[watchpoints_count].address = strtoul(argv[i] + 8, &end, 0);
+            watchpoints[watchpoints_count].size = *end == ':' ? parse_size(end + 1) : 4;
+            watchpoints_count++;
+        } else if (argv[i][0] != '-' && !input_path) {
+            input_path = argv[i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (!input_path) {
+        print_usage();
+        return 1;
+    }
+
+    if (trace_path && (profile || profile_stacks_path)) {
+        printf("error: --trace can not be combined with profiling\n");
+        return 1;
+    }
+
+    if (gpu_frames_prefix && !gpu_width) {
+        printf("error: --gpu-frames requires --gpu\n");
+        return 1;
+    }
+
+    // commands are executed outside of instructions, so a replay would not reproduce what they draw
+    if (gpu_width && trace_path) {
+        printf("error: --gpu can not be combined with --trace\n");
+        return 1;
+    }
+
+    // interrupts come from events in between instructions, which a replay does not reproduce either
+    if (with_timer && trace_path) {
+        printf("error: --timer can not be combined with --trace\n");
+        return 1;
+    }
+
+    // transfers write memory outside of instructions as well
+    if (disk_path && trace_path) {
+        printf("error: --disk can not be combined with --trace\n");
+        return 1;
+    }
+
+    // the trace is replayed from its snapshot without any devices attached
+    if (with_console && trace_path) {
+        printf("error: --console can not be combined with --trace\n");
+        return 1;
+    }
+
+    // the UI draws onto the standard output
+    if (with_console && !console_path && with_ui) {
+        printf("error: --console without a file requires --no-ui\n");
+        return 1;
+    }
+
+    bool debug = breakpoints_count > 0 || watchpoints_count > 0;
+    if (debug && with_ui) {
+        printf("error: --break and --watch require --no-ui\n");
+        return 1;
+    }
+
+    if (debug && (trace_path || profile || profile_stacks_path)) {
+        printf("error: --break and --watch can not be combined with profiling or tracing\n");
+        return 1;
+    }
+
+    // the UI, profiler, tracer and debugger only know about a single core
+    if (cores_count > 1 && with_ui) {
+        printf("error: --cores requires --no-ui\n");
+        return 1;
+    }
+
+    if (cores_count > 1 && (debug || trace_path || profile || profile_stacks_path)) {
+        printf("error: --cores can not be combined with profiling, tracing, --break or --watch\n");
+        return 1;
+    }
+
+    if (core == CPU_CORE_JIT && !cpu_jit_is_supported()) {
+        printf("warning: native code generation is not supported on this host, JIT core will only interpret\n");
+    }
+
+    starkcpu_t *cpu = cpu_create(with_ui, memory_size);
 
     if (!cpu) {
         printf("unable to create cpu\n");
         return 1;
     }
 
-    if (cpu->ui) {
-        cpu_ui_load_disassembly_map(cpu->ui, "/Users/adam.wychowaniec/Projects/starkcpu/examples/test.sasm.map", "/Users/adam.wychowaniec/Projects/starkcpu/examples/test.sasm");
+    cpu->core = core;
+    cpu->clock_rate = clock_rate;
+    cpu->fusion = fusion;
+
+    cpu_program_t program;
+    cpu_load_status_t status = cpu_load_program(cpu, input_path, &program);
+
+    if (status != CPU_LOAD_OK) {
+        printf("error: unable to load %s: %s\n", input_path, cpu_load_status_to_string(status));
+        return 1;
     }
 
-    execute_binary_file(cpu, "/Users/adam.wychowaniec/Projects/starkcpu/examples/test.sasm.bin");
+    cpu_jmp(cpu, program.entry_point);
 
-    return 0;
-}
+    cpu_profiler_t *profiler = 0;
+    if (profile || profile_stacks_path) {
+        profiler = cpu_profiler_create(cpu);
+    }
+
+    char *source_path = cpu->ui || profiler ? find_source_path(input_path) : 0;
+    char *source_map = source_path ? read_source_map(source_path, program.source_map) : 0;
+
+    if (source_map && cpu->ui) {
+        cpu_ui_set_disassembly_map(cpu->ui, source_map, source_path);
+    }
+
+    if (source_map && profiler) {
+        cpu_profiler_set_source(profiler, source_map, source_path);
+    }
+
+    free(source_path);
+    free(source_map);
+    free(program.source_map);
+
+    cpu_gpu_t *gpu = 0;
+    if (gpu_width) {
+        gpu = cpu_gpu_create(cpu, gpu_width, gpu_height);
+        if (!gpu) {
+            printf("error: unable to attach a %ux%u GPU, its framebuffer has to fit into memory after 0x%x\n",
+                   gpu_width, gpu_height, CPU_GPU_ADDRESS + CPU_GPU_FRAMEBUFFER_OFFSET);
+            return 1;
+        }
+
+        if (gpu_frames_prefix) {
+            cpu_gpu_set_output(gpu, gpu_frames_prefix);
+        }
+    }
+
+    cpu_timer_t *timer = 0;
+    if (with_timer) {
+        timer = cpu_timer_create(cpu);
+        if (!timer) {
+            printf("error: unable to attach a timer, its registers have to fit into memory at 0x%x\n", CPU_TIMER_ADDRESS);
+            return 1;
+        }
+    }
+
+    cpu_disk_t *disk = 0;
+    if (disk_path) {
+        disk = cpu_disk_create(cpu, disk_path);
+        if (!disk) {
+            printf("error: unable to attach a disk, %s has to be readable and writable and its registers have to fit into memory at 0x%x\n",
+                   disk_path, CPU_DISK_ADDRESS);
+            return 1;
+        }
+    }
+
+    cpu_console_t *console = 0;
+    if (with_console) {
+        console = cpu_console_create(cpu, console_path);
+        if (!console) {
+            printf("error: unable to attach a console, its registers have to fit into memory at 0x%x and %s has to be writable\n",
+                   CPU_CONSOLE_ADDRESS, console_path ? console_path : "the output");
+            return 1;
+        }
+    }
+
+    cpu_debugger_t *debugger = 0;
+    if (debug) {
+        debugger = cpu_debugger_create(cpu);
+
+        for (uint32_t i = 0; i < breakpoints_count; i++) {
+            if (!cpu_debugger_add_breakpoint(debugger, breakpoints[i])) {
+                printf("error: unable to set a breakpoint at 0x%x\n", breakpoints[i]);
+                return 1;
+            }
+        }
+
+        for (uint32_t i = 0; i < watchpoints_count; i++) {
+            if (!cpu_debugger_add_watchpoint(debugger, watchpoints[i].address, watchpoints[i].size)) {
+                printf("error: unable to watch %u bytes at 0x%x\n", watchpoints[i].size, watchpoints[i].address);
+                return 1;
+            }
+        }
+    }
+
+    free(breakpoints);
+    free(watchpoints);
+
+    // other cores are copies of this one, so they are made once the program is loaded and devices are attached
+    cpu_smp_t *smp = 0;
+    if (cores_count > 1) {
+        smp = cpu_smp_create(cpu, cores_count);
+        if (!smp) {
+            printf("error: unable to create %u cores, out of memory\n", cores_count);
+            return 1;
+        }
+    }
+
+    cpu_tracer_t *tracer = 0;
+    if (trace_path) {
+        tracer = start_trace(cpu, trace_path);
+        if (!tracer) {
+            return 1;
+        }
+    }
+
+    // a program that panics is still profiled, traced, or debugged, up to the instruction that made it panic,
+    // and whatever it printed before is not lost
+    jmp_buf panic_handler;
+    if (profiler || tracer || debugger || console) {
+        cpu->panic_handler = &panic_handler;
+    }
+
+    bool interactive = true;
+    double start = get_seconds();
+    if (smp) {
+        if (!cpu_smp_start(smp)) {
+            printf("error: unable to start a thread for each of %u cores\n", cores_count);
+            return 1;
+        }
+    } else if (!setjmp(panic_handler)) {
+        cpu_start(cpu);
+
+        while (debugger && debugger->stop != CPU_DEBUG_NOT_STOPPED && debug_prompt(cpu, debugger, &interactive)) {
+            cpu_start(cpu);
+        }
+    }
+    double elapsed = get_seconds() - start;
+
+    if ((profiler || tracer || console) && cpu->ui) {
+        // a panic skips stopping the UI in cpu_start
+        cpu_ui_stop(cpu->ui);
+        endwin();
+    }
+
+    // output of the program comes before anything the emulator prints about it
+    if (console && !cpu_console_destroy(console)) {
+        printf("error: unable to write console output to %s\n", console_path ? console_path : "the standard output");
+    }
+
+    bool panicked = false;
+    uint64_t instructions_executed = 0;
+
+    for (uint32_t i = 0; i < cores_count; i++) {
+        starkcpu_t *core = smp ? smp->cores[i].cpu : cpu;
+        instructions_executed += core->instructions_executed;
+
+        if (core->panic_message[0] && smp) {
+            printf("PANIC on core %u: %s\n", i, core->panic_message);
+        } else if (core->panic_message[0]) {
+            printf("PANIC: %s\n", core->panic_message);
+        }
+
+        panicked |= core->panic_message[0] != '\0';
+    }
+
+    if (tracer && !cpu_tracer_destroy(tracer)) {
+        printf("error: unable to write %s\n", trace_path);
+    }
+
+    if (gpu) {
+        // anything drawn since the last frame is not lost
+        if (cpu_gpu_has_changes(gpu)) {
+            cpu_gpu_present(gpu);
+        }
+
+        if (gpu->output_failed) {
+            printf("error: unable to write frames to %s-*.ppm\n", gpu_frames_prefix);
+        }
+    }
+
+    if (!cpu->ui) {
+        printf("executed %llu instructions in %.3f s (%.2f MIPS)",
+               (unsigned long long) instructions_executed,
+               elapsed,
+               elapsed > 0 ? instructions_executed / elapsed / 1e6 : 0);
+        printf(smp ? " on %u cores\n" : "\n", cores_count);
+
+        if (fusion_stats) {
+            uint64_t fusion_counts[CPU_FUSED_OPCODES_COUNT] = {0};
+
+            for (uint32_t i = 0; i < cores_count; i++) {
+                starkcpu_t *core = smp ? smp->cores[i].cpu : cpu;
+
+                for (uint32_t j = 0; j < CPU_FUSED_OPCODES_COUNT; j++) {
+                    fusion_counts[j] += core->executor->fusion_counts[j];
+                }
+            }
+
+            cpu_fusion_print_stats(fusion_counts);
+        }
+
+        if (gpu) {
+            printf("presented %llu frames, rendered %.1f%% of their pixels\n", (unsigned long long) gpu->frames,
+                   gpu->frames > 0 ? 100.0 * gpu->pixels_rendered / ((double) gpu->frames * gpu->width * gpu->height) : 0);
+        }
+
+        if (timer) {
+            printf("timer fired %u times\n", timer->fired);
+        }
+
+        if (disk) {
+            printf("disk completed %u transfers\n", disk->completed);
+        }
+    }
+
+    if (profile) {
+        printf("\n");
+        cpu_profiler_print_report(profiler, stdout);
+    }
+
+    if (profile_stacks_path && !cpu_profiler_write_stacks(profiler, profile_stacks_path)) {
+        printf("error: unable to write %s\n", profile_stacks_path);
+    }
+
+    // a write that is still in progress when the program halts reaches the file
+    if (disk) {
+        cpu_disk_destroy(disk);
+    }
+
+    if (smp) {
+        cpu_smp_destroy(smp);
+    }
+
+    return panicked ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,732 @@
+// REG_ERR is only defined by glibc headers when _GNU_SOURCE is set.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "memory.h"
+#include "cpu-executor.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Number of bytes that saved memory is copied from and to files at once. */
+#define CPU_MEMORY_FILE_CHUNK_SIZE (64 * CPU_PAGE_SIZE)
+
+bool is_zero_page(const char *page) {
+    static const char zero[CPU_PAGE_SIZE];
+    return memcmp(page, zero, CPU_PAGE_SIZE) == 0;
+}
+
+#ifdef CPU_GUARD_PAGES
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#define CPU_GUEST_ADDRESS_SPACE_SIZE (1ull << 32)
+
+/* Guard of the CPU that executes instructions on the current thread. */
+static _Thread_local cpu_memory_guard_t *active_guard;
+
+void cpu_memory_handle_fault(int signal, siginfo_t *info, void *context) {
+    cpu_memory_guard_t *guard = active_guard;
+    char *address = info->si_addr;
+
+    if (!guard || address < guard->cpu->mem || address >= guard->cpu->mem + CPU_GUEST_ADDRESS_SPACE_SIZE) {
+        // Not caused by the guest, let it crash the process as it would without the handler.
+        struct sigaction action = { 0 };
+        action.sa_handler = SIG_DFL;
+        sigaction(signal, &action, NULL);
+        return;
+    }
+
+    // Bit 1 of the page fault error code is set for writes.
+    ucontext_t *ucontext = context;
+    guard->address = address - guard->cpu->mem;
+    guard->write = (ucontext->uc_mcontext.gregs[REG_ERR] & 2) != 0;
+
+    active_guard = 0;
+    siglongjmp(guard->jump, 1);
+}
+
+char *cpu_memory_allocate(uint32_t size) {
+    static bool handler_installed = false;
+
+    if (!handler_installed) {
+        // SA_NODEFER keeps the signal unblocked after the handler jumps out of it.
+        struct sigaction action = { 0 };
+        action.sa_sigaction = cpu_memory_handle_fault;
+        action.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, NULL);
+        handler_installed = true;
+    }
+
+    char *mem = mmap(0, CPU_GUEST_ADDRESS_SPACE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) {
+        return 0;
+    }
+
+    if (mprotect(mem, size, PROT_READ | PROT_WRITE) != 0) {
+        munmap(mem, CPU_GUEST_ADDRESS_SPACE_SIZE);
+        return 0;
+    }
+
+    return mem;
+}
+
+void cpu_memory_free(char *mem, uint32_t size) {
+    munmap(mem, CPU_GUEST_ADDRESS_SPACE_SIZE);
+}
+
+void *cpu_memory_reserve(uint64_t size) {
+    void *ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return ptr == MAP_FAILED ? 0 : ptr;
+}
+
+void cpu_memory_release(void *ptr, uint64_t size) {
+    munmap(ptr, size);
+}
+
+void cpu_memory_zero(void *ptr, uint64_t size) {
+    // Pages of a private anonymous mapping read as zero again once they are dropped.
+    uint64_t page_size = CPU_PAGE_SIZE;
+    uint64_t mapped_size = (size + page_size - 1) / page_size * page_size;
+    madvise(ptr, mapped_size, MADV_DONTNEED);
+}
+
+void cpu_memory_clear(starkcpu_t *cpu) {
+    // Dropping pages of a file mapping would read them from the file again, so the memory is replaced instead.
+    mmap(cpu->mem, cpu->memsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    cpu->file_extents_count = 0;
+}
+
+/* Records that given range is about to be mapped from a file, see cpu_memory_save_contents. Returns false if the host is out of memory. */
+bool add_file_extent(starkcpu_t *cpu, uint64_t offset, uint64_t size) {
+    uint32_t *extents = realloc(cpu->file_extents, sizeof(uint32_t) * 2 * (cpu->file_extents_count + 1));
+    if (!extents) {
+        return false;
+    }
+
+    extents[cpu->file_extents_count * 2] = offset >> CPU_PAGE_SHIFT;
+    extents[cpu->file_extents_count * 2 + 1] = size >> CPU_PAGE_SHIFT;
+    cpu->file_extents = extents;
+    cpu->file_extents_count++;
+    return true;
+}
+
+bool cpu_memory_map_file(starkcpu_t *cpu, uint32_t address, uint32_t size, int fd, uint64_t offset) {
+    if (sysconf(_SC_PAGESIZE) != CPU_PAGE_SIZE || !add_file_extent(cpu, address, size)) {
+        return false;
+    }
+
+    if (mmap(cpu->mem + address, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset) == MAP_FAILED) {
+        // failed fixed mapping might have already unmapped the range
+        mmap(cpu->mem + address, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+        return false;
+    }
+
+    cpu_memory_mark_dirty(cpu, address, size);
+    return true;
+}
+
+void cpu_memory_apply_permissions(starkcpu_t *cpu, uint32_t address, uint32_t size, uint8_t permissions) {
+    int protection = PROT_NONE;
+    if (permissions & CPU_PAGE_READ) {
+        protection |= PROT_READ;
+    }
+
+    if (permissions & CPU_PAGE_WRITE) {
+        protection |= PROT_WRITE;
+    }
+
+    // The emulator itself writes the internal memory (see cpu_sync_internal_memory), so the first page
+    // always stays accessible on the host and its permissions are only checked by the handlers.
+    if (address < CPU_PAGE_SIZE) {
+        address += CPU_PAGE_SIZE;
+        size -= CPU_PAGE_SIZE;
+    }
+
+    if (size > 0) {
+        mprotect(cpu->mem + address, size, protection);
+    }
+}
+
+/* Beyond this many runs of used pages, the whole file is mapped at once to stay clear of the host's limit of mappings. */
+#define CPU_MEMORY_MAX_EXTENTS 256
+
+/* Runs of used pages separated by fewer zero pages than this are mapped as one, since every mapping has its cost. */
+#define CPU_MEMORY_EXTENT_GAP 64
+
+bool write_file_at(int fd, const char *data, uint64_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t written = pwrite(fd, data, size, offset);
+        if (written <= 0) {
+            return false;
+        }
+
+        data += written;
+        offset += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+/* Number of entries of /proc/self/pagemap that are read at once, one for every page. */
+#define CPU_MEMORY_PAGEMAP_CHUNK 1024
+
+/* Entries of /proc/self/pagemap for a part of guest memory, see page_may_hold_data. */
+typedef struct {
+    int fd;
+    uint32_t first;
+    uint32_t count;
+    uint64_t entries[CPU_MEMORY_PAGEMAP_CHUNK];
+} pagemap_chunk_t;
+
+/*
+ * Tells whether given page of guest memory can hold anything but zeroes: it is resident or swapped out, or it was mapped from
+ * a file. A page that was never touched can not. Pages have to be asked about in increasing order.
+ */
+bool page_may_hold_data(starkcpu_t *cpu, pagemap_chunk_t *chunk, uint32_t page) {
+    if (page - chunk->first >= chunk->count) {
+        uint32_t pages_count = cpu->memsize >> CPU_PAGE_SHIFT;
+        uint32_t count = pages_count - page < CPU_MEMORY_PAGEMAP_CHUNK ? pages_count - page : CPU_MEMORY_PAGEMAP_CHUNK;
+        uint64_t offset = ((uintptr_t) cpu->mem / CPU_PAGE_SIZE + page) * sizeof(uint64_t);
+
+        chunk->first = page;
+        chunk->count = count;
+
+        // without the pagemap, which some hosts do not let processes read, every page is compared
+        if (chunk->fd < 0 || pread(chunk->fd, chunk->entries, count * sizeof(uint64_t), offset) != (ssize_t) (count * sizeof(uint64_t))) {
+            memset(chunk->entries, 0xFF, count * sizeof(uint64_t));
+        }
+
+        // pages mapped from a file are not resident until they are touched
+        for (uint32_t i = 0; i < cpu->file_extents_count; i++) {
+            uint64_t start = cpu->file_extents[i * 2];
+            uint64_t end = start + cpu->file_extents[i * 2 + 1];
+
+            for (uint64_t mapped = start > page ? start : page; mapped < end && mapped < (uint64_t) page + count; mapped++) {
+                chunk->entries[mapped - page] = UINT64_MAX;
+            }
+        }
+    }
+
+    // bit 63 is set for resident pages, bit 62 for swapped out ones
+    return (chunk->entries[page - chunk->first] >> 62) != 0;
+}
+
+bool cpu_memory_save_contents(starkcpu_t *cpu, cpu_memory_image_t *image) {
+    uint32_t pages_count = cpu->memsize >> CPU_PAGE_SHIFT;
+
+    // Only pages that can hold data are compared, so saving takes time in proportion to memory the program used rather
+    // than to the size of memory. Reading a page that was never touched would even commit host memory for it.
+    pagemap_chunk_t *chunk = malloc(sizeof(pagemap_chunk_t));
+    uint32_t capacity = 16;
+    image->extents = malloc(sizeof(uint32_t) * 2 * capacity);
+    image->extents_count = 0;
+
+    if (!chunk || !image->extents) {
+        free(chunk);
+        return false;
+    }
+
+    chunk->fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    chunk->first = 0;
+    chunk->count = 0;
+
+    bool saved = true;
+    uint32_t page = 0;
+
+    while (page < pages_count && saved) {
+        if (!page_may_hold_data(cpu, chunk, page) || is_zero_page(cpu->mem + ((uint64_t) page << CPU_PAGE_SHIFT))) {
+            page++;
+            continue;
+        }
+
+        uint32_t first = page;
+        while (page < pages_count && page_may_hold_data(cpu, chunk, page) && !is_zero_page(cpu->mem + ((uint64_t) page << CPU_PAGE_SHIFT))) {
+            page++;
+        }
+
+        uint32_t *last = image->extents_count > 0 ? image->extents + (image->extents_count - 1) * 2 : 0;
+
+        if (last && first - (last[0] + last[1]) < CPU_MEMORY_EXTENT_GAP) {
+            last[1] = page - last[0];
+        } else {
+            if (image->extents_count == capacity) {
+                uint32_t *extents = realloc(image->extents, sizeof(uint32_t) * 2 * capacity * 2);
+                if (!extents) {
+                    saved = false;
+                    break;
+                }
+
+                image->extents = extents;
+                capacity *= 2;
+            }
+
+            image->extents[image->extents_count * 2] = first;
+            image->extents[image->extents_count * 2 + 1] = page - first;
+            image->extents_count++;
+        }
+
+        uint64_t offset = (uint64_t) first << CPU_PAGE_SHIFT;
+        saved = write_file_at(image->fd, cpu->mem + offset, (uint64_t) (page - first) << CPU_PAGE_SHIFT, offset);
+    }
+
+    if (chunk->fd >= 0) {
+        close(chunk->fd);
+    }
+
+    free(chunk);
+    return saved;
+}
+
+bool cpu_memory_save(starkcpu_t *cpu, cpu_memory_image_t *image) {
+    image->size = cpu->memsize;
+    image->pages = 0;
+    image->extents = 0;
+    image->fd = memfd_create("starkcpu-memory", MFD_CLOEXEC);
+
+    if (image->fd < 0 || ftruncate(image->fd, cpu->memsize) != 0) {
+        cpu_memory_image_destroy(image);
+        return false;
+    }
+
+    // pages that the program can not read are still saved
+    if (cpu->pages->restricted) {
+        mprotect(cpu->mem, cpu->memsize, PROT_READ | PROT_WRITE);
+    }
+
+    bool saved = cpu_memory_save_contents(cpu, image);
+
+    if (cpu->pages->restricted) {
+        cpu_memory_apply_page_table(cpu);
+    }
+
+    if (!saved) {
+        cpu_memory_image_destroy(image);
+        return false;
+    }
+
+    image->pages = cpu_page_table_copy(cpu->pages);
+    return true;
+}
+
+bool map_image_range(starkcpu_t *cpu, const cpu_memory_image_t *image, uint64_t offset, uint64_t size) {
+    return add_file_extent(cpu, offset, size) && mmap(cpu->mem + offset, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, image->fd, offset) != MAP_FAILED;
+}
+
+void cpu_memory_restore_contents(starkcpu_t *cpu, const cpu_memory_image_t *image) {
+    cpu_memory_clear(cpu);
+
+    if (image->extents_count > CPU_MEMORY_MAX_EXTENTS && map_image_range(cpu, image, 0, image->size)) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < image->extents_count; i++) {
+        uint64_t offset = (uint64_t) image->extents[i * 2] << CPU_PAGE_SHIFT;
+        uint64_t size = (uint64_t) image->extents[i * 2 + 1] << CPU_PAGE_SHIFT;
+
+        if (!map_image_range(cpu, image, offset, size)) {
+            // a failed fixed mapping might have already unmapped the range
+            mmap(cpu->mem + offset, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+            pread(image->fd, cpu->mem + offset, size, offset);
+        }
+    }
+}
+
+/* Writes runs of pages saved in given image as a page index, a number of pages and their contents. */
+bool write_image_contents(const cpu_memory_image_t *image, FILE *file) {
+    char *buffer = malloc(CPU_MEMORY_FILE_CHUNK_SIZE);
+    bool written = true;
+
+    for (uint32_t i = 0; i < image->extents_count && written; i++) {
+        uint32_t run[2] = { image->extents[i * 2], image->extents[i * 2 + 1] };
+        written = fwrite(run, sizeof(run), 1, file) == 1;
+
+        uint64_t offset = (uint64_t) run[0] << CPU_PAGE_SHIFT;
+        uint64_t end = offset + ((uint64_t) run[1] << CPU_PAGE_SHIFT);
+
+        for (; offset < end && written; offset += CPU_MEMORY_FILE_CHUNK_SIZE) {
+            size_t size = end - offset < CPU_MEMORY_FILE_CHUNK_SIZE ? end - offset : CPU_MEMORY_FILE_CHUNK_SIZE;
+            written = pread(image->fd, buffer, size, offset) == (ssize_t) size && fwrite(buffer, 1, size, file) == size;
+        }
+    }
+
+    free(buffer);
+    return written;
+}
+
+bool read_image_contents(cpu_memory_image_t *image, FILE *file) {
+    image->fd = memfd_create("starkcpu-memory", MFD_CLOEXEC);
+    image->extents = 0;
+    image->extents_count = 0;
+
+    if (image->fd < 0 || ftruncate(image->fd, image->size) != 0) {
+        return false;
+    }
+
+    char *buffer = malloc(CPU_MEMORY_FILE_CHUNK_SIZE);
+    uint32_t capacity = 0;
+
+    // a file that ends before the run that terminates the contents is not valid
+    uint32_t run[2] = { 0, 1 };
+    bool valid = buffer != 0;
+
+    while (valid && fread(run, sizeof(run), 1, file) == 1 && run[1] > 0) {
+        valid = run[0] < image->size >> CPU_PAGE_SHIFT && run[1] <= (image->size >> CPU_PAGE_SHIFT) - run[0];
+
+        if (valid && image->extents_count == capacity) {
+            uint32_t *extents = realloc(image->extents, sizeof(uint32_t) * 2 * (capacity ? capacity * 2 : 16));
+            valid = extents != 0;
+
+            if (valid) {
+                image->extents = extents;
+                capacity = capacity ? capacity * 2 : 16;
+            }
+        }
+
+        if (valid) {
+            image->extents[image->extents_count * 2] = run[0];
+            image->extents[image->extents_count * 2 + 1] = run[1];
+            image->extents_count++;
+        }
+
+        uint64_t offset = (uint64_t) run[0] << CPU_PAGE_SHIFT;
+        uint64_t end = offset + ((uint64_t) run[1] << CPU_PAGE_SHIFT);
+
+        for (; offset < end && valid; offset += CPU_MEMORY_FILE_CHUNK_SIZE) {
+            size_t size = end - offset < CPU_MEMORY_FILE_CHUNK_SIZE ? end - offset : CPU_MEMORY_FILE_CHUNK_SIZE;
+            valid = fread(buffer, 1, size, file) == size && write_file_at(image->fd, buffer, size, offset);
+        }
+    }
+
+    free(buffer);
+    return valid && run[1] == 0;
+}
+
+void cpu_memory_image_destroy(cpu_memory_image_t *image) {
+    if (image->fd >= 0) {
+        close(image->fd);
+    }
+
+    free(image->extents);
+    image->extents = 0;
+
+    if (image->pages) {
+        cpu_page_table_destroy(image->pages);
+        image->pages = 0;
+    }
+
+    // mappings of restored CPUs keep the file alive
+    image->fd = -1;
+}
+
+void cpu_memory_enter_guard(cpu_memory_guard_t *guard, starkcpu_t *cpu) {
+    guard->cpu = cpu;
+    active_guard = guard;
+}
+
+void cpu_memory_leave_guard() {
+    active_guard = 0;
+}
+#else
+char *cpu_memory_allocate(uint32_t size) {
+    return calloc(size, 1);
+}
+
+void cpu_memory_free(char *mem, uint32_t size) {
+    free(mem);
+}
+
+void *cpu_memory_reserve(uint64_t size) {
+    return calloc(size, 1);
+}
+
+void cpu_memory_release(void *ptr, uint64_t size) {
+    free(ptr);
+}
+
+void cpu_memory_zero(void *ptr, uint64_t size) {
+    memset(ptr, 0, size);
+}
+
+void cpu_memory_clear(starkcpu_t *cpu) {
+    memset(cpu->mem, 0, cpu->memsize);
+}
+
+bool cpu_memory_map_file(starkcpu_t *cpu, uint32_t address, uint32_t size, int fd, uint64_t offset) {
+    return false;
+}
+
+void cpu_memory_apply_permissions(starkcpu_t *cpu, uint32_t address, uint32_t size, uint8_t permissions) {
+    // permissions are only checked by the handlers
+}
+
+bool cpu_memory_save(starkcpu_t *cpu, cpu_memory_image_t *image) {
+    image->size = cpu->memsize;
+    image->pages = 0;
+    image->data = malloc(cpu->memsize);
+
+    if (!image->data) {
+        return false;
+    }
+
+    memcpy(image->data, cpu->mem, cpu->memsize);
+    image->pages = cpu_page_table_copy(cpu->pages);
+    return true;
+}
+
+void cpu_memory_restore_contents(starkcpu_t *cpu, const cpu_memory_image_t *image) {
+    memcpy(cpu->mem, image->data, image->size);
+}
+
+bool write_image_contents(const cpu_memory_image_t *image, FILE *file) {
+    uint32_t pages_count = image->size >> CPU_PAGE_SHIFT;
+    uint32_t page = 0;
+
+    while (page < pages_count) {
+        if (is_zero_page(image->data + ((uint64_t) page << CPU_PAGE_SHIFT))) {
+            page++;
+            continue;
+        }
+
+        uint32_t first = page;
+        while (page < pages_count && !is_zero_page(image->data + ((uint64_t) page << CPU_PAGE_SHIFT))) {
+            page++;
+        }
+
+        uint32_t run[2] = { first, page - first };
+        size_t size = (size_t) run[1] << CPU_PAGE_SHIFT;
+
+        if (fwrite(run, sizeof(run), 1, file) != 1 || fwrite(image->data + ((uint64_t) first << CPU_PAGE_SHIFT), 1, size, file) != size) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool read_image_contents(cpu_memory_image_t *image, FILE *file) {
+    image->data = calloc(image->size, 1);
+    if (!image->data) {
+        return false;
+    }
+
+    // a file that ends before the run that terminates the contents is not valid
+    uint32_t run[2] = { 0, 1 };
+    while (fread(run, sizeof(run), 1, file) == 1 && run[1] > 0) {
+        if (run[0] >= image->size >> CPU_PAGE_SHIFT || run[1] > (image->size >> CPU_PAGE_SHIFT) - run[0]) {
+            return false;
+        }
+
+        size_t size = (size_t) run[1] << CPU_PAGE_SHIFT;
+        if (fread(image->data + ((uint64_t) run[0] << CPU_PAGE_SHIFT), 1, size, file) != size) {
+            return false;
+        }
+    }
+
+    return run[1] == 0;
+}
+
+void cpu_memory_image_destroy(cpu_memory_image_t *image) {
+    free(image->data);
+    image->data = 0;
+
+    if (image->pages) {
+        cpu_page_table_destroy(image->pages);
+        image->pages = 0;
+    }
+}
+#endif
+
+cpu_page_table_t *cpu_page_table_create() {
+    return calloc(1, sizeof(cpu_page_table_t));
+}
+
+cpu_page_table_t *cpu_page_table_copy(const cpu_page_table_t *pages) {
+    cpu_page_table_t *copy = cpu_page_table_create();
+    copy->restricted = pages->restricted;
+
+    for (uint32_t i = 0; i < CPU_PAGE_TABLE_SIZE; i++) {
+        if (pages->tables[i]) {
+            copy->tables[i] = malloc(CPU_PAGE_TABLE_SIZE);
+            memcpy(copy->tables[i], pages->tables[i], CPU_PAGE_TABLE_SIZE);
+        }
+    }
+
+    return copy;
+}
+
+void cpu_page_table_destroy(cpu_page_table_t *pages) {
+    for (uint32_t i = 0; i < CPU_PAGE_TABLE_SIZE; i++) {
+        free(pages->tables[i]);
+    }
+
+    free(pages);
+}
+
+void cpu_memory_reset(starkcpu_t *cpu) {
+    cpu_page_table_t *pages = cpu->pages;
+
+    if (pages->restricted) {
+        for (uint32_t i = 0; i < CPU_PAGE_TABLE_SIZE; i++) {
+            free(pages->tables[i]);
+            pages->tables[i] = 0;
+        }
+
+        pages->restricted = false;
+    }
+
+    cpu_memory_clear(cpu);
+    cpu_memory_mark_dirty(cpu, 0, cpu->memsize);
+}
+
+bool cpu_memory_protect(starkcpu_t *cpu, uint32_t address, uint32_t size, uint8_t permissions) {
+    if (size == 0 || address >= cpu->memsize || cpu->memsize - address < size) {
+        return false;
+    }
+
+    if (permissions != 0 && !(permissions & CPU_PAGE_READ)) {
+        return false;
+    }
+
+    cpu_page_table_t *pages = cpu->pages;
+    uint32_t first = address >> CPU_PAGE_SHIFT;
+    uint32_t last = (address + (size - 1)) >> CPU_PAGE_SHIFT;
+
+    for (uint32_t page = first; page <= last; page++) {
+        uint8_t **table = pages->tables + (page >> (CPU_PAGE_TABLE_SHIFT - CPU_PAGE_SHIFT));
+        if (!*table) {
+            *table = malloc(CPU_PAGE_TABLE_SIZE);
+            memset(*table, CPU_PAGE_ALL, CPU_PAGE_TABLE_SIZE);
+        }
+
+        (*table)[page & (CPU_PAGE_TABLE_SIZE - 1)] = permissions;
+    }
+
+    if (permissions != CPU_PAGE_ALL) {
+        pages->restricted = true;
+    }
+
+    uint32_t start = first << CPU_PAGE_SHIFT;
+    cpu_memory_apply_permissions(cpu, start, ((last - first) + 1) << CPU_PAGE_SHIFT, permissions);
+    cpu_executor_reset(cpu->executor);
+
+    // pages that could not be read might not have been copied
+    cpu_memory_mark_dirty(cpu, start, ((last - first) + 1) << CPU_PAGE_SHIFT);
+    return true;
+}
+
+void cpu_memory_apply_page_table(starkcpu_t *cpu) {
+    uint32_t pages_count = cpu->memsize >> CPU_PAGE_SHIFT;
+    uint32_t pages_per_table = CPU_PAGE_TABLE_SIZE;
+    uint32_t page = 0;
+
+    // Neighbouring pages with the same permissions are applied at once, parts of the address space
+    // without a table are skipped as a whole.
+    while (page < pages_count) {
+        uint32_t first = page;
+        uint8_t permissions = cpu_memory_get_permissions(cpu, first << CPU_PAGE_SHIFT);
+
+        while (page < pages_count) {
+            uint8_t *table = cpu->pages->tables[page / pages_per_table];
+
+            if (!table && permissions == CPU_PAGE_ALL) {
+                page = (page / pages_per_table + 1) * pages_per_table;
+            } else if (table && table[page % pages_per_table] == permissions) {
+                page++;
+            } else {
+                break;
+            }
+        }
+
+        if (page > pages_count) {
+            page = pages_count;
+        }
+
+        cpu_memory_apply_permissions(cpu, first << CPU_PAGE_SHIFT, (page - first) << CPU_PAGE_SHIFT, permissions);
+    }
+}
+
+void cpu_memory_restore(starkcpu_t *cpu, const cpu_memory_image_t *image) {
+    cpu_page_table_destroy(cpu->pages);
+    cpu->pages = cpu_page_table_copy(image->pages);
+
+    cpu_memory_restore_contents(cpu, image);
+    cpu_memory_mark_dirty(cpu, 0, cpu->memsize);
+
+    if (cpu->pages->restricted) {
+        cpu_memory_apply_page_table(cpu);
+    }
+
+    cpu_executor_reset(cpu->executor);
+}
+
+bool cpu_memory_image_write(const cpu_memory_image_t *image, FILE *file) {
+    // only second-level tables that exist are written, each one after its index
+    for (uint32_t i = 0; i < CPU_PAGE_TABLE_SIZE; i++) {
+        if (image->pages->tables[i] && (fwrite(&i, sizeof(i), 1, file) != 1 || fwrite(image->pages->tables[i], CPU_PAGE_TABLE_SIZE, 1, file) != 1)) {
+            return false;
+        }
+    }
+
+    uint32_t end = CPU_PAGE_TABLE_SIZE;
+    uint32_t end_of_contents[2] = { 0, 0 };
+
+    return fwrite(&end, sizeof(end), 1, file) == 1
+        && write_image_contents(image, file)
+        && fwrite(end_of_contents, sizeof(end_of_contents), 1, file) == 1;
+}
+
+bool cpu_memory_image_read(cpu_memory_image_t *image, uint32_t size, FILE *file) {
+    memset(image, 0, sizeof(cpu_memory_image_t));
+    image->size = size;
+    image->pages = cpu_page_table_create();
+#ifdef CPU_GUARD_PAGES
+    image->fd = -1;
+#endif
+
+    uint32_t index;
+    bool valid = size > 0 && size % CPU_PAGE_SIZE == 0;
+
+    while (valid && (valid = fread(&index, sizeof(index), 1, file) == 1) && index != CPU_PAGE_TABLE_SIZE) {
+        valid = index < CPU_PAGE_TABLE_SIZE && !image->pages->tables[index];
+
+        if (valid) {
+            image->pages->tables[index] = malloc(CPU_PAGE_TABLE_SIZE);
+            valid = fread(image->pages->tables[index], CPU_PAGE_TABLE_SIZE, 1, file) == 1;
+        }
+
+        for (uint32_t page = 0; valid && page < CPU_PAGE_TABLE_SIZE; page++) {
+            if (image->pages->tables[index][page] != CPU_PAGE_ALL) {
+                image->pages->restricted = true;
+            }
+        }
+    }
+
+    if (!valid || !read_image_contents(image, file)) {
+        cpu_memory_image_destroy(image);
+        return false;
+    }
+
+    return true;
+}
+
+bool cpu_memory_track_dirty_pages(starkcpu_t *cpu) {
+    if (cpu->dirty_pages) {
+        return true;
+    }
+
+    cpu->dirty_pages = malloc(cpu->memsize >> CPU_PAGE_SHIFT);
+    if (!cpu->dirty_pages) {
+        return false;
+    }
+
+    memset(cpu->dirty_pages, CPU_DIRTY_ALL, cpu->memsize >> CPU_PAGE_SHIFT);
+
+    // translated code only marks pages it writes to if it was translated while they were tracked
+    cpu_executor_reset(cpu->executor);
+    return true;
+}
\ No newline at end of file
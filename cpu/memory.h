@@ -0,0 +1,169 @@
+#pragma once
+
+#include "cpu.h"
+#include <stdio.h>
+
+#if defined(__linux__) && defined(__x86_64__) && !defined(CPU_NO_GUARD_PAGES)
+#define CPU_GUARD_PAGES
+#include <signal.h>
+#endif
+
+#define CPU_PAGE_SIZE 4096
+#define CPU_PAGE_SHIFT 12
+
+/* Every second-level page table describes 1024 pages, i.e. 4 MiB of the address space. */
+#define CPU_PAGE_TABLE_SHIFT 22
+#define CPU_PAGE_TABLE_SIZE 1024
+
+#define CPU_PAGE_READ 0x01
+#define CPU_PAGE_WRITE 0x02
+#define CPU_PAGE_EXECUTE 0x04
+#define CPU_PAGE_ALL (CPU_PAGE_READ | CPU_PAGE_WRITE | CPU_PAGE_EXECUTE)
+
+/* Bits of cpu->dirty_pages, one for every reader of them. Writes set all of them, readers clear just their own. */
+#define CPU_DIRTY_UI 0x01
+#define CPU_DIRTY_GPU 0x02
+#define CPU_DIRTY_ALL 0xFF
+
+/*
+ * Permissions of every page of guest memory. Addresses past the end of memory can not be accessed at all,
+ * pages without a second-level table can be accessed in any way. Tables are only allocated for parts of
+ * the address space whose permissions were changed, so they cost nothing for memory that is used as is.
+ */
+typedef struct cpu_page_table_t {
+    uint8_t *tables[CPU_PAGE_TABLE_SIZE];
+
+    // Set once any page has permissions other than CPU_PAGE_ALL.
+    bool restricted;
+} cpu_page_table_t;
+
+/*
+ * Allocates guest memory of given size, which has to be a multiple of CPU_PAGE_SIZE. Memory is zeroed and host memory
+ * is only committed for pages once they are touched for the first time.
+ * With guard pages, the whole 4 GiB guest address space is reserved and only the first `size` bytes are accessible,
+ * so accessing any address past the end of memory, or accessing a page in a way it does not permit, faults instead
+ * of touching host memory. Faults that happen while instructions are executed are turned into a CPU panic,
+ * see cpu_memory_enter_guard.
+ */
+char *cpu_memory_allocate(uint32_t size);
+void cpu_memory_free(char *mem, uint32_t size);
+
+/* Allocates a zeroed block of host memory that is only committed once it is touched, e.g. for data kept per guest address. */
+void *cpu_memory_reserve(uint64_t size);
+void cpu_memory_release(void *ptr, uint64_t size);
+
+/* Zeroes a block returned by cpu_memory_reserve, releasing host memory that backed it. */
+void cpu_memory_zero(void *ptr, uint64_t size);
+
+/* Zeroes memory of given CPU, dropping files mapped into it, and makes all of it readable and writable on the host again. */
+void cpu_memory_clear(starkcpu_t *cpu);
+
+/*
+ * Maps `size` bytes of given file, starting at `offset`, into memory of given CPU at `address`. The mapping is private,
+ * so writes made by the program never reach the file. Address, offset and size have to be multiples of CPU_PAGE_SIZE and
+ * the whole range has to be inside of the file. Returns false if files can not be mapped on this host, the contents
+ * then have to be copied instead.
+ */
+bool cpu_memory_map_file(starkcpu_t *cpu, uint32_t address, uint32_t size, int fd, uint64_t offset);
+
+cpu_page_table_t *cpu_page_table_create();
+cpu_page_table_t *cpu_page_table_copy(const cpu_page_table_t *pages);
+void cpu_page_table_destroy(cpu_page_table_t *pages);
+
+/* Clears memory of given CPU and brings permissions of all its pages back to CPU_PAGE_ALL. */
+void cpu_memory_reset(starkcpu_t *cpu);
+
+/*
+ * Changes permissions of every page overlapping given range. Pages that can be written to or executed
+ * have to be readable as well. All decoded instructions are dropped, so that they are checked again.
+ * Returns false if the range is not inside of memory or the permissions are not valid.
+ */
+bool cpu_memory_protect(starkcpu_t *cpu, uint32_t address, uint32_t size, uint8_t permissions);
+
+/* Applies permissions of every page from the page table of given CPU to host memory, e.g. after it was replaced. */
+void cpu_memory_apply_page_table(starkcpu_t *cpu);
+
+/*
+ * Starts recording which pages of memory of given CPU are written to, so that copies of it only have to be brought
+ * up to date where it changed. Every page starts dirty, whoever reads cpu->dirty_pages clears its CPU_DIRTY_* bit of the pages it handled.
+ * Returns false if the host is out of memory.
+ */
+bool cpu_memory_track_dirty_pages(starkcpu_t *cpu);
+
+/*
+ * Contents and page permissions of guest memory, saved by cpu_memory_save. With guard pages, contents are kept
+ * in an anonymous in-memory file that restored CPUs map privately, so restoring takes about the same time
+ * regardless of how much memory is used, and a page is only copied once a CPU writes to it.
+ */
+typedef struct {
+    uint32_t size;
+    cpu_page_table_t *pages;
+
+#ifdef CPU_GUARD_PAGES
+    int fd;
+
+    // Runs of pages that hold anything but zeroes, as pairs of first page and number of pages. Only these are mapped.
+    uint32_t *extents;
+    uint32_t extents_count;
+#else
+    char *data;
+#endif
+} cpu_memory_image_t;
+
+/* Saves memory of given CPU into an image. Returns false if the host is out of memory. */
+bool cpu_memory_save(starkcpu_t *cpu, cpu_memory_image_t *image);
+
+/* Replaces memory of given CPU, which has to be of the same size, with contents of an image. Also drops all decoded instructions. */
+void cpu_memory_restore(starkcpu_t *cpu, const cpu_memory_image_t *image);
+void cpu_memory_image_destroy(cpu_memory_image_t *image);
+
+/*
+ * Writes an image into a file: permissions of every page followed by contents of pages that hold anything but zeroes,
+ * in host byte order. Returns false if the file can not be written.
+ */
+bool cpu_memory_image_write(const cpu_memory_image_t *image, FILE *file);
+
+/* Reads an image of memory of given size written by cpu_memory_image_write. Returns false if the file is not valid. */
+bool cpu_memory_image_read(cpu_memory_image_t *image, uint32_t size, FILE *file);
+
+static inline uint8_t cpu_memory_get_permissions(starkcpu_t *cpu, uint32_t address) {
+    if (address >= cpu->memsize) {
+        return 0;
+    }
+
+    uint8_t *table = cpu->pages->tables[address >> CPU_PAGE_TABLE_SHIFT];
+    return table ? table[(address >> CPU_PAGE_SHIFT) & (CPU_PAGE_TABLE_SIZE - 1)] : CPU_PAGE_ALL;
+}
+
+static inline bool cpu_memory_can_access(starkcpu_t *cpu, uint32_t address, uint8_t permissions) {
+    return (cpu_memory_get_permissions(cpu, address) & permissions) == permissions;
+}
+
+/* Marks every page overlapping given range as dirty, if dirty pages of given CPU are tracked. */
+static inline void cpu_memory_mark_dirty(starkcpu_t *cpu, uint32_t address, uint32_t size) {
+    if (!cpu->dirty_pages || size == 0) {
+        return;
+    }
+
+    for (uint32_t page = address >> CPU_PAGE_SHIFT; page <= (address + (size - 1)) >> CPU_PAGE_SHIFT; page++) {
+        cpu->dirty_pages[page] = CPU_DIRTY_ALL;
+    }
+}
+
+#ifdef CPU_GUARD_PAGES
+typedef struct {
+    starkcpu_t *cpu;
+    sigjmp_buf jump;
+
+    // Guest address that was accessed and whether it was written to, set when a fault is caught.
+    uint32_t address;
+    bool write;
+} cpu_memory_guard_t;
+
+/*
+ * Makes faults caused by accessing memory of given CPU on the calling thread jump to `guard->jump`.
+ * Call sigsetjmp(guard->jump, 0) first, and cpu_memory_leave_guard once execution is finished.
+ */
+void cpu_memory_enter_guard(cpu_memory_guard_t *guard, starkcpu_t *cpu);
+void cpu_memory_leave_guard();
+#endif
\ No newline at end of file
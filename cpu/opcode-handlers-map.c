@@ -7,22 +7,29 @@ opcode_handlers_map_t *opcode_handlers_map_create() {
     return map;
 }
 
+void opcode_handlers_map_destroy(opcode_handlers_map_t *map) {
+    free(map->entries);
+    free(map);
+}
+
 void opcode_handlers_map_reserve(opcode_handlers_map_t *map, uint32_t num) {
-    map->entries = malloc(sizeof(opcode_exec_func) * num);
+    map->entries = malloc(sizeof(opcode_handler_t) * num);
 
     for (int32_t i = 0; i < num; i++) {
-        opcode_exec_func *ptr = map->entries + (i);
-        *ptr = 0;
+        opcode_handler_t *ptr = map->entries + (i);
+        ptr->func = 0;
+        ptr->operands = "";
     }
 }
 
-void opcode_handlers_map_set(opcode_handlers_map_t *map, uint32_t key, opcode_exec_func data) {
+void opcode_handlers_map_set(opcode_handlers_map_t *map, uint32_t key, opcode_exec_func func, const char *operands) {
     uint32_t index = key;
-    opcode_exec_func *ptr = map->entries + (index);
-    *ptr = data;
+    opcode_handler_t *ptr = map->entries + (index);
+    ptr->func = func;
+    ptr->operands = operands;
 }
 
-opcode_exec_func *opcode_handlers_map_get(opcode_handlers_map_t *map, uint32_t key) {
+opcode_handler_t *opcode_handlers_map_get(opcode_handlers_map_t *map, uint32_t key) {
     uint32_t index = key;
     return map->entries + (index);
 }
\ No newline at end of file
@@ -3,12 +3,25 @@
 #include "cpu.h"
 #include <stdint.h>
 
-typedef void (*opcode_exec_func)(starkcpu_t *cpu);
+struct cpu_instruction_t;
+
+typedef void (*opcode_exec_func)(starkcpu_t *cpu, const struct cpu_instruction_t *instruction);
+typedef struct {
+    opcode_exec_func func;
+
+    /*
+     * Describes operands that follow the opcode, one character per operand:
+     * 'r' - register index (8 bits), 'b' - 8-bit, 'w' - 16-bit and 'd' - 32-bit value.
+     */
+    const char *operands;
+} opcode_handler_t;
+
 typedef struct {
-    opcode_exec_func* entries;
+    opcode_handler_t* entries;
 } opcode_handlers_map_t;
 
 opcode_handlers_map_t *opcode_handlers_map_create();
+void opcode_handlers_map_destroy(opcode_handlers_map_t *map);
 void opcode_handlers_map_reserve(opcode_handlers_map_t *map, uint32_t num);
-void opcode_handlers_map_set(opcode_handlers_map_t *map, uint32_t op, opcode_exec_func func);
-opcode_exec_func *opcode_handlers_map_get(opcode_handlers_map_t *map, uint32_t key);
\ No newline at end of file
+void opcode_handlers_map_set(opcode_handlers_map_t *map, uint32_t op, opcode_exec_func func, const char *operands);
+opcode_handler_t *opcode_handlers_map_get(opcode_handlers_map_t *map, uint32_t key);
\ No newline at end of file
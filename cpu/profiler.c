@@ -0,0 +1,387 @@
+#include "profiler.h"
+#include "cpu-executor.h"
+#include "memory.h"
+#include "utils.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <x86intrin.h>
+#define CPU_PROFILER_TSC
+#endif
+
+// Number of times reading the time is measured to find out how long it takes.
+#define CPU_PROFILER_CALIBRATION_ROUNDS 1000
+
+// Deepest scope that is still shown as a separate frame in collapsed stacks.
+#define CPU_PROFILER_MAX_SCOPES 64
+
+typedef struct {
+    uint32_t key;
+    cpu_profile_counter_t counter;
+} cpu_profile_row_t;
+
+static inline uint64_t get_ticks() {
+#ifdef CPU_PROFILER_TSC
+    return __rdtsc();
+#else
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+cpu_profiler_t *cpu_profiler_create(starkcpu_t *cpu) {
+    cpu_profiler_t *profiler = calloc(1, sizeof(cpu_profiler_t));
+    profiler->cpu = cpu;
+    profiler->addresses = cpu_memory_reserve((uint64_t) cpu->memsize * sizeof(cpu_profile_counter_t));
+    profiler->lowest_address = UINT32_MAX;
+    profiler->highest_address = 0;
+    profiler->overhead = UINT64_MAX;
+
+    for (uint32_t i = 0; i < CPU_PROFILER_CALIBRATION_ROUNDS; i++) {
+        uint64_t start = get_ticks();
+        uint64_t ticks = get_ticks() - start;
+
+        if (ticks < profiler->overhead) {
+            profiler->overhead = ticks;
+        }
+    }
+
+    profiler->start_ticks = get_ticks();
+    profiler->start_time = cpu_get_monotonic_time();
+    snprintf(profiler->source_name, sizeof(profiler->source_name), "program");
+
+    cpu->profiler = profiler;
+    return profiler;
+}
+
+void cpu_profiler_destroy(cpu_profiler_t *profiler) {
+    if (profiler->cpu->profiler == profiler) {
+        profiler->cpu->profiler = 0;
+    }
+
+    cpu_memory_release(profiler->addresses, (uint64_t) profiler->cpu->memsize * sizeof(cpu_profile_counter_t));
+    if (profiler->source_map) {
+        cpu_source_map_destroy(profiler->source_map);
+    }
+
+    free(profiler);
+}
+
+uint32_t cpu_execute_profiled(cpu_profiler_t *profiler, uint32_t count) {
+    starkcpu_t *cpu = profiler->cpu;
+    cpu_executor_t *executor = cpu->executor;
+    uint32_t executed = 0;
+
+    while (executed < count && cpu->running && cpu->ip < cpu->memsize) {
+        uint32_t address = cpu->ip;
+
+        // budget of a single instruction splits fused instructions back into separate ones
+        cpu_instruction_t *instruction = cpu_fetch_instruction(executor, 1);
+
+        uint64_t start = get_ticks();
+        instruction->handler(cpu, instruction);
+        uint64_t ticks = get_ticks() - start;
+        ticks = ticks > profiler->overhead ? ticks - profiler->overhead : 0;
+
+        profiler->opcodes[instruction->opcode].count++;
+        profiler->opcodes[instruction->opcode].ticks += ticks;
+        profiler->addresses[address].count++;
+        profiler->addresses[address].ticks += ticks;
+
+        if (address < profiler->lowest_address) {
+            profiler->lowest_address = address;
+        }
+
+        if (address > profiler->highest_address) {
+            profiler->highest_address = address;
+        }
+
+        executed++;
+    }
+
+    return executed;
+}
+
+bool cpu_profiler_set_source(cpu_profiler_t *profiler, const char *map_contents, const char *source_path) {
+    cpu_source_map_t *source_map = cpu_source_map_create(map_contents, source_path);
+    if (!source_map) {
+        return false;
+    }
+
+    if (profiler->source_map) {
+        cpu_source_map_destroy(profiler->source_map);
+    }
+
+    profiler->source_map = source_map;
+
+    const char *name = strrchr(source_path, '/');
+    snprintf(profiler->source_name, sizeof(profiler->source_name), "%s", name ? name + 1 : source_path);
+    return true;
+}
+
+/* Checks whether executed addresses are attributed to source lines. */
+bool has_source_lines(cpu_profiler_t *profiler) {
+    return profiler->source_map && profiler->source_map->mappings_count > 0;
+}
+
+/*
+ * Sums counters of executed addresses per source line, or copies them per address if there is no source map.
+ * With a source map, the key of every row is the index of a line, and instructions that are not in the map share
+ * a row keyed with the number of source lines. Rows are ordered by their key.
+ */
+uint32_t collect_rows(cpu_profiler_t *profiler, cpu_profile_row_t **result) {
+    bool by_line = has_source_lines(profiler);
+    cpu_profile_row_t *rows;
+    uint32_t count = 0;
+
+    if (by_line) {
+        count = profiler->source_map->lines_count + 1;
+        rows = calloc(count, sizeof(cpu_profile_row_t));
+
+        for (uint32_t i = 0; i < count; i++) {
+            rows[i].key = i;
+        }
+    } else {
+        rows = malloc(sizeof(cpu_profile_row_t) * 64);
+    }
+
+    uint32_t capacity = 64;
+
+    for (uint64_t address = profiler->lowest_address; address <= profiler->highest_address; address++) {
+        cpu_profile_counter_t *counter = profiler->addresses + address;
+        if (counter->count == 0) {
+            continue;
+        }
+
+        if (by_line) {
+            cpu_profile_row_t *row = rows + cpu_source_map_find_line(profiler->source_map, address);
+            row->counter.count += counter->count;
+            row->counter.ticks += counter->ticks;
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity *= 2;
+            rows = realloc(rows, sizeof(cpu_profile_row_t) * capacity);
+        }
+
+        rows[count].key = address;
+        rows[count].counter = *counter;
+        count++;
+    }
+
+    // lines that were never executed are dropped
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (rows[i].counter.count > 0) {
+            rows[kept++] = rows[i];
+        }
+    }
+
+    *result = rows;
+    return kept;
+}
+
+int compare_rows(const void *a, const void *b) {
+    const cpu_profile_counter_t *left = &((const cpu_profile_row_t *) a)->counter;
+    const cpu_profile_counter_t *right = &((const cpu_profile_row_t *) b)->counter;
+
+    if (left->ticks != right->ticks) {
+        return left->ticks < right->ticks ? 1 : -1;
+    }
+
+    return (left->count < right->count) - (left->count > right->count);
+}
+
+double get_nanoseconds_per_tick(cpu_profiler_t *profiler) {
+    uint64_t ticks = get_ticks() - profiler->start_ticks;
+    uint64_t time = cpu_get_monotonic_time() - profiler->start_time;
+    return ticks > 0 ? time * 1000.0 / ticks : 0;
+}
+
+double cpu_profiler_get_nanoseconds(cpu_profiler_t *profiler, uint64_t ticks) {
+    return ticks * get_nanoseconds_per_tick(profiler);
+}
+
+/* Copies given line of `line_length` characters without its comment and surrounding whitespace into `buffer`. */
+void get_source_text(const char *line, size_t line_length, char *buffer, size_t size) {
+    const char *end = line + line_length;
+    while (line < end && isspace((unsigned char) *line)) {
+        line++;
+    }
+
+    const char *comment = memchr(line, '#', end - line);
+    size_t length = (comment ? comment : end) - line;
+    while (length > 0 && isspace((unsigned char) line[length - 1])) {
+        length--;
+    }
+
+    if (length >= size) {
+        length = size - 1;
+    }
+
+    memmove(buffer, line, length);
+    buffer[length] = '\0';
+}
+
+void print_counter(FILE *output, const cpu_profile_counter_t *counter, const cpu_profile_counter_t *total, double ns_per_tick) {
+    fprintf(output, "%14llu %6.2f%% %12.3f %6.2f%%",
+            (unsigned long long) counter->count,
+            total->count > 0 ? counter->count * 100.0 / total->count : 0,
+            counter->ticks * ns_per_tick / 1e6,
+            total->ticks > 0 ? counter->ticks * 100.0 / total->ticks : 0);
+}
+
+void cpu_profiler_print_report(cpu_profiler_t *profiler, FILE *output) {
+    double ns_per_tick = get_nanoseconds_per_tick(profiler);
+    cpu_profile_counter_t total = { 0, 0 };
+    cpu_profile_row_t opcodes[256];
+    uint32_t opcodes_count = 0;
+
+    for (uint32_t i = 0; i < 256; i++) {
+        if (profiler->opcodes[i].count > 0) {
+            opcodes[opcodes_count].key = i;
+            opcodes[opcodes_count].counter = profiler->opcodes[i];
+            opcodes_count++;
+
+            total.count += profiler->opcodes[i].count;
+            total.ticks += profiler->opcodes[i].ticks;
+        }
+    }
+
+    qsort(opcodes, opcodes_count, sizeof(cpu_profile_row_t), compare_rows);
+
+    fprintf(output, "%-24s %14s %7s %12s %7s\n", "opcode", "executed", "", "time (ms)", "");
+    for (uint32_t i = 0; i < opcodes_count; i++) {
+        const char *name = cpu_get_opcode_name(opcodes[i].key);
+        char unknown[8];
+        if (!name) {
+            snprintf(unknown, sizeof(unknown), "0x%02X", opcodes[i].key);
+            name = unknown;
+        }
+
+        fprintf(output, "%-24s ", name);
+        print_counter(output, &opcodes[i].counter, &total, ns_per_tick);
+        fprintf(output, "\n");
+    }
+
+    cpu_profile_row_t *rows;
+    uint32_t rows_count = collect_rows(profiler, &rows);
+    qsort(rows, rows_count, sizeof(cpu_profile_row_t), compare_rows);
+
+    bool by_line = has_source_lines(profiler);
+    fprintf(output, "\n%-24s %14s %7s %12s %7s  %s\n", by_line ? "line" : "address", "executed", "", "time (ms)", "", by_line ? "source" : "");
+
+    for (uint32_t i = 0; i < rows_count && i < CPU_PROFILER_REPORT_LINES; i++) {
+        char text[128] = "";
+        int width;
+
+        if (!by_line) {
+            width = fprintf(output, "0x%08X", rows[i].key);
+        } else if (rows[i].key == profiler->source_map->lines_count) {
+            width = fprintf(output, "(not in source map)");
+        } else {
+            size_t length;
+            const char *line = cpu_source_map_get_line(profiler->source_map, rows[i].key, &length);
+
+            width = fprintf(output, "%s:%u", profiler->source_name, rows[i].key + 1);
+            get_source_text(line, length, text, sizeof(text));
+        }
+
+        // a location longer than its column pushes the rest of the row to the right instead of being cut off
+        fprintf(output, "%*s ", width < 24 ? 24 - width : 0, "");
+        print_counter(output, &rows[i].counter, &total, ns_per_tick);
+        fprintf(output, "  %s\n", text);
+    }
+
+    free(rows);
+}
+
+/* Copies given text into `buffer` so that it can be used as a frame of a collapsed stack. */
+void get_frame_name(const char *text, char *buffer, size_t size) {
+    snprintf(buffer, size, "%s", text);
+
+    for (char *c = buffer; *c; c++) {
+        if (*c == ';') {
+            *c = ',';
+        }
+    }
+}
+
+bool cpu_profiler_write_stacks(cpu_profiler_t *profiler, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+
+    double ns_per_tick = get_nanoseconds_per_tick(profiler);
+    cpu_profile_row_t *rows;
+    uint32_t rows_count = collect_rows(profiler, &rows);
+
+    char source_name[128];
+    get_frame_name(profiler->source_name, source_name, sizeof(source_name));
+
+    if (!has_source_lines(profiler)) {
+        for (uint32_t i = 0; i < rows_count; i++) {
+            fprintf(file, "%s;0x%08X %llu\n", source_name, rows[i].key, (unsigned long long) (rows[i].counter.ticks * ns_per_tick));
+        }
+
+        free(rows);
+        fclose(file);
+        return true;
+    }
+
+    // Scopes opened by `name {` become frames between the source file and the line, so nested loops show up as nested frames.
+    char scopes[CPU_PROFILER_MAX_SCOPES][64];
+    uint32_t depth = 0;
+    uint32_t row = 0;
+
+    for (uint32_t line = 0; line < profiler->source_map->lines_count; line++) {
+        size_t line_length;
+        const char *line_text = cpu_source_map_get_line(profiler->source_map, line, &line_length);
+
+        char text[128];
+        get_source_text(line_text, line_length, text, sizeof(text));
+
+        size_t length = strlen(text);
+        if (text[0] == '}' && depth > 0) {
+            depth--;
+        }
+
+        if (row < rows_count && rows[row].key == line) {
+            fprintf(file, "%s", source_name);
+            for (uint32_t i = 0; i < depth && i < CPU_PROFILER_MAX_SCOPES; i++) {
+                fprintf(file, ";%s", scopes[i]);
+            }
+
+            char frame[128];
+            get_frame_name(text, frame, sizeof(frame));
+            fprintf(file, ";%u: %s %llu\n", line + 1, frame, (unsigned long long) (rows[row].counter.ticks * ns_per_tick));
+            row++;
+        }
+
+        if (length > 0 && text[length - 1] == '{') {
+            if (depth < CPU_PROFILER_MAX_SCOPES) {
+                text[length - 1] = '\0';
+                get_source_text(text, strlen(text), text, sizeof(text));
+                get_frame_name(text[0] ? text : "{}", scopes[depth], sizeof(scopes[depth]));
+            }
+
+            depth++;
+        }
+    }
+
+    // instructions that are not in the source map are kept in the last row
+    if (row < rows_count) {
+        fprintf(file, "%s;(not in source map) %llu\n", source_name, (unsigned long long) (rows[row].counter.ticks * ns_per_tick));
+    }
+
+    free(rows);
+    fclose(file);
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "cpu.h"
+#include "source-map.h"
+#include <stdio.h>
+
+/* Number of source lines (or addresses, without a source map) listed by the flat report. */
+#define CPU_PROFILER_REPORT_LINES 20
+
+typedef struct {
+    uint64_t count;
+    uint64_t ticks;
+} cpu_profile_counter_t;
+
+typedef struct cpu_profiler_t {
+    starkcpu_t *cpu;
+
+    cpu_profile_counter_t opcodes[256];
+
+    // One counter per guest address, committed by the host only for addresses that were executed.
+    cpu_profile_counter_t *addresses;
+    uint32_t lowest_address;
+    uint32_t highest_address;
+
+    // Ticks that reading the time itself takes, subtracted from every measured instruction.
+    uint64_t overhead;
+
+    // Used to convert ticks into time once profiling is done.
+    uint64_t start_ticks;
+    uint64_t start_time;
+
+    // Source map with the source file it refers to, 0 if there is none.
+    cpu_source_map_t *source_map;
+    char source_name[128];
+} cpu_profiler_t;
+
+/*
+ * Starts profiling given CPU. While the profiler is attached, cpu_execute executes instructions one by one regardless of
+ * the selected core, and counts how many times every opcode and every address was executed and how much host time it took.
+ * Fused instructions are split, so every instruction is counted at its own address.
+ */
+cpu_profiler_t *cpu_profiler_create(starkcpu_t *cpu);
+
+/* Detaches the profiler from its CPU and frees it. */
+void cpu_profiler_destroy(cpu_profiler_t *profiler);
+
+/* Executes up to `count` instructions while counting them. Returns number of executed instructions. */
+uint32_t cpu_execute_profiled(cpu_profiler_t *profiler, uint32_t count);
+
+/* Converts ticks counted by given profiler into nanoseconds. */
+double cpu_profiler_get_nanoseconds(cpu_profiler_t *profiler, uint64_t ticks);
+
+/*
+ * Attributes executed addresses to lines of given source file, using a source map produced by the compiler.
+ * Returns false if the source file can not be read.
+ */
+bool cpu_profiler_set_source(cpu_profiler_t *profiler, const char *map_contents, const char *source_path);
+
+/* Prints executions and time per opcode, followed by the source lines (or addresses) that took the most time. */
+void cpu_profiler_print_report(cpu_profiler_t *profiler, FILE *output);
+
+/*
+ * Writes time spent on every source line in the collapsed stack format used by flame graph tools, one line per stack:
+ * `<source file>;<scope>;...;<line> <nanoseconds>`. Returns false if the file can not be written.
+ */
+bool cpu_profiler_write_stacks(cpu_profiler_t *profiler, const char *path);
\ No newline at end of file
@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "utils.h"
+#include "cpu-executor.h"
+#include "snapshot.h"
+#include "tracer.h"
+
+/* Number of bytes of every written range that --print shows. */
+#define REPLAY_PRINTED_BYTES 8
+
+void print_usage() {
+    printf("usage: replay [options] <trace file>\n");
+    printf("options:\n");
+    printf("  --snapshot=<file>  snapshot that the trace starts from (default: <trace file>%s)\n", CPU_TRACE_SNAPSHOT_SUFFIX);
+    printf("  --print            print every instruction with the registers and memory it changed\n");
+}
+
+void print_instruction(const cpu_trace_record_t *record) {
+    const char *operands = cpu_get_opcode_operands(record->bytes[0]);
+    uint32_t position = 1;
+
+    printf("0x%08x  %-26s", record->ip, cpu_get_opcode_name(record->bytes[0]));
+
+    for (const char *operand = operands; *operand; operand++) {
+        uint32_t size = *operand == 'd' ? 4 : *operand == 'w' ? 2 : 1;
+        uint32_t value = 0;
+
+        for (uint32_t i = 0; i < size; i++) {
+            value |= (uint32_t) record->bytes[position++] << (i * 8);
+        }
+
+        printf(*operand == 'r' ? "%sr%u" : "%s0x%x", operand == operands ? " " : ", ", value);
+    }
+}
+
+void print_changes(const cpu_trace_record_t *record, uint8_t previous_flag_equal) {
+    for (uint32_t i = 0; i < CPU_REGISTERS_COUNT; i++) {
+        if (record->changed_registers & (1 << i)) {
+            printf("  r%u=%d", i, record->registers[i]);
+        }
+    }
+
+    if (record->flag_equal != previous_flag_equal) {
+        printf("  eq=%u", record->flag_equal);
+    }
+
+    const uint8_t *data = record->data;
+    for (uint32_t i = 0; i < record->writes_count; i++) {
+        const cpu_trace_range_t *range = record->writes + i;
+        printf("  [0x%x]=", range->address);
+
+        for (uint32_t j = 0; j < range->size && j < REPLAY_PRINTED_BYTES; j++) {
+            printf("%02x", data[j]);
+        }
+
+        if (range->size > REPLAY_PRINTED_BYTES) {
+            printf("... (%u bytes)", range->size);
+        }
+
+        data += range->size;
+    }
+
+    printf("\n");
+}
+
+/* Compares state of the CPU right after executing an instruction with its record. Returns description of the first difference, or 0. */
+const char *find_difference(starkcpu_t *cpu, const cpu_trace_record_t *record) {
+    static char difference[128];
+
+    for (uint32_t i = 0; i < CPU_REGISTERS_COUNT; i++) {
+        if (cpu->registers[i] != record->registers[i]) {
+            snprintf(difference, sizeof(difference), "r%u is %d, trace has %d", i, cpu->registers[i], record->registers[i]);
+            return difference;
+        }
+    }
+
+    if (cpu->flag_equal != record->flag_equal) {
+        snprintf(difference, sizeof(difference), "eq is %u, trace has %u", cpu->flag_equal, record->flag_equal);
+        return difference;
+    }
+
+    const uint8_t *data = record->data;
+    for (uint32_t i = 0; i < record->writes_count; i++) {
+        const cpu_trace_range_t *range = record->writes + i;
+
+        if (memcmp(cpu->mem + range->address, data, range->size) != 0) {
+            snprintf(difference, sizeof(difference), "%u bytes at 0x%x differ from the trace", range->size, range->address);
+            return difference;
+        }
+
+        data += range->size;
+    }
+
+    return 0;
+}
+
+int report_divergence(cpu_trace_reader_t *reader, const char *difference) {
+    printf("DIVERGED at instruction %llu, ", (unsigned long long) reader->records_count);
+    print_instruction(&reader->record);
+    printf(": %s\n", difference);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    const char *trace_path = 0;
+    const char *snapshot_path = 0;
+    bool print = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--snapshot=", 11) == 0 && argv[i][11]) {
+            snapshot_path = argv[i] + 11;
+        } else if (strsimilar(argv[i], "--print")) {
+            print = true;
+        } else if (argv[i][0] != '-' && !trace_path) {
+            trace_path = argv[i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (!trace_path) {
+        print_usage();
+        return 1;
+    }
+
+    char *default_snapshot_path = 0;
+    if (!snapshot_path) {
+        default_snapshot_path = malloc(strlen(trace_path) + sizeof(CPU_TRACE_SNAPSHOT_SUFFIX));
+        sprintf(default_snapshot_path, "%s%s", trace_path, CPU_TRACE_SNAPSHOT_SUFFIX);
+        snapshot_path = default_snapshot_path;
+    }
+
+    cpu_trace_reader_t *reader = cpu_trace_open(trace_path);
+    if (!reader) {
+        printf("error: unable to read trace %s\n", trace_path);
+        return 1;
+    }
+
+    cpu_snapshot_t *snapshot = cpu_snapshot_read(snapshot_path);
+    if (!snapshot) {
+        printf("error: unable to read snapshot %s\n", snapshot_path);
+        return 1;
+    }
+
+    if (snapshot->memory.size != reader->memory_size || snapshot->ip != reader->start_ip
+        || snapshot->instructions_executed != reader->start_instructions || snapshot->flag_equal != reader->start_flag_equal
+        || memcmp(snapshot->registers, reader->start_registers, sizeof(snapshot->registers)) != 0) {
+        printf("error: snapshot %s is not the state that the trace starts from\n", snapshot_path);
+        return 1;
+    }
+
+    starkcpu_t *cpu = cpu_create_from_snapshot(snapshot);
+    cpu_snapshot_destroy(snapshot);
+    free(default_snapshot_path);
+
+    if (!cpu) {
+        printf("unable to create cpu\n");
+        return 1;
+    }
+
+    // instructions are replayed one by one, fused instructions would only be split again every time
+    cpu->core = CPU_CORE_DISPATCH;
+    cpu->fusion = false;
+    cpu->running = true;
+
+    jmp_buf panic_handler;
+    cpu->panic_handler = &panic_handler;
+
+    cpu_trace_record_t *record = &reader->record;
+    uint8_t previous_flag_equal = reader->start_flag_equal;
+    cpu_trace_read_status_t status;
+
+    while ((status = cpu_trace_read(reader)) == CPU_TRACE_READ_RECORD && !record->end) {
+        if (cpu->ip != record->ip) {
+            char difference[64];
+            snprintf(difference, sizeof(difference), "instruction pointer is 0x%x", cpu->ip);
+            return report_divergence(reader, difference);
+        }
+
+        if (memcmp(cpu->mem + cpu->ip, record->bytes, record->length) != 0) {
+            return report_divergence(reader, "instruction in memory differs from the trace");
+        }
+
+        if (setjmp(panic_handler)) {
+            char difference[CPU_PANIC_MESSAGE_SIZE + 16];
+            snprintf(difference, sizeof(difference), "CPU panicked: %s", cpu->panic_message);
+            return report_divergence(reader, difference);
+        }
+
+        cpu_execute(cpu, 1);
+        cpu->instructions_executed++;
+
+        const char *difference = find_difference(cpu, record);
+        if (difference) {
+            return report_divergence(reader, difference);
+        }
+
+        if (print) {
+            printf("%12llu  ", (unsigned long long) cpu->instructions_executed);
+            print_instruction(record);
+            print_changes(record, previous_flag_equal);
+        }
+
+        previous_flag_equal = record->flag_equal;
+    }
+
+    if (status == CPU_TRACE_READ_INVALID) {
+        printf("warning: trace ends in the middle of a record after %llu instructions, e.g. because the traced process was killed\n",
+               (unsigned long long) reader->records_count);
+    } else if (status == CPU_TRACE_READ_END_OF_FILE) {
+        printf("warning: trace ends without an end record after %llu instructions\n", (unsigned long long) reader->records_count);
+    } else if (record->reason == CPU_TRACE_PANICKED) {
+        // the instruction that panicked is not recorded, executing it again has to panic the same way
+        if (!setjmp(panic_handler)) {
+            if (cpu->ip != record->ip) {
+                printf("DIVERGED at the end of the trace: instruction pointer is 0x%x, trace panicked at 0x%x\n", cpu->ip, record->ip);
+                return 1;
+            }
+
+            cpu_execute(cpu, 1);
+        }
+
+        if (strcmp(cpu->panic_message, record->message) != 0) {
+            printf("DIVERGED at the end of the trace: trace panicked with \"%s\", replay %s%s%s\n", record->message,
+                   cpu->panic_message[0] ? "panicked with \"" : "did not panic", cpu->panic_message, cpu->panic_message[0] ? "\"" : "");
+            return 1;
+        }
+
+        printf("PANIC: %s\n", record->message);
+    } else if (cpu->ip != record->ip || (record->reason == CPU_TRACE_HALTED) == (cpu->running && cpu->ip < cpu->memsize)) {
+        printf("DIVERGED at the end of the trace: replay %s at 0x%x, trace %s at 0x%x\n",
+               cpu->running ? "is running" : "halted", cpu->ip, record->reason == CPU_TRACE_HALTED ? "halted" : "stopped", record->ip);
+        return 1;
+    }
+
+    printf("replayed %llu instructions, execution matches the trace\n", (unsigned long long) reader->records_count);
+    printf("ip=0x%08x eq=%u", cpu->ip, cpu->flag_equal);
+
+    for (uint32_t i = 0; i < CPU_REGISTERS_COUNT; i++) {
+        printf(" r%u=%d", i, cpu->registers[i]);
+    }
+
+    printf("\n");
+    cpu_trace_close(reader);
+    cpu_destroy(cpu);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include "ring.h"
+#include <stdlib.h>
+#include <string.h>
+
+void cpu_ring_push(cpu_ring_t *ring, const uint8_t *data, uint32_t size) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    while (size > 0) {
+        uint64_t free = ring->size - (head - ring->cached_tail);
+        if (free < size) {
+            ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+            free = ring->size - (head - ring->cached_tail);
+        }
+
+        if (free == 0) {
+            cpu_sleep(CPU_RING_PRODUCER_SLEEP_TIME);
+            continue;
+        }
+
+        uint32_t offset = head & (ring->size - 1);
+        uint32_t chunk = size < free ? size : free;
+        uint32_t first = chunk < ring->size - offset ? chunk : ring->size - offset;
+
+        memcpy(ring->data + offset, data, first);
+        memcpy(ring->data, data + first, chunk - first);
+
+        head += chunk;
+        atomic_store_explicit(&ring->head, head, memory_order_release);
+
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+void *drain_ring(void *argument) {
+    cpu_ring_t *ring = argument;
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    bool waited = false;
+
+    while (true) {
+        // checked before the head, so that bytes pushed right before stopping are still written
+        bool stopping = atomic_load(&ring->stopping);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        if (head == tail && stopping) {
+            break;
+        }
+
+        // a small batch waits once for more bytes to arrive, so the latency of the output is still bounded
+        if (head == tail || (head - tail < ring->batch_size && !stopping && !waited)) {
+            cpu_sleep(CPU_RING_WRITER_SLEEP_TIME);
+            waited = head != tail;
+            continue;
+        }
+
+        uint32_t offset = tail & (ring->size - 1);
+        uint64_t size = head - tail < ring->size - offset ? head - tail : ring->size - offset;
+
+        if (!atomic_load(&ring->output_failed) && !ring->output(ring->context, ring->data + offset, size)) {
+            atomic_store(&ring->output_failed, true);
+        }
+
+        waited = false;
+
+        tail += size;
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+
+    return 0;
+}
+
+bool cpu_ring_start(cpu_ring_t *ring, uint32_t size, uint32_t batch_size, cpu_ring_output_t output, void *context) {
+    ring->data = malloc(size);
+    ring->size = size;
+    ring->batch_size = batch_size;
+    ring->output = output;
+    ring->context = context;
+    ring->cached_tail = 0;
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->stopping, false);
+    atomic_init(&ring->output_failed, false);
+
+    if (!ring->data || pthread_create(&ring->writer, 0, drain_ring, ring) != 0) {
+        free(ring->data);
+        return false;
+    }
+
+    return true;
+}
+
+bool cpu_ring_stop(cpu_ring_t *ring) {
+    atomic_store(&ring->stopping, true);
+    pthread_join(ring->writer, 0);
+
+    free(ring->data);
+    return !atomic_load(&ring->output_failed);
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "cpu.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* Time (in microseconds) that the writer thread waits for more bytes, and that the producer waits for space when the ring is full. */
+#define CPU_RING_WRITER_SLEEP_TIME 1000
+#define CPU_RING_PRODUCER_SLEEP_TIME 50
+
+/* Writes a block of bytes taken from the ring. Returns false if they could not be written. */
+typedef bool (*cpu_ring_output_t)(void *context, const uint8_t *data, uint64_t size);
+
+/*
+ * Single producer, single consumer ring of bytes that a thread of the ring hands to its output, so the producer never
+ * waits for the host unless the ring fills up. The producer only moves `head`, the writer thread only moves `tail`,
+ * so neither of them ever takes a lock. Both are on their own cache line, and the producer only reads `tail` again
+ * once the ring looks full.
+ */
+typedef struct {
+    uint8_t *data;
+    uint32_t size;
+
+    // The writer thread only writes less than this many bytes at once if nothing more arrived while it waited,
+    // so many small pushes still end up in a few large writes. 0 writes whatever is there right away.
+    uint32_t batch_size;
+
+    cpu_ring_output_t output;
+    void *context;
+
+    _Alignas(64) _Atomic uint64_t head;
+    uint64_t cached_tail;
+    _Alignas(64) _Atomic uint64_t tail;
+    _Alignas(64) atomic_bool stopping;
+    pthread_t writer;
+
+    // Set by the writer thread, bytes are still consumed afterwards so that the producer never waits forever.
+    atomic_bool output_failed;
+} cpu_ring_t;
+
+/*
+ * Allocates a ring of given size, which has to be a power of two, and starts its writer thread.
+ * Returns false if the host is out of memory or the thread can not be started.
+ */
+bool cpu_ring_start(cpu_ring_t *ring, uint32_t size, uint32_t batch_size, cpu_ring_output_t output, void *context);
+
+/* Copies bytes into the ring, waiting for the writer thread whenever the ring is full. Only called by the producer. */
+void cpu_ring_push(cpu_ring_t *ring, const uint8_t *data, uint32_t size);
+
+/* Waits until everything pushed so far is written, stops the writer thread and frees the ring. Returns false if any output failed. */
+bool cpu_ring_stop(cpu_ring_t *ring);
\ No newline at end of file
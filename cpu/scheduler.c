@@ -0,0 +1,141 @@
+#include "scheduler.h"
+#include <stdlib.h>
+
+#define CPU_SCHEDULER_INITIAL_CAPACITY 16
+
+cpu_scheduler_t *cpu_scheduler_create() {
+    cpu_scheduler_t *scheduler = malloc(sizeof(cpu_scheduler_t));
+    if (!scheduler) {
+        return 0;
+    }
+
+    scheduler->events = malloc(CPU_SCHEDULER_INITIAL_CAPACITY * sizeof(cpu_event_t));
+    if (!scheduler->events) {
+        free(scheduler);
+        return 0;
+    }
+
+    scheduler->events_capacity = CPU_SCHEDULER_INITIAL_CAPACITY;
+    scheduler->next_id = 1;
+    cpu_scheduler_reset(scheduler);
+    return scheduler;
+}
+
+void cpu_scheduler_destroy(cpu_scheduler_t *scheduler) {
+    free(scheduler->events);
+    free(scheduler);
+}
+
+void cpu_scheduler_reset(cpu_scheduler_t *scheduler) {
+    // ids are never reused, so that a device can not cancel an event of another one with an id it kept from before
+    scheduler->events_count = 0;
+    scheduler->in_batch = false;
+    scheduler->ended_batch = false;
+}
+
+bool is_earlier(const cpu_event_t *a, const cpu_event_t *b) {
+    // ids only grow, so events scheduled for the same cycle run in the order they were scheduled in
+    return a->cycle < b->cycle || (a->cycle == b->cycle && a->id < b->id);
+}
+
+void swap_events(cpu_event_t *events, uint32_t a, uint32_t b) {
+    cpu_event_t event = events[a];
+    events[a] = events[b];
+    events[b] = event;
+}
+
+void sift_up(cpu_scheduler_t *scheduler, uint32_t index) {
+    while (index > 0 && is_earlier(scheduler->events + index, scheduler->events + (index - 1) / 2)) {
+        swap_events(scheduler->events, index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    }
+}
+
+void sift_down(cpu_scheduler_t *scheduler, uint32_t index) {
+    while (true) {
+        uint32_t earliest = index;
+        uint32_t left = index * 2 + 1;
+        uint32_t right = left + 1;
+
+        if (left < scheduler->events_count && is_earlier(scheduler->events + left, scheduler->events + earliest)) {
+            earliest = left;
+        }
+
+        if (right < scheduler->events_count && is_earlier(scheduler->events + right, scheduler->events + earliest)) {
+            earliest = right;
+        }
+
+        if (earliest == index) {
+            return;
+        }
+
+        swap_events(scheduler->events, index, earliest);
+        index = earliest;
+    }
+}
+
+void remove_event(cpu_scheduler_t *scheduler, uint32_t index) {
+    scheduler->events[index] = scheduler->events[--scheduler->events_count];
+
+    if (index < scheduler->events_count) {
+        sift_up(scheduler, index);
+        sift_down(scheduler, index);
+    }
+}
+
+uint64_t cpu_scheduler_next_cycle(cpu_scheduler_t *scheduler) {
+    return scheduler->events_count > 0 ? scheduler->events[0].cycle : UINT64_MAX;
+}
+
+uint32_t cpu_schedule_event(starkcpu_t *cpu, uint64_t cycle, cpu_event_callback_t callback, void *context) {
+    cpu_scheduler_t *scheduler = cpu->scheduler;
+
+    if (scheduler->events_count == scheduler->events_capacity) {
+        scheduler->events_capacity *= 2;
+        scheduler->events = realloc(scheduler->events, scheduler->events_capacity * sizeof(cpu_event_t));
+    }
+
+    uint32_t id = scheduler->next_id++;
+    scheduler->events[scheduler->events_count] = (cpu_event_t) { cycle, id, callback, context };
+    sift_up(scheduler, scheduler->events_count++);
+
+    if (cycle < cpu->next_event) {
+        cpu->next_event = cycle;
+    }
+
+    return id;
+}
+
+bool cpu_cancel_event(starkcpu_t *cpu, uint32_t id) {
+    cpu_scheduler_t *scheduler = cpu->scheduler;
+
+    for (uint32_t i = 0; i < scheduler->events_count; i++) {
+        if (scheduler->events[i].id == id) {
+            // next_event is left as it is, a batch that ends early at the removed event does no harm
+            remove_event(scheduler, i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void cpu_scheduler_run(starkcpu_t *cpu, uint64_t cycle) {
+    cpu_scheduler_t *scheduler = cpu->scheduler;
+
+    while (scheduler->events_count > 0 && scheduler->events[0].cycle <= cycle) {
+        cpu_event_t event = scheduler->events[0];
+        remove_event(scheduler, 0);
+        event.callback(event.context, cycle);
+    }
+}
+
+void cpu_scheduler_end_batch(starkcpu_t *cpu) {
+    cpu_scheduler_t *scheduler = cpu->scheduler;
+    cpu->next_event = 0;
+
+    if (scheduler->in_batch && cpu->running) {
+        cpu->running = false;
+        scheduler->ended_batch = true;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "cpu.h"
+
+/*
+ * Time of the machine is counted in virtual cycles, one for every executed instruction, plus the cycles the CPU spends
+ * waiting for an interrupt (see OP_WAIT). The current cycle is only known in between batches of instructions, which is
+ * when events are run, so batches are cut short at the next event, and a device that needs the exact time while a batch
+ * is executing ends the batch.
+ */
+typedef void (*cpu_event_callback_t)(void *context, uint64_t cycle);
+
+typedef struct {
+    uint64_t cycle;
+    uint32_t id;
+    cpu_event_callback_t callback;
+    void *context;
+} cpu_event_t;
+
+/* Events that are due at some cycle, kept in a binary min-heap ordered by cycle, and by order of scheduling within a cycle. */
+typedef struct cpu_scheduler_t {
+    cpu_event_t *events;
+    uint32_t events_count;
+    uint32_t events_capacity;
+    uint32_t next_id;
+
+    // Set while the CPU executes a batch of instructions, see cpu_scheduler_end_batch.
+    bool in_batch;
+    bool ended_batch;
+} cpu_scheduler_t;
+
+/* Creates an empty scheduler. Returns 0 if the host is out of memory. */
+cpu_scheduler_t *cpu_scheduler_create();
+void cpu_scheduler_destroy(cpu_scheduler_t *scheduler);
+
+/* Drops all events. */
+void cpu_scheduler_reset(cpu_scheduler_t *scheduler);
+
+/*
+ * Calls `callback` once the CPU reaches given cycle, with the cycle it is at. An event scheduled for a cycle that has
+ * already passed runs right after the current batch, which only ends early if the batch is ended as well.
+ * Returns id of the event, which is never 0.
+ */
+uint32_t cpu_schedule_event(starkcpu_t *cpu, uint64_t cycle, cpu_event_callback_t callback, void *context);
+
+/* Removes an event that did not run yet. Returns false if there is no such event. */
+bool cpu_cancel_event(starkcpu_t *cpu, uint32_t id);
+
+/* Runs every event due at or before given cycle, in order. Events can schedule new events, those that are due run as well. */
+void cpu_scheduler_run(starkcpu_t *cpu, uint64_t cycle);
+
+/* Returns cycle of the earliest event, or UINT64_MAX if there is none. */
+uint64_t cpu_scheduler_next_cycle(cpu_scheduler_t *scheduler);
+
+/*
+ * Ends the batch of instructions that is being executed right after the current instruction, so that the CPU gets to
+ * events and interrupts at the exact cycle. Does not stop the CPU, batches check whether it is running after every
+ * instruction, so that is what they are stopped with, and cpu_execute starts it again.
+ */
+void cpu_scheduler_end_batch(starkcpu_t *cpu);
\ No newline at end of file
@@ -0,0 +1,228 @@
+#include "smp.h"
+#include "bus.h"
+#include "cpu-executor.h"
+#include "memory.h"
+#include "scheduler.h"
+#include <stdlib.h>
+
+void *run_core(void *argument) {
+    cpu_smp_core_t *core = argument;
+    starkcpu_t *cpu = core->cpu;
+    jmp_buf *previous_handler = cpu->panic_handler;
+
+    // every thread needs a handler of its own, a panic must not jump onto the stack of another one
+    jmp_buf panic_handler;
+    cpu->panic_handler = &panic_handler;
+
+    if (!setjmp(panic_handler)) {
+        cpu_start(cpu);
+    } else {
+        for (uint32_t i = 0; i < core->smp->cores_count; i++) {
+            atomic_store(&core->smp->cores[i].stop_requested, true);
+        }
+    }
+
+    cpu->panic_handler = previous_handler;
+    return 0;
+}
+
+/* Frees every core but the first one, up to given number of cores. */
+void destroy_cores(cpu_smp_t *smp, uint32_t cores_count) {
+    for (uint32_t i = 1; i < cores_count; i++) {
+        starkcpu_t *core = smp->cores[i].cpu;
+
+        if (core->executor) {
+            cpu_executor_destroy(core->executor);
+        }
+
+        if (core->scheduler) {
+            cpu_scheduler_destroy(core->scheduler);
+        }
+
+        cpu_memory_release(core->io_pages, CPU_IO_PAGES_COUNT);
+        free(core);
+    }
+
+    for (uint32_t i = 0; i < cores_count; i++) {
+        free(smp->cores[i].seen_code_generations);
+    }
+
+    free(smp->code_generations);
+    free(smp->cores);
+    free(smp);
+}
+
+cpu_smp_t *cpu_smp_create(starkcpu_t *cpu, uint32_t cores_count) {
+    if (cores_count < 2 || cores_count > CPU_SMP_MAX_CORES) {
+        return 0;
+    }
+
+    cpu_smp_t *smp = malloc(sizeof(cpu_smp_t));
+    if (!smp) {
+        return 0;
+    }
+
+    uint32_t pages_count = cpu->memsize >> CPU_PAGE_SHIFT;
+    smp->cores = calloc(cores_count, sizeof(cpu_smp_core_t));
+    smp->cores_count = cores_count;
+    smp->code_generations = calloc(pages_count, sizeof(_Atomic uint32_t));
+
+    if (!smp->cores || !smp->code_generations) {
+        free(smp->cores);
+        free(smp->code_generations);
+        free(smp);
+        return 0;
+    }
+
+    atomic_init(&smp->code_start, cpu->executor->code_start);
+    atomic_init(&smp->code_end, cpu->executor->code_end);
+    atomic_init(&smp->code_generation, 0);
+
+    smp->cores[0].cpu = cpu;
+
+    for (uint32_t i = 1; i < cores_count; i++) {
+        starkcpu_t *core = malloc(sizeof(starkcpu_t));
+        uint8_t *io_pages = cpu_memory_reserve(CPU_IO_PAGES_COUNT);
+
+        if (!core || !io_pages) {
+            free(core);
+
+            if (io_pages) {
+                cpu_memory_release(io_pages, CPU_IO_PAGES_COUNT);
+            }
+
+            destroy_cores(smp, i);
+            return 0;
+        }
+
+        *core = *cpu;
+
+        // devices stay with the first core, along with everything they raise or schedule
+        core->io_pages = io_pages;
+        core->bus = 0;
+        core->interrupts = 0;
+        core->interrupts_enabled = false;
+        core->waiting = false;
+        core->scheduler = cpu_scheduler_create();
+        core->next_event = UINT64_MAX;
+
+        core->executor = cpu_executor_create(core);
+        core->ui = 0;
+        core->profiler = 0;
+        core->tracer = 0;
+        core->debugger = 0;
+        core->panic_handler = 0;
+        core->panic_message[0] = '\0';
+        core->instructions_executed = 0;
+        core->core_id = i;
+
+        smp->cores[i].cpu = core;
+
+        if (!core->scheduler || !core->executor) {
+            destroy_cores(smp, i + 1);
+            return 0;
+        }
+    }
+
+    for (uint32_t i = 0; i < cores_count; i++) {
+        smp->cores[i].seen_code_generations = calloc(pages_count, sizeof(uint32_t));
+        smp->cores[i].seen_code_generation = 0;
+
+        if (!smp->cores[i].seen_code_generations) {
+            destroy_cores(smp, cores_count);
+            return 0;
+        }
+    }
+
+    for (uint32_t i = 0; i < cores_count; i++) {
+        smp->cores[i].smp = smp;
+        smp->cores[i].cpu->cores_count = cores_count;
+        smp->cores[i].cpu->smp_core = &smp->cores[i];
+        atomic_init(&smp->cores[i].stop_requested, false);
+    }
+
+    return smp;
+}
+
+void cpu_smp_add_code(cpu_smp_t *smp, uint32_t start, uint32_t end) {
+    uint32_t shared_start = atomic_load_explicit(&smp->code_start, memory_order_relaxed);
+    while (start < shared_start && !atomic_compare_exchange_weak(&smp->code_start, &shared_start, start)) {
+    }
+
+    uint32_t shared_end = atomic_load_explicit(&smp->code_end, memory_order_relaxed);
+    while (end > shared_end && !atomic_compare_exchange_weak(&smp->code_end, &shared_end, end)) {
+    }
+}
+
+void cpu_smp_publish_code_change(cpu_smp_t *smp, uint32_t address, uint32_t size) {
+    uint32_t last = (uint32_t) (((uint64_t) address + size - 1) >> CPU_PAGE_SHIFT);
+
+    for (uint32_t page = address >> CPU_PAGE_SHIFT; page <= last; page++) {
+        atomic_fetch_add_explicit(&smp->code_generations[page], 1, memory_order_relaxed);
+    }
+
+    // a core that sees the new generation sees the pages that changed as well
+    atomic_fetch_add_explicit(&smp->code_generation, 1, memory_order_release);
+}
+
+void cpu_smp_sync_code(cpu_smp_core_t *core) {
+    cpu_smp_t *smp = core->smp;
+    cpu_executor_t *executor = core->cpu->executor;
+
+    uint32_t start = atomic_load_explicit(&smp->code_start, memory_order_relaxed);
+    uint32_t end = atomic_load_explicit(&smp->code_end, memory_order_relaxed);
+
+    if (start < executor->code_start) {
+        executor->code_start = start;
+    }
+
+    if (end > executor->code_end) {
+        executor->code_end = end;
+    }
+
+    uint64_t generation = atomic_load_explicit(&smp->code_generation, memory_order_acquire);
+    if (generation == core->seen_code_generation || executor->code_end <= executor->code_start) {
+        return;
+    }
+
+    core->seen_code_generation = generation;
+
+    for (uint32_t page = executor->code_start >> CPU_PAGE_SHIFT; page <= (executor->code_end - 1) >> CPU_PAGE_SHIFT; page++) {
+        uint32_t page_generation = atomic_load_explicit(&smp->code_generations[page], memory_order_relaxed);
+
+        if (page_generation != core->seen_code_generations[page]) {
+            core->seen_code_generations[page] = page_generation;
+            cpu_executor_discard_range(executor, page << CPU_PAGE_SHIFT, CPU_PAGE_SIZE);
+        }
+    }
+}
+
+bool cpu_smp_start(cpu_smp_t *smp) {
+    for (uint32_t i = 0; i < smp->cores_count; i++) {
+        atomic_store(&smp->cores[i].stop_requested, false);
+    }
+
+    uint32_t started = 0;
+    while (started < smp->cores_count && pthread_create(&smp->cores[started].thread, 0, run_core, &smp->cores[started]) == 0) {
+        started++;
+    }
+
+    // cores that did start would wait for the others forever
+    if (started < smp->cores_count) {
+        for (uint32_t i = 0; i < started; i++) {
+            atomic_store(&smp->cores[i].stop_requested, true);
+        }
+    }
+
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(smp->cores[i].thread, 0);
+    }
+
+    return started == smp->cores_count;
+}
+
+void cpu_smp_destroy(cpu_smp_t *smp) {
+    smp->cores[0].cpu->cores_count = 1;
+    smp->cores[0].cpu->smp_core = 0;
+    destroy_cores(smp, smp->cores_count);
+}
\ No newline at end of file
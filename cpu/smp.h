@@ -0,0 +1,76 @@
+#pragma once
+
+#include "cpu.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define CPU_SMP_MAX_CORES 64
+
+struct cpu_smp_t;
+
+typedef struct cpu_smp_core_t {
+    struct cpu_smp_t *smp;
+    starkcpu_t *cpu;
+    pthread_t thread;
+
+    // Set by the thread of a core that panicked. cpu_execute stops the core in between batches,
+    // running is only ever written by the thread of the core itself.
+    atomic_bool stop_requested;
+
+    // Generations of pages of code, one per page of memory, and of all of them, that the executor of this core last caught up with.
+    uint32_t *seen_code_generations;
+    uint64_t seen_code_generation;
+} cpu_smp_core_t;
+
+/*
+ * Cores of a machine that share memory of its first core, each executed by a thread of its own. Other cores are copies
+ * of the first one, made when the machine is created: they share memory, its page table and the configuration, start
+ * at the same instruction with the same registers, and have an executor and a scheduler of their own.
+ * Programs tell cores apart with OP_CORE_ID, and synchronize with OP_COMPARE_EXCHANGE, OP_FETCH_ADD and OP_FENCE,
+ * other accesses to memory are not ordered between cores. Limitations:
+ * - devices are only attached to the first core, on other cores their addresses are plain memory,
+ * - a core only notices code changed by another core or by a device once it synchronizes with any of these instructions,
+ *   until then it may still execute instructions it decoded before,
+ * - internal memory (registers and interrupt vectors) is shared, so only the first core should read it or use interrupts.
+ */
+typedef struct cpu_smp_t {
+    cpu_smp_core_t *cores;
+    uint32_t cores_count;
+
+    // Range of addresses that executors of all cores decoded instructions from. Every core widens its own range to this one,
+    // so that it notices writes into code decoded by any core.
+    _Atomic uint32_t code_start;
+    _Atomic uint32_t code_end;
+
+    // Incremented for every page of code that is written to, and once more for every write as a whole.
+    _Atomic uint32_t *code_generations;
+    _Atomic uint64_t code_generation;
+} cpu_smp_t;
+
+/*
+ * Creates a machine of given number of cores, between 2 and CPU_SMP_MAX_CORES, whose first core is given CPU,
+ * with its program loaded and devices attached. Returns 0 if the number is not valid or the host is out of memory.
+ */
+cpu_smp_t *cpu_smp_create(starkcpu_t *cpu, uint32_t cores_count);
+
+/*
+ * Runs all cores until every one of them halts, or any of them panics, which stops the others as well.
+ * Panic message of every core is left in its CPU. Returns false if a thread could not be started for every core,
+ * the cores that were started are stopped then.
+ */
+bool cpu_smp_start(cpu_smp_t *smp);
+
+/* Frees all cores but the first one, which is left as a CPU with a single core. */
+void cpu_smp_destroy(cpu_smp_t *smp);
+
+/* Widens the range of code shared by all cores, after a core decoded instructions from given range. */
+void cpu_smp_add_code(cpu_smp_t *smp, uint32_t start, uint32_t end);
+
+/* Tells other cores that code in given range was written to. */
+void cpu_smp_publish_code_change(cpu_smp_t *smp, uint32_t address, uint32_t size);
+
+/*
+ * Drops instructions that given core decoded from pages of code changed since it last checked, and widens its range
+ * of code to the one of all cores. Called in between batches and by instructions that synchronize cores.
+ */
+void cpu_smp_sync_code(cpu_smp_core_t *core);
\ No newline at end of file
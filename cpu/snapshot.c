@@ -0,0 +1,393 @@
+#include "snapshot.h"
+#include "bus.h"
+#include "scheduler.h"
+#include "interrupts.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CPU_SNAPSHOT_FILE_MAGIC "STKSNAP"
+#define CPU_SNAPSHOT_FILE_VERSION 3
+
+/* Largest state of a single device that a snapshot file is trusted with. */
+#define CPU_SNAPSHOT_MAX_DEVICE_STATE_SIZE (64 * 1024)
+
+/*
+ * Start of a snapshot file, followed by saved memory (see cpu_memory_image_write), the number of saved devices, and
+ * the address, size and state of every one of them.
+ */
+typedef struct {
+    char magic[7];
+    uint8_t version;
+
+    uint32_t memory_size;
+    uint32_t next_block_offset;
+    uint32_t ip;
+    int32_t registers[CPU_REGISTERS_COUNT];
+    uint64_t instructions_executed;
+    uint32_t clock_rate;
+    uint8_t flag_equal;
+    uint8_t running;
+    uint8_t core;
+    uint8_t fusion;
+    uint32_t interrupt_return;
+    uint8_t interrupt_flag_equal;
+    uint8_t interrupts_enabled;
+    uint8_t waiting;
+} cpu_snapshot_file_header_t;
+
+/* Returns the mapping of the device at given address if it can be saved and restored, otherwise 0. */
+const cpu_bus_mapping_t *find_saved_device(starkcpu_t *cpu, uint32_t address) {
+    uint8_t entry = cpu->bus ? cpu->io_pages[address >> CPU_PAGE_SHIFT] : 0;
+    const cpu_bus_mapping_t *mapping = entry ? cpu->bus->mappings + entry - 1 : 0;
+
+    if (!mapping || mapping->address != address || !mapping->hooks || !mapping->hooks->save || !mapping->hooks->restore) {
+        return 0;
+    }
+
+    return mapping;
+}
+
+/* Checks whether every device of given CPU can be saved, along with every event that is scheduled. */
+bool can_save_devices(starkcpu_t *cpu) {
+    for (uint32_t i = 0; cpu->bus && i < CPU_BUS_MAX_DEVICES; i++) {
+        const cpu_bus_mapping_t *mapping = cpu->bus->mappings + i;
+
+        if (mapping->size > 0 && !find_saved_device(cpu, mapping->address)) {
+            return false;
+        }
+    }
+
+    // devices save the events they scheduled themselves, an event of anything else would be lost
+    for (uint32_t i = 0; i < cpu->scheduler->events_count; i++) {
+        bool owned = false;
+
+        for (uint32_t j = 0; cpu->bus && j < CPU_BUS_MAX_DEVICES && !owned; j++) {
+            owned = cpu->bus->mappings[j].size > 0 && cpu->bus->mappings[j].device == cpu->scheduler->events[i].context;
+        }
+
+        if (!owned) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void free_devices(cpu_snapshot_t *snapshot) {
+    for (uint32_t i = 0; i < snapshot->devices_count; i++) {
+        free(snapshot->devices[i].state);
+    }
+
+    free(snapshot->devices);
+    snapshot->devices = 0;
+    snapshot->devices_count = 0;
+}
+
+bool save_devices(starkcpu_t *cpu, cpu_snapshot_t *snapshot) {
+    snapshot->devices = 0;
+    snapshot->devices_count = 0;
+
+    if (!cpu->bus || cpu->bus->devices_count == 0) {
+        return true;
+    }
+
+    snapshot->devices = malloc(cpu->bus->devices_count * sizeof(cpu_snapshot_device_t));
+    if (!snapshot->devices) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < CPU_BUS_MAX_DEVICES; i++) {
+        const cpu_bus_mapping_t *mapping = cpu->bus->mappings + i;
+        if (mapping->size == 0) {
+            continue;
+        }
+
+        // zeroed, so that padding of the state is written into files as zeroes
+        cpu_snapshot_device_t *device = snapshot->devices + snapshot->devices_count;
+        device->address = mapping->address;
+        device->size = mapping->hooks->state_size;
+        device->state = calloc(1, device->size);
+
+        if (!device->state) {
+            return false;
+        }
+
+        snapshot->devices_count++;
+        mapping->hooks->save(mapping->device, device->state);
+    }
+
+    return true;
+}
+
+void restore_devices(starkcpu_t *cpu, const cpu_snapshot_t *snapshot) {
+    for (uint32_t i = 0; i < snapshot->devices_count; i++) {
+        const cpu_snapshot_device_t *device = snapshot->devices + i;
+        const cpu_bus_mapping_t *mapping = find_saved_device(cpu, device->address);
+
+        if (mapping && mapping->hooks->state_size == device->size) {
+            mapping->hooks->restore(mapping->device, device->state);
+        }
+    }
+}
+
+cpu_snapshot_t *cpu_snapshot_create(starkcpu_t *cpu) {
+    if (!can_save_devices(cpu)) {
+        return 0;
+    }
+
+    cpu_snapshot_t *snapshot = malloc(sizeof(cpu_snapshot_t));
+    if (!snapshot) {
+        return 0;
+    }
+
+    // devices come first, memory then holds everything they wrote into it on the host, e.g. a transfer of the disk
+    if (!save_devices(cpu, snapshot) || !cpu_memory_save(cpu, &snapshot->memory)) {
+        free_devices(snapshot);
+        free(snapshot);
+        return 0;
+    }
+
+    snapshot->next_block_offset = cpu->nextmem - cpu->mem;
+    snapshot->ip = cpu->ip;
+    memcpy(snapshot->registers, cpu->registers, sizeof(snapshot->registers));
+    snapshot->flag_equal = cpu->flag_equal;
+    snapshot->running = cpu->running;
+    snapshot->instructions_executed = cpu->instructions_executed;
+    snapshot->interrupts_enabled = cpu->interrupts_enabled;
+    snapshot->interrupt_return = cpu->interrupt_return;
+    snapshot->interrupt_flag_equal = cpu->interrupt_flag_equal;
+    snapshot->waiting = cpu->waiting;
+
+    snapshot->core = cpu->core;
+    snapshot->fusion = cpu->fusion;
+    snapshot->clock_rate = cpu->clock_rate;
+    return snapshot;
+}
+
+void cpu_snapshot_destroy(cpu_snapshot_t *snapshot) {
+    cpu_memory_image_destroy(&snapshot->memory);
+    free_devices(snapshot);
+    free(snapshot);
+}
+
+bool cpu_snapshot_restore(starkcpu_t *cpu, const cpu_snapshot_t *snapshot) {
+    if (cpu->memsize != snapshot->memory.size) {
+        return false;
+    }
+
+    // devices finish what they do on the host before memory is replaced, and continue from the saved state once it is
+    cpu_bus_reset_devices(cpu);
+    cpu_scheduler_reset(cpu->scheduler);
+    if (cpu->interrupts) {
+        cpu_interrupts_reset(cpu->interrupts);
+    }
+
+    cpu_memory_restore(cpu, &snapshot->memory);
+
+    cpu->nextmem = cpu->mem + snapshot->next_block_offset;
+    cpu->ip = snapshot->ip;
+    memcpy(cpu->registers, snapshot->registers, sizeof(cpu->registers));
+    cpu->flag_equal = snapshot->flag_equal;
+    cpu->running = snapshot->running;
+    cpu->instructions_executed = snapshot->instructions_executed;
+    cpu->interrupts_enabled = snapshot->interrupts_enabled;
+    cpu->interrupt_return = snapshot->interrupt_return;
+    cpu->interrupt_flag_equal = snapshot->interrupt_flag_equal;
+    cpu->waiting = snapshot->waiting;
+    cpu->panic_message[0] = '\0';
+
+    // restored events and interrupts are handled before the next instruction
+    restore_devices(cpu, snapshot);
+    cpu->next_event = 0;
+
+    cpu->core = snapshot->core;
+    cpu->fusion = snapshot->fusion;
+    cpu->clock_rate = snapshot->clock_rate;
+    return true;
+}
+
+bool write_devices(const cpu_snapshot_t *snapshot, FILE *file) {
+    if (fwrite(&snapshot->devices_count, sizeof(snapshot->devices_count), 1, file) != 1) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < snapshot->devices_count; i++) {
+        const cpu_snapshot_device_t *device = snapshot->devices + i;
+        uint32_t location[2] = { device->address, device->size };
+
+        if (fwrite(location, sizeof(location), 1, file) != 1 || fwrite(device->state, 1, device->size, file) != device->size) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool read_devices(cpu_snapshot_t *snapshot, FILE *file) {
+    uint32_t count;
+    snapshot->devices = 0;
+    snapshot->devices_count = 0;
+
+    if (fread(&count, sizeof(count), 1, file) != 1 || count > CPU_BUS_MAX_DEVICES) {
+        return false;
+    }
+
+    if (count == 0) {
+        return true;
+    }
+
+    snapshot->devices = malloc(count * sizeof(cpu_snapshot_device_t));
+    if (!snapshot->devices) {
+        return false;
+    }
+
+    while (snapshot->devices_count < count) {
+        cpu_snapshot_device_t *device = snapshot->devices + snapshot->devices_count;
+        uint32_t location[2];
+
+        if (fread(location, sizeof(location), 1, file) != 1 || location[1] == 0 || location[1] > CPU_SNAPSHOT_MAX_DEVICE_STATE_SIZE) {
+            return false;
+        }
+
+        device->address = location[0];
+        device->size = location[1];
+        device->state = malloc(device->size);
+
+        if (!device->state) {
+            return false;
+        }
+
+        snapshot->devices_count++;
+
+        if (fread(device->state, 1, device->size, file) != device->size) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool cpu_snapshot_write(const cpu_snapshot_t *snapshot, const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+
+    cpu_snapshot_file_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CPU_SNAPSHOT_FILE_MAGIC, sizeof(header.magic));
+    header.version = CPU_SNAPSHOT_FILE_VERSION;
+
+    header.memory_size = snapshot->memory.size;
+    header.next_block_offset = snapshot->next_block_offset;
+    header.ip = snapshot->ip;
+    memcpy(header.registers, snapshot->registers, sizeof(header.registers));
+    header.instructions_executed = snapshot->instructions_executed;
+    header.clock_rate = snapshot->clock_rate;
+    header.flag_equal = snapshot->flag_equal;
+    header.running = snapshot->running;
+    header.core = snapshot->core;
+    header.fusion = snapshot->fusion;
+    header.interrupt_return = snapshot->interrupt_return;
+    header.interrupt_flag_equal = snapshot->interrupt_flag_equal;
+    header.interrupts_enabled = snapshot->interrupts_enabled;
+    header.waiting = snapshot->waiting;
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && cpu_memory_image_write(&snapshot->memory, file)
+        && write_devices(snapshot, file);
+
+    return fclose(file) == 0 && written;
+}
+
+cpu_snapshot_t *cpu_snapshot_read(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+
+    cpu_snapshot_file_header_t header;
+    cpu_snapshot_t *snapshot = malloc(sizeof(cpu_snapshot_t));
+
+    bool valid = snapshot
+        && fread(&header, sizeof(header), 1, file) == 1
+        && memcmp(header.magic, CPU_SNAPSHOT_FILE_MAGIC, sizeof(header.magic)) == 0
+        && header.version == CPU_SNAPSHOT_FILE_VERSION
+        && header.next_block_offset <= header.memory_size
+        && header.core <= CPU_CORE_JIT
+        && cpu_memory_image_read(&snapshot->memory, header.memory_size, file);
+
+    if (valid && !read_devices(snapshot, file)) {
+        cpu_memory_image_destroy(&snapshot->memory);
+        free_devices(snapshot);
+        valid = false;
+    }
+
+    fclose(file);
+
+    if (!valid) {
+        free(snapshot);
+        return 0;
+    }
+
+    snapshot->next_block_offset = header.next_block_offset;
+    snapshot->ip = header.ip;
+    memcpy(snapshot->registers, header.registers, sizeof(snapshot->registers));
+    snapshot->flag_equal = header.flag_equal;
+    snapshot->running = header.running;
+    snapshot->instructions_executed = header.instructions_executed;
+    snapshot->interrupts_enabled = header.interrupts_enabled;
+    snapshot->interrupt_return = header.interrupt_return;
+    snapshot->interrupt_flag_equal = header.interrupt_flag_equal;
+    snapshot->waiting = header.waiting;
+
+    snapshot->core = header.core;
+    snapshot->fusion = header.fusion;
+    snapshot->clock_rate = header.clock_rate;
+    return snapshot;
+}
+
+starkcpu_t *cpu_create_from_snapshot(const cpu_snapshot_t *snapshot) {
+    starkcpu_t *cpu = cpu_create(false, snapshot->memory.size);
+
+    if (cpu) {
+        cpu_snapshot_restore(cpu, snapshot);
+    }
+
+    return cpu;
+}
+
+/* Attaches a device of the same kind as every device of given CPU to its copy. Returns false if any of them can not be attached. */
+bool copy_devices(starkcpu_t *cpu, starkcpu_t *copy) {
+    for (uint32_t i = 0; cpu->bus && i < CPU_BUS_MAX_DEVICES; i++) {
+        const cpu_bus_mapping_t *mapping = cpu->bus->mappings + i;
+
+        if (mapping->size > 0 && !(mapping->hooks->copy && mapping->hooks->copy(mapping->device, copy))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+starkcpu_t *cpu_fork(starkcpu_t *cpu) {
+    cpu_snapshot_t *snapshot = cpu_snapshot_create(cpu);
+    if (!snapshot) {
+        return 0;
+    }
+
+    // devices of the copy are attached before it is restored, so that they continue from the saved state as well
+    starkcpu_t *copy = cpu_create(false, snapshot->memory.size);
+    if (copy && !copy_devices(cpu, copy)) {
+        cpu_destroy(copy);
+        copy = 0;
+    }
+
+    if (copy) {
+        cpu_snapshot_restore(copy, snapshot);
+    }
+
+    // the copy keeps its own mapping of saved memory, so the snapshot is not needed anymore
+    cpu_snapshot_destroy(snapshot);
+    return copy;
+}
\ No newline at end of file
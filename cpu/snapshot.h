@@ -0,0 +1,73 @@
+#pragma once
+
+#include "cpu.h"
+#include "memory.h"
+
+/* State of a device in a snapshot, as saved by the hooks of the device (see cpu_bus_hooks_t). */
+typedef struct {
+    uint32_t address;
+    uint32_t size;
+    uint8_t *state;
+} cpu_snapshot_device_t;
+
+/*
+ * Full state of a machine at some point of execution: memory with page permissions, registers, configuration
+ * of the CPU, and state of its devices along with the events they scheduled. Any number of CPUs can be created from, or brought back to, the same snapshot, e.g. to run many
+ * variations of a program from a common, already initialized state. A snapshot is never changed once taken,
+ * so CPUs on different threads can be restored from it at the same time.
+ */
+typedef struct {
+    cpu_memory_image_t memory;
+
+    uint32_t next_block_offset;
+    uint32_t ip;
+    int32_t registers[CPU_REGISTERS_COUNT];
+    uint8_t flag_equal;
+    bool running;
+    uint64_t instructions_executed;
+    bool interrupts_enabled;
+    uint32_t interrupt_return;
+    uint8_t interrupt_flag_equal;
+    bool waiting;
+
+    cpu_core_t core;
+    bool fusion;
+    uint32_t clock_rate;
+
+    cpu_snapshot_device_t *devices;
+    uint32_t devices_count;
+} cpu_snapshot_t;
+
+/*
+ * Takes a snapshot of given CPU. A transfer of the disk that is in progress is finished on the host first, and done again
+ * by a disk that is restored from the snapshot. Returns 0 if the host is out of memory, or if the CPU has a device without
+ * hooks to save it, or an event scheduled by anything but such a device.
+ */
+cpu_snapshot_t *cpu_snapshot_create(starkcpu_t *cpu);
+void cpu_snapshot_destroy(cpu_snapshot_t *snapshot);
+
+/*
+ * Brings given CPU, which has to have the same amount of memory, to the state saved in a snapshot. With guard pages,
+ * memory is mapped copy-on-write from the snapshot, so this takes about the same time regardless of how much memory
+ * the program uses. Decoded instructions are dropped. Devices of the CPU are reset, and those mapped at the address
+ * of a saved device are brought to its state. Saved devices that the CPU does not have are left out.
+ * Returns false if the sizes of memory differ.
+ */
+bool cpu_snapshot_restore(starkcpu_t *cpu, const cpu_snapshot_t *snapshot);
+
+/* Writes a snapshot into a file, so that a later run, or another process, can read it. Returns false if the file can not be written. */
+bool cpu_snapshot_write(const cpu_snapshot_t *snapshot, const char *path);
+
+/* Reads a snapshot written by cpu_snapshot_write. Returns 0 if the file can not be read or is not a snapshot. */
+cpu_snapshot_t *cpu_snapshot_read(const char *path);
+
+/* Creates a new CPU, without the UI and without devices, in the state saved in a snapshot. */
+starkcpu_t *cpu_create_from_snapshot(const cpu_snapshot_t *snapshot);
+
+/*
+ * Creates a copy of given CPU, without the UI, that continues from its current state independently. The copy gets devices
+ * of its own, which are destroyed along with it: a disk backed by the same file, so that writes of either CPU reach the other
+ * one, a console that writes into the same output, and a GPU that does not write frames. Returns 0 where cpu_snapshot_create
+ * does, or if the devices can not be copied.
+ */
+starkcpu_t *cpu_fork(starkcpu_t *cpu);
\ No newline at end of file
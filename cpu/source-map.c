@@ -0,0 +1,152 @@
+#include "source-map.h"
+#include "cpu.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Maps the source file into memory, or reads it where files can not be mapped. Returns false if it can not be read. */
+bool load_source(cpu_source_map_t *map, const char *source_path) {
+#ifndef _WIN32
+    int fd = open(source_path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void *source = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (source != MAP_FAILED) {
+            close(fd);
+            map->source = source;
+            map->source_size = info.st_size;
+            map->source_mapped = true;
+            return true;
+        }
+    }
+
+    close(fd);
+#endif
+
+    char *source = read_file(source_path);
+    if (!source) {
+        return false;
+    }
+
+    map->source = source;
+    map->source_size = strlen(source);
+    map->source_mapped = false;
+    return true;
+}
+
+int compare_source_mappings(const void *a, const void *b) {
+    uint32_t left = ((const cpu_source_mapping_t *) a)->address;
+    uint32_t right = ((const cpu_source_mapping_t *) b)->address;
+    return (left > right) - (left < right);
+}
+
+cpu_source_map_t *cpu_source_map_create(const char *map_contents, const char *source_path) {
+    cpu_source_map_t *map = calloc(1, sizeof(cpu_source_map_t));
+
+    if (!load_source(map, source_path)) {
+        free(map);
+        return 0;
+    }
+
+    uint32_t lines_count = 1;
+    for (const char *c = map->source; (c = memchr(c, '\n', map->source + map->source_size - c)); c++) {
+        lines_count++;
+    }
+
+    map->line_offsets = malloc(lines_count * sizeof(size_t));
+    map->lines_count = lines_count;
+    map->line_offsets[0] = 0;
+
+    uint32_t line = 1;
+    for (const char *c = map->source; (c = memchr(c, '\n', map->source + map->source_size - c)); c++) {
+        map->line_offsets[line++] = c - map->source + 1;
+    }
+
+    uint32_t capacity = 64;
+    map->mappings = malloc(capacity * sizeof(cpu_source_mapping_t));
+
+    for (const char *entry = map_contents; *entry; ) {
+        char *end;
+        unsigned long offset = strtoul(entry, &end, 10);
+
+        if (end != entry && *end == '|') {
+            unsigned long line_index = strtoul(end + 1, 0, 10);
+
+            if (map->mappings_count == capacity) {
+                capacity *= 2;
+                map->mappings = realloc(map->mappings, capacity * sizeof(cpu_source_mapping_t));
+            }
+
+            map->mappings[map->mappings_count].address = offset + CPU_IMAGE_LOAD_ADDRESS;
+            map->mappings[map->mappings_count].line = line_index;
+            map->mappings_count++;
+        }
+
+        entry += strcspn(entry, "\n");
+        entry += *entry == '\n';
+    }
+
+    // the compiler writes the map in order, so this rarely has anything to do
+    qsort(map->mappings, map->mappings_count, sizeof(cpu_source_mapping_t), compare_source_mappings);
+    return map;
+}
+
+void cpu_source_map_destroy(cpu_source_map_t *map) {
+#ifndef _WIN32
+    if (map->source_mapped) {
+        munmap((void *) map->source, map->source_size);
+    } else {
+        free((void *) map->source);
+    }
+#else
+    free((void *) map->source);
+#endif
+
+    free(map->line_offsets);
+    free(map->mappings);
+    free(map);
+}
+
+uint32_t cpu_source_map_find_line(const cpu_source_map_t *map, uint32_t address) {
+    uint32_t low = 0;
+    uint32_t high = map->mappings_count;
+
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (map->mappings[middle].address < address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low < map->mappings_count && map->mappings[low].address == address && map->mappings[low].line < map->lines_count) {
+        return map->mappings[low].line;
+    }
+
+    return map->lines_count;
+}
+
+const char *cpu_source_map_get_line(const cpu_source_map_t *map, uint32_t line, size_t *length) {
+    size_t start = map->line_offsets[line];
+    size_t end = line + 1 < map->lines_count ? map->line_offsets[line + 1] - 1 : map->source_size;
+
+    if (end > start && map->source[end - 1] == '\r') {
+        end--;
+    }
+
+    *length = end - start;
+    return map->source + start;
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    uint32_t address;
+    uint32_t line;
+} cpu_source_mapping_t;
+
+/*
+ * Source map produced by the compiler together with the source file it refers to. The source file is mapped into
+ * memory as it is and lines are found through the offsets they start at, so loading even a large program only takes
+ * a single pass over it and a sort of the map, and every lookup is a binary search.
+ */
+typedef struct {
+    // Sorted by address.
+    cpu_source_mapping_t *mappings;
+    uint32_t mappings_count;
+
+    const char *source;
+    size_t source_size;
+    bool source_mapped;
+
+    // Offset of the first character of every line in the source.
+    size_t *line_offsets;
+    uint32_t lines_count;
+} cpu_source_map_t;
+
+/*
+ * Parses a source map, made of lines `<offset of instruction>|<line index>` where offsets are relative to
+ * CPU_IMAGE_LOAD_ADDRESS, and loads the source file it refers to. Returns 0 if the source file can not be read.
+ */
+cpu_source_map_t *cpu_source_map_create(const char *map_contents, const char *source_path);
+void cpu_source_map_destroy(cpu_source_map_t *map);
+
+/* Returns index of the source line that instruction at given address was compiled from, or the number of lines if there is none. */
+uint32_t cpu_source_map_find_line(const cpu_source_map_t *map, uint32_t address);
+
+/* Returns given line, which has to exist, and its length without the line break. The line is not terminated with a zero byte. */
+const char *cpu_source_map_get_line(const cpu_source_map_t *map, uint32_t line, size_t *length);
\ No newline at end of file
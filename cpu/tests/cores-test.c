@@ -0,0 +1,262 @@
+#include "../cpu.h"
+#include "../cpu-executor.h"
+#include "../loader.h"
+#include "../utils.h"
+#include "../timer/timer.h"
+#include "../console/console.h"
+#include "../disk/disk.h"
+#include "../gpu/gpu.h"
+#include "../snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Runs a program with every core, with fusion of instructions on and off, and checks that all of them halt in the same
+ * state as the dispatch core without fusion: the same registers, flag, instruction pointer, number of executed
+ * instructions and contents of memory. The program is also forked halfway, along with its devices, and the copy has to
+ * halt in that state as well. A program that panics fails the test, so programs check their own results.
+ * Usage: cores-test [--memory=<size>] [--timer] [--console] [--gpu=<width>x<height>] [--disk=<size>] <executable>
+ */
+
+#define CONFIGURATIONS_COUNT 7
+
+typedef struct {
+    uint64_t memory_size;
+    bool timer;
+    bool console;
+    uint32_t gpu_width;
+    uint32_t gpu_height;
+
+    // Every run gets a disk of its own, filled with the same bytes, since programs write to it.
+    uint64_t disk_size;
+    char disk_path[64];
+} test_options_t;
+
+typedef struct {
+    cpu_core_t core;
+    bool fusion;
+    const char *name;
+
+    // Set to continue on a copy made by cpu_fork once half of the instructions are executed.
+    bool forked;
+} test_configuration_t;
+
+const test_configuration_t configurations[CONFIGURATIONS_COUNT] = {
+    { CPU_CORE_DISPATCH, false, "dispatch without fusion", false },
+    { CPU_CORE_DISPATCH, true, "dispatch", false },
+    { CPU_CORE_THREADED, false, "threaded without fusion", false },
+    { CPU_CORE_THREADED, true, "threaded", false },
+    { CPU_CORE_JIT, false, "jit without fusion", false },
+    { CPU_CORE_JIT, true, "jit", false },
+    { CPU_CORE_JIT, true, "forked jit", true }
+};
+
+bool write_disk_image(const char *path, uint64_t size) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+
+    // every 4-byte word holds its own offset, so that blocks copied to a wrong place differ
+    bool written = true;
+    for (uint64_t offset = 0; offset < size && written; offset += 4) {
+        uint32_t word = (uint32_t) offset;
+        written = fwrite(&word, sizeof(word), 1, file) == 1;
+    }
+
+    return fclose(file) == 0 && written;
+}
+
+/* Executes instructions until the program halts, or until it executed `limit` of them. Returns false if it panics. */
+bool execute_until(starkcpu_t *cpu, uint64_t limit, const test_configuration_t *configuration) {
+    jmp_buf panic_handler;
+    cpu->panic_handler = &panic_handler;
+
+    if (setjmp(panic_handler) != 0) {
+        printf("%s: PANIC: %s\n", configuration->name, cpu->panic_message);
+        cpu->panic_handler = 0;
+        return false;
+    }
+
+    while (cpu->running && cpu->ip < cpu->memsize && cpu->instructions_executed < limit) {
+        uint64_t left = limit - cpu->instructions_executed;
+        cpu->instructions_executed += cpu_execute(cpu, left < CPU_UNTHROTTLED_BATCH_SIZE ? left : CPU_UNTHROTTLED_BATCH_SIZE);
+    }
+
+    cpu->panic_handler = 0;
+    return true;
+}
+
+/*
+ * Runs the program until it halts, forking it once it executed `fork_at` instructions if the configuration says so.
+ * Returns 0 if it can not be loaded, its devices attached or forked, or it panics.
+ */
+starkcpu_t *run_program(const char *path, const test_options_t *options, const test_configuration_t *configuration, uint64_t fork_at) {
+    starkcpu_t *cpu = cpu_create(false, options->memory_size);
+    if (!cpu) {
+        printf("%s: unable to create cpu\n", configuration->name);
+        return 0;
+    }
+
+    cpu->core = configuration->core;
+    cpu->fusion = configuration->fusion;
+    cpu->clock_rate = 0;
+
+    cpu_program_t program;
+    cpu_load_status_t status = cpu_load_program(cpu, path, &program);
+    free(program.source_map);
+
+    if (status != CPU_LOAD_OK) {
+        printf("%s: unable to load %s: %s\n", configuration->name, path, cpu_load_status_to_string(status));
+        cpu_destroy(cpu);
+        return 0;
+    }
+
+    cpu_jmp(cpu, program.entry_point);
+
+    // devices that are still attached are destroyed along with the CPU, a transfer of the disk in progress finishes first
+    bool attached = (!options->timer || cpu_timer_create(cpu))
+        && (!options->console || cpu_console_create(cpu, "/dev/null"))
+        && (!options->gpu_width || cpu_gpu_create(cpu, options->gpu_width, options->gpu_height))
+        && (!options->disk_size || (write_disk_image(options->disk_path, options->disk_size) && cpu_disk_create(cpu, options->disk_path)));
+
+    if (!attached) {
+        printf("%s: unable to attach devices\n", configuration->name);
+        cpu_destroy(cpu);
+        return 0;
+    }
+
+    cpu->running = true;
+    bool halted = execute_until(cpu, configuration->forked ? fork_at : UINT64_MAX, configuration);
+
+    if (halted && configuration->forked) {
+        starkcpu_t *copy = cpu_fork(cpu);
+        cpu_destroy(cpu);
+        cpu = copy;
+
+        if (!cpu) {
+            printf("%s: unable to fork\n", configuration->name);
+            return 0;
+        }
+
+        halted = execute_until(cpu, UINT64_MAX, configuration);
+    }
+
+    if (!halted) {
+        cpu_destroy(cpu);
+        return 0;
+    }
+
+    cpu_sync_internal_memory(cpu);
+    return cpu;
+}
+
+bool has_same_state(starkcpu_t *expected, starkcpu_t *cpu, const char *name) {
+    bool same = true;
+
+    for (uint32_t i = 0; i < CPU_REGISTERS_COUNT; i++) {
+        if (cpu->registers[i] != expected->registers[i]) {
+            printf("%s: r%u is 0x%x instead of 0x%x\n", name, i, cpu->registers[i], expected->registers[i]);
+            same = false;
+        }
+    }
+
+    if (cpu->flag_equal != expected->flag_equal) {
+        printf("%s: equal flag is %u instead of %u\n", name, cpu->flag_equal, expected->flag_equal);
+        same = false;
+    }
+
+    if (cpu->ip != expected->ip) {
+        printf("%s: instruction pointer is 0x%x instead of 0x%x\n", name, cpu->ip, expected->ip);
+        same = false;
+    }
+
+    if (cpu->instructions_executed != expected->instructions_executed) {
+        printf("%s: executed %llu instructions instead of %llu\n", name,
+               (unsigned long long) cpu->instructions_executed, (unsigned long long) expected->instructions_executed);
+        same = false;
+    }
+
+    for (uint32_t page = 0; page < cpu->memsize >> CPU_PAGE_SHIFT; page++) {
+        uint64_t offset = (uint64_t) page << CPU_PAGE_SHIFT;
+        if (memcmp(cpu->mem + offset, expected->mem + offset, CPU_PAGE_SIZE) == 0) {
+            continue;
+        }
+
+        for (uint32_t address = offset; address < offset + CPU_PAGE_SIZE; address++) {
+            if (cpu->mem[address] != expected->mem[address]) {
+                printf("%s: byte at 0x%x is 0x%02x instead of 0x%02x\n", name, address, (uint8_t) cpu->mem[address], (uint8_t) expected->mem[address]);
+                break;
+            }
+        }
+
+        same = false;
+        break;
+    }
+
+    return same;
+}
+
+int main(int argc, char **argv) {
+    test_options_t options = { CPU_DEFAULT_MEMORY_SIZE, false, false, 0, 0, 0, "" };
+    const char *path = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--memory=", 9) == 0 && parse_size(argv[i] + 9) > 0) {
+            options.memory_size = parse_size(argv[i] + 9);
+        } else if (strcmp(argv[i], "--timer") == 0) {
+            options.timer = true;
+        } else if (strcmp(argv[i], "--console") == 0) {
+            options.console = true;
+        } else if (strncmp(argv[i], "--gpu=", 6) == 0 && sscanf(argv[i] + 6, "%ux%u", &options.gpu_width, &options.gpu_height) == 2) {
+            continue;
+        } else if (strncmp(argv[i], "--disk=", 7) == 0 && parse_size(argv[i] + 7) > 0) {
+            options.disk_size = parse_size(argv[i] + 7);
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            printf("usage: cores-test [--memory=<size>] [--timer] [--console] [--gpu=<width>x<height>] [--disk=<size>] <executable>\n");
+            return 1;
+        }
+    }
+
+    if (!path) {
+        printf("usage: cores-test [--memory=<size>] [--timer] [--console] [--gpu=<width>x<height>] [--disk=<size>] <executable>\n");
+        return 1;
+    }
+
+    if (options.disk_size) {
+        strcpy(options.disk_path, "/tmp/starkcpu-cores-test-XXXXXX");
+        int fd = mkstemp(options.disk_path);
+        if (fd < 0) {
+            printf("unable to create a disk\n");
+            return 1;
+        }
+
+        close(fd);
+    }
+
+    starkcpu_t *expected = run_program(path, &options, &configurations[0], 0);
+    bool passed = expected != 0;
+
+    for (uint32_t i = 1; i < CONFIGURATIONS_COUNT && expected; i++) {
+        starkcpu_t *cpu = run_program(path, &options, &configurations[i], expected->instructions_executed / 2);
+        passed &= cpu && has_same_state(expected, cpu, configurations[i].name);
+
+        if (cpu) {
+            cpu_destroy(cpu);
+        }
+    }
+
+    if (expected) {
+        cpu_destroy(expected);
+    }
+
+    if (options.disk_size) {
+        unlink(options.disk_path);
+    }
+
+    return passed ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+# Compiles a program with sasmc into the work directory and runs cores-test on it, see tests/cores-test.c.
+# Options of cores-test are passed joined with commas, like the lists of the bench target.
+
+get_filename_component(name "${PROGRAM}" NAME)
+configure_file("${PROGRAM}" "${WORK_DIR}/${name}" COPYONLY)
+
+execute_process(
+    COMMAND "${SASMC}" --no-source-map "${WORK_DIR}/${name}"
+    RESULT_VARIABLE status)
+
+if (NOT status EQUAL 0)
+    message(FATAL_ERROR "unable to compile ${name}")
+endif()
+
+string(REPLACE "," ";" OPTIONS "${OPTIONS}")
+
+execute_process(
+    COMMAND "${CORES_TEST}" ${OPTIONS} "${WORK_DIR}/${name}.bin"
+    RESULT_VARIABLE status)
+
+if (NOT status EQUAL 0)
+    message(FATAL_ERROR "${name} does not end in the same state with every core")
+endif()
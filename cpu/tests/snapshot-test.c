@@ -0,0 +1,102 @@
+#include "../cpu.h"
+#include "../loader.h"
+#include "../snapshot.h"
+#include "../../shared/stark1-executable.h"
+#include "../../shared/stark1-opcodes.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Snapshots a program whose data section is mapped straight from its executable, after the host dropped the file
+ * from its page cache. Such pages are not resident, yet they hold the contents of the file, which the snapshot must keep.
+ */
+
+#define CODE_ADDRESS 0x1000
+#define DATA_ADDRESS 0x2000
+#define DATA_PAGES 16
+
+char get_expected_byte(uint32_t address) {
+    return 'A' + (address - DATA_ADDRESS) / CPU_PAGE_SIZE;
+}
+
+bool write_executable(int fd) {
+    uint32_t file_size = DATA_ADDRESS + DATA_PAGES * CPU_PAGE_SIZE;
+    char *contents = calloc(1, file_size);
+
+    stark1_executable_header_t header = { STARK1_EXECUTABLE_MAGIC, STARK1_EXECUTABLE_VERSION, CPU_MODEL, 2, CODE_ADDRESS, 0 };
+    stark1_section_header_t sections[2] = {
+        { STARK1_SECTION_CODE, STARK1_SECTION_READ | STARK1_SECTION_EXECUTE, 0, CODE_ADDRESS, CPU_PAGE_SIZE, CODE_ADDRESS, 1 },
+        { STARK1_SECTION_DATA, STARK1_SECTION_READ | STARK1_SECTION_WRITE, 0, DATA_ADDRESS, DATA_PAGES * CPU_PAGE_SIZE, DATA_ADDRESS, DATA_PAGES * CPU_PAGE_SIZE }
+    };
+
+    memcpy(contents, &header, sizeof(header));
+    memcpy(contents + sizeof(header), sections, sizeof(sections));
+    contents[CODE_ADDRESS] = (char) OP_HALT;
+
+    for (uint32_t address = DATA_ADDRESS; address < file_size; address++) {
+        contents[address] = get_expected_byte(address);
+    }
+
+    bool written = write(fd, contents, file_size) == file_size && fsync(fd) == 0;
+    free(contents);
+    return written;
+}
+
+bool has_expected_data(starkcpu_t *cpu, const char *name) {
+    for (uint32_t address = DATA_ADDRESS; address < DATA_ADDRESS + DATA_PAGES * CPU_PAGE_SIZE; address++) {
+        if (cpu->mem[address] != get_expected_byte(address)) {
+            printf("%s: byte at 0x%x is 0x%02x instead of 0x%02x\n", name, address, (uint8_t) cpu->mem[address], get_expected_byte(address));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main() {
+    char path[] = "/tmp/starkcpu-snapshot-test-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || !write_executable(fd)) {
+        printf("unable to write %s\n", path);
+        return 1;
+    }
+
+    starkcpu_t *cpu = cpu_create(false, 1024 * 1024);
+    cpu_program_t program;
+    cpu_load_status_t status = cpu_load_program(cpu, path, &program);
+
+    if (status != CPU_LOAD_OK) {
+        printf("unable to load %s: %s\n", path, cpu_load_status_to_string(status));
+        unlink(path);
+        return 1;
+    }
+
+    // pages that were mapped but not touched yet are no longer resident
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+
+    cpu_snapshot_t *snapshot = cpu_snapshot_create(cpu);
+    starkcpu_t *restored = snapshot ? cpu_create_from_snapshot(snapshot) : 0;
+
+    char snapshot_path[sizeof(path) + 9];
+    sprintf(snapshot_path, "%s.snapshot", path);
+
+    cpu_snapshot_t *read = snapshot && cpu_snapshot_write(snapshot, snapshot_path) ? cpu_snapshot_read(snapshot_path) : 0;
+    starkcpu_t *read_restored = read ? cpu_create_from_snapshot(read) : 0;
+
+    bool passed = restored && read_restored
+        && has_expected_data(cpu, "loaded")
+        && has_expected_data(restored, "restored")
+        && has_expected_data(read_restored, "read from file");
+
+    if (!restored || !read_restored) {
+        printf("unable to take, write or restore a snapshot\n");
+    }
+
+    unlink(snapshot_path);
+    unlink(path);
+    return passed ? 0 : 1;
+}
\ No newline at end of file
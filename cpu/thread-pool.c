@@ -0,0 +1,130 @@
+#include "thread-pool.h"
+#include <stdlib.h>
+#include <stdbool.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+bool thread_pool_queue_pop(thread_pool_queue_t *queue, uint32_t *job) {
+    bool found = false;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail) {
+        *job = queue->jobs[queue->head++];
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return found;
+}
+
+bool thread_pool_queue_steal(thread_pool_queue_t *queue, uint32_t *job) {
+    bool found = false;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail) {
+        *job = queue->jobs[--queue->tail];
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return found;
+}
+
+bool thread_pool_next_job(thread_pool_t *pool, uint32_t worker, uint32_t *job) {
+    if (thread_pool_queue_pop(pool->queues + worker, job)) {
+        return true;
+    }
+
+    // Jobs are never added once the pool is running, so a worker can stop
+    // as soon as it does not find anything to steal from the others.
+    for (uint32_t i = 1; i < pool->workers_count; i++) {
+        uint32_t victim = (worker + i) % pool->workers_count;
+        if (thread_pool_queue_steal(pool->queues + victim, job)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void *thread_pool_worker_main(void *argument) {
+    thread_pool_worker_t *worker = argument;
+    thread_pool_t *pool = worker->pool;
+
+    uint32_t job;
+    while (thread_pool_next_job(pool, worker->index, &job)) {
+        pool->func(pool->context, worker->index, job);
+    }
+
+    return 0;
+}
+
+void thread_pool_run(uint32_t workers_count, uint32_t jobs_count, thread_pool_job_func func, void *context) {
+    if (workers_count == 0) {
+        workers_count = 1;
+    }
+
+    thread_pool_t pool;
+    pool.workers_count = workers_count;
+    pool.func = func;
+    pool.context = context;
+    pool.queues = calloc(workers_count, sizeof(thread_pool_queue_t));
+
+    // Every worker starts with a contiguous range of jobs.
+    uint32_t *jobs = malloc(sizeof(uint32_t) * (jobs_count > 0 ? jobs_count : 1));
+    for (uint32_t i = 0; i < jobs_count; i++) {
+        jobs[i] = i;
+    }
+
+    for (uint32_t i = 0; i < workers_count; i++) {
+        thread_pool_queue_t *queue = pool.queues + i;
+        pthread_mutex_init(&queue->lock, NULL);
+        queue->jobs = jobs;
+        queue->head = (uint64_t) jobs_count * i / workers_count;
+        queue->tail = (uint64_t) jobs_count * (i + 1) / workers_count;
+    }
+
+    // Calling thread works as the first worker.
+    thread_pool_worker_t *workers = calloc(workers_count, sizeof(thread_pool_worker_t));
+    for (uint32_t i = 0; i < workers_count; i++) {
+        workers[i].pool = &pool;
+        workers[i].index = i;
+
+        if (i > 0 && pthread_create(&workers[i].thread, NULL, thread_pool_worker_main, workers + i) != 0) {
+            // Jobs of a worker that could not be started are stolen by the others.
+            workers[i].pool = 0;
+        }
+    }
+
+    thread_pool_worker_main(workers);
+
+    for (uint32_t i = 1; i < workers_count; i++) {
+        if (workers[i].pool) {
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+
+    for (uint32_t i = 0; i < workers_count; i++) {
+        pthread_mutex_destroy(&pool.queues[i].lock);
+    }
+
+    free(workers);
+    free(jobs);
+    free(pool.queues);
+}
+
+uint32_t thread_pool_get_hardware_concurrency() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+#endif
+}
\ No newline at end of file
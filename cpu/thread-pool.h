@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <pthread.h>
+
+/* Executes a single job. `worker` is the index of the worker thread calling it, so jobs can reuse per-worker state. */
+typedef void (*thread_pool_job_func)(void *context, uint32_t worker, uint32_t job);
+
+/*
+ * Jobs assigned to a single worker. The worker takes jobs from the front of its queue,
+ * workers that ran out of jobs steal them from the back.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t *jobs;
+    uint32_t head;
+    uint32_t tail;
+} thread_pool_queue_t;
+
+typedef struct {
+    thread_pool_queue_t *queues;
+    uint32_t workers_count;
+    thread_pool_job_func func;
+    void *context;
+} thread_pool_t;
+
+typedef struct {
+    thread_pool_t *pool;
+    uint32_t index;
+    pthread_t thread;
+} thread_pool_worker_t;
+
+/* Executes jobs numbered from 0 to `jobs_count` - 1 on `workers_count` threads and waits until all of them are done. */
+void thread_pool_run(uint32_t workers_count, uint32_t jobs_count, thread_pool_job_func func, void *context);
+
+/* Returns number of threads that the host can execute in parallel. */
+uint32_t thread_pool_get_hardware_concurrency();
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include "timer.h"
+#include "../scheduler.h"
+#include "../interrupts.h"
+#include <stdlib.h>
+#include <string.h>
+
+uint32_t get_timer_register(cpu_timer_t *timer, uint32_t offset) {
+    const uint8_t *bytes = timer->io + offset;
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+void set_timer_register(cpu_timer_t *timer, uint32_t offset, uint32_t value) {
+    for (uint32_t i = 0; i < 4; i++) {
+        timer->io[offset + i] = value >> (i * 8);
+    }
+}
+
+void stop_timer(cpu_timer_t *timer) {
+    if (timer->fire_event) {
+        cpu_cancel_event(timer->cpu, timer->fire_event);
+        timer->fire_event = 0;
+    }
+
+    timer->io[CPU_TIMER_REGISTER_CONTROL] &= ~CPU_TIMER_RUNNING;
+}
+
+void fire_timer(void *context, uint64_t cycle) {
+    cpu_timer_t *timer = context;
+    uint32_t interval = get_timer_register(timer, CPU_TIMER_REGISTER_INTERVAL);
+
+    timer->fire_event = 0;
+    set_timer_register(timer, CPU_TIMER_REGISTER_FIRED, ++timer->fired);
+
+    // counted from when the timer was due rather than from when the event ran, so a periodic timer never drifts
+    if ((get_timer_register(timer, CPU_TIMER_REGISTER_CONTROL) & CPU_TIMER_PERIODIC) && interval > 0) {
+        timer->deadline += interval;
+        timer->fire_event = cpu_schedule_event(timer->cpu, timer->deadline, fire_timer, timer);
+    } else {
+        stop_timer(timer);
+    }
+
+    cpu_raise_interrupt(timer->cpu, CPU_TIMER_INTERRUPT_LINE);
+}
+
+void sync_timer(void *context, uint64_t cycle) {
+    cpu_timer_t *timer = context;
+
+    if (timer->latch_written) {
+        timer->latch_written = false;
+        set_timer_register(timer, CPU_TIMER_REGISTER_COUNTER_LOW, cycle);
+        set_timer_register(timer, CPU_TIMER_REGISTER_COUNTER_HIGH, cycle >> 32);
+    }
+
+    if (timer->control_written) {
+        timer->control_written = false;
+        bool running = timer->io[CPU_TIMER_REGISTER_CONTROL] & CPU_TIMER_RUNNING;
+        uint32_t interval = get_timer_register(timer, CPU_TIMER_REGISTER_INTERVAL);
+
+        stop_timer(timer);
+
+        // a timer without an interval would never stop firing, so it is not started at all
+        if (running && interval > 0) {
+            timer->io[CPU_TIMER_REGISTER_CONTROL] |= CPU_TIMER_RUNNING;
+            timer->deadline = cycle + interval;
+            timer->fire_event = cpu_schedule_event(timer->cpu, timer->deadline, fire_timer, timer);
+        }
+    }
+}
+
+uint32_t read_timer(void *device, uint32_t offset, uint32_t size) {
+    cpu_timer_t *timer = device;
+    uint32_t value = 0;
+
+    for (uint32_t i = 0; i < size && offset + i < CPU_TIMER_IO_SIZE; i++) {
+        value |= (uint32_t) timer->io[offset + i] << (i * 8);
+    }
+
+    return value;
+}
+
+void write_timer(void *device, uint32_t offset, uint32_t value, uint32_t size) {
+    cpu_timer_t *timer = device;
+
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t position = offset + i;
+
+        if (position < CPU_TIMER_REGISTER_LATCH) {
+            timer->io[position] = value >> (i * 8);
+            timer->control_written |= position < CPU_TIMER_REGISTER_INTERVAL;
+        } else if (position < CPU_TIMER_REGISTER_LATCH + 4) {
+            timer->latch_written = true;
+        }
+    }
+
+    if (timer->control_written || timer->latch_written) {
+        cpu_schedule_event(timer->cpu, 0, sync_timer, timer);
+        cpu_scheduler_end_batch(timer->cpu);
+    }
+}
+
+void reset_timer(void *device) {
+    cpu_timer_t *timer = device;
+    stop_timer(timer);
+
+    memset(timer->io, 0, sizeof(timer->io));
+    timer->control_written = false;
+    timer->latch_written = false;
+    timer->deadline = 0;
+    timer->fired = 0;
+}
+
+/* State of a timer in a snapshot, a pending write is applied by the restored timer once it runs. */
+typedef struct {
+    uint8_t io[CPU_TIMER_IO_SIZE];
+    uint8_t control_written;
+    uint8_t latch_written;
+    uint8_t running;
+    uint64_t deadline;
+    uint32_t fired;
+} timer_state_t;
+
+void save_timer(void *device, void *state) {
+    cpu_timer_t *timer = device;
+    timer_state_t *saved = state;
+
+    memcpy(saved->io, timer->io, sizeof(saved->io));
+    saved->control_written = timer->control_written;
+    saved->latch_written = timer->latch_written;
+    saved->running = timer->fire_event != 0;
+    saved->deadline = timer->deadline;
+    saved->fired = timer->fired;
+}
+
+void restore_timer(void *device, const void *state) {
+    cpu_timer_t *timer = device;
+    const timer_state_t *saved = state;
+
+    memcpy(timer->io, saved->io, sizeof(timer->io));
+    timer->control_written = saved->control_written;
+    timer->latch_written = saved->latch_written;
+    timer->deadline = saved->deadline;
+    timer->fired = saved->fired;
+
+    if (saved->running) {
+        timer->fire_event = cpu_schedule_event(timer->cpu, timer->deadline, fire_timer, timer);
+    }
+
+    if (timer->control_written || timer->latch_written) {
+        cpu_schedule_event(timer->cpu, 0, sync_timer, timer);
+    }
+}
+
+void *copy_timer(void *device, starkcpu_t *cpu) {
+    return cpu_timer_create(cpu);
+}
+
+void destroy_timer(void *device) {
+    cpu_timer_destroy(device);
+}
+
+const cpu_bus_hooks_t timer_hooks = { reset_timer, sizeof(timer_state_t), save_timer, restore_timer, copy_timer, destroy_timer };
+
+cpu_timer_t *cpu_timer_create(starkcpu_t *cpu) {
+    if (!cpu_interrupts_attach(cpu)) {
+        return 0;
+    }
+
+    cpu_timer_t *timer = calloc(1, sizeof(cpu_timer_t));
+    timer->cpu = cpu;
+
+    if (!cpu_bus_map(cpu, CPU_TIMER_ADDRESS, CPU_TIMER_IO_SIZE, timer, read_timer, write_timer)) {
+        free(timer);
+        return 0;
+    }
+
+    cpu_bus_set_hooks(cpu, CPU_TIMER_ADDRESS, &timer_hooks);
+    return timer;
+}
+
+void cpu_timer_destroy(cpu_timer_t *timer) {
+    stop_timer(timer);
+    cpu_bus_unmap(timer->cpu, CPU_TIMER_ADDRESS);
+    free(timer);
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "../cpu.h"
+#include "../bus.h"
+
+/* Guest address of the timer's registers, mapped by the bus. */
+#define CPU_TIMER_ADDRESS 0xFE000
+
+/* Line of the interrupt controller that the timer raises whenever it fires. */
+#define CPU_TIMER_INTERRUPT_LINE 0
+
+/*
+ * Layout of the timer's registers, all values are 32-bit and little endian. Time is counted in virtual cycles (see scheduler.h):
+ * - control, a combination of CPU_TIMER_RUNNING and CPU_TIMER_PERIODIC. Every write starts the timer anew from the cycle
+ *   of the write, or stops it if CPU_TIMER_RUNNING is not set. A timer that fires once clears CPU_TIMER_RUNNING,
+ * - number of cycles between starting the timer and firing, and between firings of a periodic timer,
+ * - latch, writing anything into it copies the current cycle into the counter,
+ * - counter, low and high 32 bits of the cycle at the last write into the latch,
+ * - number of times the timer fired so far.
+ * Only control, interval and latch can be written by the program.
+ */
+#define CPU_TIMER_REGISTER_CONTROL 0x00
+#define CPU_TIMER_REGISTER_INTERVAL 0x04
+#define CPU_TIMER_REGISTER_LATCH 0x08
+#define CPU_TIMER_REGISTER_COUNTER_LOW 0x0C
+#define CPU_TIMER_REGISTER_COUNTER_HIGH 0x10
+#define CPU_TIMER_REGISTER_FIRED 0x14
+
+#define CPU_TIMER_IO_SIZE 0x18
+
+#define CPU_TIMER_RUNNING 0x01
+#define CPU_TIMER_PERIODIC 0x02
+
+typedef struct cpu_timer_t {
+    starkcpu_t *cpu;
+
+    // Contents of the registers, as the program sees them.
+    uint8_t io[CPU_TIMER_IO_SIZE];
+
+    // Writes into control and latch need to know the cycle they happened at, so they end the batch and are applied
+    // by an event that runs right after it.
+    bool control_written;
+    bool latch_written;
+
+    // Cycle the timer fires at next, and the event that fires it, which is 0 while the timer is not running.
+    uint64_t deadline;
+    uint32_t fire_event;
+
+    // Number of times the timer fired, mirrored in CPU_TIMER_REGISTER_FIRED.
+    uint32_t fired;
+} cpu_timer_t;
+
+/*
+ * Attaches a programmable timer to given CPU, with its registers mapped at CPU_TIMER_ADDRESS, and the interrupt controller
+ * if there is none yet. The timer fires by scheduling an event, so it costs nothing while the program executes.
+ * Returns 0 if the registers of either of them can not be mapped.
+ */
+cpu_timer_t *cpu_timer_create(starkcpu_t *cpu);
+
+/* Stops the timer, unmaps it from its CPU and frees it. A timer that is still attached when its CPU is destroyed is destroyed along with it. */
+void cpu_timer_destroy(cpu_timer_t *timer);
\ No newline at end of file
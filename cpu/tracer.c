@@ -0,0 +1,422 @@
+#include "tracer.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CPU_TRACE_MAGIC "STKTRACE"
+#define CPU_TRACE_VERSION 1
+
+static inline uint32_t encode_zigzag(int32_t value) {
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+static inline int32_t decode_zigzag(uint32_t value) {
+    return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+static inline uint32_t put_varint(uint8_t *buffer, uint64_t value) {
+    uint32_t size = 0;
+
+    while (value >= 0x80) {
+        buffer[size++] = value | 0x80;
+        value >>= 7;
+    }
+
+    buffer[size++] = value;
+    return size;
+}
+
+bool write_trace_bytes(void *context, const uint8_t *data, uint64_t size) {
+    cpu_tracer_t *tracer = context;
+    return fwrite(data, 1, size, tracer->file) == size;
+}
+
+cpu_tracer_t *cpu_tracer_create(starkcpu_t *cpu, const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return 0;
+    }
+
+    cpu_tracer_t *tracer = calloc(1, sizeof(cpu_tracer_t));
+    tracer->cpu = cpu;
+    tracer->file = file;
+    tracer->next_ip = cpu->ip;
+    memcpy(tracer->registers, cpu->registers, sizeof(tracer->registers));
+
+    uint8_t header[sizeof(CPU_TRACE_MAGIC) + 10 * (4 + CPU_REGISTERS_COUNT)];
+    uint32_t size = sizeof(CPU_TRACE_MAGIC) - 1;
+    memcpy(header, CPU_TRACE_MAGIC, size);
+    header[size++] = CPU_TRACE_VERSION;
+
+    size += put_varint(header + size, cpu->memsize);
+    size += put_varint(header + size, cpu->instructions_executed);
+    size += put_varint(header + size, cpu->ip);
+    header[size++] = cpu->flag_equal;
+
+    for (uint32_t i = 0; i < CPU_REGISTERS_COUNT; i++) {
+        size += put_varint(header + size, encode_zigzag(cpu->registers[i]));
+    }
+
+    if (fwrite(header, 1, size, file) != size || !cpu_ring_start(&tracer->ring, CPU_TRACE_RING_SIZE, 0, write_trace_bytes, tracer)) {
+        fclose(file);
+        free(tracer);
+        return 0;
+    }
+
+    cpu->tracer = tracer;
+    return tracer;
+}
+
+bool cpu_tracer_destroy(cpu_tracer_t *tracer) {
+    starkcpu_t *cpu = tracer->cpu;
+    if (cpu->tracer == tracer) {
+        cpu->tracer = 0;
+    }
+
+    uint8_t record[CPU_TRACE_MAX_RECORD_SIZE + CPU_PANIC_MESSAGE_SIZE];
+    uint32_t size = 0;
+    record[size++] = CPU_TRACE_END;
+
+    if (cpu->panic_message[0]) {
+        uint32_t length = strlen(cpu->panic_message);
+
+        record[size++] = CPU_TRACE_PANICKED;
+        size += put_varint(record + size, tracer->current_ip);
+        size += put_varint(record + size, length);
+        memcpy(record + size, cpu->panic_message, length);
+        size += length;
+    } else {
+        record[size++] = cpu->running && cpu->ip < cpu->memsize ? CPU_TRACE_STOPPED : CPU_TRACE_HALTED;
+        size += put_varint(record + size, cpu->ip);
+    }
+
+    cpu_ring_push(&tracer->ring, record, size);
+
+    bool written = cpu_ring_stop(&tracer->ring);
+    written = fclose(tracer->file) == 0 && written;
+
+    free(tracer);
+    return written;
+}
+
+/* Pushes record of an instruction that was just executed. Record starts with its flags, address and the instruction itself. */
+void push_instruction_record(cpu_tracer_t *tracer, uint8_t *record, uint32_t size) {
+    starkcpu_t *cpu = tracer->cpu;
+    uint8_t changed = 0;
+
+    for (uint32_t i = 0; i < CPU_REGISTERS_COUNT; i++) {
+        if (cpu->registers[i] != tracer->registers[i]) {
+            changed |= 1 << i;
+        }
+    }
+
+    if (changed) {
+        record[0] |= CPU_TRACE_REGISTERS;
+        record[size++] = changed;
+
+        for (uint32_t i = 0; i < CPU_REGISTERS_COUNT; i++) {
+            if (changed & (1 << i)) {
+                size += put_varint(record + size, encode_zigzag((uint32_t) cpu->registers[i] - (uint32_t) tracer->registers[i]));
+                tracer->registers[i] = cpu->registers[i];
+            }
+        }
+    }
+
+    if (cpu->flag_equal) {
+        record[0] |= CPU_TRACE_FLAG_EQUAL;
+    }
+
+    if (tracer->writes_count == 0) {
+        cpu_ring_push(&tracer->ring, record, size);
+        return;
+    }
+
+    record[0] |= CPU_TRACE_WRITES;
+    size += put_varint(record + size, tracer->writes_count);
+
+    for (uint32_t i = 0; i < tracer->writes_count; i++) {
+        cpu_trace_range_t *range = tracer->writes + i;
+        const uint8_t *contents = (const uint8_t *) cpu->mem + range->address;
+
+        // blocks of a single byte, e.g. from `fill`, are recorded as that byte
+        bool filled = range->size > 2 && memcmp(contents, contents + 1, range->size - 1) == 0;
+
+        size += put_varint(record + size, encode_zigzag(range->address - tracer->last_write_end));
+        size += put_varint(record + size, (uint64_t) range->size << 1 | filled);
+        tracer->last_write_end = range->address + range->size;
+
+        if (filled) {
+            record[size++] = contents[0];
+        }
+
+        // contents are copied from guest memory straight into the ring, the record only holds the rest
+        cpu_ring_push(&tracer->ring, record, size);
+        size = 0;
+
+        if (!filled) {
+            cpu_ring_push(&tracer->ring, contents, range->size);
+        }
+    }
+}
+
+uint32_t cpu_execute_traced(cpu_tracer_t *tracer, uint32_t count) {
+    starkcpu_t *cpu = tracer->cpu;
+    cpu_executor_t *executor = cpu->executor;
+    uint32_t executed = 0;
+
+    while (executed < count && cpu->running && cpu->ip < cpu->memsize) {
+        uint32_t address = cpu->ip;
+        tracer->current_ip = address;
+
+        // budget of a single instruction splits fused instructions back into separate ones
+        cpu_instruction_t *instruction = cpu_fetch_instruction(executor, 1);
+
+        uint8_t record[CPU_TRACE_MAX_RECORD_SIZE];
+        uint32_t size = 1;
+        record[0] = 0;
+
+        if (address != tracer->next_ip) {
+            record[0] |= CPU_TRACE_JUMPED;
+            size += put_varint(record + size, address);
+        }
+
+        // taken before the instruction runs, since it might overwrite itself
+        memcpy(record + size, cpu->mem + address, instruction->length);
+        size += instruction->length;
+        tracer->next_ip = address + instruction->length;
+
+        tracer->writes_count = 0;
+        instruction->handler(cpu, instruction);
+
+        push_instruction_record(tracer, record, size);
+        executed++;
+    }
+
+    return executed;
+}
+
+bool read_varint64(FILE *file, uint64_t *value) {
+    uint64_t result = 0;
+
+    for (uint32_t shift = 0; shift < 64; shift += 7) {
+        int byte = fgetc(file);
+        if (byte == EOF) {
+            return false;
+        }
+
+        result |= (uint64_t) (byte & 0x7F) << shift;
+
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool read_varint(FILE *file, uint32_t *value) {
+    uint64_t result;
+    if (!read_varint64(file, &result) || result > UINT32_MAX) {
+        return false;
+    }
+
+    *value = result;
+    return true;
+}
+
+/* Returns length of an instruction with given opcode, or 0 if the opcode is not known. */
+uint8_t get_instruction_length(uint8_t opcode) {
+    const char *operands = cpu_get_opcode_operands(opcode);
+    if (!operands) {
+        return 0;
+    }
+
+    uint8_t length = 1;
+    for (; *operands; operands++) {
+        length += *operands == 'd' ? 4 : *operands == 'w' ? 2 : 1;
+    }
+
+    return length;
+}
+
+cpu_trace_reader_t *cpu_trace_open(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+
+    cpu_trace_reader_t *reader = calloc(1, sizeof(cpu_trace_reader_t));
+    reader->file = file;
+
+    char magic[sizeof(CPU_TRACE_MAGIC) - 1];
+    uint32_t value;
+    bool valid = fread(magic, sizeof(magic), 1, file) == 1
+        && memcmp(magic, CPU_TRACE_MAGIC, sizeof(magic)) == 0
+        && fgetc(file) == CPU_TRACE_VERSION
+        && read_varint(file, &reader->memory_size)
+        && read_varint64(file, &reader->start_instructions)
+        && read_varint(file, &reader->start_ip);
+
+    int flag_equal = valid ? fgetc(file) : EOF;
+    valid = valid && flag_equal != EOF;
+
+    for (uint32_t i = 0; i < CPU_REGISTERS_COUNT && valid; i++) {
+        valid = read_varint(file, &value);
+        reader->start_registers[i] = decode_zigzag(value);
+    }
+
+    if (!valid) {
+        cpu_trace_close(reader);
+        return 0;
+    }
+
+    reader->start_flag_equal = flag_equal;
+    reader->next_ip = reader->start_ip;
+    memcpy(reader->record.registers, reader->start_registers, sizeof(reader->record.registers));
+    reader->record.flag_equal = reader->start_flag_equal;
+    return reader;
+}
+
+void cpu_trace_close(cpu_trace_reader_t *reader) {
+    fclose(reader->file);
+    free(reader->record.data);
+    free(reader);
+}
+
+cpu_trace_read_status_t read_end_record(cpu_trace_reader_t *reader) {
+    cpu_trace_record_t *record = &reader->record;
+    int reason = fgetc(reader->file);
+
+    if (reason < CPU_TRACE_HALTED || reason > CPU_TRACE_STOPPED || !read_varint(reader->file, &record->ip)) {
+        return CPU_TRACE_READ_INVALID;
+    }
+
+    record->end = true;
+    record->reason = reason;
+    record->message[0] = '\0';
+
+    if (reason == CPU_TRACE_PANICKED) {
+        uint32_t length;
+        if (!read_varint(reader->file, &length) || length >= CPU_PANIC_MESSAGE_SIZE || fread(record->message, 1, length, reader->file) != length) {
+            return CPU_TRACE_READ_INVALID;
+        }
+
+        record->message[length] = '\0';
+    }
+
+    return CPU_TRACE_READ_RECORD;
+}
+
+cpu_trace_read_status_t read_writes(cpu_trace_reader_t *reader) {
+    cpu_trace_record_t *record = &reader->record;
+    uint32_t data_size = 0;
+    uint32_t value;
+
+    if (!read_varint(reader->file, &record->writes_count) || record->writes_count == 0 || record->writes_count > CPU_TRACE_MAX_WRITES) {
+        return CPU_TRACE_READ_INVALID;
+    }
+
+    for (uint32_t i = 0; i < record->writes_count; i++) {
+        cpu_trace_range_t *range = record->writes + i;
+        if (!read_varint(reader->file, &value)) {
+            return CPU_TRACE_READ_INVALID;
+        }
+
+        range->address = reader->last_write_end + decode_zigzag(value);
+
+        uint64_t size;
+        if (!read_varint64(reader->file, &size) || size >> 1 > UINT32_MAX) {
+            return CPU_TRACE_READ_INVALID;
+        }
+
+        range->size = size >> 1;
+        bool filled = size & 1;
+
+        if (range->size == 0 || range->address >= reader->memory_size || range->size > reader->memory_size - range->address) {
+            return CPU_TRACE_READ_INVALID;
+        }
+
+        reader->last_write_end = range->address + range->size;
+
+        if ((uint64_t) data_size + range->size > reader->data_capacity) {
+            reader->data_capacity = data_size + range->size;
+            record->data = realloc(record->data, reader->data_capacity);
+        }
+
+        uint8_t *contents = record->data + data_size;
+        data_size += range->size;
+
+        if (filled) {
+            int byte = fgetc(reader->file);
+            if (byte == EOF) {
+                return CPU_TRACE_READ_INVALID;
+            }
+
+            memset(contents, byte, range->size);
+        } else if (fread(contents, 1, range->size, reader->file) != range->size) {
+            return CPU_TRACE_READ_INVALID;
+        }
+    }
+
+    return CPU_TRACE_READ_RECORD;
+}
+
+cpu_trace_read_status_t cpu_trace_read(cpu_trace_reader_t *reader) {
+    cpu_trace_record_t *record = &reader->record;
+    int flags = fgetc(reader->file);
+
+    if (flags == EOF) {
+        return CPU_TRACE_READ_END_OF_FILE;
+    }
+
+    if (flags & CPU_TRACE_END) {
+        return read_end_record(reader);
+    }
+
+    record->end = false;
+    record->ip = reader->next_ip;
+
+    if ((flags & CPU_TRACE_JUMPED) && !read_varint(reader->file, &record->ip)) {
+        return CPU_TRACE_READ_INVALID;
+    }
+
+    int opcode = fgetc(reader->file);
+    record->length = opcode != EOF ? get_instruction_length(opcode) : 0;
+
+    if (record->length == 0 || fread(record->bytes + 1, 1, record->length - 1, reader->file) != record->length - 1u) {
+        return CPU_TRACE_READ_INVALID;
+    }
+
+    record->bytes[0] = opcode;
+    reader->next_ip = record->ip + record->length;
+    record->flag_equal = (flags & CPU_TRACE_FLAG_EQUAL) != 0;
+    record->changed_registers = 0;
+    record->writes_count = 0;
+
+    if (flags & CPU_TRACE_REGISTERS) {
+        int changed = fgetc(reader->file);
+        if (changed == EOF) {
+            return CPU_TRACE_READ_INVALID;
+        }
+
+        record->changed_registers = changed;
+
+        for (uint32_t i = 0; i < CPU_REGISTERS_COUNT; i++) {
+            uint32_t difference;
+            if ((changed & (1 << i)) && !read_varint(reader->file, &difference)) {
+                return CPU_TRACE_READ_INVALID;
+            }
+
+            if (changed & (1 << i)) {
+                record->registers[i] = (uint32_t) record->registers[i] + (uint32_t) decode_zigzag(difference);
+            }
+        }
+    }
+
+    if ((flags & CPU_TRACE_WRITES) && read_writes(reader) != CPU_TRACE_READ_RECORD) {
+        return CPU_TRACE_READ_INVALID;
+    }
+
+    reader->records_count++;
+    return CPU_TRACE_READ_RECORD;
+}
\ No newline at end of file
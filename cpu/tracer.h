@@ -0,0 +1,158 @@
+#pragma once
+
+#include "cpu.h"
+#include "cpu-executor.h"
+#include "ring.h"
+#include <stdio.h>
+
+/* Bytes of encoded records that can wait for the writer thread, has to be a power of two. */
+#define CPU_TRACE_RING_SIZE (4 * 1024 * 1024)
+
+/* Separate ranges of memory that are recorded for a single instruction, further ranges are merged with the last one. */
+#define CPU_TRACE_MAX_WRITES 4
+
+/* Longest instruction record, not counting contents of the memory it wrote. */
+#define CPU_TRACE_MAX_RECORD_SIZE 80
+
+/* Snapshot of the machine taken when tracing starts is written next to the trace, e.g. `run.trace.snapshot`. */
+#define CPU_TRACE_SNAPSHOT_SUFFIX ".snapshot"
+
+/*
+ * Trace file starts with "STKTRACE", a version byte, size of memory, number of instructions executed before tracing
+ * started, instruction pointer, flag_equal and all registers at that point. Every executed instruction follows as one
+ * record, and an end record closes the trace. All numbers are LEB128 varints, signed ones are zigzag encoded.
+ *
+ * Instruction record is a byte of CPU_TRACE_* flags, followed by:
+ * - address of the instruction, only if it does not follow the previous one (CPU_TRACE_JUMPED),
+ * - opcode and operands, as they were in memory,
+ * - mask of registers that the instruction changed and the difference of each of them (CPU_TRACE_REGISTERS),
+ * - number of ranges of memory written to (CPU_TRACE_WRITES), and for every range: its distance from the end of
+ *   the previously written range, its size times two plus one if all of it holds the same byte, and that byte or contents.
+ *
+ * End record is a CPU_TRACE_END byte, cpu_trace_end_reason_t, instruction pointer, which is the address of the instruction
+ * that panicked for a panic, and for a panic also the length and text of its message.
+ */
+#define CPU_TRACE_JUMPED 0x01
+#define CPU_TRACE_REGISTERS 0x02
+#define CPU_TRACE_WRITES 0x04
+#define CPU_TRACE_FLAG_EQUAL 0x08
+#define CPU_TRACE_END 0x80
+
+typedef enum {
+    CPU_TRACE_HALTED,
+    CPU_TRACE_PANICKED,
+
+    // Tracing was stopped while the program was still running.
+    CPU_TRACE_STOPPED
+} cpu_trace_end_reason_t;
+
+typedef struct {
+    uint32_t address;
+    uint32_t size;
+} cpu_trace_range_t;
+
+typedef struct cpu_tracer_t {
+    starkcpu_t *cpu;
+    FILE *file;
+
+    // Encoded records, written into the file by a thread of the ring.
+    cpu_ring_t ring;
+
+    // State that the next record is encoded against.
+    uint32_t next_ip;
+    int32_t registers[CPU_REGISTERS_COUNT];
+    uint32_t last_write_end;
+
+    // Address of the instruction that is being executed, and ranges of memory it wrote to so far.
+    uint32_t current_ip;
+    cpu_trace_range_t writes[CPU_TRACE_MAX_WRITES];
+    uint32_t writes_count;
+} cpu_tracer_t;
+
+/*
+ * Starts recording every instruction executed by given CPU into a trace file. While the tracer is attached, cpu_execute
+ * executes instructions one by one regardless of the selected core, like with the profiler, and records are encoded
+ * on the executing thread and written into the file by a thread of the tracer. Returns 0 if the file can not be created.
+ */
+cpu_tracer_t *cpu_tracer_create(starkcpu_t *cpu, const char *path);
+
+/*
+ * Records how the trace ended, waits until every record is written, detaches the tracer from its CPU and frees it.
+ * Returns false if any part of the trace could not be written.
+ */
+bool cpu_tracer_destroy(cpu_tracer_t *tracer);
+
+/* Executes up to `count` instructions while recording them. Returns number of executed instructions. */
+uint32_t cpu_execute_traced(cpu_tracer_t *tracer, uint32_t count);
+
+/* Records that the instruction being executed wrote `size` bytes at given address. Called wherever guest memory is written. */
+static inline void cpu_tracer_note_write(cpu_tracer_t *tracer, uint32_t address, uint32_t size) {
+    cpu_trace_range_t *last = tracer->writes_count > 0 ? tracer->writes + tracer->writes_count - 1 : 0;
+
+    // stores write their bytes in order, so they mostly extend the previous range
+    if (last && address == last->address + last->size) {
+        last->size += size;
+    } else if (tracer->writes_count < CPU_TRACE_MAX_WRITES) {
+        tracer->writes[tracer->writes_count].address = address;
+        tracer->writes[tracer->writes_count].size = size;
+        tracer->writes_count++;
+    } else {
+        uint64_t end = (uint64_t) last->address + last->size > (uint64_t) address + size ? (uint64_t) last->address + last->size : (uint64_t) address + size;
+        last->address = address < last->address ? address : last->address;
+        last->size = end - last->address;
+    }
+}
+
+typedef struct {
+    bool end;
+
+    // Instruction and the state right after it was executed.
+    uint32_t ip;
+    uint8_t bytes[CPU_MAX_INSTRUCTION_LENGTH];
+    uint8_t length;
+    uint8_t changed_registers;
+    int32_t registers[CPU_REGISTERS_COUNT];
+    uint8_t flag_equal;
+
+    // Contents of written ranges follow each other in `data`.
+    cpu_trace_range_t writes[CPU_TRACE_MAX_WRITES];
+    uint32_t writes_count;
+    uint8_t *data;
+
+    // Only set for the end record.
+    cpu_trace_end_reason_t reason;
+    char message[CPU_PANIC_MESSAGE_SIZE];
+} cpu_trace_record_t;
+
+typedef enum {
+    CPU_TRACE_READ_RECORD,
+    CPU_TRACE_READ_END_OF_FILE,
+
+    // File ends in the middle of a record, e.g. because the traced process was killed, or the record is not valid.
+    CPU_TRACE_READ_INVALID
+} cpu_trace_read_status_t;
+
+typedef struct {
+    FILE *file;
+
+    // State of the CPU when tracing started.
+    uint32_t memory_size;
+    uint64_t start_instructions;
+    uint32_t start_ip;
+    int32_t start_registers[CPU_REGISTERS_COUNT];
+    uint8_t start_flag_equal;
+
+    // Last record that was read, and the state it was decoded against.
+    cpu_trace_record_t record;
+    uint64_t records_count;
+    uint32_t next_ip;
+    uint32_t last_write_end;
+    uint32_t data_capacity;
+} cpu_trace_reader_t;
+
+/* Opens a trace file for reading. Returns 0 if it can not be read or is not a trace. */
+cpu_trace_reader_t *cpu_trace_open(const char *path);
+void cpu_trace_close(cpu_trace_reader_t *reader);
+
+/* Reads the next record into `reader->record`. */
+cpu_trace_read_status_t cpu_trace_read(cpu_trace_reader_t *reader);
\ No newline at end of file
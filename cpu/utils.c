@@ -1,4 +1,5 @@
 #include "utils.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
 #include <string.h>
@@ -95,4 +96,38 @@ char* itoa2(int value, int base) {
         *ptr1++ = tmp_char;
     }
     return result;
+}
+
+uint64_t parse_size(const char* source) {
+    char* end;
+    uint64_t value = strtoull(source, &end, 0);
+
+    switch (*end) {
+        case 'K': case 'k': value <<= 10; end++; break;
+        case 'M': case 'm': value <<= 20; end++; break;
+        case 'G': case 'g': value <<= 30; end++; break;
+    }
+
+    if (end == source || *end != '\0') {
+        return 0;
+    }
+
+    return value;
+}
+
+char* read_file(const char *path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return 0;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* data = malloc(sizeof(char) * (size + 1));
+    data[fread(data, 1, size, file)] = '\0';
+    fclose(file);
+
+    return data;
 }
\ No newline at end of file
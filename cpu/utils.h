@@ -16,4 +16,10 @@ struct string_array_t* split_buffer_by_char(const char* buffer, size_t buffer_le
 char* strtrim(const char* source);
 char* strslice(const char* source, uint32_t start, uint32_t end);
 
-char* itoa2(int value, int base);
\ No newline at end of file
+char* itoa2(int value, int base);
+
+/* Parses a number of bytes with an optional K, M or G suffix. Returns 0 if it is not a valid size. */
+uint64_t parse_size(const char* source);
+
+/* Reads whole file into a buffer terminated with a zero byte. Returns 0 if the file can not be read. */
+char* read_file(const char *path);
\ No newline at end of file
@@ -15,4 +15,7 @@ typedef int32_t int32;
 typedef int16_t int16;
 typedef int8_t int8;
 
+/** Address that compiled code is loaded at. */
+#define MEMORY_CODE_OFFSET 0x00000100
+
 using namespace std;
\ No newline at end of file
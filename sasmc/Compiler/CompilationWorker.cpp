@@ -4,8 +4,6 @@
 #include "Scope.hpp"
 #include "SourceMapWriter.hpp"
 
-#define MEMORY_CODE_OFFSET 0x00000100
-
 CompilationWorker::CompilationWorker(
     const vector<Token> &_tokens,
     const shared_ptr<OpcodeWriter>& _writer,
@@ -92,6 +90,30 @@ void CompilationWorker::CompileIdentifier(const Token& token) {
             CompileOpMul();
         } else if (token.HasValue("div")) {
             CompileOpDiv();
+        } else if (token.HasValue("copy")) {
+            CompileOpCopy();
+        } else if (token.HasValue("fill")) {
+            CompileOpFill();
+        } else if (token.HasValue("ei")) {
+            CompileOpEi();
+        } else if (token.HasValue("di")) {
+            CompileOpDi();
+        } else if (token.HasValue("iret")) {
+            CompileOpIret();
+        } else if (token.HasValue("vec")) {
+            CompileOpVec();
+        } else if (token.HasValue("wait")) {
+            CompileOpWait();
+        } else if (token.HasValue("cas")) {
+            CompileOpCas();
+        } else if (token.HasValue("xadd")) {
+            CompileOpXadd();
+        } else if (token.HasValue("fence")) {
+            CompileOpFence();
+        } else if (token.HasValue("core")) {
+            CompileOpCore();
+        } else if (token.HasValue("cores")) {
+            CompileOpCores();
         } else {
             diagnostics->ReportSyntaxErrorAt(token, "unknown token %s", token.value.c_str());
         }
@@ -392,6 +414,155 @@ void CompilationWorker::CompileOpDiv() {
     }
 }
 
+void CompilationWorker::CompileOpCopy() {
+    auto destinationToken = CompileAddressRefOperand("copy");
+    EatToken(TokenKind::Comma);
+    auto sourceToken = CompileAddressRefOperand("copy");
+    EatToken(TokenKind::Comma);
+    auto sizeToken = EatToken(TokenKind::Identifier);
+
+    if (currentScope->HasDestinationAlias(sizeToken.value)) {
+        sizeToken = currentScope->GetDestinationAlias(sizeToken.value);
+    }
+
+    writer->WriteCopyRAddrRAddrReg(GetRegisterIndexOrThrow(destinationToken.value), GetRegisterIndexOrThrow(sourceToken.value),
+                                   GetRegisterIndexOrThrow(sizeToken.value));
+}
+
+void CompilationWorker::CompileOpFill() {
+    auto destinationToken = CompileAddressRefOperand("fill");
+    EatToken(TokenKind::Comma);
+    auto valueToken = NextToken();
+    EatToken(TokenKind::Comma);
+    auto sizeToken = EatToken(TokenKind::Identifier);
+
+    if (valueToken.kind == TokenKind::Identifier) {
+        if (currentScope->HasDestinationAlias(valueToken.value)) {
+            valueToken = currentScope->GetDestinationAlias(valueToken.value);
+        }
+    }
+
+    if (currentScope->HasDestinationAlias(sizeToken.value)) {
+        sizeToken = currentScope->GetDestinationAlias(sizeToken.value);
+    }
+
+    if (valueToken.kind == TokenKind::Identifier) {
+        writer->WriteFillRAddrRegReg(GetRegisterIndexOrThrow(destinationToken.value), GetRegisterIndexOrThrow(valueToken.value),
+                                     GetRegisterIndexOrThrow(sizeToken.value));
+    } else if (valueToken.kind == TokenKind::Number) {
+        auto value = valueToken.ValueAsInt32();
+        if (value < -128 || value > 255) {
+            diagnostics->ReportSyntaxErrorAt(valueToken, "fill expects value to fit in a byte, got %d", value);
+        }
+
+        writer->WriteFillRAddrImmReg(GetRegisterIndexOrThrow(destinationToken.value), value,
+                                     GetRegisterIndexOrThrow(sizeToken.value));
+    } else {
+        diagnostics->ReportSyntaxErrorAt(valueToken, "fill expects second operand to be a register or a number");
+    }
+}
+
+void CompilationWorker::CompileOpEi() {
+    writer->WriteInterruptsEnable();
+}
+
+void CompilationWorker::CompileOpDi() {
+    writer->WriteInterruptsDisable();
+}
+
+void CompilationWorker::CompileOpIret() {
+    writer->WriteInterruptReturn();
+}
+
+void CompilationWorker::CompileOpVec() {
+    auto lineToken = EatToken(TokenKind::Number);
+    EatToken(TokenKind::Comma);
+    auto handlerToken = NextToken();
+
+    auto line = lineToken.ValueAsInt32();
+    if (line < 0 || line > 15) {
+        diagnostics->ReportSyntaxErrorAt(lineToken, "vec expects interrupt line between 0 and 15, got %d", line);
+    }
+
+    if (handlerToken.kind == TokenKind::Identifier) {
+        if (currentScope->GetName() == handlerToken.value) {
+            writer->WriteSetInterruptVector(line, MEMORY_CODE_OFFSET + currentScope->GetCodeBeginPosition());
+        } else if (currentScope->HasDirectChild(handlerToken.value)) {
+            writer->WriteSetInterruptVector(line, MEMORY_CODE_OFFSET + currentScope->GetDirectChild(handlerToken.value)->GetCodeBeginPosition());
+        } else {
+            // address of the handler comes right after the opcode, so it is filled in just like a jump
+            auto start = writer->GetPosition();
+            writer->WriteSetInterruptVector(line, 0);
+            jmpsToFill[start] = handlerToken;
+        }
+    } else if (handlerToken.kind == TokenKind::Number) {
+        writer->WriteSetInterruptVector(line, handlerToken.ValueAsInt32());
+    } else {
+        diagnostics->ReportSyntaxErrorAt(handlerToken, "vec expects second operand to be the name of a scope or an address");
+    }
+}
+
+void CompilationWorker::CompileOpWait() {
+    writer->WriteWait();
+}
+
+void CompilationWorker::CompileOpCas() {
+    auto addressToken = CompileAddressRefOperand("cas");
+    EatToken(TokenKind::Comma);
+    auto expectedToken = CompileRegisterOperand();
+    EatToken(TokenKind::Comma);
+    auto desiredToken = CompileRegisterOperand();
+
+    writer->WriteCompareExchange(GetRegisterIndexOrThrow(addressToken.value), GetRegisterIndexOrThrow(expectedToken.value),
+                                 GetRegisterIndexOrThrow(desiredToken.value));
+}
+
+void CompilationWorker::CompileOpXadd() {
+    auto addressToken = CompileAddressRefOperand("xadd");
+    EatToken(TokenKind::Comma);
+    auto valueToken = CompileRegisterOperand();
+
+    writer->WriteFetchAdd(GetRegisterIndexOrThrow(addressToken.value), GetRegisterIndexOrThrow(valueToken.value));
+}
+
+void CompilationWorker::CompileOpFence() {
+    writer->WriteFence();
+}
+
+void CompilationWorker::CompileOpCore() {
+    writer->WriteCoreId(GetRegisterIndexOrThrow(CompileRegisterOperand().value));
+}
+
+void CompilationWorker::CompileOpCores() {
+    writer->WriteCoresCount(GetRegisterIndexOrThrow(CompileRegisterOperand().value));
+}
+
+Token CompilationWorker::CompileRegisterOperand() {
+    auto token = EatToken(TokenKind::Identifier);
+    if (currentScope->HasDestinationAlias(token.value)) {
+        token = currentScope->GetDestinationAlias(token.value);
+    }
+
+    return token;
+}
+
+Token CompilationWorker::CompileAddressRefOperand(const char *opName) {
+    auto token = NextToken();
+    if (token.kind != TokenKind::SquareBracketOpen) {
+        diagnostics->ReportSyntaxErrorAt(token, "%s expects address operands to be register references", opName);
+        return token;
+    }
+
+    token = EatToken(TokenKind::Identifier);
+    EatToken(TokenKind::SquareBracketClose);
+
+    if (currentScope->HasDestinationAlias(token.value)) {
+        token = currentScope->GetDestinationAlias(token.value);
+    }
+
+    return token;
+}
+
 void CompilationWorker::CompileArithmeticOp(Token *outA, Token *outB, Token *outDestination) {
     auto firstValueToken = NextToken();
     EatToken(TokenKind::Comma);
@@ -466,12 +637,9 @@ int32 CompilationWorker::GetRegisterIndexOrThrow(const string &name) {
 }
 
 int32 CompilationWorker::GetRegisterIndex(const string &name) {
-    if (name == "r0") {
-        return 0;
-    } else if (name == "r1") {
-        return 1;
-    } else if (name == "r2") {
-        return 2;
+    // Stark 1 has eight general purpose registers, r0 to r7
+    if (name.size() == 2 && name[0] == 'r' && name[1] >= '0' && name[1] <= '7') {
+        return name[1] - '0';
     }
 
     return -1;
@@ -48,6 +48,20 @@ private:
     void CompileOpSub();
     void CompileOpMul();
     void CompileOpDiv();
+    void CompileOpCopy();
+    void CompileOpFill();
+    void CompileOpEi();
+    void CompileOpDi();
+    void CompileOpIret();
+    void CompileOpVec();
+    void CompileOpWait();
+    void CompileOpCas();
+    void CompileOpXadd();
+    void CompileOpFence();
+    void CompileOpCore();
+    void CompileOpCores();
+    Token CompileRegisterOperand();
+    Token CompileAddressRefOperand(const char *opName);
     void CompileArithmeticOp(Token *outA, Token *outB, Token *outDestination);
 
     void FillEmptyJmps();
@@ -3,7 +3,13 @@
 #include "SourceFile.hpp"
 #include "OpcodeWriter.hpp"
 #include "SourceMapWriter.hpp"
+#include "ExecutableWriter.hpp"
 #include "../Parsing/Tokenizer.hpp"
+#include <algorithm>
+
+Compiler::Compiler(const CompilerOptions &_options) {
+    options = _options;
+}
 
 void Compiler::Compile() {
     for (auto &entry : sourceFiles) {
@@ -26,8 +32,35 @@ void Compiler::CompileFile(const shared_ptr<SourceFile> &sourceFile) {
     auto worker = make_shared<CompilationWorker>(tokens, writer, mapWriter);
 
     worker->Compile();
+
+    if (!options.raw) {
+        WriteExecutable(sourceFile, writer, mapWriter);
+        return;
+    }
+
     writer->Flush();
-    mapWriter->Flush();
+    if (options.sourceMap) {
+        mapWriter->Flush();
+    }
+}
+
+void Compiler::WriteExecutable(const shared_ptr<SourceFile> &sourceFile, const shared_ptr<OpcodeWriter> &writer, const shared_ptr<SourceMapWriter> &mapWriter) {
+    auto executable = make_shared<ExecutableWriter>(MakeOutputFilePath(sourceFile));
+    auto code = writer->GetContents();
+
+    // Code stays writable, since programs are allowed to modify themselves.
+    executable->SetEntryPoint(MEMORY_CODE_OFFSET);
+    executable->AddSection(STARK1_SECTION_CODE, STARK1_SECTION_READ | STARK1_SECTION_WRITE | STARK1_SECTION_EXECUTE, MEMORY_CODE_OFFSET, max<uint32>(code.length(), 1), code);
+
+    for (auto &section : options.sections) {
+        executable->AddSection(section.type, section.flags, section.address, section.size, section.contents);
+    }
+
+    if (options.sourceMap) {
+        executable->AddSection(STARK1_SECTION_SOURCE_MAP, 0, 0, 0, mapWriter->GetContents());
+    }
+
+    executable->Flush();
 }
 
 void Compiler::AddSourceFile(const shared_ptr<SourceFile> &sourceFile) {
@@ -2,10 +2,34 @@
 
 #include "../Common.hpp"
 #include <map>
+#include <vector>
+
+/** Memory section added to every executable next to the compiled code. */
+struct SectionDefinition {
+    uint8 type;
+    uint8 flags;
+    uint32 address;
+    uint32 size;
+    string contents;
+};
+
+struct CompilerOptions {
+    /** Write raw images, loaded at 0x100 and started at their first byte, instead of executables. */
+    bool raw = false;
+
+    /** Embed the source map in the executable, or write it next to a raw image. */
+    bool sourceMap = true;
+
+    vector<SectionDefinition> sections;
+};
 
 class SourceFile;
+class OpcodeWriter;
+class SourceMapWriter;
 class Compiler {
 public:
+    Compiler() = default;
+    explicit Compiler(const CompilerOptions& options);
 
     void Compile();
 
@@ -32,6 +56,9 @@ public:
 private:
 
     void CompileFile(const shared_ptr<SourceFile>& sourceFile);
+    void WriteExecutable(const shared_ptr<SourceFile>& sourceFile, const shared_ptr<OpcodeWriter>& writer, const shared_ptr<SourceMapWriter>& mapWriter);
+
+    CompilerOptions options;
 
     /** List of all source files in the virtual filesystem. */
     map<string, shared_ptr<SourceFile>> sourceFiles;
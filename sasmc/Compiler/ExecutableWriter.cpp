@@ -0,0 +1,82 @@
+#include "ExecutableWriter.hpp"
+#include "../../shared/stark1-opcodes.h"
+
+ExecutableWriter::ExecutableWriter(const string &file) {
+    filePath = file;
+    entryPoint = 0;
+}
+
+void ExecutableWriter::SetEntryPoint(uint32 address) {
+    entryPoint = address;
+}
+
+void ExecutableWriter::AddSection(uint8 type, uint8 flags, uint32 address, uint32 size, const string &contents) {
+    if (sections.size() >= STARK1_EXECUTABLE_MAX_SECTIONS) {
+        throw runtime_error("Executable can not have more than " + to_string(STARK1_EXECUTABLE_MAX_SECTIONS) + " sections.");
+    }
+
+    bool inMemory = type != STARK1_SECTION_SOURCE_MAP;
+
+    if (inMemory && contents.length() > size) {
+        throw runtime_error("Contents of a section do not fit in its size.");
+    }
+
+    if (inMemory && size == 0) {
+        throw runtime_error("Section can not be empty.");
+    }
+
+    for (auto &section : sections) {
+        auto &other = section.header;
+        bool overlaps = (uint64_t) address < (uint64_t) other.address + other.size && other.address < (uint64_t) address + size;
+
+        if (inMemory && other.type != STARK1_SECTION_SOURCE_MAP && overlaps) {
+            throw runtime_error("Section at address " + to_string(address) + " overlaps another section.");
+        }
+    }
+
+    Section section {};
+    section.header.type = type;
+    section.header.flags = inMemory ? flags : 0;
+    section.header.address = inMemory ? address : 0;
+    section.header.size = inMemory ? size : 0;
+    section.header.file_size = contents.length();
+    section.contents = contents;
+    sections.push_back(section);
+}
+
+void ExecutableWriter::Flush() {
+    stark1_executable_header_t header {};
+    header.magic = STARK1_EXECUTABLE_MAGIC;
+    header.version = STARK1_EXECUTABLE_VERSION;
+    header.model = CPU_MODEL;
+    header.sections_count = sections.size();
+    header.entry_point = entryPoint;
+
+    string output(sizeof(header) + sections.size() * sizeof(stark1_section_header_t), '\0');
+
+    for (auto &section : sections) {
+        uint32 offset = output.length();
+
+        // Loader can only map contents that are placed the same way within a page in the file and in memory.
+        if (section.header.type != STARK1_SECTION_SOURCE_MAP && !section.contents.empty()) {
+            offset += (section.header.address - offset) % STARK1_EXECUTABLE_ALIGNMENT;
+        }
+
+        section.header.offset = offset;
+        output.resize(offset, '\0');
+        output += section.contents;
+    }
+
+    memcpy(output.data(), &header, sizeof(header));
+    for (size_t i = 0; i < sections.size(); i++) {
+        memcpy(output.data() + sizeof(header) + i * sizeof(stark1_section_header_t), &sections[i].header, sizeof(stark1_section_header_t));
+    }
+
+    FILE *file = fopen(filePath.c_str(), "wb+");
+    if (!file) {
+        throw runtime_error("Unable to write " + filePath + ".");
+    }
+
+    fwrite(output.data(), 1, output.length(), file);
+    fclose(file);
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "../Common.hpp"
+#include "../../shared/stark1-executable.h"
+#include <vector>
+
+class ExecutableWriter {
+public:
+    explicit ExecutableWriter(const string& file);
+
+    void SetEntryPoint(uint32 address);
+
+    /**
+     * Adds a section to the executable. Memory sections can have fewer bytes of contents than their size,
+     * the rest of them is filled with zeroes by the loader.
+     * @param type one of STARK1_SECTION_* types
+     * @param flags access flags of section's memory, ignored for source maps
+     * @param address address in memory, ignored for source maps
+     * @param size size in memory, ignored for source maps
+     * @param contents
+     */
+    void AddSection(uint8 type, uint8 flags, uint32 address, uint32 size, const string& contents);
+
+    void Flush();
+
+private:
+    struct Section {
+        stark1_section_header_t header;
+        string contents;
+    };
+
+    string filePath;
+    uint32 entryPoint;
+    vector<Section> sections;
+};
\ No newline at end of file
@@ -4,7 +4,8 @@
 OpcodeWriter::OpcodeWriter(const string& file) {
     filePath = file;
     position = 0;
-    buffer = (char*) malloc(sizeof(char) * 4096);
+    capacity = 4096;
+    buffer = (char*) malloc(sizeof(char) * capacity);
 }
 
 void OpcodeWriter::WriteSetRegImmediate(uint8 registerIndex, int32 value) {
@@ -184,6 +185,76 @@ void OpcodeWriter::WriteDivImmRegReg(uint8 registerA, int32 value, uint8 destina
     WriteInt8(destinationRegister);
 }
 
+void OpcodeWriter::WriteCopyRAddrRAddrReg(uint8 destinationRegisterIndex, uint8 sourceRegisterIndex, uint8 sizeRegisterIndex) {
+    WriteByte(OP_COPY_RADDR_RADDR_REG);
+    WriteInt8(destinationRegisterIndex);
+    WriteInt8(sourceRegisterIndex);
+    WriteInt8(sizeRegisterIndex);
+}
+
+void OpcodeWriter::WriteFillRAddrRegReg(uint8 destinationRegisterIndex, uint8 valueRegisterIndex, uint8 sizeRegisterIndex) {
+    WriteByte(OP_FILL_RADDR_REG_REG);
+    WriteInt8(destinationRegisterIndex);
+    WriteInt8(valueRegisterIndex);
+    WriteInt8(sizeRegisterIndex);
+}
+
+void OpcodeWriter::WriteFillRAddrImmReg(uint8 destinationRegisterIndex, int32 value, uint8 sizeRegisterIndex) {
+    WriteByte(OP_FILL_RADDR_IMMEDIATE8_REG);
+    WriteInt8(destinationRegisterIndex);
+    WriteInt8(value);
+    WriteInt8(sizeRegisterIndex);
+}
+
+void OpcodeWriter::WriteInterruptsEnable() {
+    WriteByte(OP_INTERRUPTS_ENABLE);
+}
+
+void OpcodeWriter::WriteInterruptsDisable() {
+    WriteByte(OP_INTERRUPTS_DISABLE);
+}
+
+void OpcodeWriter::WriteInterruptReturn() {
+    WriteByte(OP_INTERRUPT_RETURN);
+}
+
+void OpcodeWriter::WriteSetInterruptVector(uint8 line, int32 address) {
+    WriteByte(OP_SET_INTERRUPT_VECTOR);
+    WriteInt32(address);
+    WriteInt8(line);
+}
+
+void OpcodeWriter::WriteWait() {
+    WriteByte(OP_WAIT);
+}
+
+void OpcodeWriter::WriteCompareExchange(uint8 addressRegisterIndex, uint8 expectedRegisterIndex, uint8 desiredRegisterIndex) {
+    WriteByte(OP_COMPARE_EXCHANGE);
+    WriteInt8(addressRegisterIndex);
+    WriteInt8(expectedRegisterIndex);
+    WriteInt8(desiredRegisterIndex);
+}
+
+void OpcodeWriter::WriteFetchAdd(uint8 addressRegisterIndex, uint8 valueRegisterIndex) {
+    WriteByte(OP_FETCH_ADD);
+    WriteInt8(addressRegisterIndex);
+    WriteInt8(valueRegisterIndex);
+}
+
+void OpcodeWriter::WriteFence() {
+    WriteByte(OP_FENCE);
+}
+
+void OpcodeWriter::WriteCoreId(uint8 registerIndex) {
+    WriteByte(OP_CORE_ID);
+    WriteInt8(registerIndex);
+}
+
+void OpcodeWriter::WriteCoresCount(uint8 registerIndex) {
+    WriteByte(OP_CORES_COUNT);
+    WriteInt8(registerIndex);
+}
+
 void OpcodeWriter::ReplaceInt32(uint32 pos, uint32 value) {
     buffer[pos + 0] = value;
     buffer[pos + 1] = value >> 8;
@@ -191,22 +262,38 @@ void OpcodeWriter::ReplaceInt32(uint32 pos, uint32 value) {
     buffer[pos + 3] = value >> 24;
 }
 
+void OpcodeWriter::Reserve(uint32 size) {
+    if (capacity - position >= size) {
+        return;
+    }
+
+    while (capacity - position < size) {
+        capacity *= 2;
+    }
+
+    buffer = (char*) realloc(buffer, sizeof(char) * capacity);
+}
+
 void OpcodeWriter::WriteByte(char byte) {
+    Reserve(1);
     buffer[position] = byte;
     position += 1;
 }
 
 void OpcodeWriter::WriteInt8(int8 value) {
+    Reserve(1);
     buffer[position] = value;
     position += 1;
 }
 
 void OpcodeWriter::WriteInt16(int16 value) {
+    Reserve(2);
     buffer[position++] = value;
     buffer[position++] = value >> 8;
 }
 
 void OpcodeWriter::WriteInt32(int32 value) {
+    Reserve(4);
     buffer[position++] = value;
     buffer[position++] = value >> 8;
     buffer[position++] = value >> 16;
@@ -222,3 +309,8 @@ void OpcodeWriter::Flush() {
 uint32 OpcodeWriter::GetPosition() const {
     return position;
 }
+
+
+string OpcodeWriter::GetContents() const {
+    return string(buffer, position);
+}
\ No newline at end of file
@@ -30,14 +30,29 @@ public:
     void WriteDivRegRegReg(uint8 registerA, uint8 registerB, uint8 destinationRegister);
     void WriteDivRegImmReg(uint8 registerA, int32 value, uint8 destinationRegister);
     void WriteDivImmRegReg(uint8 registerA, int32 value, uint8 destinationRegister);
+    void WriteCopyRAddrRAddrReg(uint8 destinationRegisterIndex, uint8 sourceRegisterIndex, uint8 sizeRegisterIndex);
+    void WriteFillRAddrRegReg(uint8 destinationRegisterIndex, uint8 valueRegisterIndex, uint8 sizeRegisterIndex);
+    void WriteFillRAddrImmReg(uint8 destinationRegisterIndex, int32 value, uint8 sizeRegisterIndex);
+    void WriteInterruptsEnable();
+    void WriteInterruptsDisable();
+    void WriteInterruptReturn();
+    void WriteSetInterruptVector(uint8 line, int32 address);
+    void WriteWait();
+    void WriteCompareExchange(uint8 addressRegisterIndex, uint8 expectedRegisterIndex, uint8 desiredRegisterIndex);
+    void WriteFetchAdd(uint8 addressRegisterIndex, uint8 valueRegisterIndex);
+    void WriteFence();
+    void WriteCoreId(uint8 registerIndex);
+    void WriteCoresCount(uint8 registerIndex);
 
     void ReplaceInt32(uint32 position, uint32 value);
 
     void Flush();
 
     uint32 GetPosition() const;
+    string GetContents() const;
 
 private:
+    void Reserve(uint32 size);
     void WriteByte(char byte);
     void WriteInt8(int8 value);
     void WriteInt16(int16 value);
@@ -45,5 +60,6 @@ private:
 
     string filePath;
     char* buffer;
+    uint32 capacity;
     uint32 position;
 };
\ No newline at end of file
@@ -14,4 +14,8 @@ void SourceMapWriter::Flush() {
     FILE *file = fopen(filePath.c_str(), "wb+");
     fwrite(buffer.c_str(), 1, buffer.length(), file);
     fclose(file);
+}
+
+string SourceMapWriter::GetContents() const {
+    return buffer;
 }
\ No newline at end of file
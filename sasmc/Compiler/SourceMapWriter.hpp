@@ -10,6 +10,8 @@ public:
 
     void Flush();
 
+    string GetContents() const;
+
 private:
     string filePath;
     string buffer;
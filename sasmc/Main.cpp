@@ -1,10 +1,95 @@
 #include "Compiler/Compiler.hpp"
 #include "Compiler/SourceFile.hpp"
+#include "../shared/stark1-executable.h"
+#include <fstream>
+#include <vector>
+
+void PrintUsage() {
+    printf("usage: sasmc [options] <source file>...\n");
+    printf("options:\n");
+    printf("  --raw                      write a raw image and a separate source map instead of an executable\n");
+    printf("  --no-source-map            do not generate a source map\n");
+    printf("  --data=<address>:<file>    add a writable data section with contents of given file\n");
+    printf("  --rodata=<address>:<file>  add a read-only data section with contents of given file\n");
+    printf("  --bss=<address>:<size>     add a writable section of given size, filled with zeroes\n");
+}
+
+string ReadWholeFile(const string& path) {
+    auto stream = ifstream(path, ios::binary);
+    if (!stream) {
+        throw runtime_error("Unable to read " + path + ".");
+    }
+
+    return string((istreambuf_iterator<char>(stream)), istreambuf_iterator<char>());
+}
+
+/**
+ * Parses a section definition given as `<address>:<value>`, where value is either a path to the file
+ * with section's contents, or size of a bss section.
+ */
+SectionDefinition ParseSection(const string& definition, uint8 type, uint8 flags) {
+    auto separator = definition.find(':');
+    if (separator == string::npos) {
+        throw runtime_error("Section '" + definition + "' is missing its address.");
+    }
+
+    SectionDefinition section {};
+    section.type = type;
+    section.flags = flags;
+    section.address = stoul(definition.substr(0, separator), nullptr, 0);
+
+    auto value = definition.substr(separator + 1);
+    if (type == STARK1_SECTION_BSS) {
+        section.size = stoul(value, nullptr, 0);
+    } else {
+        section.contents = ReadWholeFile(value);
+        section.size = section.contents.length();
+    }
+
+    return section;
+}
 
 int main(int argc, char** argv) {
-    auto compiler = make_shared<Compiler>();
-    compiler->AddSourceFile(SourceFile::LoadFromPath("../../examples/test.sasm"));
-    compiler->Compile();
+    CompilerOptions options;
+    vector<string> paths;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            string argument = argv[i];
+
+            if (argument == "--raw") {
+                options.raw = true;
+            } else if (argument == "--no-source-map") {
+                options.sourceMap = false;
+            } else if (argument.starts_with("--data=")) {
+                options.sections.push_back(ParseSection(argument.substr(7), STARK1_SECTION_DATA, STARK1_SECTION_READ | STARK1_SECTION_WRITE));
+            } else if (argument.starts_with("--rodata=")) {
+                options.sections.push_back(ParseSection(argument.substr(9), STARK1_SECTION_DATA, STARK1_SECTION_READ));
+            } else if (argument.starts_with("--bss=")) {
+                options.sections.push_back(ParseSection(argument.substr(6), STARK1_SECTION_BSS, STARK1_SECTION_READ | STARK1_SECTION_WRITE));
+            } else if (argument[0] != '-') {
+                paths.push_back(argument);
+            } else {
+                PrintUsage();
+                return 1;
+            }
+        }
+
+        if (paths.empty() || (options.raw && !options.sections.empty())) {
+            PrintUsage();
+            return 1;
+        }
+
+        auto compiler = make_shared<Compiler>(options);
+        for (auto &path : paths) {
+            compiler->AddSourceFile(SourceFile::LoadFromPath(path));
+        }
+
+        compiler->Compile();
+    } catch (const exception& e) {
+        printf("error: %s\n", e.what());
+        return 1;
+    }
 
     return 0;
 }
\ No newline at end of file
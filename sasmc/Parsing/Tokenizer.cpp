@@ -58,6 +58,8 @@ Token Tokenizer::NextToken() {
         while (!IsOutOfBounds()) {
             ch = ReadBuffer();
             if (ch == '\n') {
+                line++;
+                column = 0;
                 break;
             }
         }
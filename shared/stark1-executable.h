@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Executable format of Stark 1 programs. A file starts with a header, followed by a table of sections.
+ * Every section describes a block of guest memory, filled with `file_size` bytes read from `offset` in the file
+ * and zeroes after them. A section with `file_size` of 0 is a bss section, made only of zeroes.
+ *
+ * Loaders can map sections straight from the file into guest memory, so writers should put section contents
+ * at offsets that are equal to their addresses modulo STARK1_EXECUTABLE_ALIGNMENT.
+ * All values are little-endian.
+ */
+
+// "SX1" followed by a zero byte
+#define STARK1_EXECUTABLE_MAGIC 0x00315853
+#define STARK1_EXECUTABLE_VERSION 1
+#define STARK1_EXECUTABLE_ALIGNMENT 4096
+#define STARK1_EXECUTABLE_MAX_SECTIONS 8
+
+#define STARK1_SECTION_CODE 1
+#define STARK1_SECTION_DATA 2
+#define STARK1_SECTION_BSS 3
+
+// Contents of a source map generated by the compiler, never loaded into guest memory.
+#define STARK1_SECTION_SOURCE_MAP 4
+
+#define STARK1_SECTION_READ 0x01
+#define STARK1_SECTION_WRITE 0x02
+#define STARK1_SECTION_EXECUTE 0x04
+
+typedef struct {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t model;
+    uint16_t sections_count;
+    uint32_t entry_point;
+    uint32_t reserved;
+} stark1_executable_header_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t address;
+    uint32_t size;
+    uint32_t offset;
+    uint32_t file_size;
+} stark1_section_header_t;
\ No newline at end of file
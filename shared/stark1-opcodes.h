@@ -19,9 +19,13 @@
 #define OP_SET_RADDR_IMMEDIATE16 0x13
 #define OP_SET_RADDR_IMMEDIATE32 0x14
 
+#define OP_COPY_RADDR_RADDR_REG 0x37
+#define OP_FILL_RADDR_REG_REG 0x38
+#define OP_FILL_RADDR_IMMEDIATE8_REG 0x39
+
 #define OP_JMP_RELATIVE 0x20
 #define OP_JMP_ABSOLUTE 0x21
-#define OP_JMP_REG 0x33
+#define OP_JMP_REG 0x36
 #define OP_JMP_IF_NOT_EQUAL 0x22
 
 #define OP_INCREMENT 0x23
@@ -40,4 +44,16 @@
 #define OP_DIV_REG_IMM32 0x34
 #define OP_DIV_IMM32_REG 0x35
 
+#define OP_INTERRUPTS_ENABLE 0x40
+#define OP_INTERRUPTS_DISABLE 0x41
+#define OP_INTERRUPT_RETURN 0x42
+#define OP_SET_INTERRUPT_VECTOR 0x43
+#define OP_WAIT 0x44
+
+#define OP_COMPARE_EXCHANGE 0x45
+#define OP_FETCH_ADD 0x46
+#define OP_FENCE 0x47
+#define OP_CORE_ID 0x48
+#define OP_CORES_COUNT 0x49
+
 #define OP_HALT 0xFF
\ No newline at end of file